@@ -15,6 +15,9 @@ namespace MySpace.BerkeleyDb.Configuration
 		private int maxPoolItemReuse = 10;
 		private StatTimer statTimer = new StatTimer();
 		private ThrottleThreads throttleThreads = new ThrottleThreads();
+		private ChangeCapture changeCapture;
+		private WriteBehind writeBehind;
+		private MigrationCopy migrationCopy;
 		private long shutdownWindow;
 		private bool allowPartialDatabaseRecovery;
 		private EnvironmentConfig envConfig = new EnvironmentConfig();
@@ -43,6 +46,15 @@ namespace MySpace.BerkeleyDb.Configuration
 		[XmlElement("ThrottleThreads")]
 		public ThrottleThreads ThrottleThreads { get { return throttleThreads; } set { throttleThreads = value; } }
 
+		[XmlElement("ChangeCapture")]
+		public ChangeCapture ChangeCapture { get { return changeCapture; } set { changeCapture = value; } }
+
+		[XmlElement("WriteBehind")]
+		public WriteBehind WriteBehind { get { return writeBehind; } set { writeBehind = value; } }
+
+		[XmlElement("MigrationCopy")]
+		public MigrationCopy MigrationCopy { get { return migrationCopy; } set { migrationCopy = value; } }
+
 		[XmlElement("ShutdownWindow")]
 		public long ShutdownWindow { get { return shutdownWindow; } set { shutdownWindow = value; } }
 
@@ -94,6 +106,101 @@ namespace MySpace.BerkeleyDb.Configuration
 
 	}
 
+	/// <summary>
+	/// Settings for publishing the changes recorded by databases with
+	/// <see cref="DatabaseConfig.ChangeCapture"/> set as replication messages.
+	/// </summary>
+	public class ChangeCapture : ITimerConfig
+	{
+		private int interval = 1000;//Milliseconds
+		private int maxBatchSize = 500;
+		private string checkpointFileName = "ChangeCapture.lsn";
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+		[XmlElement("Interval")]
+		public int Interval { get { return interval; } set { interval = value; } }
+		/// <summary>
+		/// The most committed changes published before the checkpoint is advanced.
+		/// </summary>
+		[XmlElement("MaxBatchSize")]
+		public int MaxBatchSize { get { return maxBatchSize; } set { maxBatchSize = value; } }
+		/// <summary>
+		/// The file, relative to the environment home directory, the last published log position is kept in.
+		/// </summary>
+		[XmlElement("CheckpointFileName")]
+		public string CheckpointFileName { get { return checkpointFileName; } set { checkpointFileName = value; } }
+	}
+
+	/// <summary>
+	/// Settings for holding one-way Save and Delete messages in memory, keeping only the latest
+	/// per key, and writing them to Berkeley Db in batches.
+	/// </summary>
+	public class WriteBehind : ITimerConfig
+	{
+		private int interval = 1000;//Milliseconds
+		private int maxPendingEntries = 10000;
+		private long maxPendingBytes = 67108864;
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+		/// <summary>
+		/// The longest a pending write waits before it is flushed.
+		/// </summary>
+		[XmlElement("Interval")]
+		public int Interval { get { return interval; } set { interval = value; } }
+		/// <summary>
+		/// Pending writes are flushed early once there are this many keys pending.
+		/// </summary>
+		[XmlElement("MaxPendingEntries")]
+		public int MaxPendingEntries { get { return maxPendingEntries; } set { maxPendingEntries = value; } }
+		/// <summary>
+		/// Pending writes are flushed early once their payloads add up to this many bytes.
+		/// </summary>
+		[XmlElement("MaxPendingBytes")]
+		public long MaxPendingBytes { get { return maxPendingBytes; } set { maxPendingBytes = value; } }
+		/// <summary>
+		/// The types to buffer; all types if empty.
+		/// </summary>
+		[XmlArray("TypeIds"), XmlArrayItem("TypeId")]
+		public short[] TypeIds { get; set; }
+	}
+
+	/// <summary>
+	/// Settings for copying stored records to the clusters that hold them after their group
+	/// changes its number of clusters and starts migrating.
+	/// </summary>
+	public class MigrationCopy : ITimerConfig
+	{
+		private int startDelay = 60000;//Milliseconds
+		private int interval = 1000;//Milliseconds
+		private int maxBatchSize = 500;
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+		/// <summary>
+		/// How long after the new mapping is loaded copying starts, so the forwarder has loaded it too.
+		/// </summary>
+		[XmlElement("StartDelay")]
+		public int StartDelay { get { return startDelay; } set { startDelay = value; } }
+		/// <summary>
+		/// The pause between batches.
+		/// </summary>
+		[XmlElement("Interval")]
+		public int Interval { get { return interval; } set { interval = value; } }
+		/// <summary>
+		/// The most records read and handed to the forwarder per batch.
+		/// </summary>
+		[XmlElement("MaxBatchSize")]
+		public int MaxBatchSize { get { return maxBatchSize; } set { maxBatchSize = value; } }
+		/// <summary>
+		/// The types to copy; all types that check race conditions if empty. Types whose
+		/// extended ids are four bytes long must be left out, since those keys read as object ids.
+		/// </summary>
+		[XmlArray("TypeIds"), XmlArrayItem("TypeId")]
+		public short[] TypeIds { get; set; }
+	}
+
 	/// <remarks/>
 	public enum DbLoadMode
 	{
@@ -27,6 +27,10 @@ namespace MySpace.BerkeleyDb.Configuration
 		private int maxDeadlockRetries = 1;
 		private DatabaseTransactionMode transactionMode = DatabaseTransactionMode.None;
 		private DatabaseCompact compact;
+		private bool changeCapture;
+		private DatabaseKeyComparison keyComparison = DatabaseKeyComparison.Bytewise;
+		private DatabaseCachePriority cachePriority = DatabaseCachePriority.Default;
+		private DatabaseValueSeparation valueSeparation;
 
 		private static string GetFilePath(string directory, string fileName)
 		{
@@ -270,6 +274,29 @@ namespace MySpace.BerkeleyDb.Configuration
 
 		[XmlElement("TransactionMode")]
 		public DatabaseTransactionMode TransactionMode { get { return transactionMode; } set { transactionMode = value; } }
+
+		/// <summary>
+		/// Whether puts and deletes are also written to the transaction log as change records
+		/// that can be read back with a log cursor.
+		/// </summary>
+		[XmlElement("ChangeCapture")]
+		public bool ChangeCapture { get { return changeCapture; } set { changeCapture = value; } }
+
+		/// <summary>
+		/// How btree keys are ordered. Files written with one order must be migrated before
+		/// they are opened with another.
+		/// </summary>
+		[XmlElement("KeyComparison")]
+		public DatabaseKeyComparison KeyComparison { get { return keyComparison; } set { keyComparison = value; } }
+
+		/// <summary>
+		/// How readily the cache gives up this database's pages to make room for others.
+		/// </summary>
+		[XmlElement("CachePriority")]
+		public DatabaseCachePriority CachePriority { get { return cachePriority; } set { cachePriority = value; } }
+
+		[XmlElement("ValueSeparation")]
+		public DatabaseValueSeparation ValueSeparation { get { return valueSeparation; } set { valueSeparation = value; } }
 		
 		public DatabaseConfig Clone(int newId)
 		{
@@ -287,7 +314,10 @@ namespace MySpace.BerkeleyDb.Configuration
 											 HashSize = hashSize,
 											 RecordLength = recordLength,
 											 MaxDeadlockRetries = maxDeadlockRetries,
-											 TransactionMode = transactionMode
+											 TransactionMode = transactionMode,
+											 ChangeCapture = changeCapture,
+											 KeyComparison = keyComparison,
+											 CachePriority = cachePriority
 										 };
 			
 			if (compact != null)
@@ -300,6 +330,16 @@ namespace MySpace.BerkeleyDb.Configuration
 										  Timeout = compact.Timeout
 									  };
 			}
+			if (valueSeparation != null)
+			{
+				newDbConfig.ValueSeparation = new DatabaseValueSeparation
+											  {
+												  Enabled = valueSeparation.Enabled,
+												  Threshold = valueSeparation.Threshold,
+												  SegmentSize = valueSeparation.SegmentSize,
+												  GarbagePercentage = valueSeparation.GarbagePercentage
+											  };
+			}
 			return newDbConfig;
 		}
 
@@ -421,6 +461,33 @@ namespace MySpace.BerkeleyDb.Configuration
 		PerCall = 1,
 	}
 
+	/// <remarks/>
+	public enum DatabaseKeyComparison
+	{
+		/// <summary>
+		/// Keys are compared byte by byte, the Berkeley Db default. Object id keys are stored
+		/// little endian, so consecutive ids land on unrelated pages.
+		/// </summary>
+		Bytewise = 0,
+		/// <summary>
+		/// Four byte keys are compared as signed integers and sort ahead of all other keys,
+		/// which keep the byte-wise order. Consecutive object ids share leaf pages.
+		/// </summary>
+		Int32 = 1,
+	}
+
+	/// <summary>
+	/// Cache eviction priority classes; values match Berkeley Db's DB_CACHE_PRIORITY.
+	/// </summary>
+	public enum DatabaseCachePriority
+	{
+		VeryLow = 1,
+		Low = 2,
+		Default = 3,
+		High = 4,
+		VeryHigh = 5,
+	}
+
 	
 	public class DatabaseCompact
 	{
@@ -438,4 +505,42 @@ namespace MySpace.BerkeleyDb.Configuration
 		[XmlElement("Timeout")]
 		public int Timeout { get { return timeout; } set { timeout = value; } }
 	}
+
+	/// <summary>
+	/// Keeps values larger than <see cref="Threshold"/> in append-only segment files next to the
+	/// database file, leaving only a small pointer record in the btree.
+	/// </summary>
+	/// <remarks>
+	/// The layout of every value changes, so this can only be turned on for a new database file,
+	/// and the wrapper's Database reads it through the DataBuffer, object id and byte array key
+	/// methods only; string keys and enumeration are refused.
+	/// </remarks>
+	public class DatabaseValueSeparation
+	{
+		private int threshold = 16384;
+		private int segmentSize = 67108864;
+		private int garbagePercentage = 50;
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+
+		/// <summary>
+		/// Values longer than this many bytes are stored in a segment file.
+		/// </summary>
+		[XmlElement("Threshold")]
+		public int Threshold { get { return threshold; } set { threshold = value; } }
+
+		/// <summary>
+		/// Size in bytes at which a segment file is sealed and a new one started.
+		/// </summary>
+		[XmlElement("SegmentSize")]
+		public int SegmentSize { get { return segmentSize; } set { segmentSize = value; } }
+
+		/// <summary>
+		/// Share of a sealed segment that must be unreferenced before its live values are copied
+		/// forward and the segment is deleted.
+		/// </summary>
+		[XmlElement("GarbagePercentage")]
+		public int GarbagePercentage { get { return garbagePercentage; } set { garbagePercentage = value; } }
+	}
 }
@@ -185,6 +185,12 @@ namespace MySpace.BerkeleyDb.Configuration
 		[XmlElement("CacheTrickle")]
 		public CacheTrickle CacheTrickle { get; set; }
 
+		[XmlElement("CacheBudget")]
+		public CacheBudget CacheBudget { get; set; }
+
+		[XmlElement("BlobCollection")]
+		public BlobCollection BlobCollection { get; set; }
+
 		[XmlElement("Checkpoint")]
 		public Checkpoint Checkpoint { get; set; }
 
@@ -342,6 +348,51 @@ namespace MySpace.BerkeleyDb.Configuration
 		public int Percentage { get { return percentage; } set { percentage = value; } }
 	}
 
+	/// <summary>
+	/// Soft limits on how much of the cache each <see cref="DatabaseCachePriority"/> class may hold.
+	/// A class over its budget has its priority dropped to <see cref="DatabaseCachePriority.VeryLow"/>
+	/// until it is back under, so its pages are evicted ahead of everyone else's. That is the only
+	/// enforcement: a class can stay over its budget when nothing else needs the cache.
+	/// </summary>
+	public class CacheBudget : ITimerConfig
+	{
+		private int interval = 30000;//Milliseconds
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+
+		[XmlElement("Interval")]
+		public int Interval { get { return interval; } set { interval = value; } }
+
+		[XmlArray("Budgets"), XmlArrayItem("Budget")]
+		public CachePriorityBudget[] Budgets { get; set; }
+	}
+
+	/// <summary>
+	/// Timer that reclaims the segment files of databases with
+	/// <see cref="DatabaseConfig.ValueSeparation"/>.
+	/// </summary>
+	public class BlobCollection : ITimerConfig
+	{
+		private int interval = 60000;//Milliseconds
+
+		[XmlElement("Enabled")]
+		public bool Enabled { get; set; }
+
+		[XmlElement("Interval")]
+		public int Interval { get { return interval; } set { interval = value; } }
+	}
+
+	/// <remarks/>
+	public class CachePriorityBudget
+	{
+		[XmlElement("Priority")]
+		public DatabaseCachePriority Priority { get; set; }
+
+		[XmlElement("MaxBytes")]
+		public long MaxBytes { get; set; }
+	}
+
 	/// <remarks/>
 	public class Checkpoint : ITimerConfig
 	{
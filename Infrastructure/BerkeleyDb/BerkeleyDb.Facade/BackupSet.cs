@@ -218,6 +218,9 @@ namespace MySpace.BerkeleyDb.Facade
 					}
 				}
 
+				// value separation segments are written outside the log, so they are copied after the
+				// data and log files whose pointers refer to them
+				CopyValueSegments();
 
 				// Set post backup values
 				lastCheckpointLogNumber = newCheckpointLogNumber;
@@ -236,6 +239,51 @@ namespace MySpace.BerkeleyDb.Facade
 			}
 		}
 
+		void CopyValueSegments()
+		{
+			foreach (string dataFile in dataFilesCopied)
+			{
+				string directory = Path.GetDirectoryName(dataFile);
+				if (string.IsNullOrEmpty(directory) || !Directory.Exists(directory)) continue;
+				foreach (string segmentFile in Directory.GetFiles(directory, Path.GetFileName(dataFile) + ".blob.*"))
+				{
+					string backupSegmentFile = MakeRelativeToNewFolder(backupDir, segmentFile);
+					FileStream source;
+					try
+					{
+						// the current segment is held open for append, so share write access
+						source = new FileStream(segmentFile, FileMode.Open, FileAccess.Read,
+							FileShare.ReadWrite | FileShare.Delete);
+					}
+					catch (FileNotFoundException)
+					{
+						// collected since the listing; its live values were relocated and synced first
+						continue;
+					}
+					using (source)
+					{
+						// segments are append only, so one of the same length is already current
+						FileInfo target = new FileInfo(backupSegmentFile);
+						if (target.Exists && target.Length == source.Length) continue;
+						if (copyBuffer == null || copyBuffer.Length == 0)
+						{
+							copyBuffer = new byte[dataCopyBufferSize > 0 ? dataCopyBufferSize : 65536];
+						}
+						using (FileStream destination = new FileStream(backupSegmentFile, FileMode.Create,
+							FileAccess.Write, FileShare.None))
+						{
+							int read;
+							while ((read = source.Read(copyBuffer, 0, copyBuffer.Length)) > 0)
+							{
+								destination.Write(copyBuffer, 0, read);
+							}
+						}
+					}
+					Log("Backup", "Value segment {0} copied to {1}", segmentFile, backupSegmentFile);
+				}
+			}
+		}
+
 		void RestoreFileType(string pattern, ICollection<string> fileNames)
 		{
 			// copy data files
@@ -271,7 +319,7 @@ namespace MySpace.BerkeleyDb.Facade
 					}
 					return false;
 				}
-				// copy data files
+				// copy data files, including their value separation segments
 				RestoreFileType("*.bdb*", dataFilesCopied);
 				// copy log files
 				RestoreFileType("log.*", logFilesCopied);
@@ -344,7 +392,7 @@ namespace MySpace.BerkeleyDb.Facade
 		{
 			if (copyLogFiles || IsOnFirstBackup)
 			{
-				DeleteFiles(GetUnusedLogFiles());
+				DeleteFiles(storage != null ? storage.GetDeletableLogFiles(unusedLogFiles) : unusedLogFiles);
 			}
 		}
 
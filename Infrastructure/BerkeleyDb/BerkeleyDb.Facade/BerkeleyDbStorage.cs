@@ -65,6 +65,11 @@ namespace MySpace.BerkeleyDb.Facade
 		private const short adminDbKey = -1; //used for config access
 		private const string shutdownTimeKey = "ShutdownTime";
 		private const string dataVersion = "DataVersion";
+		private const string keyComparisonKeyPrefix = "KeyComparison:";
+		private const string valueLayoutKeyPrefix = "ValueLayout:";
+		private const string separatedValueLayout = "Separated";
+		private const string inlineValueLayout = "Inline";
+		private const string keyMigrationExtension = ".keymigration";
 
 		// if there are changes in data that require a complete 
 		// database rebuild (ie flush all of the data)
@@ -94,12 +99,16 @@ namespace MySpace.BerkeleyDb.Facade
 		private ConfigurableCallbackTimer dbStatTimer;
 		private ConfigurableCallbackTimer dbLockStatCounterTimer;
 		private ConfigurableCallbackTimer dbCompactTimer;
+		private ConfigurableCallbackTimer cacheBudgetTimer;
+		private ConfigurableCallbackTimer blobCollectionTimer;
+		private readonly CacheBudgetMonitor cacheBudgetMonitor = new CacheBudgetMonitor();
 		private const int maxDbEntryReuse = 5;
 		private readonly ResourcePool<DatabaseEntry> dbEntryPool;
 		private const int initialBufferSize = 1048;
 		private int bufferSize = initialBufferSize;
 		private bool isShuttingDown;
 		private DateTime lastCompactTime = DateTime.MinValue;
+		private volatile int changeCaptureLogFloor;
 		private int _status = (int) BerkeleyDbStatus.NotRunning;
 
 
@@ -113,7 +122,7 @@ namespace MySpace.BerkeleyDb.Facade
 		}
 
 		#region Private Methods
-		private bool AddRecord(Database db, byte[] key, byte[] data)
+		private bool AddRecord(Database db, int objectId, byte[] key, byte[] data)
 		{
 			try
 			{
@@ -123,7 +132,7 @@ namespace MySpace.BerkeleyDb.Facade
 					case DatabaseType.Queue:
 						throw new ApplicationException("Database type " + dbType + " cannot have binary key");
 					default:
-						db.Put(key, data);
+						db.Put(objectId, key, data);
 						break;
 				}
 				return true;
@@ -367,6 +376,14 @@ namespace MySpace.BerkeleyDb.Facade
 				Log.DebugFormat("CreateDatabase() DbConfig: HashSize = {0}", dbConfig.HashSize);
 				Log.DebugFormat("CreateDatabase() DbConfig: RecordLength = {0}", dbConfig.RecordLength);
 				Log.DebugFormat("CreateDatabase() DbConfig: TransactionMode = {0}", dbConfig.TransactionMode);
+				Log.DebugFormat("CreateDatabase() DbConfig: KeyComparison = {0}", dbConfig.KeyComparison);
+				Log.DebugFormat("CreateDatabase() DbConfig: CachePriority = {0}", dbConfig.CachePriority);
+			}
+			if (dbConfig.ValueSeparation != null && dbConfig.ValueSeparation.Enabled && envConfig.Checkpoint != null &&
+				envConfig.Checkpoint.Backup != null && envConfig.Checkpoint.Backup.Enabled && Log.IsWarnEnabled)
+			{
+				Log.WarnFormat("CreateDatabase() Segment files of database with id {0} are not included in backups",
+					dbConfig.Id);
 			}
 			try
 			{
@@ -379,7 +396,18 @@ namespace MySpace.BerkeleyDb.Facade
 
 				if (environment != null)
 				{
-					db = environment.OpenDatabase(dbConfig);
+					if (fileName != null && dbConfig.Id != adminDbKey)
+					{
+						CheckValueLayout(dbConfig);
+					}
+					if (fileName != null && dbConfig.Id != adminDbKey && dbConfig.Type == DatabaseType.BTree)
+					{
+						db = OpenDatabaseInKeyOrder(environment, dbConfig);
+					}
+					else
+					{
+						db = environment.OpenDatabase(dbConfig);
+					}
 				}
 				else
 				{
@@ -573,7 +601,7 @@ namespace MySpace.BerkeleyDb.Facade
 			return false;
 		}
 
-		private bool DeleteRecord(Database db, byte[] key)
+		private bool DeleteRecord(Database db, int objectId, byte[] key)
 		{
 			try
 			{
@@ -583,7 +611,7 @@ namespace MySpace.BerkeleyDb.Facade
 					throw new ApplicationException("Database type " + dbType + " cannot have binary key");
 				}
 
-				DbRetVal dbRetVal = db.Delete(key);
+				DbRetVal dbRetVal = db.Delete(objectId, key);
 				return dbRetVal == DbRetVal.SUCCESS;
 			}
 			catch (BdbException ex)
@@ -1091,7 +1119,13 @@ namespace MySpace.BerkeleyDb.Facade
 						string numberExtension = Path.GetFileName(dbFile).Substring(baseRoot.Length);
 						if (reNumeric.IsMatch(numberExtension))
 						{
-							DbRetVal ret = Database.Verify(dbFile);
+							DbRetVal ret = Database.Verify(dbFile, dbConfig.KeyComparison);
+							if (ret == DbRetVal.VERIFY_BAD)
+							{
+								// the file, or the copy of one being migrated, may still be in the other key order
+								ret = Database.Verify(dbFile, dbConfig.KeyComparison == DatabaseKeyComparison.Bytewise ?
+									DatabaseKeyComparison.Int32 : DatabaseKeyComparison.Bytewise);
+							}
 							if (Log.IsInfoEnabled)
 							{
 								Log.InfoFormat("Verify on {0} returned {1}", dbFile, ret);
@@ -1724,6 +1758,130 @@ namespace MySpace.BerkeleyDb.Facade
 			}
 		}
 
+		/// <summary>
+		/// Opens the database for <paramref name="dbConfig"/>, first rewriting its file in the
+		/// configured <see cref="DatabaseConfig.KeyComparison"/> order if it was written in another.
+		/// </summary>
+		/// <remarks>
+		/// The order each file was written in is kept in the admin database; files without an entry
+		/// predate key comparisons and are byte-wise. A file being migrated is renamed aside and
+		/// copied into a new file under the original name. The copy is only removed after the new
+		/// order is recorded, so an interrupted migration starts over from it on the next open.
+		/// </remarks>
+		private Database OpenDatabaseInKeyOrder(BerkeleyDbWrapper.Environment environment, DatabaseConfig dbConfig)
+		{
+			string fileName = dbConfig.FileName;
+			string filePath = Path.Combine(bdbConfig.EnvironmentConfig.HomeDirectory, fileName);
+			string stagedFileName = fileName + keyMigrationExtension;
+			bool staged = File.Exists(filePath + keyMigrationExtension);
+			string markerKey = keyComparisonKeyPrefix + fileName;
+			DatabaseKeyComparison keyComparison = DatabaseKeyComparison.Bytewise;
+
+			using (Database adminDb = GetAdminDatabase())
+			{
+				string storedKeyComparison = adminDb.Get(markerKey);
+				if (!string.IsNullOrEmpty(storedKeyComparison))
+				{
+					keyComparison = (DatabaseKeyComparison)Enum.Parse(typeof(DatabaseKeyComparison), storedKeyComparison);
+				}
+				if (keyComparison == dbConfig.KeyComparison)
+				{
+					if (staged)
+					{
+						Database.Remove(environment, stagedFileName);
+					}
+					return environment.OpenDatabase(dbConfig);
+				}
+				if (!staged)
+				{
+					if (!File.Exists(filePath))
+					{
+						adminDb.Put(markerKey, dbConfig.KeyComparison.ToString());
+						return environment.OpenDatabase(dbConfig);
+					}
+					Database.Rename(environment, fileName, stagedFileName);
+				}
+				else if (File.Exists(filePath))
+				{
+					// left over from an interrupted migration
+					Database.Remove(environment, fileName);
+				}
+
+				if (Log.IsInfoEnabled)
+				{
+					Log.InfoFormat("OpenDatabaseInKeyOrder() Migrating {0} from {1} to {2} key order",
+						fileName, keyComparison, dbConfig.KeyComparison);
+				}
+				Stopwatch watch = Stopwatch.StartNew();
+				Database db = environment.OpenDatabase(dbConfig);
+				try
+				{
+					int count = db.CopyFrom(stagedFileName, keyComparison);
+					db.Sync();
+					adminDb.Put(markerKey, dbConfig.KeyComparison.ToString());
+					adminDb.Sync();
+					Database.Remove(environment, stagedFileName);
+					if (Log.IsInfoEnabled)
+					{
+						Log.InfoFormat("OpenDatabaseInKeyOrder() Migrated {0} records of {1} in {2} ms, leaf pages are {3}% full",
+							count, fileName, watch.ElapsedMilliseconds, db.GetLeafPageFill());
+					}
+				}
+				catch
+				{
+					db.Dispose();
+					throw;
+				}
+				return db;
+			}
+		}
+
+		/// <summary>
+		/// Makes sure the file of <paramref name="dbConfig"/> was written with the
+		/// <see cref="DatabaseConfig.ValueSeparation"/> setting it is being opened with.
+		/// </summary>
+		/// <remarks>
+		/// The layout each file was written in is kept in the admin database; files without an entry
+		/// predate value separation and hold their values inline. There is no migration between the
+		/// two layouts, so a file whose layout does not match the configuration is refused rather
+		/// than opened, since its records would be misread.
+		/// </remarks>
+		/// <exception cref="InvalidOperationException">The file was written in the other layout.</exception>
+		private void CheckValueLayout(DatabaseConfig dbConfig)
+		{
+			string fileName = dbConfig.FileName;
+			string filePath = Path.Combine(bdbConfig.EnvironmentConfig.HomeDirectory, fileName);
+			string markerKey = valueLayoutKeyPrefix + fileName;
+			string configuredLayout = dbConfig.ValueSeparation != null && dbConfig.ValueSeparation.Enabled
+				? separatedValueLayout : inlineValueLayout;
+
+			using (Database adminDb = GetAdminDatabase())
+			{
+				if (!File.Exists(filePath) && !File.Exists(filePath + keyMigrationExtension))
+				{
+					adminDb.Put(markerKey, configuredLayout);
+					adminDb.Sync();
+					return;
+				}
+				string storedLayout = adminDb.Get(markerKey);
+				if (string.IsNullOrEmpty(storedLayout))
+				{
+					storedLayout = inlineValueLayout;
+				}
+				if (storedLayout != configuredLayout)
+				{
+					if (Log.IsErrorEnabled)
+					{
+						Log.ErrorFormat("CheckValueLayout() {0} holds {1} values but is configured for {2} values; remove the file or restore its ValueSeparation setting",
+							fileName, storedLayout, configuredLayout);
+					}
+					throw new InvalidOperationException(string.Format(
+						"Database file {0} holds {1} values and cannot be opened with {2} values", fileName, storedLayout,
+						configuredLayout));
+				}
+			}
+		}
+
 		public Database GetAdminDatabase()
 		{
 			return CreateDatabase(env, adminDbKey, 0);
@@ -1918,6 +2076,64 @@ namespace MySpace.BerkeleyDb.Facade
 
 		internal BerkeleyDbWrapper.Environment Environment { get { return env; } }
 
+		/// <summary>
+		/// Opens a cursor over the change records written to the transaction log by databases
+		/// configured with <see cref="DatabaseConfig.ChangeCapture"/>.
+		/// </summary>
+		public LogCursor OpenLogCursor()
+		{
+			return env.OpenLogCursor();
+		}
+
+		/// <summary>
+		/// Gets or sets the number of the oldest log file a change capture reader has not
+		/// finished with. Unused log files from this one on are kept when checkpointing
+		/// deletes logs. 0 keeps nothing back.
+		/// </summary>
+		public int ChangeCaptureLogFloor
+		{
+			get { return changeCaptureLogFloor; }
+			set { changeCaptureLogFloor = value; }
+		}
+
+		internal IList<string> GetDeletableLogFiles(IList<string> unusedLogFiles)
+		{
+			int floor = changeCaptureLogFloor;
+			if (floor <= 0 || unusedLogFiles == null)
+			{
+				return unusedLogFiles;
+			}
+			List<string> deletable = new List<string>(unusedLogFiles.Count);
+			foreach (string logFile in unusedLogFiles)
+			{
+				int logNumber;
+				string extension = Path.GetExtension(logFile);
+				if (extension != null && extension.Length > 1 &&
+					int.TryParse(extension.Substring(1), out logNumber) && logNumber < floor)
+				{
+					deletable.Add(logFile);
+				}
+			}
+			return deletable;
+		}
+
+		private void DeleteUnusedLogs()
+		{
+			if (changeCaptureLogFloor <= 0)
+			{
+				env.DeleteUnusedLogs();
+				return;
+			}
+			IList<string> logFiles = GetDeletableLogFiles(env.GetUnusedLogFiles());
+			if (logFiles != null)
+			{
+				foreach (string logFile in logFiles)
+				{
+					if (File.Exists(logFile)) File.Delete(logFile);
+				}
+			}
+		}
+
 		internal bool IsShuttingDown { get { return isShuttingDown; } }
 
 		private void CloseEnvironment()
@@ -2259,6 +2475,76 @@ namespace MySpace.BerkeleyDb.Facade
 			}
 		}
 
+		private void UpdateCacheBudgets()
+		{
+			CacheBudget cacheBudget = envConfig.CacheBudget;
+			if (cacheBudget != null && cacheBudget.Enabled && env != null)
+			{
+				List<Database> openDatabases = new List<Database>();
+				Database[,] databasesToCheck = databases;
+				for (short typeIndex = 0; typeIndex < databasesToCheck.GetLength(0); typeIndex++)
+				{
+					for (int federationIndex = 0; federationIndex < databasesToCheck.GetLength(1); federationIndex++)
+					{
+						Database db = databasesToCheck[typeIndex, federationIndex];
+						if (db != null && !db.Disposed)
+						{
+							openDatabases.Add(db);
+						}
+					}
+				}
+				cacheBudgetMonitor.Update(env.GetCacheStatistics(), openDatabases, cacheBudget.Budgets);
+				if (Log.IsDebugEnabled)
+				{
+					foreach (CachePriorityStatistics stats in cacheBudgetMonitor.Statistics)
+					{
+						Log.DebugFormat("UpdateCacheBudgets() {0}", stats);
+					}
+				}
+			}
+		}
+
+		private void CollectBlobs()
+		{
+			Database[,] databasesToCheck = databases;
+			for (short typeIndex = 0; typeIndex < databasesToCheck.GetLength(0); typeIndex++)
+			{
+				for (int federationIndex = 0; federationIndex < databasesToCheck.GetLength(1); federationIndex++)
+				{
+					Database db = databasesToCheck[typeIndex, federationIndex];
+					if (db == null || db.Disposed || !db.ValueSeparation)
+					{
+						continue;
+					}
+					try
+					{
+						long bytesReclaimed = db.CollectBlobs(db.GetDatabaseConfig().ValueSeparation.GarbagePercentage);
+						if (bytesReclaimed > 0 && Log.IsDebugEnabled)
+						{
+							Log.DebugFormat("CollectBlobs() Reclaimed {0} bytes of segment files from database with id {1}",
+								bytesReclaimed, db.Id);
+						}
+					}
+					catch (Exception ex)
+					{
+						if (Log.IsErrorEnabled)
+						{
+							Log.Error(string.Format("CollectBlobs() Error collecting segment files of database with id {0}", db.Id), ex);
+						}
+					}
+				}
+			}
+		}
+
+		/// <summary>
+		/// Gets the cache usage of each <see cref="DatabaseCachePriority"/> class as of the last
+		/// <see cref="CacheBudget"/> interval; empty if <see cref="CacheBudget"/> is not enabled.
+		/// </summary>
+		public IList<CachePriorityStatistics> GetCachePriorityStatistics()
+		{
+			return cacheBudgetMonitor.Statistics;
+		}
+
 		private void CompactDatabases()
 		{
 			Compact compact = envConfig.Compact;
@@ -2406,7 +2692,7 @@ namespace MySpace.BerkeleyDb.Facade
 					{
 						Log.DebugFormat("Unused log deletion() started ...");
 					}
-					env.DeleteUnusedLogs();
+					DeleteUnusedLogs();
 					if (Log.IsDebugEnabled)
 					{
 						Log.DebugFormat("Unused log deletion() is complete");
@@ -2685,7 +2971,7 @@ namespace MySpace.BerkeleyDb.Facade
 			Database db = GetDatabase(typeId, objectId);
 			if (key != null)
 			{
-				return DeleteRecord(db, key);
+				return DeleteRecord(db, objectId, key);
 			}
 			return DeleteRecord(db, objectId);
 		}
@@ -3225,7 +3511,7 @@ namespace MySpace.BerkeleyDb.Facade
 			Database db = GetDatabase(typeId, objectId);
 			if (key != null)
 			{
-				return AddRecord(db, key, data);
+				return AddRecord(db, objectId, key, data);
 			}
 			return AddRecord(db, objectId, data);
 		}
@@ -3275,6 +3561,14 @@ namespace MySpace.BerkeleyDb.Facade
 				"Stat Timer", 10000,
 				DbStatPrint);
 
+			cacheBudgetTimer = new ConfigurableCallbackTimer(this, envConfig.CacheBudget,
+				"Cache Budget", 30000,
+				UpdateCacheBudgets);
+
+			blobCollectionTimer = new ConfigurableCallbackTimer(this, envConfig.BlobCollection,
+				"Blob Collection", 60000,
+				CollectBlobs);
+
 			// compaction has to be co-ordinated with any backups
 			if (envConfig.Checkpoint == null || !envConfig.Checkpoint.Enabled ||
 				envConfig.Checkpoint.Backup == null || !envConfig.Checkpoint.Backup.Enabled)
@@ -3293,6 +3587,8 @@ namespace MySpace.BerkeleyDb.Facade
 			ShutdownTimer(ref deadlockDetectTimer);
 			ShutdownTimer(ref dbStatTimer);
 			ShutdownTimer(ref dbCompactTimer);
+			ShutdownTimer(ref cacheBudgetTimer);
+			ShutdownTimer(ref blobCollectionTimer);
 		}
 
 		static void ShutdownTimer(ref ConfigurableCallbackTimer timer)
@@ -0,0 +1,67 @@
+using MySpace.BerkeleyDb.Configuration;
+
+namespace MySpace.BerkeleyDb.Facade
+{
+	/// <summary>
+	/// Cache usage of the databases configured with one <see cref="DatabaseCachePriority"/>,
+	/// as of the last <see cref="CacheBudget"/> interval.
+	/// </summary>
+	public class CachePriorityStatistics
+	{
+		/// <summary>
+		/// Gets the configured priority class.
+		/// </summary>
+		public DatabaseCachePriority Priority { get; internal set; }
+
+		/// <summary>
+		/// Gets the number of open databases in the class.
+		/// </summary>
+		public int DatabaseCount { get; internal set; }
+
+		/// <summary>
+		/// Gets an estimate of the bytes of cache held by the class. Berkeley Db does not count
+		/// resident pages per file, so the resident pages of the whole cache are shared out in
+		/// proportion to the pages each class hit or brought in during the interval.
+		/// </summary>
+		public long EstimatedResidentBytes { get; internal set; }
+
+		/// <summary>
+		/// Gets the soft budget of the class in bytes, or 0 if it has none.
+		/// </summary>
+		public long BudgetBytes { get; internal set; }
+
+		/// <summary>
+		/// Gets whether the class is over budget and its priority has been lowered.
+		/// </summary>
+		public bool OverBudget { get; internal set; }
+
+		/// <summary>
+		/// Gets the page requests of the class satisfied from the cache during the interval.
+		/// </summary>
+		public long CacheHits { get; internal set; }
+
+		/// <summary>
+		/// Gets the page requests of the class that had to go to disk during the interval.
+		/// </summary>
+		public long CacheMisses { get; internal set; }
+
+		/// <summary>
+		/// Gets the fraction of page requests during the interval satisfied from the cache.
+		/// </summary>
+		public double HitRatio
+		{
+			get
+			{
+				long requests = CacheHits + CacheMisses;
+				return requests == 0 ? 0 : (double)CacheHits / requests;
+			}
+		}
+
+		public override string ToString()
+		{
+			return string.Format("{0}: {1} dbs, ~{2} bytes resident (budget {3}{4}), hit ratio {5:P1}",
+				Priority, DatabaseCount, EstimatedResidentBytes, BudgetBytes, OverBudget ? ", over" : string.Empty,
+				HitRatio);
+		}
+	}
+}
@@ -0,0 +1,171 @@
+using System;
+using System.Collections.Generic;
+using MySpace.BerkeleyDb.Configuration;
+using BerkeleyDbWrapper;
+
+namespace MySpace.BerkeleyDb.Facade
+{
+	/// <summary>
+	/// Tracks cache usage per <see cref="DatabaseCachePriority"/> class and lowers the priority
+	/// of classes that go over their <see cref="CacheBudget"/>.
+	/// </summary>
+	/// <remarks>
+	/// <para>Berkeley Db does not count resident pages per file, so the resident pages of the
+	/// cache are shared out by the pages each class touched during the interval: its cache hits,
+	/// which are pages it is holding, plus the pages it brought in. A class that keeps rereading
+	/// a hot working set is charged for it even though it brings nothing new in.</para>
+	/// <para>A budget is only enforced by lowering the class's priority, so its pages are evicted
+	/// first. Nothing stops a class from growing past its budget while the rest of the cache is
+	/// idle, and a class whose priority was configured <see cref="DatabaseCachePriority.VeryLow"/>
+	/// can't be lowered further.</para>
+	/// </remarks>
+	internal class CacheBudgetMonitor
+	{
+		// a demoted class is restored once its estimate drops below this share of its budget
+		private const double restoreRatio = 0.9;
+
+		private class FileCounters
+		{
+			public long Hits;
+			public long Misses;
+			public long PagesIn;
+		}
+
+		private class ClassState
+		{
+			public double ResidentBytes;
+			public bool Demoted;
+		}
+
+		private readonly Dictionary<string, FileCounters> lastCounters = new Dictionary<string, FileCounters>(StringComparer.OrdinalIgnoreCase);
+		private readonly Dictionary<DatabaseCachePriority, ClassState> classStates = new Dictionary<DatabaseCachePriority, ClassState>();
+		private volatile IList<CachePriorityStatistics> statistics = new CachePriorityStatistics[0];
+
+		/// <summary>
+		/// Gets the statistics computed by the last call to <see cref="Update"/>.
+		/// </summary>
+		public IList<CachePriorityStatistics> Statistics { get { return statistics; } }
+
+		/// <summary>
+		/// Recomputes the per class statistics from <paramref name="cacheStatistics"/> and
+		/// applies <paramref name="budgets"/> to <paramref name="databases"/>.
+		/// </summary>
+		public void Update(CacheStatistics cacheStatistics, IList<Database> databases, CachePriorityBudget[] budgets)
+		{
+			Dictionary<string, CacheFileStatistics> files = new Dictionary<string, CacheFileStatistics>(StringComparer.OrdinalIgnoreCase);
+			foreach (CacheFileStatistics file in cacheStatistics.Files)
+			{
+				files[file.FileName] = file;
+			}
+
+			Dictionary<DatabaseCachePriority, CachePriorityStatistics> classes = new Dictionary<DatabaseCachePriority, CachePriorityStatistics>();
+			Dictionary<DatabaseCachePriority, long> classBytesTouched = new Dictionary<DatabaseCachePriority, long>();
+			long totalPagesTouched = 0;
+			long totalBytesTouched = 0;
+			foreach (Database db in databases)
+			{
+				DatabaseConfig dbConfig = db.GetDatabaseConfig();
+				DatabaseCachePriority priority = dbConfig.CachePriority;
+				CachePriorityStatistics classStats;
+				if (!classes.TryGetValue(priority, out classStats))
+				{
+					classStats = new CachePriorityStatistics { Priority = priority };
+					classes.Add(priority, classStats);
+					classBytesTouched.Add(priority, 0);
+				}
+				classStats.DatabaseCount++;
+
+				CacheFileStatistics file;
+				if (dbConfig.FileName == null || !files.TryGetValue(dbConfig.FileName, out file))
+				{
+					continue;
+				}
+				FileCounters last;
+				if (!lastCounters.TryGetValue(file.FileName, out last))
+				{
+					last = new FileCounters();
+					lastCounters.Add(file.FileName, last);
+				}
+				long pagesIn = file.PagesRead + file.PagesCreated;
+				// counters restart with the environment
+				if (pagesIn < last.PagesIn || file.CacheHits < last.Hits || file.CacheMisses < last.Misses)
+				{
+					last.PagesIn = last.Hits = last.Misses = 0;
+				}
+				long windowHits = file.CacheHits - last.Hits;
+				long windowPagesTouched = windowHits + pagesIn - last.PagesIn;
+				classStats.CacheHits += windowHits;
+				classStats.CacheMisses += file.CacheMisses - last.Misses;
+				classBytesTouched[priority] += windowPagesTouched * file.PageSize;
+				totalPagesTouched += windowPagesTouched;
+				totalBytesTouched += windowPagesTouched * file.PageSize;
+				last.PagesIn = pagesIn;
+				last.Hits = file.CacheHits;
+				last.Misses = file.CacheMisses;
+			}
+
+			// share the resident pages out by what each class touched this interval, weighting
+			// them by page size; smooth to ride out quiet intervals
+			double residentBytes = totalPagesTouched > 0 ?
+				(double)cacheStatistics.ResidentPages * totalBytesTouched / totalPagesTouched : 0;
+			foreach (CachePriorityStatistics classStats in classes.Values)
+			{
+				ClassState state;
+				if (!classStates.TryGetValue(classStats.Priority, out state))
+				{
+					state = new ClassState();
+					classStates.Add(classStats.Priority, state);
+				}
+				if (totalBytesTouched > 0)
+				{
+					double estimate = residentBytes * classBytesTouched[classStats.Priority] / totalBytesTouched;
+					state.ResidentBytes = (state.ResidentBytes + estimate) / 2;
+				}
+				classStats.EstimatedResidentBytes = (long)state.ResidentBytes;
+				classStats.BudgetBytes = GetBudget(budgets, classStats.Priority);
+				bool overBudget = classStats.BudgetBytes > 0 && (state.Demoted ?
+					state.ResidentBytes >= classStats.BudgetBytes * restoreRatio :
+					state.ResidentBytes > classStats.BudgetBytes);
+				if (overBudget != state.Demoted)
+				{
+					SetPriority(databases, classStats.Priority, overBudget);
+					state.Demoted = overBudget;
+					if (BerkeleyDbStorage.Log.IsInfoEnabled)
+					{
+						BerkeleyDbStorage.Log.InfoFormat("UpdateCacheBudgets() {0} {1}", overBudget ?
+							"Lowering priority of class over budget" : "Restoring priority of class back under budget",
+							classStats);
+					}
+				}
+				classStats.OverBudget = state.Demoted;
+			}
+			statistics = new List<CachePriorityStatistics>(classes.Values).AsReadOnly();
+		}
+
+		private static long GetBudget(CachePriorityBudget[] budgets, DatabaseCachePriority priority)
+		{
+			if (budgets != null)
+			{
+				foreach (CachePriorityBudget budget in budgets)
+				{
+					if (budget != null && budget.Priority == priority)
+					{
+						return budget.MaxBytes;
+					}
+				}
+			}
+			return 0;
+		}
+
+		private static void SetPriority(IList<Database> databases, DatabaseCachePriority priority, bool demote)
+		{
+			foreach (Database db in databases)
+			{
+				if (db.GetDatabaseConfig().CachePriority == priority)
+				{
+					db.SetCachePriority(demote ? DatabaseCachePriority.VeryLow : priority);
+				}
+			}
+		}
+	}
+}
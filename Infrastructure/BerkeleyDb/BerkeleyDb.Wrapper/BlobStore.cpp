@@ -0,0 +1,200 @@
+#include "stdafx.h"
+#include "BlobStore.h"
+
+using namespace System::Globalization;
+using namespace System::Runtime::InteropServices;
+
+BerkeleyDbWrapper::BlobStore::BlobStore(String ^basePath, int segmentSize) : _basePath(basePath),
+	_segmentSize(segmentSize), _currentSegment(0), _lastCandidate(-1), _writer(nullptr),
+	_appendLock(gcnew Object()), _relocationLock(gcnew ReaderWriterLock())
+{
+	// always start a new segment, so everything written before this open is sealed
+	String ^directory = Path::GetDirectoryName(Path::GetFullPath(basePath));
+	String ^prefix = Path::GetFileName(basePath) + ".blob.";
+	if (Directory::Exists(directory))
+	{
+		for each (String ^file in Directory::GetFiles(directory, prefix + "*"))
+		{
+			int segment;
+			if (Int32::TryParse(Path::GetFileName(file)->Substring(prefix->Length), NumberStyles::None,
+				CultureInfo::InvariantCulture, segment) && segment >= _currentSegment)
+			{
+				_currentSegment = segment + 1;
+			}
+		}
+	}
+}
+
+BerkeleyDbWrapper::BlobStore::~BlobStore()
+{
+	Monitor::Enter(_appendLock);
+	try
+	{
+		Seal();
+	}
+	finally
+	{
+		Monitor::Exit(_appendLock);
+	}
+}
+
+String^ BerkeleyDbWrapper::BlobStore::GetSegmentPath(int segment)
+{
+	return _basePath + ".blob." + segment.ToString("D6", CultureInfo::InvariantCulture);
+}
+
+void BerkeleyDbWrapper::BlobStore::Seal()
+{
+	if (_writer != nullptr)
+	{
+		_writer->Close();
+		_writer = nullptr;
+		++_currentSegment;
+	}
+}
+
+void BerkeleyDbWrapper::BlobStore::Append(const void *key, int keyLength, const void *value, int valueLength,
+	BlobPointer *pointer)
+{
+	array<Byte> ^entry = gcnew array<Byte>(entryHeaderSize + keyLength + valueLength);
+	BitConverter::GetBytes(keyLength)->CopyTo(entry, 0);
+	BitConverter::GetBytes(valueLength)->CopyTo(entry, sizeof(__int32));
+	if (keyLength > 0)
+	{
+		Marshal::Copy(IntPtr(const_cast<void *>(key)), entry, entryHeaderSize, keyLength);
+	}
+	if (valueLength > 0)
+	{
+		Marshal::Copy(IntPtr(const_cast<void *>(value)), entry, entryHeaderSize + keyLength, valueLength);
+	}
+
+	Monitor::Enter(_appendLock);
+	try
+	{
+		if (_writer == nullptr)
+		{
+			// write through so the value is on disk before the pointer to it is committed
+			_writer = gcnew FileStream(GetSegmentPath(_currentSegment), FileMode::Append, FileAccess::Write,
+				FileShare::Read | FileShare::Delete, 4096, FileOptions::WriteThrough);
+		}
+		__int64 position = _writer->Position;
+		_writer->Write(entry, 0, entry->Length);
+		_writer->Flush();
+		pointer->tag = BlobValueTag;
+		pointer->segment = _currentSegment;
+		pointer->offset = position + entryHeaderSize + keyLength;
+		pointer->length = valueLength;
+		if (_writer->Position >= _segmentSize)
+		{
+			Seal();
+		}
+	}
+	finally
+	{
+		Monitor::Exit(_appendLock);
+	}
+}
+
+int BerkeleyDbWrapper::BlobStore::Read(const BlobPointer *pointer, int offset, void *dest, int count)
+{
+	if (offset >= pointer->length || count <= 0)
+	{
+		return 0;
+	}
+	if (count > pointer->length - offset)
+	{
+		count = pointer->length - offset;
+	}
+	array<Byte> ^buffer = gcnew array<Byte>(count);
+	int read = 0;
+	FileStream ^reader = gcnew FileStream(GetSegmentPath(pointer->segment), FileMode::Open, FileAccess::Read,
+		FileShare::ReadWrite | FileShare::Delete);
+	try
+	{
+		reader->Seek(pointer->offset + offset, SeekOrigin::Begin);
+		int n;
+		while (read < count && (n = reader->Read(buffer, read, count - read)) > 0)
+		{
+			read += n;
+		}
+	}
+	finally
+	{
+		reader->Close();
+	}
+	if (read != count)
+	{
+		throw gcnew IOException(String::Format("Segment {0} ends before the value at {1}",
+			GetSegmentPath(pointer->segment), pointer->offset));
+	}
+	Marshal::Copy(buffer, 0, IntPtr(dest), count);
+	return count;
+}
+
+int BerkeleyDbWrapper::BlobStore::GetCollectionCandidate()
+{
+	int current;
+	Monitor::Enter(_appendLock);
+	try
+	{
+		current = _currentSegment;
+	}
+	finally
+	{
+		Monitor::Exit(_appendLock);
+	}
+	String ^directory = Path::GetDirectoryName(Path::GetFullPath(_basePath));
+	String ^prefix = Path::GetFileName(_basePath) + ".blob.";
+	int first = -1, next = -1;
+	for each (String ^file in Directory::GetFiles(directory, prefix + "*"))
+	{
+		int segment;
+		if (!Int32::TryParse(Path::GetFileName(file)->Substring(prefix->Length), NumberStyles::None,
+			CultureInfo::InvariantCulture, segment) || segment >= current)
+		{
+			continue;
+		}
+		if (first < 0 || segment < first) first = segment;
+		if (segment > _lastCandidate && (next < 0 || segment < next)) next = segment;
+	}
+	_lastCandidate = next >= 0 ? next : first;
+	return _lastCandidate;
+}
+
+List<BerkeleyDbWrapper::BlobEntry>^ BerkeleyDbWrapper::BlobStore::ReadEntries(int segment)
+{
+	List<BlobEntry> ^entries = gcnew List<BlobEntry>();
+	FileStream ^reader = gcnew FileStream(GetSegmentPath(segment), FileMode::Open, FileAccess::Read,
+		FileShare::ReadWrite | FileShare::Delete);
+	try
+	{
+		BinaryReader ^binaryReader = gcnew BinaryReader(reader);
+		__int64 length = reader->Length;
+		while (reader->Position + entryHeaderSize <= length)
+		{
+			int keyLength = binaryReader->ReadInt32();
+			int valueLength = binaryReader->ReadInt32();
+			if (keyLength < 0 || valueLength < 0 || reader->Position + keyLength + valueLength > length)
+			{
+				// torn write at the end of a segment whose writer did not close cleanly
+				break;
+			}
+			BlobEntry entry;
+			entry.Key = binaryReader->ReadBytes(keyLength);
+			entry.Offset = reader->Position;
+			entry.Length = valueLength;
+			entries->Add(entry);
+			reader->Seek(valueLength, SeekOrigin::Current);
+		}
+	}
+	finally
+	{
+		reader->Close();
+	}
+	return entries;
+}
+
+void BerkeleyDbWrapper::BlobStore::DeleteSegment(int segment)
+{
+	File::Delete(GetSegmentPath(segment));
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "Stdafx.h"
+
+using namespace System;
+using namespace System::IO;
+using namespace System::Threading;
+using namespace System::Collections::Generic;
+
+namespace BerkeleyDbWrapper
+{
+	// First byte of every value in a database with value separation.
+	const unsigned char InlineValueTag = 0;
+	const unsigned char BlobValueTag = 1;
+
+#pragma pack(push, 1)
+	// Value stored in the btree in place of a value kept in a segment file.
+	struct BlobPointer
+	{
+		unsigned char tag;
+		__int32 segment;
+		// position of the value itself in the segment, past the entry header and key
+		__int64 offset;
+		__int32 length;
+	};
+#pragma pack(pop)
+
+	// An entry read back from a sealed segment.
+	value struct BlobEntry
+	{
+		array<Byte> ^Key;
+		__int64 Offset;
+		int Length;
+	};
+
+	///<summary>
+	///Append-only segment files holding the large values of one database. Each entry is
+	///[int32 key length][int32 value length][key][value]; the key is kept so that a sealed
+	///segment can be checked against the btree and its live values copied forward.
+	///</summary>
+	ref class BlobStore
+	{
+	internal:
+		BlobStore(String ^basePath, int segmentSize);
+		~BlobStore();
+
+		void Append(const void *key, int keyLength, const void *value, int valueLength, BlobPointer *pointer);
+		int Read(const BlobPointer *pointer, int offset, void *dest, int count);
+		///<summary>
+		///Gets the next sealed segment to collect, in turn, or -1 if there is none.
+		///</summary>
+		int GetCollectionCandidate();
+		List<BlobEntry>^ ReadEntries(int segment);
+		void DeleteSegment(int segment);
+
+		///<summary>
+		///Held as reader by every write to the database and as writer while a live value is
+		///copied out of a segment being collected, so a pointer checked under it stays current.
+		///</summary>
+		property ReaderWriterLock^ RelocationLock { ReaderWriterLock^ get() { return _relocationLock; } }
+
+	private:
+		String^ GetSegmentPath(int segment);
+		void Seal();
+
+		static const int entryHeaderSize = 2 * sizeof(__int32);
+
+		String ^_basePath;
+		int _segmentSize;
+		int _currentSegment;
+		int _lastCandidate;
+		FileStream ^_writer;
+		Object ^_appendLock;
+		ReaderWriterLock ^_relocationLock;
+	};
+}
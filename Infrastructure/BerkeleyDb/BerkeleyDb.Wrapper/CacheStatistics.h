@@ -0,0 +1,88 @@
+#pragma once
+#include "Stdafx.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace BerkeleyDbWrapper
+{
+	///<summary>
+	///Cache counters for one file in the environment's memory pool. Counters accumulate from
+	///the time the environment was opened.
+	///</summary>
+	public ref class CacheFileStatistics
+	{
+	public:
+		///<summary>
+		///Gets the name of the file, relative to the environment home directory.
+		///</summary>
+		property String^ FileName { String^ get() { return _fileName; } }
+		property int PageSize { int get() { return _pageSize; } }
+		///<summary>
+		///Gets the number of page requests satisfied from the cache.
+		///</summary>
+		property Int64 CacheHits { Int64 get() { return _cacheHits; } }
+		///<summary>
+		///Gets the number of page requests that had to go to disk.
+		///</summary>
+		property Int64 CacheMisses { Int64 get() { return _cacheMisses; } }
+		property Int64 PagesCreated { Int64 get() { return _pagesCreated; } }
+		property Int64 PagesRead { Int64 get() { return _pagesRead; } }
+		property Int64 PagesWritten { Int64 get() { return _pagesWritten; } }
+
+	internal:
+		CacheFileStatistics(const DB_MPOOL_FSTAT *stat) :
+			_fileName(gcnew String(stat->file_name)), _pageSize(stat->st_pagesize),
+			_cacheHits(stat->st_cache_hit), _cacheMisses(stat->st_cache_miss),
+			_pagesCreated(stat->st_page_create), _pagesRead(stat->st_page_in),
+			_pagesWritten(stat->st_page_out) {}
+
+	private:
+		String ^_fileName;
+		int _pageSize;
+		Int64 _cacheHits;
+		Int64 _cacheMisses;
+		Int64 _pagesCreated;
+		Int64 _pagesRead;
+		Int64 _pagesWritten;
+	};
+
+	///<summary>
+	///Counters for the environment's memory pool as a whole and for each file in it.
+	///</summary>
+	public ref class CacheStatistics
+	{
+	public:
+		///<summary>
+		///Gets the configured size of the cache in bytes.
+		///</summary>
+		property Int64 CacheBytes { Int64 get() { return _cacheBytes; } }
+		///<summary>
+		///Gets the number of pages currently held in the cache, clean or dirty.
+		///</summary>
+		property Int64 ResidentPages { Int64 get() { return _residentPages; } }
+		property Int64 CacheHits { Int64 get() { return _cacheHits; } }
+		property Int64 CacheMisses { Int64 get() { return _cacheMisses; } }
+		///<summary>
+		///Gets the number of pages forced out of the cache to make room for others.
+		///</summary>
+		property Int64 PagesEvicted { Int64 get() { return _pagesEvicted; } }
+		property IList<CacheFileStatistics^>^ Files { IList<CacheFileStatistics^>^ get() { return _files; } }
+
+	internal:
+		CacheStatistics(const DB_MPOOL_STAT *stat, List<CacheFileStatistics^> ^files) :
+			_cacheBytes(static_cast<Int64>(stat->st_gbytes) * 1024 * 1024 * 1024 + stat->st_bytes),
+			_residentPages(static_cast<Int64>(stat->st_page_clean) + stat->st_page_dirty),
+			_cacheHits(stat->st_cache_hit), _cacheMisses(stat->st_cache_miss),
+			_pagesEvicted(static_cast<Int64>(stat->st_ro_evict) + stat->st_rw_evict),
+			_files(files->AsReadOnly()) {}
+
+	private:
+		Int64 _cacheBytes;
+		Int64 _residentPages;
+		Int64 _cacheHits;
+		Int64 _cacheMisses;
+		Int64 _pagesEvicted;
+		IList<CacheFileStatistics^> ^_files;
+	};
+}
@@ -4,6 +4,8 @@
 #include "DatabaseEnum.h"
 #include "BdbException.h"
 #include "Alloc.h"
+#include "LogCursor.h"
+#include "BlobStore.h"
 
 using namespace std;
 using namespace System::Runtime::InteropServices;
@@ -21,10 +23,50 @@ using namespace System::IO;
 	CheckForNullKey(key, methodName); \
 	else CheckForEmptyKey(key, methodName)
 
+// values of a database with value separation carry a tag only the DataBuffer, object id and byte
+// array key methods understand
+#define CheckForValueSeparation(methodName) \
+	if (m_blobStore != nullptr) \
+		throw gcnew InvalidOperationException("BerkeleyDbWrapper:Database:" + (methodName) + ": Only the DataBuffer methods can be used on a database with value separation")
+
+#pragma managed(push, off)
+// Btree comparator for DatabaseKeyComparison::Int32. Four byte keys are object ids and sort as
+// signed integers ahead of every other key; all other keys keep Berkeley Db's default order,
+// byte-wise and then shorter first. Key data is not guaranteed to be aligned.
+static int CompareInt32Keys(Db *db, const Dbt *a, const Dbt *b)
+{
+	u_int32_t aSize = a->get_size();
+	u_int32_t bSize = b->get_size();
+	if (aSize == sizeof(int) && bSize == sizeof(int))
+	{
+		int aId, bId;
+		memcpy(&aId, a->get_data(), sizeof(int));
+		memcpy(&bId, b->get_data(), sizeof(int));
+		return aId < bId ? -1 : (aId > bId ? 1 : 0);
+	}
+	if (aSize == sizeof(int)) return -1;
+	if (bSize == sizeof(int)) return 1;
+	int cmp = memcmp(a->get_data(), b->get_data(), aSize < bSize ? aSize : bSize);
+	if (cmp != 0) return cmp;
+	return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
+}
+#pragma managed(pop)
+
+static int SetKeyComparison(Db *db, DatabaseKeyComparison keyComparison)
+{
+	switch (keyComparison)
+	{
+	case DatabaseKeyComparison::Int32:
+		return db->set_bt_compare(&CompareInt32Keys);
+	default:
+		return 0;
+	}
+}
+
 BerkeleyDbWrapper::Database::Database(DatabaseConfig^ dbConfig): 
 	m_pDb(NULL), m_pEnv(NULL), m_errpfx(0), m_dbConfig(dbConfig), Id(dbConfig->Id),
 	m_isTxn(false), m_maxDeadlockRetries(1), m_pTrMode(dbConfig->TransactionMode),
-	disposed(false)
+	m_captureChanges(false), m_blobThreshold(0), disposed(false)
 {
 	try
 	{
@@ -41,7 +83,7 @@ BerkeleyDbWrapper::Database::Database(DatabaseConfig^ dbConfig):
 BerkeleyDbWrapper::Database::Database(BerkeleyDbWrapper::Environment^ environment, DatabaseConfig^ dbConfig): 
 	m_pDb(NULL), m_pEnv(environment->m_pEnv), m_errpfx(0), m_dbConfig(dbConfig), Id(dbConfig->Id), 
 	m_isTxn(false), m_maxDeadlockRetries(1), m_pTrMode(dbConfig->TransactionMode),
-	disposed(false)
+	m_captureChanges(dbConfig->ChangeCapture), m_blobThreshold(0), disposed(false)
 {
 	try
 	{
@@ -103,6 +145,11 @@ BerkeleyDbWrapper::Database::!Database()
 
 BerkeleyDbWrapper::Database::~Database()
 {
+	if (m_blobStore != nullptr)
+	{
+		delete m_blobStore;
+		m_blobStore = nullptr;
+	}
 	this->!Database();
 }
 
@@ -197,6 +244,15 @@ void BerkeleyDbWrapper::Database::Open(DatabaseConfig^ dbConfig)
 			}
 			throw gcnew BdbException(NULL, "BerkeleyDbWrapper:Database:Open: Unknown Database Type");
 		}
+		if (dbType == DatabaseType::BTree)
+		{
+			// no prefix function is needed, Berkeley Db drops its default one with the comparator
+			ret = SetKeyComparison(m_pDb, dbConfig->KeyComparison);
+		}
+		if (dbConfig->CachePriority != DatabaseCachePriority::Default)
+		{
+			ret = m_pDb->set_priority(static_cast<DB_CACHE_PRIORITY>(dbConfig->CachePriority));
+		}
 		if (dbConfig->Flags != DbFlags::None)
 		{
 			dbflags = static_cast<u_int32_t>(dbConfig->Flags);
@@ -254,6 +310,18 @@ void BerkeleyDbWrapper::Database::Open(DatabaseConfig^ dbConfig)
 				ret, dbflags, static_cast<u_int32_t>(dbOpenFlags)));
 	}
 
+	DatabaseValueSeparation ^valueSeparation = dbConfig->ValueSeparation;
+	if (valueSeparation != nullptr && valueSeparation->Enabled && dbConfig->FileName != nullptr)
+	{
+		String ^path = dbConfig->FileName;
+		String ^homeDirectory = environment != nullptr ? environment->GetHomeDirectory() : nullptr;
+		if (homeDirectory != nullptr && !Path::IsPathRooted(path))
+		{
+			path = Path::Combine(homeDirectory, path);
+		}
+		m_blobStore = gcnew BlobStore(path, valueSeparation->SegmentSize);
+		m_blobThreshold = valueSeparation->Threshold;
+	}
 }
 
 //void BerkeleyDbWrapper::Database::Put(Dbt *dbtKey, Dbt *dbtValue, long lastUpdateTicks, bool bCheckRaceCondition)
@@ -270,6 +338,16 @@ void BerkeleyDbWrapper::Database::Open(DatabaseConfig^ dbConfig)
 
 void BerkeleyDbWrapper::Database::Put(Dbt *dbtKey, Dbt *dbtValue)
 {
+	Put(dbtKey, dbtValue, 0, true);
+}
+
+void BerkeleyDbWrapper::Database::Put(Dbt *dbtKey, Dbt *dbtValue, int objectId, bool extendedKey)
+{
+	if (m_blobStore != nullptr)
+	{
+		PutSeparatedRecord(dbtKey, dbtValue, objectId, extendedKey);
+		return;
+	}
 	int ret = 0;
 	DBTYPE dbType = DB_UNKNOWN;
 	DbTxn *txn = NULL;
@@ -288,6 +366,16 @@ void BerkeleyDbWrapper::Database::Put(Dbt *dbtKey, Dbt *dbtValue)
 		{
 			txn = BeginTrans();
 			ret = m_pDb->put(txn, dbtKey, dbtValue, 0);
+			if (ret == 0)
+			{
+				ret = LogChange(txn, ChangeLog::PutRecordType, objectId, extendedKey ? dbtKey : NULL, dbtValue);
+				if (ret != 0)
+				{
+					// committing would keep the write without its change record
+					RollbackTrans(txn);
+					throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Change record not logged, write rolled back, ret value " + ret);
+				}
+			}
 			CommitTrans(txn);
 			switch(ret)
 			{
@@ -365,6 +453,11 @@ BerkeleyDbWrapper::Environment^ BerkeleyDbWrapper::Database::Environment::get()
 
 void BerkeleyDbWrapper::Database::Put(int objectId, array<Byte> ^key, DatabaseEntry ^dbEntry, RMWDelegate ^rmwDelegate)
 {
+	if (m_blobStore != nullptr)
+	{
+		PutSeparatedRecord(objectId, key, dbEntry, rmwDelegate);
+		return;
+	}
 	int ret = 0;
 
 	Dbt dbtKey;//(pKeyData, keyBuffer->Length);
@@ -430,6 +523,16 @@ void BerkeleyDbWrapper::Database::Put(int objectId, array<Byte> ^key, DatabaseEn
 						dbtSetValue.set_flags(DB_DBT_USERMEM);
 
 						ret = m_pDb->put(txn, &dbtKey, &dbtSetValue, 0);
+						if (ret == 0)
+						{
+							ret = LogChange(txn, ChangeLog::PutRecordType, objectId, key != nullptr ? &dbtKey : NULL, &dbtSetValue);
+							if (ret != 0)
+							{
+								// committing would keep the write without its change record
+								RollbackTrans(txn);
+								throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Change record not logged, write rolled back, ret value " + ret);
+							}
+						}
 					}
 					else if(dbEntry->Length == 0)
 					{
@@ -438,6 +541,16 @@ void BerkeleyDbWrapper::Database::Put(int objectId, array<Byte> ^key, DatabaseEn
 							case DbRetVal::SUCCESS:
 								//else if no record delete stored record.
 								ret = m_pDb->del(txn, &dbtKey, 0);
+								if (ret == 0)
+								{
+									ret = LogChange(txn, ChangeLog::DeleteRecordType, objectId, key != nullptr ? &dbtKey : NULL, NULL);
+									if (ret != 0)
+									{
+										// committing would keep the write without its change record
+										RollbackTrans(txn);
+										throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Change record not logged, write rolled back, ret value " + ret);
+									}
+								}
 								break;
 							case DbRetVal::NOTFOUND:
 							case DbRetVal::KEYEMPTY:
@@ -615,7 +728,7 @@ void BerkeleyDbWrapper::Database::Put(int key, array<Byte> ^value)
 		Dbt dbtValue(pData, size);
 
 		//Put(&dbtKey, &dbtValue, ((PayloadStorage *)pData)->LastUpdatedTicks, m_dbConfig->CheckRaceCondition );
-		Put(&dbtKey, &dbtValue);
+		Put(&dbtKey, &dbtValue, key, false);
 	}
 	catch (const exception &ex)
 	{
@@ -676,6 +789,11 @@ void BerkeleyDbWrapper::Database::Put(int key, DatabaseEntry ^value)
 }
 
 void BerkeleyDbWrapper::Database::Put(array<Byte> ^key, array<Byte> ^value)
+{
+	Put(0, key, value);
+}
+
+void BerkeleyDbWrapper::Database::Put(int objectId, array<Byte> ^key, array<Byte> ^value)
 {
 	CheckForNullOrEmptyKey(key, "Put");
 	int ret = 0;
@@ -720,7 +838,7 @@ void BerkeleyDbWrapper::Database::Put(array<Byte> ^key, array<Byte> ^value)
 		Dbt dbtValue(pData, size);
 
 		//Put(&dbtKey, &dbtValue, ((PayloadStorage *)pData)->LastUpdatedTicks, m_dbConfig->CheckRaceCondition );
-		Put(&dbtKey, &dbtValue);
+		Put(&dbtKey, &dbtValue, objectId, true);
 	}
 	catch (const exception &ex)
 	{
@@ -840,6 +958,10 @@ void BerkeleyDbWrapper::Database::Put(DatabaseEntry ^key, DatabaseEntry ^value)
 
 BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Get(Dbt *dbtKey, Dbt *dbtValue)
 {
+	if (m_blobStore != nullptr)
+	{
+		return GetSeparatedRecord(dbtKey, dbtValue);
+	}
 	int ret = 0;
 
 	BufferSmallException^ e;
@@ -1063,6 +1185,10 @@ int __cdecl exists_core(Db *db, DbTxn *txn, Dbt *key, Dbt *data, int options)
 int BerkeleyDbWrapper::Database::Get(DataBuffer key, int offset, DataBuffer buffer,
 	GetOpFlags flags)
 {
+	if (m_blobStore != nullptr)
+	{
+		return GetSeparated(key, offset, buffer, flags);
+	}
 	int ret = 0;
 	int size = -1;
 	Database ^db = this;
@@ -1084,6 +1210,10 @@ int BerkeleyDbWrapper::Database::Get(DataBuffer key, int offset, DataBuffer buff
 Stream^ BerkeleyDbWrapper::Database::Get(DataBuffer key,
 	int offset, int length, GetOpFlags flags)
 {
+	if (m_blobStore != nullptr)
+	{
+		return GetSeparated(key, offset, length, flags);
+	}
 	int ret = 0;
 	int size = -1;
 	Database ^db = this;
@@ -1107,6 +1237,10 @@ Stream^ BerkeleyDbWrapper::Database::Get(DataBuffer key,
 int BerkeleyDbWrapper::Database::Put(DataBuffer key, int offset, int count, DataBuffer buffer,
 	PutOpFlags flags)
 {
+	if (m_blobStore != nullptr)
+	{
+		return PutSeparated(key, offset, count, buffer, flags);
+	}
 	int ret = 0;
 	int size = -1;
 	Database ^db = this;
@@ -1134,11 +1268,24 @@ bool BerkeleyDbWrapper::Database::Delete(DataBuffer key, DeleteOpFlags flags)
 	int ret = 0;
 	Database ^db = this;
 	TransactionContext context(db);
+	if (m_blobStore != nullptr)
+	{
+		// the value's segment entry becomes garbage for CollectBlobs
+		m_blobStore->RelocationLock->AcquireReaderLock(Timeout::Infinite);
+	}
+	try
 	{
 		DbtHolder dbtKey;
 		dbtKey.initialize_for_read(key);
 		ret = TryStd("Delete", context, &dbtKey, NULL, static_cast<int>(flags), &del_core);
 	}
+	finally
+	{
+		if (m_blobStore != nullptr)
+		{
+			m_blobStore->RelocationLock->ReleaseReaderLock();
+		}
+	}
 	bool found;
 	switch(ret) {
 	case DbRetVal::SUCCESS:
@@ -1183,6 +1330,16 @@ int BerkeleyDbWrapper::Database::GetLength(DataBuffer key, GetOpFlags flags)
 	int size = -1;
 	Database ^db = this;
 	TransactionContext context(db);
+	if (m_blobStore != nullptr)
+	{
+		DbtHolder dbtKey;
+		dbtKey.initialize_for_read(key);
+		BlobPointer head;
+		size = GetSeparatedHead("GetLength", context, &dbtKey, static_cast<int>(flags), &head);
+		context.commit();
+		if (size < 0) return size;
+		return head.tag == BlobValueTag ? head.length : (size > 0 ? size - 1 : 0);
+	}
 	{
 		DbtHolder dbtKey;
 		dbtKey.initialize_for_read(key);
@@ -1195,9 +1352,535 @@ int BerkeleyDbWrapper::Database::GetLength(DataBuffer key, GetOpFlags flags)
 	return SwitchMemStd("GetLength", context, ret, size);
 }
 
+int BerkeleyDbWrapper::Database::GetSeparatedHead(String ^methodName, TransactionContext &context, Dbt *key,
+	int options, BlobPointer *head)
+{
+	int size = -1;
+	memset(head, 0, sizeof(BlobPointer));
+	// a record longer than a pointer is an inline value, only its length is needed here
+	Dbt dbtHead(head, sizeof(BlobPointer));
+	dbtHead.set_ulen(sizeof(BlobPointer));
+	dbtHead.set_flags(DB_DBT_USERMEM);
+	int ret = TryMemStd(methodName, context, key, &dbtHead, &size, options, &get_core);
+	switch(ret) {
+	case DbRetVal::SUCCESS:
+		break;
+	case DbRetVal::BUFFER_SMALL:
+		head->tag = InlineValueTag;
+		break;
+	case DbRetVal::NOTFOUND:
+	case DbRetVal::KEYEMPTY:
+		size = -1;
+		break;
+	default:
+		throw gcnew BdbException(ret, String::Format(
+			L"BerkeleyDbWrapper:Database:{0}: Unexpected error with ret value {1}", methodName, ret));
+	}
+	return size;
+}
+
+void BerkeleyDbWrapper::Database::PutSeparatedValue(TransactionContext &context, Dbt *key, const void *value,
+	int length, int options)
+{
+	int ret = WriteSeparatedValue(context, key, value, length, options);
+	SwitchStd("Put", context, ret);
+}
+
+// writes the value in the layout of a separated database, leaving context uncommitted
+int BerkeleyDbWrapper::Database::WriteSeparatedValue(TransactionContext &context, Dbt *key, const void *value,
+	int length, int options)
+{
+	int ret = 0;
+	if (length > m_blobThreshold)
+	{
+		BlobPointer pointer;
+		m_blobStore->Append(key->get_data(), key->get_size(), value, length, &pointer);
+		Dbt dbtValue(&pointer, sizeof(BlobPointer));
+		ret = TryStd("Put", context, key, &dbtValue, options, &put_core);
+	}
+	else
+	{
+		char *record = static_cast<char *>(malloc_wrapper(length + 1));
+		if (record == NULL)
+		{
+			throw gcnew OutOfMemoryException();
+		}
+		try
+		{
+			record[0] = InlineValueTag;
+			if (length > 0)
+			{
+				memcpy(record + 1, value, length);
+			}
+			Dbt dbtValue(record, length + 1);
+			ret = TryStd("Put", context, key, &dbtValue, options, &put_core);
+		}
+		finally
+		{
+			free_wrapper(record);
+		}
+	}
+	return ret;
+}
+
+// Get(Dbt *, Dbt *) on a separated database: fills the user memory of value with the whole
+// value, or throws BufferSmallException like the btree get
+BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::GetSeparatedRecord(Dbt *key, Dbt *value)
+{
+	Database ^db = this;
+	for (int attempt = 0; ; ++attempt)
+	{
+		bool collected = false;
+		TransactionContext context(db);
+		BlobPointer head;
+		int size = GetSeparatedHead("Get", context, key, 0, &head);
+		if (size < 0)
+		{
+			context.commit();
+			return DbRetVal::NOTFOUND;
+		}
+		int length = head.tag == BlobValueTag ? head.length : (size > 0 ? size - 1 : 0);
+		if (static_cast<int>(value->get_ulen()) < length)
+		{
+			context.commit();
+			BufferSmallException ^e = gcnew BufferSmallException("Buffer is too small");
+			e->BufferLength = value->get_ulen();
+			e->RecordLength = length;
+			throw e;
+		}
+		if (head.tag == BlobValueTag)
+		{
+			context.commit();
+			try
+			{
+				m_blobStore->Read(&head, 0, value->get_data(), length);
+				value->set_size(length);
+				return DbRetVal::SUCCESS;
+			}
+			catch (FileNotFoundException ^)
+			{
+				// the segment was collected after the pointer was read, the btree has the new one
+				if (attempt > 0) throw;
+				collected = true;
+			}
+			if (collected) continue;
+		}
+		Dbt dbtInline(value->get_data(), 0);
+		dbtInline.set_ulen(value->get_ulen());
+		dbtInline.set_doff(1);
+		dbtInline.set_dlen(length);
+		dbtInline.set_flags(DB_DBT_USERMEM | DB_DBT_PARTIAL);
+		int ret = TryMemStd("Get", context, key, &dbtInline, &size, 0, &get_core);
+		size = SwitchMemStd("Get", context, ret, size);
+		if (size < 0)
+		{
+			return DbRetVal::NOTFOUND;
+		}
+		value->set_size(length);
+		return DbRetVal::SUCCESS;
+	}
+}
+
+// Put(Dbt *, Dbt *) on a separated database, logging the change like the btree put
+void BerkeleyDbWrapper::Database::PutSeparatedRecord(Dbt *key, Dbt *value, int objectId, bool extendedKey)
+{
+	Database ^db = this;
+	m_blobStore->RelocationLock->AcquireReaderLock(Timeout::Infinite);
+	try
+	{
+		TransactionContext context(db);
+		int ret = WriteSeparatedValue(context, key, value->get_data(), value->get_size(), 0);
+		if (ret == 0)
+		{
+			ret = LogChange(context.begin(), ChangeLog::PutRecordType, objectId, extendedKey ? key : NULL, value);
+			if (ret != 0)
+			{
+				// committing would keep the write without its change record
+				context.rollback();
+				throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Change record not logged, write rolled back, ret value " + ret);
+			}
+		}
+		SwitchStd("Put", context, ret);
+	}
+	finally
+	{
+		m_blobStore->RelocationLock->ReleaseReaderLock();
+	}
+}
+
+// the read-modify-write put on a separated database; the delegate sees the requested part of
+// the value at the start of the entry's buffer, as with the btree partial get
+void BerkeleyDbWrapper::Database::PutSeparatedRecord(int objectId, array<Byte> ^key, DatabaseEntry ^dbEntry,
+	RMWDelegate ^rmwDelegate)
+{
+	Database ^db = this;
+	array<Byte> ^keyBuffer = key;
+	Dbt dbtKey;
+	if (key != nullptr)
+	{
+		CheckForEmptyKey(key, "Put");
+	}
+	else
+	{
+		keyBuffer = BitConverter::GetBytes(objectId);
+	}
+	pin_ptr<Byte> pKeyData(&keyBuffer[0]);
+	dbtKey.set_data(pKeyData);
+	dbtKey.set_size(keyBuffer->Length);
+
+	m_blobStore->RelocationLock->AcquireReaderLock(Timeout::Infinite);
+	try
+	{
+		TransactionContext context(db);
+		BlobPointer head;
+		int size = GetSeparatedHead("Put", context, &dbtKey, DB_RMW, &head);
+		bool found = size >= 0;
+		if (!found)
+		{
+			dbEntry->Length = 0;
+		}
+		else
+		{
+			array<Byte> ^readBuffer = dbEntry->Buffer;
+			int length = head.tag == BlobValueTag ? head.length : (size > 0 ? size - 1 : 0);
+			int start = dbEntry->StartPosition < length ? dbEntry->StartPosition : length;
+			int count = length - start;
+			if (count > dbEntry->Length) count = dbEntry->Length;
+			if (count > readBuffer->Length) count = readBuffer->Length;
+			pin_ptr<Byte> pRead(&readBuffer[0]);
+			if (head.tag == BlobValueTag)
+			{
+				m_blobStore->Read(&head, start, pRead, count);
+			}
+			else if (count > 0)
+			{
+				Dbt dbtPart(pRead, 0);
+				dbtPart.set_ulen(readBuffer->Length);
+				dbtPart.set_doff(start + 1);
+				dbtPart.set_dlen(count);
+				dbtPart.set_flags(DB_DBT_USERMEM | DB_DBT_PARTIAL);
+				int ret = TryMemStd("Put", context, &dbtKey, &dbtPart, &size, 0, &get_core);
+				if (ret != 0)
+				{
+					throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Unexpected error with ret value " + ret);
+				}
+			}
+		}
+
+		rmwDelegate(dbEntry);
+
+		int ret = 0;
+		if (dbEntry->Length > 0)
+		{
+			array<Byte> ^value = dbEntry->Buffer;
+			pin_ptr<Byte> pValue(&value[0]);
+			Dbt dbtSetValue(pValue, value->Length);
+			ret = WriteSeparatedValue(context, &dbtKey, pValue, value->Length, 0);
+			if (ret == 0)
+			{
+				ret = LogChange(context.begin(), ChangeLog::PutRecordType, objectId, key != nullptr ? &dbtKey : NULL, &dbtSetValue);
+			}
+		}
+		else if (found)
+		{
+			// the value's segment entry becomes garbage for CollectBlobs
+			ret = TryStd("Put", context, &dbtKey, NULL, 0, &del_core);
+			if (ret == 0)
+			{
+				ret = LogChange(context.begin(), ChangeLog::DeleteRecordType, objectId, key != nullptr ? &dbtKey : NULL, NULL);
+			}
+		}
+		if (ret != 0)
+		{
+			context.rollback();
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Put: Write or change record failed, write rolled back, ret value " + ret);
+		}
+		context.commit();
+	}
+	finally
+	{
+		m_blobStore->RelocationLock->ReleaseReaderLock();
+	}
+}
+
+int BerkeleyDbWrapper::Database::GetSeparated(DataBuffer key, int offset, DataBuffer buffer,
+	GetOpFlags flags)
+{
+	Database ^db = this;
+	for (int attempt = 0; ; ++attempt)
+	{
+		bool collected = false;
+		TransactionContext context(db);
+		DbtHolder dbtKey;
+		DbtHolder dbtBuffer;
+		dbtKey.initialize_for_read(key);
+		dbtBuffer.initialize_for_write(buffer);
+		int bufferSize = dbtBuffer.get_size();
+		BlobPointer head;
+		int size = GetSeparatedHead("Get", context, &dbtKey, static_cast<int>(flags), &head);
+		if (size < 0)
+		{
+			context.commit();
+			return size;
+		}
+		if (head.tag == BlobValueTag)
+		{
+			context.commit();
+			// as with a whole record get, a buffer too small for the value is left untouched
+			if (offset < 0 && bufferSize < head.length)
+			{
+				return head.length;
+			}
+			try
+			{
+				int read = m_blobStore->Read(&head, offset < 0 ? 0 : offset, dbtBuffer.get_data(), bufferSize);
+				return offset < 0 ? head.length : read;
+			}
+			catch (FileNotFoundException ^)
+			{
+				// the segment was collected after the pointer was read, the btree has the new one
+				if (attempt > 0) throw;
+				collected = true;
+			}
+			if (collected) continue;
+		}
+		int length = size > 0 ? size - 1 : 0;
+		if (offset < 0 && bufferSize < length)
+		{
+			context.commit();
+			return length;
+		}
+		dbtBuffer.set_for_partial(offset < 0 ? 1 : offset + 1, bufferSize);
+		int ret = TryMemStd("Get", context, &dbtKey, &dbtBuffer, &size, static_cast<int>(flags),
+			&get_core);
+		size = SwitchMemStd("Get", context, ret, size);
+		return size < 0 || offset >= 0 ? size : length;
+	}
+}
+
+Stream^ BerkeleyDbWrapper::Database::GetSeparated(DataBuffer key, int offset, int length, GetOpFlags flags)
+{
+	Database ^db = this;
+	for (int attempt = 0; ; ++attempt)
+	{
+		bool collected = false;
+		DbtExtended dbtBuffer;
+		TransactionContext context(db);
+		DbtHolder dbtKey;
+		dbtKey.initialize_for_read(key);
+		BlobPointer head;
+		int size = GetSeparatedHead("Get", context, &dbtKey, static_cast<int>(flags), &head);
+		if (size < 0)
+		{
+			context.commit();
+			return nullptr;
+		}
+		if (head.tag == BlobValueTag)
+		{
+			context.commit();
+			int start = offset < 0 ? 0 : (offset < head.length ? offset : head.length);
+			int count = head.length - start;
+			if (length > 0 && length < count)
+			{
+				count = length;
+			}
+			void *data = malloc_wrapper(count > 0 ? count : 1);
+			if (data == NULL)
+			{
+				throw gcnew OutOfMemoryException();
+			}
+			try
+			{
+				m_blobStore->Read(&head, start, data, count);
+			}
+			catch (Exception ^ex)
+			{
+				free_wrapper(data);
+				// the segment was collected after the pointer was read, the btree has the new one
+				if (attempt > 0 || dynamic_cast<FileNotFoundException ^>(ex) == nullptr) throw;
+				collected = true;
+			}
+			if (collected) continue;
+			dbtBuffer.set_data(data);
+			dbtBuffer.set_size(count);
+			return dbtBuffer.CreateStream();
+		}
+		dbtBuffer.set_flags(DB_DBT_MALLOC);
+		dbtBuffer.set_for_partial(offset < 0 ? 1 : offset + 1, length > 0 ? length : -1);
+		int ret = TryMemStd("Get", context, &dbtKey, &dbtBuffer, &size, static_cast<int>(flags),
+			&get_core);
+		size = SwitchMemStd("Get", context, ret, size);
+		if (size < 0) return nullptr;
+		return dbtBuffer.CreateStream();
+	}
+}
+
+int BerkeleyDbWrapper::Database::PutSeparated(DataBuffer key, int offset, int count, DataBuffer buffer,
+	PutOpFlags flags)
+{
+	Database ^db = this;
+	int size = buffer.ByteLength;
+	m_blobStore->RelocationLock->AcquireReaderLock(Timeout::Infinite);
+	try
+	{
+		TransactionContext context(db);
+		DbtHolder dbtKey;
+		DbtHolder dbtBuffer;
+		dbtKey.initialize_for_read(key);
+		dbtBuffer.initialize_for_read(buffer);
+		if (offset < 0)
+		{
+			PutSeparatedValue(context, &dbtKey, dbtBuffer.get_data(), size, static_cast<int>(flags));
+			return size;
+		}
+		if (count < 0)
+		{
+			count = size;
+		}
+		BlobPointer head;
+		int recordSize = GetSeparatedHead("Put", context, &dbtKey, 0, &head);
+		if (recordSize < 0 || head.tag != BlobValueTag)
+		{
+			// a missing record is created zero filled, so its first byte reads as the inline tag
+			dbtBuffer.set_for_partial(offset + 1, count);
+			int ret = TryStd("Put", context, &dbtKey, &dbtBuffer, static_cast<int>(flags), &put_core);
+			SwitchStd("Put", context, ret);
+			return size;
+		}
+		// splice the new bytes into the value read back from its segment and write it out whole
+		int prefix = offset < head.length ? offset : head.length;
+		int tail = head.length > offset + count ? head.length - offset - count : 0;
+		int newLength = offset + size + tail;
+		char *value = static_cast<char *>(malloc_wrapper(newLength > 0 ? newLength : 1));
+		if (value == NULL)
+		{
+			throw gcnew OutOfMemoryException();
+		}
+		try
+		{
+			m_blobStore->Read(&head, 0, value, prefix);
+			if (offset > prefix)
+			{
+				memset(value + prefix, 0, offset - prefix);
+			}
+			if (size > 0)
+			{
+				memcpy(value + offset, dbtBuffer.get_data(), size);
+			}
+			if (tail > 0)
+			{
+				m_blobStore->Read(&head, offset + count, value + offset + size, tail);
+			}
+			PutSeparatedValue(context, &dbtKey, value, newLength, static_cast<int>(flags));
+		}
+		finally
+		{
+			free_wrapper(value);
+		}
+		return size;
+	}
+	finally
+	{
+		m_blobStore->RelocationLock->ReleaseReaderLock();
+	}
+}
+
+bool BerkeleyDbWrapper::Database::IsLiveBlob(int segment, BlobEntry entry, BlobPointer *pointer)
+{
+	if (entry.Key->Length == 0)
+	{
+		return false;
+	}
+	Database ^db = this;
+	TransactionContext context(db);
+	pin_ptr<Byte> pKeyData(&entry.Key[0]);
+	Dbt dbtKey(pKeyData, entry.Key->Length);
+	int size = GetSeparatedHead("CollectBlobs", context, &dbtKey, 0, pointer);
+	context.commit();
+	return size == sizeof(BlobPointer) && pointer->tag == BlobValueTag && pointer->segment == segment
+		&& pointer->offset == entry.Offset;
+}
+
+Int64 BerkeleyDbWrapper::Database::CollectBlobs(int garbagePercentage)
+{
+	if (m_blobStore == nullptr)
+	{
+		return 0;
+	}
+	int segment = m_blobStore->GetCollectionCandidate();
+	if (segment < 0)
+	{
+		return 0;
+	}
+	List<BlobEntry> ^entries = m_blobStore->ReadEntries(segment);
+	List<BlobEntry> ^liveEntries = gcnew List<BlobEntry>();
+	Int64 totalBytes = 0;
+	Int64 liveBytes = 0;
+	BlobPointer pointer;
+	for each (BlobEntry entry in entries)
+	{
+		totalBytes += entry.Length;
+		if (IsLiveBlob(segment, entry, &pointer))
+		{
+			liveBytes += entry.Length;
+			liveEntries->Add(entry);
+		}
+	}
+	if (totalBytes > 0 && (totalBytes - liveBytes) * 100 < static_cast<Int64>(garbagePercentage) * totalBytes)
+	{
+		return 0;
+	}
+
+	Database ^db = this;
+	for each (BlobEntry entry in liveEntries)
+	{
+		m_blobStore->RelocationLock->AcquireWriterLock(Timeout::Infinite);
+		try
+		{
+			// the value may have been overwritten or deleted since the scan
+			if (IsLiveBlob(segment, entry, &pointer))
+			{
+				char *value = static_cast<char *>(malloc_wrapper(entry.Length > 0 ? entry.Length : 1));
+				if (value == NULL)
+				{
+					throw gcnew OutOfMemoryException();
+				}
+				try
+				{
+					m_blobStore->Read(&pointer, 0, value, entry.Length);
+					pin_ptr<Byte> pKeyData(&entry.Key[0]);
+					Dbt dbtKey(pKeyData, entry.Key->Length);
+					TransactionContext context(db);
+					PutSeparatedValue(context, &dbtKey, value, entry.Length, 0);
+				}
+				finally
+				{
+					free_wrapper(value);
+				}
+			}
+		}
+		finally
+		{
+			m_blobStore->RelocationLock->ReleaseWriterLock();
+		}
+	}
+	// the relocated pointers must be durable before the only other copy of their values is removed
+	if (liveEntries->Count > 0)
+	{
+		if (m_isTxn && environment != nullptr)
+		{
+			environment->FlushLogsToDisk();
+		}
+		Sync();
+	}
+	m_blobStore->DeleteSegment(segment);
+	return totalBytes - liveBytes;
+}
+
 String^ BerkeleyDbWrapper::Database::Get(String ^key)
 {
 	CheckForNullOrEmptyKey(key, "Get");
+	CheckForValueSeparation("Get");
 	int ret = 0;
 	pin_ptr<const wchar_t> pKeyStr = PtrToStringChars(key);
 	Dbt dbtKey(const_cast<wchar_t*>(pKeyStr), key->Length * sizeof(Char));
@@ -1395,6 +2078,29 @@ BerkeleyDbWrapper::DatabaseEntry^ BerkeleyDbWrapper::Database::Get(array<Byte> ^
 }
 
 BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(Dbt *dbtKey)
+{
+	return Delete(dbtKey, 0, true);
+}
+
+BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(Dbt *dbtKey, int objectId, bool extendedKey)
+{
+	if (m_blobStore == nullptr)
+	{
+		return DeleteRecord(dbtKey, objectId, extendedKey);
+	}
+	// the value's segment entry becomes garbage for CollectBlobs
+	m_blobStore->RelocationLock->AcquireReaderLock(Timeout::Infinite);
+	try
+	{
+		return DeleteRecord(dbtKey, objectId, extendedKey);
+	}
+	finally
+	{
+		m_blobStore->RelocationLock->ReleaseReaderLock();
+	}
+}
+
+BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::DeleteRecord(Dbt *dbtKey, int objectId, bool extendedKey)
 {
 	int ret = 0;
 	DbTxn *txn = NULL;
@@ -1411,6 +2117,16 @@ BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(Dbt *dbtKey)
 		{
 			txn = BeginTrans();
 			ret = m_pDb->del(txn, dbtKey, 0);
+			if (ret == 0)
+			{
+				ret = LogChange(txn, ChangeLog::DeleteRecordType, objectId, extendedKey ? dbtKey : NULL, NULL);
+				if (ret != 0)
+				{
+					// committing would keep the write without its change record
+					RollbackTrans(txn);
+					throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:Delete: Change record not logged, write rolled back, ret value " + ret);
+				}
+			}
 			CommitTrans(txn);
 		}
 		catch (DbDeadlockException &de) 
@@ -1483,16 +2199,21 @@ BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(Dbt *dbtKey)
 BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(int key)
 {
 	Dbt dbtKey(&key, sizeof(key));
-	return Delete(&dbtKey);
+	return Delete(&dbtKey, key, false);
 }
 
 BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(array<Byte> ^key)
+{
+	return Delete(0, key);
+}
+
+BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Delete(int objectId, array<Byte> ^key)
 {
 	CheckForNullOrEmptyKey(key, "Delete");
 	pin_ptr<Byte> pKey = &key[0];
 	Dbt dbtKey(pKey, key->Length);
 
-	return Delete(&dbtKey);
+	return Delete(&dbtKey, objectId, true);
 }
 
 void BerkeleyDbWrapper::Database::Delete(String ^key)
@@ -1643,6 +2364,48 @@ BerkeleyDbWrapper::DbOpenFlags BerkeleyDbWrapper::Database::GetOpenFlags()
 	return dbOpenFlags;
 }
 
+DatabaseCachePriority BerkeleyDbWrapper::Database::GetCachePriority()
+{
+	int ret = 0;
+	DB_CACHE_PRIORITY priority = DB_PRIORITY_DEFAULT;
+	try
+	{
+		ret = m_pDb->get_priority(&priority);
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			return static_cast<DatabaseCachePriority>(priority);
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:GetCachePriority: Unexpected error with ret value " + ret);
+	}
+}
+
+void BerkeleyDbWrapper::Database::SetCachePriority(DatabaseCachePriority priority)
+{
+	int ret = 0;
+	try
+	{
+		// applies to pages of this file from now on, pages already cached keep their priority
+		ret = m_pDb->set_priority(static_cast<DB_CACHE_PRIORITY>(priority));
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			break;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:SetCachePriority: Unexpected error with ret value " + ret);
+	}
+}
+
 int BerkeleyDbWrapper::Database::GetHashFillFactor()
 {
 	u_int32_t hFFactor = 0;
@@ -1921,6 +2684,49 @@ int BerkeleyDbWrapper::Database::GetKeyCount(DbStatFlags statFlag)
 	}
 }
 
+int BerkeleyDbWrapper::Database::GetLeafPageFill()
+{
+	if (m_pDb == NULL || GetType() != DatabaseType::BTree)
+	{
+		return 0;
+	}
+	int ret = 0;
+	void *sp = NULL;
+	int fill = 0;
+	try
+	{
+		// free bytes are only counted by a full stat, which walks every page
+		ret = m_pDb->stat(NULL, &sp, 0);
+		if (ret == 0)
+		{
+			DB_BTREE_STAT *stat = static_cast<DB_BTREE_STAT*>(sp);
+			double leafBytes = static_cast<double>(stat->bt_leaf_pg) * stat->bt_pagesize;
+			if (leafBytes > 0)
+			{
+				fill = static_cast<int>(100.0 * (leafBytes - stat->bt_leaf_pgfree) / leafBytes);
+			}
+		}
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	finally
+	{
+		if (sp != NULL)
+		{
+			free_wrapper(sp);
+		}
+	}
+	switch(ret)
+	{
+	case DbRetVal::SUCCESS:
+		return fill;
+	default:
+		throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:GetLeafPageFill: Unexpected error with ret value " + ret);
+	}
+}
+
 int BerkeleyDbWrapper::Database::Compact(int fillPercentage, int maxPagesFreed, int implicitTxnTimeoutMsecs)
 {
 	int ret = 0;
@@ -2064,6 +2870,7 @@ System::Collections::Generic::IEnumerator<BerkeleyDbWrapper::DatabaseRecord^>^ B
 
 Dbc *BerkeleyDbWrapper::Database::GetCursor()
 {
+	CheckForValueSeparation("GetCursor");
 	int ret = 0;
 	Dbc *cursor = NULL;
 	DbTxn *txn = NULL;
@@ -2452,6 +3259,11 @@ BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Reset(Dbc *cursor)
 }
 
 BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Verify(String ^fileName)
+{
+	return Verify(fileName, DatabaseKeyComparison::Bytewise);
+}
+
+BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Verify(String ^fileName, DatabaseKeyComparison keyComparison)
 {
 	int ret = 0;
 	Db *db = NULL;
@@ -2460,7 +3272,12 @@ BerkeleyDbWrapper::DbRetVal BerkeleyDbWrapper::Database::Verify(String ^fileName
 		ConvStr fn(fileName);
 		// verify has to use unopened db handle that can't be used thereafter
 		db = new Db(NULL, 0);
-		ret = db->verify(fn.Str(), NULL, NULL, 0);
+		// key order is checked too, so the handle needs the comparator the file was written with
+		ret = SetKeyComparison(db, keyComparison);
+		if (ret == 0)
+		{
+			ret = db->verify(fn.Str(), NULL, NULL, 0);
+		}
 	}
 	catch(const DbException &dex)
 	{
@@ -2539,6 +3356,130 @@ void BerkeleyDbWrapper::Database::Remove(BerkeleyDbWrapper::Environment^ env, St
 	}
 }
 
+void BerkeleyDbWrapper::Database::Rename(BerkeleyDbWrapper::Environment^ env, String ^fileName, String ^newFileName)
+{
+	int ret = 0;
+	Db *db = NULL;
+	DbEnv *m_pEnv = NULL;
+	if (env != nullptr)
+	{
+		m_pEnv = env->m_pEnv;
+	}
+	try
+	{
+		ConvStr fn(fileName);
+		ConvStr newFn(newFileName);
+		// use dummy handle
+		db = new Db(m_pEnv, 0);
+		ret = db->rename(fn.Str(), NULL, newFn.Str(), 0);
+	}
+	catch(const DbException &dex)
+	{
+		throw gcnew BdbException(ret, &dex, String::Format("While renaming {0} to {1}: {2}", fileName,
+			newFileName, gcnew String(dex.what())));
+	}
+	catch(const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, String::Format("While renaming {0} to {1}: {2}", fileName,
+			newFileName, gcnew String(ex.what())));
+	}
+	finally
+	{
+		if (db != NULL) {
+			delete db;
+		}
+	}
+	switch (ret)
+	{
+		case DbRetVal::SUCCESS:
+			return;
+		default:
+			throw gcnew BdbException(ret, "Unrecognized return code from rename");
+	}
+}
+
+int BerkeleyDbWrapper::Database::CopyFrom(String ^fileName, DatabaseKeyComparison keyComparison)
+{
+	int ret = 0;
+	int count = 0;
+	Db *source = NULL;
+	Dbc *cursor = NULL;
+	Dbt dbtKey;
+	Dbt dbtValue;
+	dbtKey.set_flags(DB_DBT_REALLOC);
+	dbtValue.set_flags(DB_DBT_REALLOC);
+	try
+	{
+		ConvStr fn(fileName);
+		source = new Db(m_pEnv, 0);
+		if (m_pEnv == NULL)
+		{
+			source->set_alloc(&malloc_wrapper, &realloc_wrapper, &free_wrapper);
+		}
+		ret = SetKeyComparison(source, keyComparison);
+		if (ret == 0)
+		{
+			ret = source->open(NULL, fn.Str(), NULL, DB_UNKNOWN, DB_RDONLY, 0);
+		}
+		if (ret == 0)
+		{
+			ret = source->cursor(NULL, &cursor, 0);
+		}
+		while (ret == 0 && (ret = cursor->get(&dbtKey, &dbtValue, DB_NEXT)) == 0)
+		{
+			DbTxn *txn = BeginTrans();
+			try
+			{
+				ret = m_pDb->put(txn, &dbtKey, &dbtValue, 0);
+				CommitTrans(txn);
+			}
+			catch (const exception &)
+			{
+				RollbackTrans(txn);
+				throw;
+			}
+			++count;
+		}
+	}
+	catch(const DbException &dex)
+	{
+		throw gcnew BdbException(ret, &dex, String::Format("While copying from {0}: {1}", fileName,
+			gcnew String(dex.what())));
+	}
+	catch(const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, String::Format("While copying from {0}: {1}", fileName,
+			gcnew String(ex.what())));
+	}
+	finally
+	{
+		if (cursor != NULL)
+		{
+			cursor->close();
+		}
+		if (source != NULL)
+		{
+			source->close(0);
+			delete source;
+		}
+		if (dbtKey.get_data() != NULL)
+		{
+			free_wrapper(dbtKey.get_data());
+		}
+		if (dbtValue.get_data() != NULL)
+		{
+			free_wrapper(dbtValue.get_data());
+		}
+	}
+	switch (ret)
+	{
+		case DbRetVal::NOTFOUND:
+			return count;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:Database:CopyFrom: Unexpected error with ret value " + ret);
+	}
+}
+
 void BerkeleyDbWrapper::Database::BackupFromDisk(String^ backupFile, array<Byte>^ copyBuffer)
 {
 	int ret = 0;
@@ -2701,6 +3642,13 @@ void BerkeleyDbWrapper::Database::BackupFromMpf(String^ backupFile, array<Byte>^
 	}
 }
 
+// dbtKey is NULL for records stored under their object id
+int BerkeleyDbWrapper::Database::LogChange(DbTxn *txn, u_int32_t recordType, int objectId, Dbt *dbtKey, Dbt *dbtValue)
+{
+	if (!m_captureChanges || m_skipCaptureOnThread || m_pEnv == NULL) return 0;
+	return ChangeLog::Write(m_pEnv, txn, recordType, Id, objectId, dbtKey, dbtValue);
+}
+
 DbTxn * BerkeleyDbWrapper::Database::BeginTrans()
 {
 	switch(m_pTrMode) {
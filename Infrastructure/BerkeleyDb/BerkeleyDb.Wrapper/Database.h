@@ -2,6 +2,7 @@
 #include "Stdafx.h"
 #include "DbtHolder.h"
 #include "Environment.h"
+#include "BlobStore.h"
 #include "DatabaseEntry.h"
 #include "Databaserecord.h"
 #include "CacheSize.h"
@@ -46,6 +47,7 @@ namespace BerkeleyDbWrapper
 
 		BerkeleyDbWrapper::DbRetVal Delete(int key);
 		BerkeleyDbWrapper::DbRetVal Delete(array<Byte> ^key);
+		BerkeleyDbWrapper::DbRetVal Delete(int objectId, array<Byte> ^key);
 		void Delete(String ^key);
 		void Delete(DatabaseEntry ^key);
 
@@ -60,12 +62,18 @@ namespace BerkeleyDbWrapper
 		DatabaseConfig^ GetDatabaseConfig();
 		String^ GetErrorPrefix();
 		DbFlags GetFlags();
+		DatabaseCachePriority GetCachePriority();
+		void SetCachePriority(DatabaseCachePriority priority);
 		int GetHashFillFactor();
 		DbOpenFlags GetOpenFlags();
 		int GetPageSize();
 		int GetRecordLength();
 		DatabaseType GetType();
 		int GetKeyCount(DbStatFlags statFlag);
+		///<summary>
+		///Gets how full the leaf pages of a btree are, as a percentage; 0 for other database types.
+		///</summary>
+		int GetLeafPageFill();
 		//void Stat(DbStatFlags statFlags);
 		void PrintStats(DbStatFlags statFlags);
 
@@ -73,6 +81,7 @@ namespace BerkeleyDbWrapper
 		void Put(int key, array<Byte> ^value);
 		void Put(int key, DatabaseEntry ^value);
 		void Put(array<Byte> ^key, array<Byte> ^value);
+		void Put(int objectId, array<Byte> ^key, array<Byte> ^value);
 		void Put(array<Byte> ^key, DatabaseEntry ^value);
 		void Put(DatabaseEntry ^key, DatabaseEntry ^value);
 		void Put(int objectId, array<Byte> ^key, DatabaseEntry ^dbEntry, RMWDelegate ^rmwDelegate);
@@ -88,10 +97,25 @@ namespace BerkeleyDbWrapper
 		BerkeleyDbWrapper::DbRetVal Reset(Dbc *cursor);
 
 		static DbRetVal Verify(String ^fileName);
+		static DbRetVal Verify(String ^fileName, DatabaseKeyComparison keyComparison);
 		static void Remove(BerkeleyDbWrapper::Environment^ env, String^ fileName);
+		static void Rename(BerkeleyDbWrapper::Environment^ env, String^ fileName, String^ newFileName);
+		///<summary>
+		///Copies every record of the database file <paramref name="fileName"/>, which was written
+		///with <paramref name="keyComparison"/>, into this database.
+		///</summary>
+		///<returns>The number of records copied.</returns>
+		int CopyFrom(String ^fileName, DatabaseKeyComparison keyComparison);
 		void BackupFromMpf(String^ backupFile, array<Byte>^ copyBuffer);
 		void BackupFromDisk(String^ backupFile, array<Byte>^ copyBuffer);
 		int Compact(int fillPercentage, int maxPagesFreed, int implicitTxnTimeoutMsecs);
+		///<summary>
+		///Takes the next sealed segment file of a database with value separation and, if at least
+		///<paramref name="garbagePercentage"/> of its bytes are no longer referenced, copies the
+		///live values forward and deletes it.
+		///</summary>
+		///<returns>The number of bytes reclaimed.</returns>
+		Int64 CollectBlobs(int garbagePercentage);
 		void Sync();
 
 		int Get(DataBuffer key, int offset, DataBuffer buffer, GetOpFlags flags);
@@ -111,6 +135,24 @@ namespace BerkeleyDbWrapper
 			int get() { return m_maxDeadlockRetries; }
 		}
 
+		///<summary>
+		///Gets whether large values are kept in segment files outside the btree.
+		///</summary>
+		property bool ValueSeparation
+		{
+			bool get() { return m_blobStore != nullptr; }
+		}
+
+		///<summary>
+		///Gets or sets whether puts and deletes made on the calling thread write change records.
+		///Cleared while storing changes replicated from another node, which that node already published.
+		///</summary>
+		static property bool CaptureChangesOnThread
+		{
+			bool get() { return !m_skipCaptureOnThread; }
+			void set(bool value) { m_skipCaptureOnThread = !value; }
+		}
+
 	internal:
 		Database(BerkeleyDbWrapper::Environment ^environment, DatabaseConfig^ dbCOnfig);
 		void Log(int errNumber, const char *errMessage);
@@ -126,14 +168,22 @@ namespace BerkeleyDbWrapper
 		DbEnv *m_pEnv;
 		ConvStr *m_errpfx; 
 		bool m_isTxn;
+		bool m_captureChanges;
+		[ThreadStatic] static bool m_skipCaptureOnThread;
 		int m_maxDeadlockRetries;
 		DatabaseConfig^ m_dbConfig;
+		BlobStore ^m_blobStore;
+		int m_blobThreshold;
 		void Database::Open(DbTxn *txn, Db* pDb, String ^path, DatabaseType type, DbOpenFlags flags);
 		void Open(DatabaseConfig ^dbConfig);
 		//void Open(String ^path, DatabaseType type, DbOpenFlags flags);
 		BerkeleyDbWrapper::DbRetVal Delete(Dbt *dbtKey);
+		BerkeleyDbWrapper::DbRetVal Delete(Dbt *dbtKey, int objectId, bool extendedKey);
+		BerkeleyDbWrapper::DbRetVal DeleteRecord(Dbt *dbtKey, int objectId, bool extendedKey);
 		BerkeleyDbWrapper::DbRetVal Get(Dbt *dbtKey, Dbt *dbtValue);
 		void Put(Dbt *dbtKey, Dbt *dbtValue);
+		void Put(Dbt *dbtKey, Dbt *dbtValue, int objectId, bool extendedKey);
+		int LogChange(DbTxn *txn, u_int32_t recordType, int objectId, Dbt *dbtKey, Dbt *dbtValue);
 		//void Put(Dbt *dbtKey, Dbt *dbtValue, long lastUpdateTicks, bool bCheckRaceCondition);
 		//void CheckRacePut(Dbt *dbtKey, Dbt *dbtValue, long lastUpdateTicks);
 		//void MsgCall (const DbEnv *dbenv, char *msg);
@@ -164,6 +214,17 @@ namespace BerkeleyDbWrapper
 			int options, BdbCall bdbCall);
 		int SwitchMemStd(String ^methodName, TransactionContext &context, int ret, int size);
 		void SwitchStd(String ^methodName, TransactionContext &context, int ret);
+		int GetSeparatedHead(String ^methodName, TransactionContext &context, Dbt *key, int options,
+			BlobPointer *head);
+		void PutSeparatedValue(TransactionContext &context, Dbt *key, const void *value, int length, int options);
+		int WriteSeparatedValue(TransactionContext &context, Dbt *key, const void *value, int length, int options);
+		BerkeleyDbWrapper::DbRetVal GetSeparatedRecord(Dbt *key, Dbt *value);
+		void PutSeparatedRecord(Dbt *key, Dbt *value, int objectId, bool extendedKey);
+		void PutSeparatedRecord(int objectId, array<Byte> ^key, DatabaseEntry ^dbEntry, RMWDelegate ^rmwDelegate);
+		int GetSeparated(DataBuffer key, int offset, DataBuffer buffer, GetOpFlags flags);
+		Stream^ GetSeparated(DataBuffer key, int offset, int length, GetOpFlags flags);
+		int PutSeparated(DataBuffer key, int offset, int count, DataBuffer buffer, PutOpFlags flags);
+		bool IsLiveBlob(int segment, BlobEntry entry, BlobPointer *pointer);
 	};
 
 	class TransactionContext
@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "Environment.h"
 #include "Database.h"
+#include "LogCursor.h"
+#include "CacheStatistics.h"
 #include "BdbException.h"
 #include "Alloc.h"
 
@@ -87,6 +89,10 @@ BerkeleyDbWrapper::Environment::Environment(EnvironmentConfig^ envConfig) : m_er
 			ret = m_pEnv->set_flags(preOpenFlags, 1);
 		}
 
+		// change capture records must be accepted by recovery even on environments
+		// whose databases no longer capture changes
+		ret = m_pEnv->set_app_dispatch(&ChangeLog::Dispatch);
+
 		ConvStr homeDir(envConfig->HomeDirectory);
 		ret = env_setalloc(m_pEnv);
 		ret = m_pEnv->open(homeDir.Str(), static_cast<u_int32_t>(envConfig->OpenFlags), 0);
@@ -125,6 +131,7 @@ BerkeleyDbWrapper::Environment::Environment(String^ dbHome, EnvOpenFlags flags)
 	{
 		m_pEnv = new DbEnv(0);
 		ConvStr pszDbHome(dbHome);
+		ret = m_pEnv->set_app_dispatch(&ChangeLog::Dispatch);
 		ret = env_setalloc(m_pEnv);
 		m_pEnv->open(pszDbHome.Str(), static_cast<u_int32_t>(flags), 0);
 	}
@@ -576,6 +583,11 @@ String^ BerkeleyDbWrapper::Environment::GetLogFileNameFromNumber(int logNumber)
 	}
 }
 
+BerkeleyDbWrapper::LogCursor^ BerkeleyDbWrapper::Environment::OpenLogCursor()
+{
+	return gcnew LogCursor(this);
+}
+
 void BerkeleyDbWrapper::Environment::PrintStats ()
 {
 	int ret = 0;
@@ -616,6 +628,52 @@ void BerkeleyDbWrapper::Environment::PrintCacheStats ()
 	}
 }
 
+BerkeleyDbWrapper::CacheStatistics^ BerkeleyDbWrapper::Environment::GetCacheStatistics()
+{
+	int ret = 0;
+	DB_MPOOL_STAT *gsp = NULL;
+	DB_MPOOL_FSTAT **fsp = NULL;
+	CacheStatistics ^stats = nullptr;
+	try
+	{
+		ret = m_pEnv->memp_stat(&gsp, &fsp, 0);
+		if (ret == 0)
+		{
+			List<CacheFileStatistics^> ^files = gcnew List<CacheFileStatistics^>();
+			if (fsp != NULL)
+			{
+				for (DB_MPOOL_FSTAT **fstat = fsp; *fstat != NULL; ++fstat)
+				{
+					files->Add(gcnew CacheFileStatistics(*fstat));
+				}
+			}
+			stats = gcnew CacheStatistics(gsp, files);
+		}
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	finally
+	{
+		if (gsp != NULL)
+		{
+			free_wrapper(gsp);
+		}
+		if (fsp != NULL)
+		{
+			free_wrapper(fsp);
+		}
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			return stats;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrappwer:Environment:GetCacheStatistics: Unexpected error with ret value " + ret);
+	}
+}
+
 void BerkeleyDbWrapper::Environment::PrintLockStats ()
 {
 	int ret = 0;
@@ -14,6 +14,8 @@ using namespace MySpace::Logging;
 namespace BerkeleyDbWrapper
 {
 	ref class Database;
+	ref class LogCursor;
+	ref class CacheStatistics;
 
 	public ref class BerkeleyDbMessageEventArgs : EventArgs
 	{
@@ -73,6 +75,7 @@ namespace BerkeleyDbWrapper
 		System::Collections::Generic::List<String^>^ GetDataFilesForArchiving();
 		void PrintStats ();
 		void PrintCacheStats ();
+		CacheStatistics^ GetCacheStatistics();
 		void PrintLockStats ();
 		void RemoveFlags (BerkeleyDbWrapper::EnvFlags flags);
 		void SetFlags (BerkeleyDbWrapper::EnvFlags flags);
@@ -93,6 +96,7 @@ namespace BerkeleyDbWrapper
 		void CancelPendingTransactions();
 		void FlushLogsToDisk();
 		String^ GetLogFileNameFromNumber(int logNumber);
+		LogCursor^ OpenLogCursor();
 
 		static void Remove(String^ dbHome, EnvOpenFlags openFlags, bool force);
 
@@ -0,0 +1,333 @@
+#include "stdafx.h"
+#include "LogCursor.h"
+#include "BdbException.h"
+
+using namespace std;
+
+// Transaction commit/abort records are internal to Berkeley Db; these values match
+// __txn_regop and its opcodes in the 4.7 log format (dbinc_auto/txn_auto.h, dbinc/txn.h).
+const u_int32_t txnRegopRecordType = 10;
+// __txn_recycle, logged when transaction ids start over, carries the reused range as min, max
+const u_int32_t txnRecycleRecordType = 14;
+const u_int32_t txnCommitOpcode = 1;
+const u_int32_t txnAbortOpcode = 2;
+
+// rectype, txnid, prev_lsn
+const u_int32_t logRecordHeaderSize = sizeof(u_int32_t) + sizeof(u_int32_t) + sizeof(DB_LSN);
+
+BerkeleyDbWrapper::LogSequenceNumber BerkeleyDbWrapper::LogSequenceNumber::Parse(String ^value)
+{
+	if (value == nullptr)
+	{
+		throw gcnew ArgumentNullException("value");
+	}
+	array<String^> ^parts = value->Trim()->Split('/');
+	if (parts->Length != 2)
+	{
+		throw gcnew FormatException("Log sequence number must be in the form file/offset: " + value);
+	}
+	return LogSequenceNumber(Int32::Parse(parts[0]), Int32::Parse(parts[1]));
+}
+
+BerkeleyDbWrapper::LogCursor::LogCursor(BerkeleyDbWrapper::Environment ^env) : _env(env), _logcp(NULL),
+	_positioned(false)
+{
+	int ret = 0;
+	DbLogc *logcp = NULL;
+	try
+	{
+		ret = env->m_pEnv->log_cursor(&logcp, 0);
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			_logcp = logcp;
+			break;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:LogCursor:Constructor: Unexpected error with ret value " + ret);
+	}
+}
+
+BerkeleyDbWrapper::LogCursor::~LogCursor()
+{
+	this->!LogCursor();
+	_env = nullptr;
+}
+
+BerkeleyDbWrapper::LogCursor::!LogCursor()
+{
+	if (_logcp != NULL)
+	{
+		try
+		{
+			_logcp->close(0);
+		}
+		catch (const exception &)
+		{
+			// nothing to be done about a failed close
+		}
+		finally
+		{
+			_logcp = NULL;
+		}
+	}
+}
+
+bool BerkeleyDbWrapper::LogCursor::Seek(LogSequenceNumber lsn)
+{
+	if (lsn.IsEmpty)
+	{
+		_positioned = false;
+		_position = lsn;
+		return true;
+	}
+	int ret = 0;
+	DbLsn dbLsn;
+	lsn.CopyTo(&dbLsn);
+	Dbt data;
+	try
+	{
+		ret = _logcp->get(&dbLsn, &data, DB_SET);
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			_positioned = true;
+			_position = lsn;
+			return true;
+		case DbRetVal::NOTFOUND:
+			return false;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:LogCursor:Seek: Unexpected error with ret value " + ret);
+	}
+}
+
+void BerkeleyDbWrapper::LogCursor::SeekToEnd()
+{
+	int ret = 0;
+	DbLsn dbLsn;
+	Dbt data;
+	try
+	{
+		ret = _logcp->get(&dbLsn, &data, DB_LAST);
+	}
+	catch (const exception &ex)
+	{
+		throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+	}
+	switch(ret)
+	{
+		case DbRetVal::SUCCESS:
+			_positioned = true;
+			_position = LogSequenceNumber(dbLsn);
+			break;
+		case DbRetVal::NOTFOUND:
+			// empty log; everything written from now on is new
+			_positioned = false;
+			_position = LogSequenceNumber();
+			break;
+		default:
+			throw gcnew BdbException(ret, "BerkeleyDbWrapper:LogCursor:SeekToEnd: Unexpected error with ret value " + ret);
+	}
+}
+
+BerkeleyDbWrapper::ChangeRecord^ BerkeleyDbWrapper::LogCursor::Next()
+{
+	int ret = 0;
+	DbLsn dbLsn;
+	Dbt data;
+	while (true)
+	{
+		try
+		{
+			ret = _logcp->get(&dbLsn, &data, _positioned ? DB_NEXT : DB_FIRST);
+		}
+		catch (const exception &ex)
+		{
+			throw gcnew BdbException(ret, &ex, gcnew String(ex.what()));
+		}
+		switch(ret)
+		{
+			case DbRetVal::SUCCESS:
+				break;
+			case DbRetVal::NOTFOUND:
+				// end of log; DB_NEXT at the last record keeps the cursor where it is
+				return nullptr;
+			default:
+				throw gcnew BdbException(ret, "BerkeleyDbWrapper:LogCursor:Next: Unexpected error with ret value " + ret);
+		}
+		_positioned = true;
+		_position = LogSequenceNumber(dbLsn);
+		ChangeRecord ^record = Decode(dbLsn, data);
+		if (record != nullptr)
+		{
+			return record;
+		}
+	}
+}
+
+BerkeleyDbWrapper::ChangeRecord^ BerkeleyDbWrapper::LogCursor::Decode(const DbLsn &lsn, const Dbt &data)
+{
+	if (data.get_size() < logRecordHeaderSize + sizeof(u_int32_t))
+	{
+		return nullptr;
+	}
+	const char *pData = static_cast<const char *>(data.get_data());
+	const char *pEnd = pData + data.get_size();
+	u_int32_t recordType = *reinterpret_cast<const u_int32_t *>(pData);
+	int transactionId = *reinterpret_cast<const int *>(pData + sizeof(u_int32_t));
+	pData += logRecordHeaderSize;
+
+	if (recordType == txnRegopRecordType)
+	{
+		u_int32_t opcode = *reinterpret_cast<const u_int32_t *>(pData);
+		switch (opcode)
+		{
+			case txnCommitOpcode:
+				return gcnew ChangeRecord(LogSequenceNumber(lsn), ChangeOperation::Commit, transactionId, 0, 0, nullptr, nullptr);
+			case txnAbortOpcode:
+				return gcnew ChangeRecord(LogSequenceNumber(lsn), ChangeOperation::Abort, transactionId, 0, 0, nullptr, nullptr);
+			default:
+				return nullptr;
+		}
+	}
+
+	if (recordType == txnRecycleRecordType)
+	{
+		if (pData + 2 * sizeof(u_int32_t) > pEnd)
+		{
+			throw gcnew BdbException(0, "BerkeleyDbWrapper:LogCursor:Next: Truncated recycle record at " + LogSequenceNumber(lsn).ToString());
+		}
+		int firstTransactionId = *reinterpret_cast<const int *>(pData);
+		int lastTransactionId = *reinterpret_cast<const int *>(pData + sizeof(u_int32_t));
+		return gcnew ChangeRecord(LogSequenceNumber(lsn), firstTransactionId, lastTransactionId);
+	}
+
+	ChangeOperation operation;
+	switch (recordType)
+	{
+		case ChangeLog::PutRecordType:
+			operation = ChangeOperation::Put;
+			break;
+		case ChangeLog::DeleteRecordType:
+			operation = ChangeOperation::Delete;
+			break;
+		default:
+			return nullptr;
+	}
+
+	if (pData + 2 * sizeof(int) + sizeof(u_int32_t) > pEnd)
+	{
+		throw gcnew BdbException(0, "BerkeleyDbWrapper:LogCursor:Next: Truncated change record at " + LogSequenceNumber(lsn).ToString());
+	}
+	int databaseId = *reinterpret_cast<const int *>(pData);
+	pData += sizeof(int);
+	int objectId = *reinterpret_cast<const int *>(pData);
+	pData += sizeof(int);
+	u_int32_t keySize = *reinterpret_cast<const u_int32_t *>(pData);
+	pData += sizeof(u_int32_t);
+	if (pData + keySize > pEnd)
+	{
+		throw gcnew BdbException(0, "BerkeleyDbWrapper:LogCursor:Next: Truncated change record at " + LogSequenceNumber(lsn).ToString());
+	}
+	array<Byte> ^key = gcnew array<Byte>(keySize);
+	if (keySize > 0)
+	{
+		Marshal::Copy(IntPtr(const_cast<char *>(pData)), key, 0, keySize);
+	}
+	pData += keySize;
+	array<Byte> ^value = nullptr;
+	if (operation == ChangeOperation::Put)
+	{
+		if (pData + sizeof(u_int32_t) > pEnd)
+		{
+			throw gcnew BdbException(0, "BerkeleyDbWrapper:LogCursor:Next: Truncated change record at " + LogSequenceNumber(lsn).ToString());
+		}
+		u_int32_t valueSize = *reinterpret_cast<const u_int32_t *>(pData);
+		pData += sizeof(u_int32_t);
+		if (pData + valueSize > pEnd)
+		{
+			throw gcnew BdbException(0, "BerkeleyDbWrapper:LogCursor:Next: Truncated change record at " + LogSequenceNumber(lsn).ToString());
+		}
+		value = gcnew array<Byte>(valueSize);
+		if (valueSize > 0)
+		{
+			Marshal::Copy(IntPtr(const_cast<char *>(pData)), value, 0, valueSize);
+		}
+	}
+	return gcnew ChangeRecord(LogSequenceNumber(lsn), operation, transactionId, databaseId, objectId, key, value);
+}
+
+int BerkeleyDbWrapper::ChangeLog::Write(DbEnv *env, DbTxn *txn, u_int32_t recordType, int databaseId, int objectId,
+	const Dbt *key, const Dbt *value)
+{
+	u_int32_t keySize = key != NULL ? key->get_size() : 0;
+	u_int32_t valueSize = value != NULL ? value->get_size() : 0;
+	u_int32_t size = logRecordHeaderSize + 2 * sizeof(int) + sizeof(u_int32_t) + keySize;
+	if (recordType == PutRecordType)
+	{
+		size += sizeof(u_int32_t) + valueSize;
+	}
+
+	char *buffer = static_cast<char *>(malloc(size));
+	if (buffer == NULL)
+	{
+		return ENOMEM;
+	}
+	char *pData = buffer;
+	*reinterpret_cast<u_int32_t *>(pData) = recordType;
+	pData += sizeof(u_int32_t);
+	*reinterpret_cast<u_int32_t *>(pData) = txn != NULL ? txn->id() : 0;
+	pData += sizeof(u_int32_t);
+	// change records are not chained to the transaction, recovery never undoes them
+	memset(pData, 0, sizeof(DB_LSN));
+	pData += sizeof(DB_LSN);
+	*reinterpret_cast<int *>(pData) = databaseId;
+	pData += sizeof(int);
+	*reinterpret_cast<int *>(pData) = objectId;
+	pData += sizeof(int);
+	*reinterpret_cast<u_int32_t *>(pData) = keySize;
+	pData += sizeof(u_int32_t);
+	if (keySize > 0)
+	{
+		memcpy(pData, key->get_data(), keySize);
+		pData += keySize;
+	}
+	if (recordType == PutRecordType)
+	{
+		*reinterpret_cast<u_int32_t *>(pData) = valueSize;
+		pData += sizeof(u_int32_t);
+		if (valueSize > 0)
+		{
+			memcpy(pData, value->get_data(), valueSize);
+		}
+	}
+
+	DbLsn lsn;
+	Dbt record(buffer, size);
+	int ret = 0;
+	try
+	{
+		ret = env->log_put(&lsn, &record, 0);
+	}
+	catch (...)
+	{
+		free(buffer);
+		throw;
+	}
+	free(buffer);
+	return ret;
+}
+
+int __cdecl BerkeleyDbWrapper::ChangeLog::Dispatch(DbEnv *env, Dbt *data, DbLsn *lsn, db_recops op)
+{
+	return 0;
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include "Stdafx.h"
+#include "Environment.h"
+
+using namespace System;
+using namespace System::Security;
+
+namespace BerkeleyDbWrapper
+{
+	///<summary>
+	///Identifies a position in the Berkeley Db transaction log.
+	///</summary>
+	public value class LogSequenceNumber : IComparable<LogSequenceNumber>
+	{
+	public:
+		/// <summary>
+		/// 	<para>Initializes a new instance of the <see cref="LogSequenceNumber"/> structure.</para>
+		/// </summary>
+		/// <param name="file">
+		/// 	<para>The <see cref="Int32" /> number of the log file.</para>
+		/// </param>
+		/// <param name="offset">
+		/// 	<para>The <see cref="Int32" /> byte offset within the log file.</para>
+		/// </param>
+		LogSequenceNumber(int file, int offset) : _file(file), _offset(offset) {}
+		///<summary>
+		///Gets the number of the log file.
+		///</summary>
+		property int File { int get() { return _file; } }
+		///<summary>
+		///Gets the byte offset within the log file.
+		///</summary>
+		property int Offset { int get() { return _offset; } }
+		///<summary>
+		///Gets whether this is the empty position, which precedes every record in the log.
+		///</summary>
+		property bool IsEmpty { bool get() { return _file == 0; } }
+
+		virtual int CompareTo(LogSequenceNumber other)
+		{
+			if (_file != other._file) return _file < other._file ? -1 : 1;
+			if (_offset != other._offset) return _offset < other._offset ? -1 : 1;
+			return 0;
+		}
+
+		virtual String^ ToString() override
+		{
+			return String::Format("{0}/{1}", _file, _offset);
+		}
+
+		/// <summary>
+		/// 	<para>Parses a value previously produced by <see cref="ToString"/>.</para>
+		/// </summary>
+		static LogSequenceNumber Parse(String ^value);
+
+	internal:
+		LogSequenceNumber(const DbLsn &lsn) : _file(lsn.file), _offset(lsn.offset) {}
+		void CopyTo(DbLsn *lsn)
+		{
+			lsn->file = static_cast<u_int32_t>(_file);
+			lsn->offset = static_cast<u_int32_t>(_offset);
+		}
+
+	private:
+		int _file;
+		int _offset;
+	};
+
+	///<summary>
+	///The kind of change described by a <see cref="ChangeRecord"/>.
+	///</summary>
+	public enum class ChangeOperation
+	{
+		None = 0,
+		Put = 1,
+		Delete = 2,
+		Commit = 3,
+		Abort = 4,
+		Recycle = 5
+	};
+
+	///<summary>
+	///A single change read from the transaction log by a <see cref="LogCursor"/>.
+	///</summary>
+	public ref class ChangeRecord
+	{
+	public:
+		///<summary>
+		///Gets the position of the record in the log.
+		///</summary>
+		property LogSequenceNumber Lsn { LogSequenceNumber get() { return _lsn; } }
+		///<summary>
+		///Gets the kind of change.
+		///</summary>
+		property ChangeOperation Operation { ChangeOperation get() { return _operation; } }
+		///<summary>
+		///Gets the id of the transaction the change belongs to, or 0 if the change was not transactional.
+		///For <see cref="ChangeOperation.Recycle"/>, the lowest of the transaction ids being reused.
+		///</summary>
+		property int TransactionId { int get() { return _transactionId; } }
+		///<summary>
+		///For <see cref="ChangeOperation.Recycle"/>, the highest of the transaction ids being reused;
+		///otherwise the same as <see cref="TransactionId"/>.
+		///</summary>
+		property int LastTransactionId { int get() { return _lastTransactionId; } }
+		///<summary>
+		///Gets the <see cref="DatabaseConfig.Id"/> of the database that was changed.
+		///</summary>
+		property int DatabaseId { int get() { return _databaseId; } }
+		///<summary>
+		///Gets the object id of the changed record.
+		///</summary>
+		property int ObjectId { int get() { return _objectId; } }
+		///<summary>
+		///Gets the key the record is stored under; empty when the record is stored under its object id.
+		///</summary>
+		property array<Byte>^ Key { array<Byte>^ get() { return _key; } }
+		///<summary>
+		///Gets the stored value for puts; <see langword="null"/> for every other operation.
+		///</summary>
+		property array<Byte>^ Value { array<Byte>^ get() { return _value; } }
+
+	internal:
+		ChangeRecord(LogSequenceNumber lsn, ChangeOperation operation, int transactionId,
+			int databaseId, int objectId, array<Byte> ^key, array<Byte> ^value) :
+			_lsn(lsn), _operation(operation), _transactionId(transactionId), _lastTransactionId(transactionId),
+			_databaseId(databaseId), _objectId(objectId), _key(key), _value(value) {}
+		ChangeRecord(LogSequenceNumber lsn, int firstTransactionId, int lastTransactionId) :
+			_lsn(lsn), _operation(ChangeOperation::Recycle), _transactionId(firstTransactionId),
+			_lastTransactionId(lastTransactionId), _databaseId(0), _objectId(0), _key(nullptr), _value(nullptr) {}
+
+	private:
+		LogSequenceNumber _lsn;
+		ChangeOperation _operation;
+		int _transactionId;
+		int _lastTransactionId;
+		int _databaseId;
+		int _objectId;
+		array<Byte> ^_key;
+		array<Byte> ^_value;
+	};
+
+	///<summary>
+	///Reads committed put/delete changes, along with the commit and abort markers of the
+	///transactions that contain them, from the environment's transaction log.
+	///</summary>
+	///<remarks>
+	///Only databases opened with <see cref="DatabaseConfig.ChangeCapture"/> write change records.
+	///Records of a transaction are reported before its <see cref="ChangeOperation.Commit"/>, so
+	///consumers must hold them until the commit is seen and drop them on
+	///<see cref="ChangeOperation.Abort"/>. Non transactional changes have a transaction id of 0.
+	///A transaction rolled back by recovery gets no abort record; the
+	///<see cref="ChangeOperation.Recycle"/> record logged when its id is reused is the last
+	///word on it, and any changes still held for the recycled ids must be dropped.
+	///</remarks>
+	[SuppressUnmanagedCodeSecurity()]
+	public ref class LogCursor
+	{
+	public:
+		~LogCursor();
+		!LogCursor();
+
+		///<summary>
+		///Positions the cursor so that the next call to <see cref="Next"/> returns the first
+		///change after <paramref name="lsn"/>. An empty position starts at the beginning of the log.
+		///</summary>
+		///<returns><see langword="false"/> if the position is no longer in the log.</returns>
+		bool Seek(LogSequenceNumber lsn);
+		///<summary>
+		///Positions the cursor at the last record in the log, so that <see cref="Next"/> returns
+		///only changes written after this call.
+		///</summary>
+		void SeekToEnd();
+		///<summary>
+		///Returns the next change in the log, or <see langword="null"/> if the end of the log was reached.
+		///</summary>
+		ChangeRecord^ Next();
+		///<summary>
+		///Gets the position of the last record read, changes or not.
+		///</summary>
+		property LogSequenceNumber Position { LogSequenceNumber get() { return _position; } }
+
+	internal:
+		LogCursor(BerkeleyDbWrapper::Environment ^env);
+
+	private:
+		BerkeleyDbWrapper::Environment ^_env;
+		DbLogc *_logcp;
+		LogSequenceNumber _position;
+		bool _positioned;
+		ChangeRecord^ Decode(const DbLsn &lsn, const Dbt &data);
+	};
+
+	// Native helpers for the application specific log records behind change capture.
+	class ChangeLog
+	{
+	public:
+		// record types; application record types must start at DB_user_BEGIN
+		static const u_int32_t PutRecordType = DB_user_BEGIN + 1;
+		static const u_int32_t DeleteRecordType = DB_user_BEGIN + 2;
+
+		// Writes a change record for a put or delete done in txn. Must be called before txn
+		// commits so that the commit record follows it in the log.
+		static int Write(DbEnv *env, DbTxn *txn, u_int32_t recordType, int databaseId, int objectId,
+			const Dbt *key, const Dbt *value);
+
+		// Recovery hands application record types to the dispatch function; change records
+		// carry nothing to redo or undo.
+		static int __cdecl Dispatch(DbEnv *env, Dbt *data, DbLsn *lsn, db_recops op);
+	};
+}
@@ -26,6 +26,7 @@ namespace MySpace.DataRelay
 		DeleteInAllTypesWithConfirm,
 		NotificationWithConfirm,
 		IncrementWithConfirm,
+		Bundle,		// one way messages packed and compressed together, unpacked by the relay node that receives them
         NumTypes        // This must always be the last item
     }
 }
@@ -37,6 +37,10 @@ namespace MySpace.DataRelay
 		/// <summary>
 		/// An unknown error was encountered.
 		/// </summary>
-		Unknown
+		Unknown,
+		/// <summary>
+		/// The destination node already had as many messages outstanding as its concurrency limit allows.
+		/// </summary>
+		NodeOverloaded
 	}
 }
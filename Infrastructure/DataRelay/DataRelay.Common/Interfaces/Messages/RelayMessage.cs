@@ -9,6 +9,7 @@ using System.Text;
 using MySpace.Common;
 using MySpace.Common.IO;
 using MySpace.DataRelay.Common.Interfaces.Query;
+using MySpace.DataRelay.Formatters;
 
 namespace MySpace.DataRelay
 {
@@ -279,6 +280,21 @@ namespace MySpace.DataRelay
 		[NonSerialized]
 		public long EnteredCurrentSystemAt = 0;
 
+		/// <summary>
+		/// Set on the Saves and Deletes a storage component publishes from what it actually
+		/// stored, which replicate even for types whose client writes don't.  Do not serialize.
+		/// </summary>
+		[NonSerialized]
+		public bool IsCapturedChange;
+
+		/// <summary>
+		/// Set on the Saves a storage component publishes to copy what it stores to the cluster
+		/// that holds it after a migration; the forwarder drops those its own cluster still holds.
+		/// Do not serialize.
+		/// </summary>
+		[NonSerialized]
+		public bool IsMigrationCopy;
+
 		public int Priority;
 
 		public short RelayTTL = 2;
@@ -836,6 +852,39 @@ namespace MySpace.DataRelay
 			return InterZoneMsg;
 		}
 
+		/// <summary>
+		/// Packs one way messages into a single <see cref="MessageType.Bundle"/> message whose
+		/// payload is the compressed message list.
+		/// </summary>
+		/// <param name="messages">The messages to pack.</param>
+		/// <param name="serializedLength">The length of the message list before it was compressed.</param>
+		/// <returns>The bundle.</returns>
+		public static RelayMessage CreateBundleFrom(IList<RelayMessage> messages, out int serializedLength)
+		{
+			byte[] serialized = RelayMessageFormatter.WriteRelayMessageList(messages).ToArray();
+			serializedLength = serialized.Length;
+			byte[] compressed = Compressor.GetInstance().Compress(serialized, RelayCompressionImplementation);
+			return new RelayMessage(0, messages.Count, compressed, false, MessageType.Bundle);
+		}
+
+		/// <summary>
+		/// Unpacks the messages of a bundle made with <see cref="CreateBundleFrom"/>.
+		/// </summary>
+		/// <returns>The messages in the bundle.</returns>
+		public List<RelayMessage> GetBundledMessages()
+		{
+			if (MessageType != MessageType.Bundle)
+			{
+				throw new InvalidOperationException(string.Format("Message {0} is not a bundle.", this));
+			}
+			if (Payload == null || Payload.ByteArray == null)
+			{
+				return new List<RelayMessage>(0);
+			}
+			byte[] serialized = Compressor.GetInstance().Decompress(Payload.ByteArray, RelayCompressionImplementation);
+			return RelayMessageFormatter.ReadRelayMessageList(new MemoryStream(serialized));
+		}
+
 		public void Reset()
 		{
 			Id = 0;
@@ -851,6 +900,8 @@ namespace MySpace.DataRelay
 
 			RelayTTL = 2;
 			SourceZone = 0;
+			IsCapturedChange = false;
+			IsMigrationCopy = false;
 		}
 
 		public bool OriginatesDirectlyFromClient(ushort ServerZone)
@@ -378,6 +378,23 @@ namespace MySpace.DataRelay.Common.Schemas
 		public int NodeReselectMinutes;
 		[XmlAttribute("UseIdRanges")]
 		public bool UseIdRanges;
+		/// <summary>
+		/// Places ids on clusters with a consistent hash rather than by modulus, so that when
+		/// clusters are added to the end of the group only the ids that move to them change
+		/// cluster. Ignored when <see cref="UseIdRanges"/> is set.
+		/// </summary>
+		[XmlAttribute("UseConsistentHashing")]
+		public bool UseConsistentHashing;
+		/// <summary>
+		/// When the number of clusters in a consistently hashed group changes, how many minutes
+		/// a Get that misses on an id's new cluster is retried on its previous one, and what is
+		/// found there copied to the new one; the copy is only made for types that check race
+		/// conditions. Storage nodes with a BerkeleyDb <c>MigrationCopy</c> also copy the records
+		/// they hold to their new clusters in the background, so keys that aren't read in this
+		/// time move too. 0 turns migration off.
+		/// </summary>
+		[XmlAttribute("MigrationMinutes")]
+		public int MigrationMinutes;
 
 		[XmlAttribute("StartupRepopulateDuration")]
 		public int StartupRepopulateDuration;
@@ -827,6 +844,24 @@ namespace MySpace.DataRelay.Common.Schemas
 		public int ItemsPerDequeue = 100;
 		[XmlElement("DequeueIntervalSeconds")]
 		public int DequeueIntervalSeconds = 10;
+		/// <summary>
+		/// The folder under which each node's error queue is kept on disk, so queued messages
+		/// survive a restart and aren't limited by <see cref="MaxCount"/>. When empty, the
+		/// default, queues are kept in memory. Only the value at startup is meaningful.
+		/// </summary>
+		[XmlElement("PersistenceFolder")]
+		public string PersistenceFolder;
+		/// <summary>
+		/// The most disk one node's persisted queue may use. Messages beyond it are dropped.
+		/// </summary>
+		[XmlElement("PersistenceMaxMegabytes")]
+		public int PersistenceMaxMegabytes = 1024;
+		/// <summary>
+		/// The size of the files a persisted queue is written in. A file is deleted once all
+		/// of its messages have been dequeued.
+		/// </summary>
+		[XmlElement("PersistenceSegmentMegabytes")]
+		public int PersistenceSegmentMegabytes = 16;
 
 	}
 
@@ -156,6 +156,21 @@ namespace MySpace.DataRelay.Common.Schemas
 		[XmlElement("ThrowOnSyncFailure")]
 		public bool ThrowOnSyncFailure;
 
+		/// <summary>
+		/// If true, concurrent identical Gets of this type passing through the forwarder are sent once
+		/// and share the answer.
+		/// </summary>
+		[XmlElement("CoalesceGets")]
+		public bool CoalesceGets;
+
+		/// <summary>
+		/// If true, Saves and Deletes of this type are replicated by the BerkeleyDb change capture
+		/// of the node that stored them, so the forwarder doesn't send the ones clients send to the
+		/// other nodes of the cluster. The type's database must have ChangeCapture on.
+		/// </summary>
+		[XmlElement("ReplicateByChangeCapture")]
+		public bool ReplicateByChangeCapture;
+
 		/// <summary>
 		/// Gets or sets the assembly qualified type name of the target object.
 		/// </summary>
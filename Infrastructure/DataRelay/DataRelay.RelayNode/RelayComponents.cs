@@ -303,26 +303,72 @@ namespace MySpace.DataRelay
 				for (int i = 0; i < components.Count; i++)
 				{
 					IRelayComponent component = components[i];
-					bool passExclustionListFilter = true;
+					if (!IsExcluded(component, messageWithContext.ProcessingContext))
+					{
+						component.HandleMessage(messageWithContext.RelayMessage);
+					}
+				}
+			}
 
-					foreach (Type excludedType in messageWithContext.ProcessingContext.ExclusionComponentList)
+			Replicate(messageWithContext.RelayMessage, replicationComponents);
+		}
+
+		/// <summary>
+		/// Call this method to process a list of 'In' <see cref="RelayMessage"/>s that share one
+		/// <see cref="RelayMessageProcessingContext"/>.
+		/// </summary>
+		/// <param name="messagesWithContext">This container class contians both the messages and
+		/// the corresponding <see cref="RelayMessageProcessingContext"/></param>
+		public void HandleInMessages(RelayMessageListWithContext messagesWithContext)
+		{
+			IList<RelayMessage> messages = messagesWithContext.RelayMessages;
+			for (int i = 0; i < messages.Count; i++)
+			{
+				this.ttl.ApplyDefaultTTL(messages[i]);
+				if (CheckForConfigurationProblems(messages[i])) return;
+			}
+
+			TypeIdMessageListPair[] typedMessages = TypeIdMessageListPair.SplitMessagesByType(this.maxTypeId, messages, this.doHandleMessageByType, this);
+			List<IRelayComponent> components = null;
+			List<IReplicationComponent> replicationComponent = null;
+
+			for (int typeId = 0; typeId < typedMessages.Length; typeId++)
+			{
+				if (typedMessages[typeId] != null)
+				{
+					GetInComponents(typeId, out components, out replicationComponent);
+
+					if (components != null)
 					{
-						if (component.GetType() == excludedType ||
-							  component.GetType().IsSubclassOf(excludedType))
+						for (int i = 0; i < components.Count; i++)
 						{
-							passExclustionListFilter = false;
-							break;
+							if (!IsExcluded(components[i], messagesWithContext.ProcessingContext))
+							{
+								components[i].HandleMessages(typedMessages[typeId].GetMessages());
+							}
 						}
 					}
 
-					if (passExclustionListFilter)
-					{
-						component.HandleMessage(messageWithContext.RelayMessage);
-					}
+					Replicate(typedMessages[typeId].GetMessages(), replicationComponent);
 				}
 			}
+		}
 
-			Replicate(messageWithContext.RelayMessage, replicationComponents);
+		private static bool IsExcluded(IRelayComponent component, RelayMessageProcessingContext processingContext)
+		{
+			if (processingContext.ExclusionComponentList == null)
+			{
+				return false;
+			}
+			foreach (Type excludedType in processingContext.ExclusionComponentList)
+			{
+				if (component.GetType() == excludedType ||
+					  component.GetType().IsSubclassOf(excludedType))
+				{
+					return true;
+				}
+			}
+			return false;
 		}
 
 		/// <summary>
@@ -38,6 +38,7 @@ namespace MySpace.DataRelay
 		Port<RelayMessage> inMessagePort = new Port<RelayMessage>();
 		Port<RelayMessageWithContext> inMessageWithContextPort = new Port<RelayMessageWithContext>();
 		Port<IList<RelayMessage>> inMessagesPort = new Port<IList<RelayMessage>>();
+		Port<RelayMessageListWithContext> inMessagesWithContextPort = new Port<RelayMessageListWithContext>();
 
 		Port<RelayMessageAsyncResult> outMessagePort;
 		Port<RelayMessageListAsyncResult> outMessagesPort;
@@ -152,6 +153,8 @@ namespace MySpace.DataRelay
 								Arbiter.Receive<RelayMessageWithContext>(true, inMessageWithContextPort, HandleInMessage));
 					Arbiter.Activate(inMessageQueue,
 								Arbiter.Receive<IList<RelayMessage>>(true, inMessagesPort, HandleInMessages));
+					Arbiter.Activate(inMessageQueue,
+								Arbiter.Receive<RelayMessageListWithContext>(true, inMessagesWithContextPort, HandleInMessages));
 					
 
 					//by having after the Arbiter.Activate it allows Initialize components to use 
@@ -467,6 +470,7 @@ namespace MySpace.DataRelay
 						Interlocked.Exchange(ref inMessagePort, new Port<RelayMessage>());
 						Interlocked.Exchange(ref inMessageWithContextPort, new Port<RelayMessageWithContext>());
 						Interlocked.Exchange(ref inMessagesPort, new Port<IList<RelayMessage>>());
+						Interlocked.Exchange(ref inMessagesWithContextPort, new Port<RelayMessageListWithContext>());
 
 						Arbiter.Activate(newInQueue,
 							 Arbiter.Receive<RelayMessage>(true, inMessagePort, HandleInMessage));
@@ -474,6 +478,8 @@ namespace MySpace.DataRelay
 							 Arbiter.Receive<RelayMessageWithContext>(true, inMessageWithContextPort, HandleInMessage));
 						Arbiter.Activate(newInQueue,
 							 Arbiter.Receive<IList<RelayMessage>>(true, inMessagesPort, HandleInMessages));
+						Arbiter.Activate(newInQueue,
+							 Arbiter.Receive<RelayMessageListWithContext>(true, inMessagesWithContextPort, HandleInMessages));
 
 						inMessageQueue = newInQueue;
 						inDispatcher = newInDispatcher;
@@ -665,6 +671,21 @@ namespace MySpace.DataRelay
 			}
 		}
 
+		private void HandleInMessages(RelayMessageListWithContext messagesWithContext)
+		{
+			try
+			{
+				counters.CountInputBytes(messagesWithContext.RelayMessages);
+				components.HandleInMessages(messagesWithContext);
+				countersInternal.CountInMessages(messagesWithContext.RelayMessages);
+			}
+			catch (Exception ex)
+			{
+                if (log.IsErrorEnabled)
+                    log.ErrorFormat("Error handling in message list: {0}", ex);
+			}
+		}
+
 		private IEnumerator<ITask> HandleOutMessages(RelayMessageListAsyncResult asyncMessages)
 		{
 			try
@@ -740,6 +761,12 @@ namespace MySpace.DataRelay
 		{
 			if (message != null)
 			{
+				if (message.MessageType == MessageType.Bundle)
+				{
+					HandleMessages(message.GetBundledMessages());
+					return;
+				}
+
 				messageTracer.WriteMessageInfo(message);
 
 				if (components.DoHandleMessagesOfType(message.MessageType))
@@ -774,6 +801,7 @@ namespace MySpace.DataRelay
 		/// <param name="messages">The given list of <see cref="RelayMessage"/>.</param>
 		public void HandleMessages(IList<RelayMessage> messages)
 		{
+			messages = UnpackBundles(messages);
 			counters.CountMessageList(messages);
 
 			#region Assing SourceZone for each msg
@@ -800,6 +828,41 @@ namespace MySpace.DataRelay
 			}
 		}
 
+		/// <summary>
+		/// Replaces the <see cref="MessageType.Bundle"/> messages in <paramref name="messages"/>
+		/// with the messages packed in them.
+		/// </summary>
+		/// <returns><paramref name="messages"/> if it holds no bundles, otherwise a new list.</returns>
+		private static IList<RelayMessage> UnpackBundles(IList<RelayMessage> messages)
+		{
+			List<RelayMessage> unpacked = null;
+			for (int i = 0; i < messages.Count; i++)
+			{
+				RelayMessage message = messages[i];
+				if (message != null && message.MessageType == MessageType.Bundle)
+				{
+					if (unpacked == null)
+					{
+						unpacked = new List<RelayMessage>(messages.Count);
+						for (int j = 0; j < i; j++)
+						{
+							unpacked.Add(messages[j]);
+						}
+					}
+					unpacked.AddRange(message.GetBundledMessages());
+				}
+				else if (unpacked != null)
+				{
+					unpacked.Add(message);
+				}
+			}
+			if (unpacked == null)
+			{
+				return messages;
+			}
+			return unpacked;
+		}
+
 		#endregion
 
 		#region AcceptNewConnection
@@ -926,6 +989,44 @@ namespace MySpace.DataRelay
 			}
 		}
 
+		/// <summary>
+		/// Use this method to process a list of 'In' <see cref="RelayMessage"/>s together while providing a list of 
+		/// component types that should not receive them.
+		/// </summary>
+		/// <param name="messages">The messages to process</param>
+		/// <param name="exclusionList">The components that should not receive the messages</param>
+		/// <exception cref="InvalidOperationException"> This exception is thrown if any message is NOT an 'In 'message type </exception>
+		void IRelayNodeServices.HandleInMessagesWithComponentExclusionList(IList<RelayMessage> messages, params Type[] exclusionList)
+		{
+			if (messages == null || messages.Count == 0)
+			{
+				return;
+			}
+			for (int i = 0; i < messages.Count; i++)
+			{
+				RelayMessage message = messages[i];
+				if (message.MessageType == MessageType.Get ||
+					 message.MessageType == MessageType.Query ||
+					 message.MessageType == MessageType.Invoke)
+				{
+					throw new InvalidOperationException("HandleInMessagesWithComponentExclusionList() processes 'In' MessageTypes Only.  Encountred Out MessageType: " + message.MessageType);
+				}
+
+				messageTracer.WriteMessageInfo(message);
+
+				#region Assign SourceZone
+				if (message.SourceZone == 0)
+				{
+					message.SourceZone = MyZone;
+				}
+				#endregion
+			}
+
+			inMessagesWithContextPort.Post(new RelayMessageListWithContext(
+				messages,
+				new RelayMessageProcessingContext(exclusionList)));
+		}
+
 		private readonly object fatalFailureLock = new object();
 		private Timer fatalFailureTimer;
 		private TimeSpan fatalFailureTimeout = TimeSpan.FromMinutes(5);
@@ -1047,7 +1148,13 @@ namespace MySpace.DataRelay
 			RelayMessageAsyncResult resultMessage = new RelayMessageAsyncResult(message, state, callback);
 			try
 			{
-				if (message != null)
+				if (message != null && message.MessageType == MessageType.Bundle)
+				{
+					HandleMessages(message.GetBundledMessages());
+					const bool wasSynchronous = true;
+					resultMessage.CompleteOperation(wasSynchronous);
+				}
+				else if (message != null)
 				{
 					messageTracer.WriteMessageInfo(message);
 
@@ -1107,6 +1214,7 @@ namespace MySpace.DataRelay
 		{
 			RelayMessageListAsyncResult result;
 
+			messages = UnpackBundles(messages);
 			MessageList list = new MessageList(messages);
 			
 			messageTracer.WriteMessageInfo(messages);
@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Collections.Generic;
 
 namespace MySpace.DataRelay.Server.Common
 {
@@ -15,6 +16,13 @@ namespace MySpace.DataRelay.Server.Common
 		/// <param name="exclusionList">list of <see cref="IRelayComponent"/> Types to exclude</param>
 		void HandleInMessageWithComponentExclusionList(RelayMessage message, params Type[] exclusionList);
 
+		/// <summary>
+		/// This method is used to dispatch a list of "in" <see cref="RelayMessage"/>s together to all local components except those in the <paramref name="exclusionList"/> 
+		/// </summary>
+		/// <param name="messages">the <see cref="RelayMessage"/>s to send; the caller must not change the list afterwards</param>
+		/// <param name="exclusionList">list of <see cref="IRelayComponent"/> Types to exclude</param>
+		void HandleInMessagesWithComponentExclusionList(IList<RelayMessage> messages, params Type[] exclusionList);
+
 		/// <summary>
 		/// This method is used to dispatch an "out" (get, query, etc) <see cref="RelayMessage"/> to all local components except those in the <paramref name="exclusionList"/> 
 		/// </summary>
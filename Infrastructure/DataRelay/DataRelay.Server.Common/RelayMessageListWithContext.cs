@@ -0,0 +1,63 @@
+﻿using System;
+using System.Collections.Generic;
+
+namespace MySpace.DataRelay.Server.Common
+{
+    /// <summary>
+    /// Class Represents a container for a list of <see cref="RelayMessage"/>s and the <see cref="RelayMessageProcessingContext"/> they share
+    /// </summary>
+    public class RelayMessageListWithContext
+    {
+        #region DataMembers
+        /// <summary>
+        /// The <see cref="RelayMessage"/>s that need to be processed
+        /// </summary>
+        private readonly IList<RelayMessage> relayMessages;
+        /// <summary>
+        /// The <see cref="RelayMessageProcessingContext"/> associated to every message of the list
+        /// </summary>
+        private readonly RelayMessageProcessingContext processingContext;
+        #endregion
+
+        #region Constructors
+        /// <summary>
+        /// Constructor to create a <see cref="RelayMessageListWithContext"/>
+        /// </summary>
+        /// <param name="relayMessages">The <see cref="RelayMessage"/>s that need to be processed</param>
+        /// <param name="processingContext">The <see cref="RelayMessageProcessingContext"/> associated to every message of the list</param>
+        /// <exception cref="ArgumentNullException">All arguments for this constructor must be non-null</exception>
+        public RelayMessageListWithContext(IList<RelayMessage> relayMessages, RelayMessageProcessingContext processingContext)
+        {
+            if (relayMessages == null || processingContext == null)
+            {
+                throw new ArgumentNullException("RelayMessageListWithContext consturctor requires non-null arguments");
+            }
+            this.relayMessages = relayMessages;
+            this.processingContext = processingContext;
+        }
+        #endregion
+
+        #region Getters/Setters
+        /// <summary>
+        /// Used to access the <see cref="RelayMessage"/>s that need to be processed
+        /// </summary>
+        public IList<RelayMessage> RelayMessages
+        {
+            get
+            {
+                return this.relayMessages;
+            }
+        }
+        /// <summary>
+        /// Used to access the <see cref="RelayMessageProcessingContext"/> associated to every message of the list
+        /// </summary>
+        public RelayMessageProcessingContext ProcessingContext
+        {
+            get
+            {
+                return this.processingContext;
+            }
+        }
+        #endregion
+    }
+}
@@ -35,6 +35,7 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 		private static readonly LogWrapper Log = new LogWrapper();
 
 		private RelayNodeConfig relayNodeConfig;
+		private ushort myZone;
 		private BerkeleyDbConfig bdbConfig;
 		private BerkeleyDbStorage storage;
 		public BerkeleyDbStorage Storage
@@ -47,6 +48,12 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 		//private Dispatcher[] dispatchers;
 		//private Port<RelayMessage>[] ports;
 		private ThrottledQueue[] queues;
+		private ChangeCapturePublisher changeCapturePublisher;
+		private MigrationCopier migrationCopier;
+		private string myGroupName;
+		private int myGroupClusterCount;
+		private WriteBehindBuffer writeBehindBuffer;
+		private volatile bool shuttingDown;
 		Timer queueCounterTimer;
 		private readonly Dictionary<short, bool> RaceConditionLookup = new Dictionary<short, bool>();
 
@@ -81,7 +88,7 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 			return (long)result;
 		}
 
-		unsafe private static RelayPayload DeserializePayload(short typeId, int objectId, byte[] bytes, int offset, int length)
+		unsafe internal static RelayPayload DeserializePayload(short typeId, int objectId, byte[] bytes, int offset, int length)
 		{
 			if (bytes == null || length == 0)
 			{
@@ -332,6 +339,7 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 				
 
 				relayNodeConfig = config;
+				myZone = GetMyZone(config);
 
 				Initialize(GetConfig(config), GetInstanceName(), runState);
 			}
@@ -544,6 +552,14 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 							bdbConfig.EnvironmentConfig.DatabaseConfigs.Add(newDbConfig);
 						}						
 						RaceConditionLookup[typeSetting.TypeId] = typeSetting.CheckRaceCondition;
+						if (typeSetting.ReplicateByChangeCapture && !(dbConfig.ChangeCapture &&
+							bdbConfig.ChangeCapture != null && bdbConfig.ChangeCapture.Enabled))
+						{
+							if (Log.IsErrorEnabled)
+							{
+								Log.ErrorFormat("Initialize() Type {0} is replicated by change capture, but its changes aren't captured and published; its writes won't be replicated", typeSetting.TypeId);
+							}
+						}
 					}
 				}
 
@@ -585,6 +601,30 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 					}
 					queueCounterTimer = new Timer(CountThrottledQueues, null, 5000, 5000);
 				}
+
+				WriteBehind writeBehind = bdbConfig.WriteBehind;
+				if (writeBehind != null && writeBehind.Enabled)
+				{
+					writeBehindBuffer = new WriteBehindBuffer(writeBehind, WritePending, ChecksRaceCondition);
+				}
+
+				ChangeCapture changeCapture = bdbConfig.ChangeCapture;
+				if (changeCapture != null && changeCapture.Enabled)
+				{
+					changeCapturePublisher = new ChangeCapturePublisher(storage, changeCapture,
+						bdbConfig.EnvironmentConfig.HomeDirectory);
+					changeCapturePublisher.Start();
+				}
+
+				MigrationCopy migrationCopy = bdbConfig.MigrationCopy;
+				if (migrationCopy != null && migrationCopy.Enabled)
+				{
+					migrationCopier = new MigrationCopier(storage, migrationCopy, ChecksRaceCondition);
+				}
+				if (relayNodeConfig != null)
+				{
+					CopyMigratingTypes(relayNodeConfig);
+				}
 			}
 			catch (Exception exc)
 			{
@@ -634,8 +674,10 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 
 		public void ReloadConfig(RelayNodeConfig config)
 		{
+			myZone = GetMyZone(config);
 			bdbConfig = GetConfig(config);
 			ReloadConfig(bdbConfig);
+			CopyMigratingTypes(config);
 		}
 
 		public void Shutdown()
@@ -645,6 +687,23 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 				queueCounterTimer.Change(System.Threading.Timeout.Infinite, System.Threading.Timeout.Infinite);
 				queueCounterTimer.Dispose();
 			}
+			if (changeCapturePublisher != null)
+			{
+				changeCapturePublisher.Dispose();
+				changeCapturePublisher = null;
+			}
+			if (migrationCopier != null)
+			{
+				migrationCopier.Dispose();
+				migrationCopier = null;
+			}
+			if (writeBehindBuffer != null)
+			{
+				// the queues stop with the storage, so write what is left on this thread
+				shuttingDown = true;
+				writeBehindBuffer.Dispose();
+				writeBehindBuffer = null;
+			}
 			if (storage != null)
 			{
 				storage.Shutdown();
@@ -667,6 +726,16 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 		{
 			try
 			{
+				WriteBehindBuffer buffer = writeBehindBuffer;
+				if (buffer != null && buffer.Handle(message))
+				{
+					if (message.MessageType == MessageType.Get)
+					{
+						BerkeleyDbCounters.Instance.CountGet(GetInstanceName(), message.Payload != null,
+							message.Payload != null ? message.Payload.ByteArray.Length : 0);
+					}
+					return;
+				}
 				ThrottleThreads throttleThreads = bdbConfig.ThrottleThreads;
 				if (throttleThreads != null && throttleThreads.Enabled)
 				{
@@ -721,6 +790,67 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 			}
 		}
 
+		private static ushort GetMyZone(RelayNodeConfig config)
+		{
+			RelayNodeDefinition myNode = config.GetMyNode();
+			return myNode != null ? myNode.Zone : (ushort)0;
+		}
+
+		private bool ChecksRaceCondition(short typeId)
+		{
+			bool checkRaceCondition;
+			return RaceConditionLookup.TryGetValue(typeId, out checkRaceCondition) && checkRaceCondition;
+		}
+
+		/// <summary>
+		/// Has the <see cref="MigrationCopier"/> copy the types of this node's group when a new
+		/// mapping changes the group's number of clusters and the group migrates.
+		/// </summary>
+		private void CopyMigratingTypes(RelayNodeConfig config)
+		{
+			RelayNodeGroupDefinition myGroup = config.GetMyGroup();
+			if (myGroup == null)
+			{
+				myGroupName = null;
+				myGroupClusterCount = 0;
+				return;
+			}
+			bool clusterCountChanged = myGroup.Name == myGroupName && myGroupClusterCount > 0 &&
+				myGroup.RelayNodeClusters.Length != myGroupClusterCount;
+			myGroupName = myGroup.Name;
+			myGroupClusterCount = myGroup.RelayNodeClusters.Length;
+			if (!clusterCountChanged || migrationCopier == null ||
+				!myGroup.UseConsistentHashing || myGroup.UseIdRanges || myGroup.MigrationMinutes <= 0)
+			{
+				return;
+			}
+			List<short> typeIds = new List<short>();
+			foreach (TypeSetting typeSetting in config.TypeSettings.TypeSettingCollection)
+			{
+				if (typeSetting.GroupName == myGroup.Name && !typeSetting.Disabled)
+				{
+					typeIds.Add(typeSetting.TypeId);
+				}
+			}
+			migrationCopier.Copy(typeIds);
+		}
+
+		/// <summary>
+		/// Sends a write released by the <see cref="WriteBehindBuffer"/> down the path it would
+		/// have taken without it.
+		/// </summary>
+		private void WritePending(RelayMessage message)
+		{
+			if (queues != null && !shuttingDown)
+			{
+				queues[GetQueueIndex(message.TypeId, message.Id)].Post(message);
+			}
+			else
+			{
+				PostMessage(message);
+			}
+		}
+
 		/// <summary>
 		/// Process SNM messages
 		/// </summary>
@@ -847,6 +977,12 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 				Log.DebugFormat("PostMessage() Posts message to BerkeleyDb (TypeId={0}, ObjectId={1}, MessageType={2})"
 					, typeId, objectId, message.MessageType);
 			}
+			// writes that came from another node were published by that node's change capture
+			bool replicated = !message.OriginatesDirectlyFromClient(myZone);
+			if (replicated)
+			{
+				Database.CaptureChangesOnThread = false;
+			}
 			try
 			{
 				if (storage != null)
@@ -1038,6 +1174,13 @@ namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
 				message.ResultDetails = exc.ToString();
 				throw;
 			}
+			finally
+			{
+				if (replicated)
+				{
+					Database.CaptureChangesOnThread = true;
+				}
+			}
 		}
 
 		private static void MarkOutcome(RelayMessage message, bool success)
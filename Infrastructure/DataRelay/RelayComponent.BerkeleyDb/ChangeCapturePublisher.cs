@@ -0,0 +1,361 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Threading;
+using BerkeleyDbWrapper;
+using MySpace.BerkeleyDb.Configuration;
+using MySpace.BerkeleyDb.Facade;
+using MySpace.DataRelay.Server.Common;
+using MySpace.Logging;
+
+namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
+{
+	/// <summary>
+	/// Tails the change records Berkeley Db writes to its transaction log and hands the
+	/// committed changes to the other local components in batches of Save and Delete messages,
+	/// so replication follows what was actually stored rather than what clients sent.
+	/// </summary>
+	/// <remarks>
+	/// <para>Published messages have one hop of <see cref="RelayMessage.RelayTTL"/> left and are
+	/// marked <see cref="RelayMessage.IsCapturedChange"/>, so the forwarder sends them to the other
+	/// nodes of the cluster once, and those nodes store them without capturing them again.</para>
+	/// <para>The log position of the last published batch is kept in a checkpoint file; after a
+	/// restart publishing resumes from it, so a change may be published more than once but
+	/// never lost. Without a checkpoint publishing starts at the end of the log, since what is
+	/// already stored was replicated when it was written. Log files the checkpoint still needs
+	/// are kept by <see cref="BerkeleyDbStorage.ChangeCaptureLogFloor"/>.</para>
+	/// </remarks>
+	internal class ChangeCapturePublisher : IDisposable
+	{
+		private static readonly LogWrapper Log = new LogWrapper();
+		private static readonly Type[] excludedComponents = new[] { typeof(BerkeleyDbComponent) };
+		// puts and deletes commit right after their change record, so a transaction still open this
+		// many log files later was rolled back by recovery and will never get a commit or abort
+		private const int maxPendingLogFiles = 2;
+
+		private readonly BerkeleyDbStorage storage;
+		private readonly ChangeCapture config;
+		private readonly string checkpointPath;
+		private readonly object pollLock = new object();
+		private readonly Dictionary<int, PendingTransaction> pendingTransactions = new Dictionary<int, PendingTransaction>();
+		// handed off whole once published, so each batch gets a new list
+		private List<RelayMessage> batch = new List<RelayMessage>();
+		private LogCursor cursor;
+		private LogSequenceNumber checkpoint;
+		private Timer timer;
+
+		private class PendingTransaction
+		{
+			public PendingTransaction(LogSequenceNumber resumeFrom, int startFile)
+			{
+				ResumeFrom = resumeFrom;
+				StartFile = startFile;
+				Messages = new List<RelayMessage>();
+			}
+
+			// position to restart from so that the transaction's first change is read again
+			public readonly LogSequenceNumber ResumeFrom;
+			// log file of the transaction's first change
+			public readonly int StartFile;
+			public readonly List<RelayMessage> Messages;
+		}
+
+		public ChangeCapturePublisher(BerkeleyDbStorage storage, ChangeCapture config, string homeDirectory)
+		{
+			this.storage = storage;
+			this.config = config;
+			checkpointPath = Path.Combine(homeDirectory, config.CheckpointFileName);
+		}
+
+		public void Start()
+		{
+			cursor = storage.OpenLogCursor();
+			if (!TryReadCheckpoint(out checkpoint))
+			{
+				cursor.SeekToEnd();
+				checkpoint = cursor.Position;
+				// keep the starting point, or changes written before the first poll are skipped after a restart
+				WriteCheckpoint(checkpoint);
+				if (Log.IsInfoEnabled)
+				{
+					Log.InfoFormat("Start() No checkpoint in {0}, publishing from the end of the log", checkpointPath);
+				}
+			}
+			else if (!cursor.Seek(checkpoint))
+			{
+				if (Log.IsWarnEnabled)
+				{
+					Log.WarnFormat("Start() Checkpoint {0} is no longer in the log, publishing from the oldest log file", checkpoint);
+				}
+				checkpoint = new LogSequenceNumber();
+				cursor.Seek(checkpoint);
+			}
+			storage.ChangeCaptureLogFloor = Math.Max(checkpoint.File, 1);
+			if (Log.IsInfoEnabled)
+			{
+				Log.InfoFormat("Start() Publishing changes after log position {0}", checkpoint);
+			}
+			timer = new Timer(Poll, null, config.Interval, config.Interval);
+		}
+
+		public void Dispose()
+		{
+			if (timer != null)
+			{
+				timer.Change(Timeout.Infinite, Timeout.Infinite);
+				timer.Dispose();
+				timer = null;
+			}
+			lock (pollLock)
+			{
+				if (cursor != null)
+				{
+					cursor.Dispose();
+					cursor = null;
+				}
+			}
+		}
+
+		private void Poll(object state)
+		{
+			if (!Monitor.TryEnter(pollLock))
+			{
+				return;
+			}
+			try
+			{
+				if (cursor == null)
+				{
+					return;
+				}
+				IRelayNodeServices services = RelayServicesClient.Instance.RelayNodeServices;
+				if (services == null)
+				{
+					return;
+				}
+				while (PublishBatch(services))
+				{
+				}
+			}
+			catch (Exception ex)
+			{
+				if (Log.IsErrorEnabled)
+				{
+					Log.Error("Poll() Error publishing changes", ex);
+				}
+			}
+			finally
+			{
+				Monitor.Exit(pollLock);
+			}
+		}
+
+		/// <summary>
+		/// Publishes up to <see cref="ChangeCapture.MaxBatchSize"/> committed changes and
+		/// advances the checkpoint past them.
+		/// </summary>
+		/// <returns><see langword="true"/> if the batch filled up and more changes may be waiting.</returns>
+		private bool PublishBatch(IRelayNodeServices services)
+		{
+			int maxBatchSize = config.MaxBatchSize > 0 ? config.MaxBatchSize : 1;
+			LogSequenceNumber previous = cursor.Position;
+			ChangeRecord record;
+			PendingTransaction transaction;
+			while (batch.Count < maxBatchSize && (record = cursor.Next()) != null)
+			{
+				switch (record.Operation)
+				{
+					case ChangeOperation.Put:
+					case ChangeOperation.Delete:
+						RelayMessage message = CreateMessage(record);
+						if (record.TransactionId == 0)
+						{
+							batch.Add(message);
+						}
+						else
+						{
+							if (!pendingTransactions.TryGetValue(record.TransactionId, out transaction))
+							{
+								transaction = new PendingTransaction(previous, record.Lsn.File);
+								pendingTransactions.Add(record.TransactionId, transaction);
+							}
+							transaction.Messages.Add(message);
+						}
+						break;
+					case ChangeOperation.Commit:
+						if (pendingTransactions.TryGetValue(record.TransactionId, out transaction))
+						{
+							batch.AddRange(transaction.Messages);
+							pendingTransactions.Remove(record.TransactionId);
+						}
+						break;
+					case ChangeOperation.Abort:
+						pendingTransactions.Remove(record.TransactionId);
+						break;
+					case ChangeOperation.Recycle:
+						DropPendingTransactions(record.TransactionId, record.LastTransactionId);
+						break;
+				}
+				previous = record.Lsn;
+			}
+			DropStalePendingTransactions(cursor.Position);
+
+			bool full = batch.Count >= maxBatchSize;
+			if (batch.Count > 0)
+			{
+				services.HandleInMessagesWithComponentExclusionList(batch, excludedComponents);
+				if (Log.IsDebugEnabled)
+				{
+					Log.DebugFormat("PublishBatch() Published {0} changes up to log position {1}", batch.Count, cursor.Position);
+				}
+				batch = new List<RelayMessage>();
+			}
+
+			LogSequenceNumber newCheckpoint = cursor.Position;
+			foreach (PendingTransaction pending in pendingTransactions.Values)
+			{
+				if (pending.ResumeFrom.CompareTo(newCheckpoint) < 0)
+				{
+					newCheckpoint = pending.ResumeFrom;
+				}
+			}
+			if (newCheckpoint.CompareTo(checkpoint) != 0)
+			{
+				WriteCheckpoint(newCheckpoint);
+				checkpoint = newCheckpoint;
+				if (checkpoint.File > 0)
+				{
+					storage.ChangeCaptureLogFloor = checkpoint.File;
+				}
+			}
+			return full;
+		}
+
+		/// <summary>
+		/// Drops the changes held for transactions whose ids are being reused, which can only be
+		/// transactions recovery rolled back, so a later commit under the same id doesn't publish them.
+		/// </summary>
+		private void DropPendingTransactions(int firstTransactionId, int lastTransactionId)
+		{
+			List<int> recycled = null;
+			foreach (int transactionId in pendingTransactions.Keys)
+			{
+				if ((uint)transactionId >= (uint)firstTransactionId && (uint)transactionId <= (uint)lastTransactionId)
+				{
+					if (recycled == null)
+					{
+						recycled = new List<int>();
+					}
+					recycled.Add(transactionId);
+				}
+			}
+			if (recycled != null)
+			{
+				if (Log.IsWarnEnabled)
+				{
+					Log.WarnFormat("DropPendingTransactions() Dropping changes of {0} transactions that never finished, their ids are being reused", recycled.Count);
+				}
+				foreach (int transactionId in recycled)
+				{
+					pendingTransactions.Remove(transactionId);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Drops the changes held for transactions that started too long before <paramref name="position"/>
+		/// to still be open, so they don't hold the checkpoint and the log files behind it forever.
+		/// </summary>
+		private void DropStalePendingTransactions(LogSequenceNumber position)
+		{
+			List<int> stale = null;
+			foreach (KeyValuePair<int, PendingTransaction> pending in pendingTransactions)
+			{
+				if (position.File - pending.Value.StartFile >= maxPendingLogFiles)
+				{
+					if (stale == null)
+					{
+						stale = new List<int>();
+					}
+					stale.Add(pending.Key);
+				}
+			}
+			if (stale != null)
+			{
+				if (Log.IsWarnEnabled)
+				{
+					Log.WarnFormat("DropStalePendingTransactions() Dropping changes of {0} transactions with no commit or abort within {1} log files", stale.Count, maxPendingLogFiles);
+				}
+				foreach (int transactionId in stale)
+				{
+					pendingTransactions.Remove(transactionId);
+				}
+			}
+		}
+
+		private static RelayMessage CreateMessage(ChangeRecord record)
+		{
+			short typeId = (short)record.DatabaseId;
+			byte[] extendedId = record.Key.Length > 0 ? record.Key : null;
+			RelayPayload payload = null;
+			if (record.Operation == ChangeOperation.Put)
+			{
+				payload = BerkeleyDbComponent.DeserializePayload(typeId, record.ObjectId, record.Value, 0, record.Value.Length);
+			}
+			RelayMessage message;
+			if (payload == null)
+			{
+				// deactivated records read as missing, so they replicate as deletes
+				message = new RelayMessage(typeId, record.ObjectId, extendedId, MessageType.Delete);
+			}
+			else
+			{
+				payload.ExtendedId = extendedId;
+				message = new RelayMessage(typeId, record.ObjectId, extendedId, MessageType.Save);
+				message.Payload = payload;
+			}
+			// the forwarder sends it to the cluster with the last hop, so the nodes that store it
+			// see a replicated write and neither send it on nor capture it
+			message.RelayTTL = 1;
+			message.IsCapturedChange = true;
+			return message;
+		}
+
+		/// <returns><see langword="false"/> if there is no checkpoint file.</returns>
+		private bool TryReadCheckpoint(out LogSequenceNumber lsn)
+		{
+			lsn = new LogSequenceNumber();
+			try
+			{
+				if (!File.Exists(checkpointPath))
+				{
+					return false;
+				}
+				lsn = LogSequenceNumber.Parse(File.ReadAllText(checkpointPath));
+			}
+			catch (Exception ex)
+			{
+				if (Log.IsErrorEnabled)
+				{
+					Log.Error(string.Format("TryReadCheckpoint() Error reading {0}, publishing from the oldest log file", checkpointPath), ex);
+				}
+			}
+			return true;
+		}
+
+		private void WriteCheckpoint(LogSequenceNumber lsn)
+		{
+			// write aside and swap so a crash never leaves a partial checkpoint
+			string tempPath = checkpointPath + ".tmp";
+			File.WriteAllText(tempPath, lsn.ToString());
+			if (File.Exists(checkpointPath))
+			{
+				File.Replace(tempPath, checkpointPath, null);
+			}
+			else
+			{
+				File.Move(tempPath, checkpointPath);
+			}
+		}
+	}
+}
@@ -0,0 +1,231 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using BerkeleyDbWrapper;
+using MySpace.BerkeleyDb.Configuration;
+using MySpace.BerkeleyDb.Facade;
+using MySpace.DataRelay.Server.Common;
+using MySpace.Logging;
+
+namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
+{
+	/// <summary>
+	/// Walks the records of types whose group changed its number of clusters and hands each to the
+	/// other local components as a Save, so the forwarder copies it to the cluster that holds it
+	/// now, rather than leaving it to move only when it is read during the migration.
+	/// </summary>
+	/// <remarks>
+	/// <para>The Saves are marked <see cref="RelayMessage.IsInterClusterMsg"/> and
+	/// <see cref="RelayMessage.IsMigrationCopy"/>, so the forwarder routes them by id across the
+	/// group and drops those whose cluster is still this one.</para>
+	/// <para>A newer Save can reach the new cluster before the copy does, so only types that check
+	/// race conditions are copied; their stores won't let the older copy overwrite it.</para>
+	/// <para>The ids of a type are listed first and each record is then read again when its batch
+	/// is copied, so no cursor is held open between batches. Records stored under an extended id
+	/// don't carry their object id and are left to move when they are read, as are the records of
+	/// databases with value separation, which can't be walked with a cursor.</para>
+	/// </remarks>
+	internal class MigrationCopier : IDisposable
+	{
+		private static readonly LogWrapper Log = new LogWrapper();
+		private static readonly Type[] excludedComponents = new[] { typeof(BerkeleyDbComponent) };
+
+		private readonly BerkeleyDbStorage storage;
+		private readonly MigrationCopy config;
+		private readonly Predicate<short> checksRaceCondition;
+		private readonly object pollLock = new object();
+		private readonly Queue<short> pendingTypes = new Queue<short>();
+		private List<int> objectIds;
+		private int nextIndex;
+		private short typeId;
+		private int copiedCount;
+		private DateTime typeStarted;
+		private Timer timer;
+
+		public MigrationCopier(BerkeleyDbStorage storage, MigrationCopy config, Predicate<short> checksRaceCondition)
+		{
+			this.storage = storage;
+			this.config = config;
+			this.checksRaceCondition = checksRaceCondition;
+		}
+
+		/// <summary>
+		/// Queues the records of <paramref name="typeIds"/> to be copied, starting after
+		/// <see cref="MigrationCopy.StartDelay"/> unless a copy is already under way.
+		/// </summary>
+		public void Copy(IEnumerable<short> typeIds)
+		{
+			lock (pendingTypes)
+			{
+				foreach (short pendingTypeId in typeIds)
+				{
+					if (!checksRaceCondition(pendingTypeId))
+					{
+						if (Log.IsWarnEnabled)
+						{
+							Log.WarnFormat("Copy() Type {0} doesn't check race conditions and is left to move when it is read", pendingTypeId);
+						}
+						continue;
+					}
+					if (config.TypeIds != null && config.TypeIds.Length > 0 &&
+						Array.IndexOf(config.TypeIds, pendingTypeId) < 0)
+					{
+						continue;
+					}
+					if (!pendingTypes.Contains(pendingTypeId))
+					{
+						pendingTypes.Enqueue(pendingTypeId);
+					}
+				}
+				if (timer == null && pendingTypes.Count > 0)
+				{
+					if (Log.IsInfoEnabled)
+					{
+						Log.InfoFormat("Copy() Copying the records of {0} types in {1} ms", pendingTypes.Count, config.StartDelay);
+					}
+					timer = new Timer(Poll, null, config.StartDelay, config.Interval);
+				}
+			}
+		}
+
+		public void Dispose()
+		{
+			lock (pendingTypes)
+			{
+				StopTimer();
+				pendingTypes.Clear();
+			}
+			lock (pollLock)
+			{
+				objectIds = null;
+			}
+		}
+
+		private void StopTimer()
+		{
+			if (timer != null)
+			{
+				timer.Change(Timeout.Infinite, Timeout.Infinite);
+				timer.Dispose();
+				timer = null;
+			}
+		}
+
+		private void Poll(object state)
+		{
+			if (!Monitor.TryEnter(pollLock))
+			{
+				return;
+			}
+			try
+			{
+				IRelayNodeServices services = RelayServicesClient.Instance.RelayNodeServices;
+				if (services == null)
+				{
+					return;
+				}
+				if (objectIds == null && !StartNextType())
+				{
+					return;
+				}
+				CopyBatch(services);
+			}
+			catch (Exception ex)
+			{
+				if (Log.IsErrorEnabled)
+				{
+					Log.Error(string.Format("Poll() Error copying the records of type {0}, skipping the rest of them", typeId), ex);
+				}
+				objectIds = null;
+			}
+			finally
+			{
+				Monitor.Exit(pollLock);
+			}
+		}
+
+		/// <returns><see langword="false"/> if no types are left to copy.</returns>
+		private bool StartNextType()
+		{
+			lock (pendingTypes)
+			{
+				if (pendingTypes.Count == 0)
+				{
+					StopTimer();
+					return false;
+				}
+				typeId = pendingTypes.Dequeue();
+			}
+			typeStarted = DateTime.Now;
+			copiedCount = 0;
+			nextIndex = 0;
+			List<int> ids = new List<int>();
+			int extendedCount = 0;
+			foreach (DatabaseRecord record in storage.GetRecords(typeId))
+			{
+				if (record.Key.Length == sizeof(int))
+				{
+					ids.Add(BitConverter.ToInt32(record.Key.Buffer, 0));
+				}
+				else
+				{
+					extendedCount++;
+				}
+			}
+			objectIds = ids;
+			if (Log.IsInfoEnabled)
+			{
+				Log.InfoFormat("StartNextType() Copying {0} records of type {1}; {2} records with extended ids move when they are read",
+					ids.Count, typeId, extendedCount);
+			}
+			return true;
+		}
+
+		private void CopyBatch(IRelayNodeServices services)
+		{
+			int maxBatchSize = config.MaxBatchSize > 0 ? config.MaxBatchSize : 1;
+			List<RelayMessage> batch = new List<RelayMessage>(Math.Min(maxBatchSize, objectIds.Count - nextIndex));
+			while (batch.Count < maxBatchSize && nextIndex < objectIds.Count)
+			{
+				RelayMessage message = CreateMessage(typeId, objectIds[nextIndex++]);
+				if (message != null)
+				{
+					batch.Add(message);
+				}
+			}
+			if (batch.Count > 0)
+			{
+				services.HandleInMessagesWithComponentExclusionList(batch, excludedComponents);
+				copiedCount += batch.Count;
+			}
+			if (nextIndex >= objectIds.Count)
+			{
+				if (Log.IsInfoEnabled)
+				{
+					Log.InfoFormat("CopyBatch() Handed {0} records of type {1} to the forwarder in {2}",
+						copiedCount, typeId, DateTime.Now - typeStarted);
+				}
+				objectIds = null;
+			}
+		}
+
+		/// <returns>The Save copying the record, or <see langword="null"/> if it is gone or deactivated.</returns>
+		private RelayMessage CreateMessage(short messageTypeId, int objectId)
+		{
+			RelayPayload payload = null;
+			storage.GetDbObject(messageTypeId, objectId,
+				dbEntry =>
+				{
+					payload = BerkeleyDbComponent.DeserializePayload(messageTypeId, objectId, dbEntry.Buffer, dbEntry.StartPosition, dbEntry.Length);
+				});
+			if (payload == null)
+			{
+				return null;
+			}
+			RelayMessage message = new RelayMessage(payload, MessageType.Save);
+			message.IsInterClusterMsg = true;
+			message.IsMigrationCopy = true;
+			return message;
+		}
+	}
+}
@@ -0,0 +1,391 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using MySpace.BerkeleyDb.Configuration;
+using MySpace.Logging;
+
+namespace MySpace.DataRelay.RelayComponent.BerkeleyDb
+{
+	/// <summary>
+	/// Holds one-way Save and Delete messages in memory, keeping only the latest per key, so
+	/// that a key rewritten several times between flushes is written to Berkeley Db once.
+	/// </summary>
+	/// <remarks>
+	/// Any other message for a key with a pending write first passes the pending write on, so
+	/// the writes of a key reach the database in the order they arrived. Pending writes are
+	/// flushed every <see cref="WriteBehind.Interval"/>, or sooner once
+	/// <see cref="WriteBehind.MaxPendingEntries"/> or <see cref="WriteBehind.MaxPendingBytes"/>
+	/// is reached.
+	/// </remarks>
+	internal class WriteBehindBuffer : IDisposable
+	{
+		private static readonly LogWrapper Log = new LogWrapper();
+		private const int partitionCount = 16;
+
+		private readonly WriteBehind config;
+		private readonly Action<RelayMessage> write;
+		private readonly Predicate<short> checksRaceCondition;
+		private readonly Dictionary<short, bool> bufferedTypes;
+		private readonly Dictionary<PendingKey, RelayMessage>[] partitions;
+		private readonly object flushLock = new object();
+		private int pendingEntries;
+		private long pendingBytes;
+		private Timer timer;
+
+		private struct PendingKey : IEquatable<PendingKey>
+		{
+			private readonly short typeId;
+			private readonly int objectId;
+			private readonly byte[] extendedId;
+
+			public PendingKey(RelayMessage message)
+			{
+				typeId = message.TypeId;
+				objectId = message.Id;
+				extendedId = message.ExtendedId;
+			}
+
+			public short TypeId { get { return typeId; } }
+
+			public bool Equals(PendingKey other)
+			{
+				if (typeId != other.typeId || objectId != other.objectId)
+				{
+					return false;
+				}
+				if (extendedId == null || other.extendedId == null)
+				{
+					return extendedId == other.extendedId;
+				}
+				if (extendedId.Length != other.extendedId.Length)
+				{
+					return false;
+				}
+				for (int i = 0; i < extendedId.Length; i++)
+				{
+					if (extendedId[i] != other.extendedId[i])
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+
+			public override bool Equals(object obj)
+			{
+				return obj is PendingKey && Equals((PendingKey)obj);
+			}
+
+			public override int GetHashCode()
+			{
+				int hash = typeId * 31 + objectId;
+				if (extendedId != null)
+				{
+					for (int i = 0; i < extendedId.Length; i++)
+					{
+						hash = hash * 31 + extendedId[i];
+					}
+				}
+				return hash;
+			}
+		}
+
+		/// <param name="config">The buffer settings.</param>
+		/// <param name="write">Called with each pending message that is flushed or passed on.</param>
+		/// <param name="checksRaceCondition">Tells whether saves of a type are checked against
+		/// <c>PayloadStorage.LastUpdatedTicks</c> of the stored record.</param>
+		public WriteBehindBuffer(WriteBehind config, Action<RelayMessage> write, Predicate<short> checksRaceCondition)
+		{
+			this.config = config;
+			this.write = write;
+			this.checksRaceCondition = checksRaceCondition;
+			if (config.TypeIds != null && config.TypeIds.Length > 0)
+			{
+				bufferedTypes = new Dictionary<short, bool>();
+				foreach (short typeId in config.TypeIds)
+				{
+					bufferedTypes[typeId] = true;
+				}
+			}
+			partitions = new Dictionary<PendingKey, RelayMessage>[partitionCount];
+			for (int i = 0; i < partitions.Length; i++)
+			{
+				partitions[i] = new Dictionary<PendingKey, RelayMessage>();
+			}
+			timer = new Timer(OnTimer, null, config.Interval, config.Interval);
+		}
+
+		/// <summary>
+		/// Buffers <paramref name="message"/>, answers it from a pending write, or passes on the
+		/// pending writes it has to follow.
+		/// </summary>
+		/// <returns><see langword="true"/> if <paramref name="message"/> has been handled and must
+		/// not be processed further.</returns>
+		public bool Handle(RelayMessage message)
+		{
+			switch (message.MessageType)
+			{
+				case MessageType.Save:
+					if (message.Payload == null || !IsBuffered(message.TypeId))
+					{
+						return false;
+					}
+					Buffer(message);
+					return true;
+				case MessageType.Delete:
+					if (!IsBuffered(message.TypeId))
+					{
+						return false;
+					}
+					Buffer(message);
+					return true;
+				case MessageType.Get:
+					return IsBuffered(message.TypeId) && TryAnswer(message);
+				case MessageType.DeleteAll:
+				case MessageType.DeleteAllWithConfirm:
+				case MessageType.DeleteInAllTypes:
+				case MessageType.DeleteInAllTypesWithConfirm:
+					Flush(null);
+					return false;
+				case MessageType.DeleteAllInType:
+				case MessageType.DeleteAllInTypeWithConfirm:
+					if (IsBuffered(message.TypeId))
+					{
+						Flush(message.TypeId);
+					}
+					return false;
+				default:
+					if (IsBuffered(message.TypeId))
+					{
+						PassOn(message);
+					}
+					return false;
+			}
+		}
+
+		/// <summary>
+		/// Stops the flush timer and flushes every pending write.
+		/// </summary>
+		public void Dispose()
+		{
+			if (timer != null)
+			{
+				timer.Change(System.Threading.Timeout.Infinite, System.Threading.Timeout.Infinite);
+				timer.Dispose();
+				timer = null;
+			}
+			Flush(null);
+		}
+
+		private bool IsBuffered(short typeId)
+		{
+			return bufferedTypes == null || bufferedTypes.ContainsKey(typeId);
+		}
+
+		private Dictionary<PendingKey, RelayMessage> GetPartition(PendingKey key)
+		{
+			return partitions[(key.GetHashCode() & int.MaxValue) % partitions.Length];
+		}
+
+		private static int GetSize(RelayMessage message)
+		{
+			return message.Payload != null && message.Payload.ByteArray != null ? message.Payload.ByteArray.Length : 0;
+		}
+
+		private void Buffer(RelayMessage message)
+		{
+			PendingKey key = new PendingKey(message);
+			Dictionary<PendingKey, RelayMessage> partition = GetPartition(key);
+			lock (partition)
+			{
+				RelayMessage pending;
+				if (partition.TryGetValue(key, out pending))
+				{
+					partition.Remove(key);
+					Interlocked.Decrement(ref pendingEntries);
+					Interlocked.Add(ref pendingBytes, -GetSize(pending));
+					if (Supersedes(message, pending))
+					{
+						pending.ResultOutcome = RelayOutcome.Success;
+					}
+					else
+					{
+						// the stored record decides how these two combine, so both have to be written
+						Write(pending);
+					}
+				}
+				partition.Add(key, message);
+				Interlocked.Increment(ref pendingEntries);
+				Interlocked.Add(ref pendingBytes, GetSize(message));
+			}
+			if (IsOverLimit())
+			{
+				// wait out a flush in progress, then flush on the caller's thread if that wasn't
+				// enough, so writers are held back until memory is released
+				lock (flushLock)
+				{
+					if (IsOverLimit())
+					{
+						FlushPending();
+					}
+				}
+			}
+		}
+
+		private bool IsOverLimit()
+		{
+			return Thread.VolatileRead(ref pendingEntries) >= config.MaxPendingEntries ||
+				Interlocked.Read(ref pendingBytes) >= config.MaxPendingBytes;
+		}
+
+		/// <summary>
+		/// Gets whether writing <paramref name="pending"/> and then <paramref name="message"/>
+		/// leaves the same record as writing <paramref name="message"/> alone.
+		/// </summary>
+		private bool Supersedes(RelayMessage message, RelayMessage pending)
+		{
+			if (message.MessageType == MessageType.Delete)
+			{
+				return true;
+			}
+			if (!checksRaceCondition(message.TypeId))
+			{
+				return true;
+			}
+			// an older or equally old save is deactivated or restamped against the one before it
+			return pending.MessageType == MessageType.Save &&
+				message.Payload.LastUpdatedTicks > pending.Payload.LastUpdatedTicks;
+		}
+
+		private bool TryAnswer(RelayMessage message)
+		{
+			PendingKey key = new PendingKey(message);
+			Dictionary<PendingKey, RelayMessage> partition = GetPartition(key);
+			lock (partition)
+			{
+				RelayMessage pending;
+				if (!partition.TryGetValue(key, out pending))
+				{
+					return false;
+				}
+				if (pending.MessageType == MessageType.Save && checksRaceCondition(message.TypeId))
+				{
+					// the save may yet be deactivated against the stored record, let the Get see the result
+					partition.Remove(key);
+					Interlocked.Decrement(ref pendingEntries);
+					Interlocked.Add(ref pendingBytes, -GetSize(pending));
+					Write(pending);
+					return false;
+				}
+				message.Payload = pending.MessageType == MessageType.Save ? pending.Payload : null;
+				message.ResultOutcome = RelayOutcome.Success;
+				return true;
+			}
+		}
+
+		private void PassOn(RelayMessage message)
+		{
+			PendingKey key = new PendingKey(message);
+			Dictionary<PendingKey, RelayMessage> partition = GetPartition(key);
+			lock (partition)
+			{
+				RelayMessage pending;
+				if (partition.TryGetValue(key, out pending))
+				{
+					partition.Remove(key);
+					Interlocked.Decrement(ref pendingEntries);
+					Interlocked.Add(ref pendingBytes, -GetSize(pending));
+					Write(pending);
+				}
+			}
+		}
+
+		private void OnTimer(object state)
+		{
+			// a flush in progress already covers this tick
+			if (!Monitor.TryEnter(flushLock))
+			{
+				return;
+			}
+			try
+			{
+				FlushPending();
+			}
+			finally
+			{
+				Monitor.Exit(flushLock);
+			}
+		}
+
+		/// <summary>
+		/// Flushes every pending write. Call holding <see cref="flushLock"/>.
+		/// </summary>
+		private void FlushPending()
+		{
+			try
+			{
+				Flush(null);
+			}
+			catch (Exception ex)
+			{
+				if (Log.IsErrorEnabled)
+				{
+					Log.Error("FlushPending() Error flushing pending writes", ex);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Writes the pending messages of <paramref name="typeId"/>, or of every type if it is null.
+		/// </summary>
+		private void Flush(short? typeId)
+		{
+			int flushed = 0;
+			List<PendingKey> keys = new List<PendingKey>();
+			foreach (Dictionary<PendingKey, RelayMessage> partition in partitions)
+			{
+				// written under the partition lock so a later message for the key can't overtake them
+				lock (partition)
+				{
+					keys.Clear();
+					foreach (PendingKey key in partition.Keys)
+					{
+						if (typeId == null || key.TypeId == typeId.Value)
+						{
+							keys.Add(key);
+						}
+					}
+					foreach (PendingKey key in keys)
+					{
+						RelayMessage pending = partition[key];
+						partition.Remove(key);
+						Interlocked.Decrement(ref pendingEntries);
+						Interlocked.Add(ref pendingBytes, -GetSize(pending));
+						Write(pending);
+					}
+					flushed += keys.Count;
+				}
+			}
+			if (flushed > 0 && Log.IsDebugEnabled)
+			{
+				Log.DebugFormat("Flush() Flushed {0} pending writes", flushed);
+			}
+		}
+
+		private void Write(RelayMessage message)
+		{
+			try
+			{
+				write(message);
+			}
+			catch (Exception ex)
+			{
+				if (Log.IsErrorEnabled)
+				{
+					Log.Error(string.Format("Write() Error writing pending {0} (TypeId={1}, ObjectId={2})",
+						message.MessageType, message.TypeId, message.Id), ex);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,139 @@
+using System;
+using System.Diagnostics;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Sizes the bursts a node gathers in messages into, so a burst costs no more than a latency
+	/// target in waiting plus sending.
+	/// </summary>
+	/// <remarks>
+	/// <para>The burst length grows by one while messages are still waiting when a burst has been
+	/// sent, and halves when a burst times out before filling or when waiting and sending took
+	/// longer than the target. With the length at 1 each message is sent as soon as it arrives,
+	/// and messages only start to be gathered once they queue up behind a send.</para>
+	/// <para>The timeout is the target less the average send time, but no more than twice the
+	/// time the burst is expected to take to fill at the arrival rate seen.</para>
+	/// <para>Only the burst receive loop of one node calls this, one burst at a time, so it isn't
+	/// locked. Status reads may see a burst half recorded.</para>
+	/// </remarks>
+	internal class BurstController
+	{
+		private const int _maximumLength = 1000;
+		private const int _weight = 8; //each burst moves the averages 1/8 of the way to it
+
+		private readonly long _targetTicks;
+		private int _length = 1;
+		private long _timeoutTicks;
+		private long _averageSendTicks;
+		private long _averageArrivalTicks; //Stopwatch ticks between messages arriving
+		private long _averageWaitTicks; //Stopwatch ticks the oldest message of a burst waited for it
+		private double _averageBurstLength = 1;
+
+		internal BurstController(int targetMilliseconds)
+		{
+			_targetTicks = targetMilliseconds * Stopwatch.Frequency / 1000;
+			_timeoutTicks = _targetTicks;
+		}
+
+		/// <summary>
+		/// The number of messages to gather into the next burst.
+		/// </summary>
+		internal int Length
+		{
+			get
+			{
+				return _length;
+			}
+		}
+
+		/// <summary>
+		/// How long to wait for the next burst to fill.
+		/// </summary>
+		internal TimeSpan Timeout
+		{
+			get
+			{
+				return TimeSpan.FromMilliseconds(_timeoutTicks * 1000.0 / Stopwatch.Frequency);
+			}
+		}
+
+		/// <summary>
+		/// The average number of messages sent together.
+		/// </summary>
+		internal double AverageBurstLength
+		{
+			get
+			{
+				return _averageBurstLength;
+			}
+		}
+
+		/// <summary>
+		/// The average milliseconds the oldest message of a burst waited for it to be sent.
+		/// </summary>
+		internal double AverageWaitMilliseconds
+		{
+			get
+			{
+				return _averageWaitTicks * 1000.0 / Stopwatch.Frequency;
+			}
+		}
+
+		/// <summary>
+		/// Records a burst that has been sent.
+		/// </summary>
+		/// <param name="length">The number of messages sent.</param>
+		/// <param name="receivedTicks">Stopwatch ticks from waiting for the burst to it being received,
+		/// or 0 if the burst was taken after a timeout.</param>
+		/// <param name="waitTicks">Stopwatch ticks the oldest message waited before being sent.</param>
+		/// <param name="sendTicks">Stopwatch ticks the send took.</param>
+		/// <param name="backlog">The number of messages waiting once the burst was sent.</param>
+		internal void BurstSent(int length, long receivedTicks, long waitTicks, long sendTicks, int backlog)
+		{
+			_averageBurstLength += (length - _averageBurstLength) / _weight;
+			_averageSendTicks = Average(_averageSendTicks, sendTicks);
+			_averageWaitTicks = Average(_averageWaitTicks, waitTicks);
+			if (receivedTicks > 0 && length > 1)
+			{
+				_averageArrivalTicks = Average(_averageArrivalTicks, receivedTicks / length);
+			}
+
+			if (waitTicks + sendTicks > _targetTicks)
+			{
+				_length = Math.Max(1, _length / 2);
+			}
+			else if (backlog > 0 && length >= _length)
+			{
+				_length = Math.Min(_maximumLength, _length + 1);
+			}
+			SetTimeout();
+		}
+
+		/// <summary>
+		/// Records a burst that didn't fill before timing out.
+		/// </summary>
+		/// <param name="received">The number of messages that arrived in time.</param>
+		internal void BurstTimedOut(int received)
+		{
+			_averageArrivalTicks = Average(_averageArrivalTicks, _timeoutTicks / Math.Max(1, received));
+			_length = Math.Max(1, _length / 2);
+			SetTimeout();
+		}
+
+		private void SetTimeout()
+		{
+			long timeoutTicks = _targetTicks - _averageSendTicks;
+			if (_averageArrivalTicks > 0)
+			{
+				timeoutTicks = Math.Min(timeoutTicks, 2 * _averageArrivalTicks * _length);
+			}
+			_timeoutTicks = Math.Max(timeoutTicks, Stopwatch.Frequency / 1000);
+		}
+
+		private static long Average(long average, long sample)
+		{
+			return average == 0 ? sample : average + (sample - average) / _weight;
+		}
+	}
+}
@@ -0,0 +1,292 @@
+using System;
+using System.Collections.Generic;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Where the ids of a group go: its clusters, and whether an id is placed on one by id range,
+	/// by jump consistent hash or by modulo.
+	/// </summary>
+	/// <remarks>
+	/// <para>Like <see cref="RoutingTable"/>, a map is built when the mapping is loaded and never
+	/// changed. A reload replaces it in a single assignment, so an id is never placed by the
+	/// clusters of one map and the placement of another.</para>
+	/// <para>Ranges that don't overlap are sorted so the cluster of an id is found by binary
+	/// search. Where they overlap an id goes to the first cluster in config order holding it,
+	/// and the ranges are searched in that order.</para>
+	/// </remarks>
+	internal class ClusterMap
+	{
+		private readonly NodeCluster[] _clusters; //in config order
+		private readonly bool _clusterByRange;
+		private readonly bool _clusterByHash;
+		private readonly int[] _minimumIds; //sorted if _rangeIndexes is set, else in config order
+		private readonly int[] _maximumIds;
+		private readonly int[] _rangeIndexes; //the cluster of each sorted range, null if the ranges overlap
+		private readonly int _previousClusterCount; //while migrating, the number of clusters ids were hashed over before
+		private readonly DateTime _migrationEnds;
+
+		/// <summary>
+		/// Builds the map of <paramref name="clusters"/>.
+		/// </summary>
+		/// <param name="previousClusterCount">The number of clusters ids were hashed over before a
+		/// change in the number of clusters, or 0 if the group isn't migrating.</param>
+		internal static ClusterMap Create(IList<NodeCluster> clusters, bool clusterByRange, bool clusterByHash,
+			int previousClusterCount, DateTime migrationEnds)
+		{
+			NodeCluster[] clusterArray = new NodeCluster[clusters.Count];
+			int[] minimumIds = new int[clusters.Count];
+			int[] maximumIds = new int[clusters.Count];
+			for (int i = 0; i < clusterArray.Length; i++)
+			{
+				clusterArray[i] = clusters[i];
+				minimumIds[i] = clusters[i].MinimumId;
+				maximumIds[i] = clusters[i].MaximumId;
+			}
+			return new ClusterMap(clusterArray, minimumIds, maximumIds, clusterByRange, clusterByHash,
+				previousClusterCount, migrationEnds);
+		}
+
+		/// <param name="clusters">The clusters in config order; the map only hands them back.</param>
+		/// <param name="minimumIds">The lowest id of each cluster's range.</param>
+		/// <param name="maximumIds">The highest id of each cluster's range.</param>
+		internal ClusterMap(NodeCluster[] clusters, int[] minimumIds, int[] maximumIds, bool clusterByRange,
+			bool clusterByHash, int previousClusterCount, DateTime migrationEnds)
+		{
+			_clusters = clusters;
+			_clusterByRange = clusterByRange;
+			_clusterByHash = clusterByHash;
+			_previousClusterCount = !clusterByRange && clusterByHash ? previousClusterCount : 0;
+			_migrationEnds = migrationEnds;
+			_minimumIds = minimumIds;
+			_maximumIds = maximumIds;
+			if (!clusterByRange)
+			{
+				return;
+			}
+			int[] rangeIndexes = new int[clusters.Length];
+			int[] sortedMinimumIds = (int[])minimumIds.Clone();
+			for (int i = 0; i < rangeIndexes.Length; i++)
+			{
+				rangeIndexes[i] = i;
+			}
+			Array.Sort(sortedMinimumIds, rangeIndexes);
+			int[] sortedMaximumIds = new int[clusters.Length];
+			for (int i = 0; i < rangeIndexes.Length; i++)
+			{
+				sortedMaximumIds[i] = maximumIds[rangeIndexes[i]];
+				if (i > 0 && sortedMinimumIds[i] <= sortedMaximumIds[i - 1])
+				{
+					//overlapping, so config order decides
+					return;
+				}
+			}
+			_minimumIds = sortedMinimumIds;
+			_maximumIds = sortedMaximumIds;
+			_rangeIndexes = rangeIndexes;
+		}
+
+		/// <summary>
+		/// The number of clusters.
+		/// </summary>
+		internal int Count
+		{
+			get
+			{
+				return _clusters.Length;
+			}
+		}
+
+		/// <summary>
+		/// Whether the group clusters by id range and some of the ranges overlap.
+		/// </summary>
+		internal bool RangesOverlap
+		{
+			get
+			{
+				return _clusterByRange && _rangeIndexes == null;
+			}
+		}
+
+		/// <summary>
+		/// Whether ids are still being read from the clusters that held them before the number
+		/// of clusters changed.
+		/// </summary>
+		internal bool Migrating
+		{
+			get
+			{
+				return _previousClusterCount > 0;
+			}
+		}
+
+		/// <summary>
+		/// The number of clusters ids were hashed over before, while migrating.
+		/// </summary>
+		internal int PreviousClusterCount
+		{
+			get
+			{
+				return _previousClusterCount;
+			}
+		}
+
+		/// <summary>
+		/// When the migration window closes.
+		/// </summary>
+		internal DateTime MigrationEnds
+		{
+			get
+			{
+				return _migrationEnds;
+			}
+		}
+
+		/// <summary>
+		/// Gets the map with the same clusters that is no longer migrating.
+		/// </summary>
+		internal ClusterMap WithoutMigration()
+		{
+			return new ClusterMap(_clusters, _minimumIds, _maximumIds, _clusterByRange, _clusterByHash, 0,
+				DateTime.MinValue, _rangeIndexes);
+		}
+
+		private ClusterMap(NodeCluster[] clusters, int[] minimumIds, int[] maximumIds, bool clusterByRange,
+			bool clusterByHash, int previousClusterCount, DateTime migrationEnds, int[] rangeIndexes)
+		{
+			_clusters = clusters;
+			_minimumIds = minimumIds;
+			_maximumIds = maximumIds;
+			_clusterByRange = clusterByRange;
+			_clusterByHash = clusterByHash;
+			_previousClusterCount = previousClusterCount;
+			_migrationEnds = migrationEnds;
+			_rangeIndexes = rangeIndexes;
+		}
+
+		/// <summary>
+		/// Gets the cluster at <paramref name="index"/> in config order.
+		/// </summary>
+		internal NodeCluster this[int index]
+		{
+			get
+			{
+				return _clusters[index];
+			}
+		}
+
+		/// <summary>
+		/// Finds the cluster <paramref name="objectId"/> is placed on.
+		/// </summary>
+		/// <returns>The cluster, or null if no range holds the id.</returns>
+		internal NodeCluster GetCluster(int objectId)
+		{
+			int index = GetClusterIndex(objectId);
+			return index >= 0 ? _clusters[index] : null;
+		}
+
+		/// <summary>
+		/// Finds the config order index of the cluster <paramref name="objectId"/> is placed on.
+		/// </summary>
+		/// <returns>The index, or -1 if there are no clusters or no range holds the id.</returns>
+		internal int GetClusterIndex(int objectId)
+		{
+			if (_clusters.Length == 0)
+			{
+				return -1;
+			}
+			if (!_clusterByRange)
+			{
+				return GetPlacedIndex(objectId, _clusters.Length);
+			}
+			if (_rangeIndexes == null)
+			{
+				for (int i = 0; i < _minimumIds.Length; i++)
+				{
+					if (objectId >= _minimumIds[i] && objectId <= _maximumIds[i])
+					{
+						return i;
+					}
+				}
+				return -1;
+			}
+			int low = 0;
+			int high = _minimumIds.Length - 1;
+			while (low <= high)
+			{
+				int middle = low + ((high - low) >> 1);
+				if (objectId < _minimumIds[middle])
+				{
+					high = middle - 1;
+				}
+				else if (objectId > _maximumIds[middle])
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					return _rangeIndexes[middle];
+				}
+			}
+			return -1;
+		}
+
+		/// <summary>
+		/// Places <paramref name="objectId"/> on one of <paramref name="clusterCount"/> clusters
+		/// by hash or modulo, as the group does when it doesn't cluster by range.
+		/// </summary>
+		internal int GetPlacedIndex(int objectId, int clusterCount)
+		{
+			if (_clusterByHash)
+			{
+				return GetHashedIndex(objectId, clusterCount);
+			}
+			return GetModdedIndex(objectId, clusterCount);
+		}
+
+		/// <summary>
+		/// While migrating, finds the config order indexes of the cluster that held
+		/// <paramref name="objectId"/> before and the one that holds it now.
+		/// </summary>
+		/// <returns>True if the id has moved and its previous cluster is still in the group.</returns>
+		internal bool TryGetMigration(int objectId, out int previousIndex, out int currentIndex)
+		{
+			if (_previousClusterCount == 0)
+			{
+				previousIndex = -1;
+				currentIndex = -1;
+				return false;
+			}
+			previousIndex = GetHashedIndex(objectId, _previousClusterCount);
+			currentIndex = GetHashedIndex(objectId, _clusters.Length);
+			return previousIndex != currentIndex && previousIndex < _clusters.Length;
+		}
+
+		private static int GetModdedIndex(int objectId, int clusterCount)
+		{
+			if (objectId == Int32.MinValue) return 0; //cause Math.Abs(Int32.MinValue) throws
+			return Math.Abs(objectId) % clusterCount;
+		}
+
+		/// <summary>
+		/// Jump consistent hash (Lamping and Veach). Going from n to n + 1 clusters moves only
+		/// the 1/(n + 1) of ids that now belong to the new last cluster; no id moves between
+		/// the existing ones.
+		/// </summary>
+		internal static int GetHashedIndex(int objectId, int clusterCount)
+		{
+			unchecked
+			{
+				ulong key = (uint)objectId;
+				long bucket = -1, jump = 0;
+				while (jump < clusterCount)
+				{
+					bucket = jump;
+					key = key * 2862933555777941757UL + 1;
+					jump = (long)((bucket + 1) * ((double)(1L << 31) / (double)((key >> 33) + 1)));
+				}
+				return (int)bucket;
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+using System;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// A Get being sent to a node, that identical Gets arriving while it is outstanding wait for
+	/// instead of being sent themselves.
+	/// </summary>
+	internal class CoalescedGet
+	{
+		private readonly object _padLock = new object();
+		private bool _completed;
+		private RelayMessage _answer;
+
+		/// <summary>
+		/// Sets the answered Get, and releases the Gets waiting for it.
+		/// </summary>
+		/// <param name="answer">The answered Get, or null if sending it failed.</param>
+		internal void Complete(RelayMessage answer)
+		{
+			lock (_padLock)
+			{
+				_completed = true;
+				_answer = answer;
+				Monitor.PulseAll(_padLock);
+			}
+		}
+
+		/// <summary>
+		/// Waits for the Get to be answered.
+		/// </summary>
+		/// <returns>True if it was answered in time, false if it wasn't or sending it failed.</returns>
+		internal bool WaitForAnswer(int milliseconds)
+		{
+			lock (_padLock)
+			{
+				int deadline = Environment.TickCount + milliseconds;
+				int remaining = milliseconds;
+				while (!_completed && remaining > 0)
+				{
+					Monitor.Wait(_padLock, remaining);
+					remaining = deadline - Environment.TickCount;
+				}
+				return _answer != null;
+			}
+		}
+
+		/// <summary>
+		/// Copies the answer to a Get that waited for it. Call after <see cref="WaitForAnswer"/> returns true.
+		/// </summary>
+		internal void CopyAnswer(RelayMessage message)
+		{
+			RelayMessage answer;
+			lock (_padLock)
+			{
+				answer = _answer;
+			}
+			message.SetError(answer.ErrorType);
+			message.Payload = answer.Payload;
+			message.ResultOutcome = answer.ResultOutcome;
+			message.ResultDetails = answer.ResultDetails;
+			message.Freshness = answer.Freshness;
+		}
+	}
+}
@@ -0,0 +1,172 @@
+using System;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Limits the messages and message lists outstanding on one node, to a limit that follows
+	/// the node's reply time, so a node that is slowing down is sent less before it gets so
+	/// slow it falls into the danger zone.
+	/// </summary>
+	/// <remarks>
+	/// <para>Each reply moves the limit a fifth of the way to a target set by the gradient between
+	/// a long term average of the node's reply time and a short term one: while replies are about
+	/// as fast as they have been the target is the limit plus its square root, and as they slow it
+	/// drops to as little as half the limit. It only grows while at least half of it is in use, so
+	/// a quiet node's limit doesn't run away.</para>
+	/// <para>The long term average follows a node that has slowed for good, and is pulled down
+	/// when replies get much faster than it, so a node that recovers isn't held back. Only
+	/// successful round trips should be sampled; fast failures would drag both averages down.</para>
+	/// </remarks>
+	internal class ConcurrencyLimiter
+	{
+		private const int _initialLimit = 20;
+		private const double _shortWeight = 2.0 / (10 + 1); //about the last 10 replies
+		private const double _longWeight = 2.0 / (600 + 1); //about the last 600 replies
+		private const double _tolerance = 1.5; //how much slower than the long term the short term average may get before the limit shrinks
+		private const double _smoothing = 0.2;
+
+		private readonly object _padLock = new object();
+		private readonly int _maximumLimit;
+		private double _limit;
+		private int _outstanding;
+		private double _shortTicks;
+		private double _longTicks;
+		private long _rejected;
+
+		internal ConcurrencyLimiter(int maximumLimit)
+		{
+			_maximumLimit = maximumLimit;
+			_limit = Math.Min(_initialLimit, maximumLimit);
+		}
+
+		/// <summary>
+		/// The most the limit may grow to.
+		/// </summary>
+		internal int MaximumLimit
+		{
+			get
+			{
+				return _maximumLimit;
+			}
+		}
+
+		/// <summary>
+		/// The number of messages and message lists that may be outstanding.
+		/// </summary>
+		internal int Limit
+		{
+			get
+			{
+				return (int)_limit;
+			}
+		}
+
+		/// <summary>
+		/// The number of messages and message lists outstanding.
+		/// </summary>
+		internal int Outstanding
+		{
+			get
+			{
+				return _outstanding;
+			}
+		}
+
+		/// <summary>
+		/// The number of messages and message lists turned away because the limit was reached.
+		/// </summary>
+		internal long Rejected
+		{
+			get
+			{
+				return Interlocked.Read(ref _rejected);
+			}
+		}
+
+		/// <summary>
+		/// Whether the limit has been reached.
+		/// </summary>
+		internal bool Full
+		{
+			get
+			{
+				return _outstanding >= (int)_limit;
+			}
+		}
+
+		/// <summary>
+		/// Takes a place for a message or message list, waiting up to <paramref name="milliseconds"/>
+		/// for one if the limit has been reached.
+		/// </summary>
+		/// <returns>True if a place was taken, and <see cref="Release"/> must be called.</returns>
+		internal bool TryAcquire(int milliseconds)
+		{
+			lock (_padLock)
+			{
+				if (_outstanding >= (int)_limit && milliseconds > 0)
+				{
+					int deadline = Environment.TickCount + milliseconds;
+					int remaining = milliseconds;
+					while (_outstanding >= (int)_limit && remaining > 0)
+					{
+						Monitor.Wait(_padLock, remaining);
+						remaining = deadline - Environment.TickCount;
+					}
+				}
+				if (_outstanding >= (int)_limit)
+				{
+					Interlocked.Increment(ref _rejected);
+					return false;
+				}
+				_outstanding++;
+				return true;
+			}
+		}
+
+		/// <summary>
+		/// Releases a place taken with <see cref="TryAcquire"/>.
+		/// </summary>
+		/// <param name="replyTicks">The Stopwatch ticks the node took to answer, or 0 if the
+		/// message failed or otherwise shouldn't move the limit.</param>
+		internal void Release(long replyTicks)
+		{
+			lock (_padLock)
+			{
+				_outstanding--;
+				if (replyTicks > 0)
+				{
+					SetLimit(replyTicks);
+				}
+				Monitor.PulseAll(_padLock);
+			}
+		}
+
+		private void SetLimit(long replyTicks)
+		{
+			if (_longTicks == 0)
+			{
+				_shortTicks = replyTicks;
+				_longTicks = replyTicks;
+			}
+			else
+			{
+				_shortTicks += (replyTicks - _shortTicks) * _shortWeight;
+				_longTicks += (replyTicks - _longTicks) * _longWeight;
+				if (_longTicks > 2 * _shortTicks)
+				{
+					//replies got much faster, let the long term average catch up
+					_longTicks *= 0.95;
+				}
+			}
+
+			double gradient = Math.Max(0.5, Math.Min(1.0, _tolerance * _longTicks / _shortTicks));
+			double limit = _limit * gradient + Math.Sqrt(_limit);
+			if (limit > _limit && _outstanding < _limit / 2)
+			{
+				return;
+			}
+			_limit = Math.Max(1.0, Math.Min(_maximumLimit, _limit + (limit - _limit) * _smoothing));
+		}
+	}
+}
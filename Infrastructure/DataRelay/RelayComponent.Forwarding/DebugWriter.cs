@@ -66,7 +66,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		private static string DescribeDestinations(SimpleLinkedList<Node> destinations)
 		{
-			if (destinations == null || destinations.Count == 0)
+			if (destinations.Count == 0)
 			{
 				return "nowhere";
 			}
@@ -40,6 +40,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		private DateTime _initDate = DateTime.Now;
 		private RelayNodeDefinition _myNodeDefinition;
 		private bool _enableAsyncBulkGets;
+		private HedgeBudget _hedgeBudget; //null when hedging is off
+		private int _hedgeMinimumDelayMilliseconds;
+		private const int _defaultSocketTimeoutMilliseconds = 1000; //the socket client's send and receive timeouts when a group sets none
+		private GetCoalescer _getCoalescer;
 
 		#region IRelayComponent Members
 
@@ -87,6 +91,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 					}
 					NodeManager.Initialize(config, forwardingConfig, GetErrorQueues(runState));
 					_enableAsyncBulkGets = forwardingConfig.EnableAsyncBulkGets;
+					SetHedging(forwardingConfig);
+					_getCoalescer = new GetCoalescer(forwardingConfig.CoalescedGetMaximumWaitMilliseconds);
 					_myNodeDefinition = NodeManager.Instance.GetMyNodeDefinition();
                     
 					short maxTypeId = 0;
@@ -144,6 +150,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						NodeManager.Instance.ReloadConfig(config, forwardingConfig);
 						
 						_enableAsyncBulkGets = forwardingConfig.EnableAsyncBulkGets;
+						SetHedging(forwardingConfig);
+						_getCoalescer = new GetCoalescer(forwardingConfig.CoalescedGetMaximumWaitMilliseconds);
 						_myNodeDefinition = NodeManager.Instance.GetMyNodeDefinition();
 
 						short maxTypeId = 0;
@@ -177,6 +185,12 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return runState;
 		}
 
+		private void SetHedging(ForwardingConfig forwardingConfig)
+		{
+			_hedgeMinimumDelayMilliseconds = forwardingConfig.HedgeMinimumDelayMilliseconds;
+			_hedgeBudget = forwardingConfig.HedgeBudgetPercent > 0 ? new HedgeBudget(forwardingConfig.HedgeBudgetPercent) : null;
+		}
+
 		private static Dictionary<string, Dictionary<string, MessageQueue>> GetErrorQueues(ComponentRunState runState)
 		{
 			if (runState == null || runState.SerializedState == null) return null;
@@ -304,26 +318,21 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			Node node;
 			if (message.IsTwoWayMessage)
 			{
-				int allowedRetries = NodeManager.Instance.GetRetryCountForMessage(message);
-				bool triedBefore = false;
-				do
+				GetCoalescer getCoalescer = _getCoalescer;
+				if (getCoalescer != null && IsCoalesced(message))
 				{
-					if (PrepareMessage(message, triedBefore).Pop(out node))
-					{
-						triedBefore = true;
-						node.HandleOutMessage(message);
-					}
-					else
-					{
-						message.SetError(RelayErrorType.NoNodesAvailable);
-					}
+					getCoalescer.HandleGet(message, HandleTwoWayMessage);
+				}
+				else
+				{
+					HandleTwoWayMessage(message);
 				}
-				while (message.ErrorType == RelayErrorType.NodeUnreachable && --allowedRetries >= 0);
 			}
 			else
 			{
 				SimpleLinkedList<Node> nodes = PrepareMessage(message, false);
 				SerializedRelayMessage serializedMessage = new SerializedRelayMessage(message);
+				RelayMessage interZoneMessage = null;
 				SerializedRelayMessage serializedMessageInterZone = null;
 
 				bool messageHandled = true; // start with "true" so that we do not pop
@@ -349,13 +358,25 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						if (_myNodeDefinition != null && _myNodeDefinition.Zone != node.NodeDefinition.Zone)
 						{
 							// Message needs to cross Zone bounderies
-							if (serializedMessageInterZone == null)
+							if (interZoneMessage == null)
 							{
-								serializedMessageInterZone = new SerializedRelayMessage(RelayMessage.CreateInterZoneMessageFrom(message));
+								interZoneMessage = RelayMessage.CreateInterZoneMessageFrom(message);
 							}
 
 							if (message.ResultOutcome == null) message.ResultOutcome = RelayOutcome.Queued;
-							node.HandleInMessage(serializedMessageInterZone);
+							InterZoneShipper interZoneShipper = NodeManager.Instance.InterZoneShipper;
+							if (interZoneShipper != null)
+							{
+								interZoneShipper.Ship(interZoneMessage, node);
+							}
+							else
+							{
+								if (serializedMessageInterZone == null)
+								{
+									serializedMessageInterZone = new SerializedRelayMessage(interZoneMessage);
+								}
+								node.HandleInMessage(serializedMessageInterZone);
+							}
 						}
 						else if (typesettingSyncInMessages)
 						{
@@ -455,6 +476,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					resetEvent.WaitOne();
 				}
+				ReadFromPreviousClusters(messages);
 				return;
 			}
 			else
@@ -475,6 +497,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						nodeMessages.NodeWithInfo.Node.HandleOutMessages(nodeMessages.Messages.OutMessages);
 					}
 				}
+				ReadFromPreviousClusters(messages);
 			}
 
 			if (unhandledNodes.Count > 0)
@@ -503,6 +526,178 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 		}
 
+		private void HandleTwoWayMessage(RelayMessage message)
+		{
+			Node node;
+			int allowedRetries = NodeManager.Instance.GetRetryCountForMessage(message);
+			bool triedBefore = false;
+			do
+			{
+				if (PrepareMessage(message, triedBefore).Pop(out node))
+				{
+					triedBefore = true;
+					if (!HandleHedgedOutMessage(message, node))
+					{
+						node.HandleOutMessage(message);
+					}
+				}
+				else
+				{
+					message.SetError(RelayErrorType.NoNodesAvailable);
+				}
+			}
+			while ((message.ErrorType == RelayErrorType.NodeUnreachable || message.ErrorType == RelayErrorType.NodeOverloaded)
+				&& --allowedRetries >= 0);
+			ReadFromPreviousCluster(message);
+		}
+
+		/// <summary>
+		/// Whether <paramref name="message"/> is a Get of a type whose identical concurrent Gets
+		/// are sent once.
+		/// </summary>
+		private static bool IsCoalesced(RelayMessage message)
+		{
+			if (message.MessageType != MessageType.Get)
+			{
+				return false;
+			}
+			TypeSetting typeSetting = NodeManager.Instance.Config.TypeSettings.TypeSettingCollection[message.TypeId];
+			return typeSetting != null && typeSetting.CoalesceGets;
+		}
+
+		/// <summary>
+		/// Sends a Get or Query to <paramref name="node"/> and, if it hasn't answered within its
+		/// group's 95th percentile reply time, to a second node of its cluster as well, while the
+		/// hedge budget allows. The first answer is copied back to <paramref name="message"/>, which
+		/// times out if there is none within the group's socket send and receive timeouts.
+		/// </summary>
+		/// <returns>False if the message isn't hedged and should be sent to the node as usual.</returns>
+		private bool HandleHedgedOutMessage(RelayMessage message, Node node)
+		{
+			HedgeBudget hedgeBudget = _hedgeBudget;
+			if (hedgeBudget == null || (message.MessageType != MessageType.Get && message.MessageType != MessageType.Query))
+			{
+				return false;
+			}
+			int delay = node.NodeGroup.OutLatencies.Percentile95Milliseconds;
+			if (delay < 0)
+			{
+				//too few replies yet to know what slow is
+				return false;
+			}
+			hedgeBudget.CountRequest();
+
+			int timeout = GetSocketTimeout(node.NodeGroup.GroupDefinition.SocketSettings);
+			int firstWait = Math.Min(Math.Max(delay, _hedgeMinimumDelayMilliseconds), timeout);
+			HedgedRequest request = new HedgedRequest(message);
+			request.Send(node, false);
+			if (!request.WaitForWinner(firstWait))
+			{
+				Node hedgeNode = node.NodeCluster.ChooseNodeForHedge(node);
+				if (hedgeNode != null && hedgeBudget.TryTakeHedge())
+				{
+					request.Send(hedgeNode, true);
+					NodeManager.Instance.Counters.CountHedgeSent();
+				}
+				if (!request.WaitForWinner(timeout - firstWait))
+				{
+					//answers still outstanding are left to the copies
+					message.SetError(RelayErrorType.TimedOut);
+					return true;
+				}
+			}
+			request.CopyWinner();
+			if (request.HedgeWon)
+			{
+				NodeManager.Instance.Counters.CountHedgeWon();
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// The longest a two way message can take on a group's sockets before the transport gives up on it.
+		/// </summary>
+		private static int GetSocketTimeout(SocketSettings socketSettings)
+		{
+			int sendTimeout = _defaultSocketTimeoutMilliseconds;
+			int receiveTimeout = _defaultSocketTimeoutMilliseconds;
+			if (socketSettings != null)
+			{
+				if (socketSettings.SendTimeout > 0)
+				{
+					sendTimeout = socketSettings.SendTimeout;
+				}
+				if (socketSettings.ReceiveTimeout > 0)
+				{
+					receiveTimeout = socketSettings.ReceiveTimeout;
+				}
+			}
+			return sendTimeout + receiveTimeout;
+		}
+
+		/// <summary>
+		/// While a group migrates to a new number of clusters, retries a Get that missed on its
+		/// id's new cluster against the cluster that held the id before, and copies what is
+		/// found there to the new cluster through the in message queues.
+		/// </summary>
+		/// <remarks>
+		/// A newer Save can reach the new cluster before the copy does. Only types that check
+		/// <see cref="TypeSetting.CheckRaceCondition"/> are copied, since their stores compare
+		/// <c>LastUpdatedTicks</c> and won't let the older copy overwrite the newer Save.
+		/// </remarks>
+		private void ReadFromPreviousCluster(RelayMessage message)
+		{
+			if (message.MessageType != MessageType.Get || message.Payload != null || message.ErrorOccurred)
+			{
+				return;
+			}
+			NodeCluster previousCluster, currentCluster;
+			if (!NodeManager.Instance.TryGetMigration(message, out previousCluster, out currentCluster))
+			{
+				return;
+			}
+			Node node;
+			if (!previousCluster.GetNodesForMessage(message).Pop(out node))
+			{
+				return;
+			}
+			node.HandleOutMessage(message);
+			if (message.Payload == null)
+			{
+				if (message.ErrorOccurred)
+				{
+					//the miss on the new cluster stands
+					message.SetError(RelayErrorType.None);
+					message.ResultOutcome = null;
+				}
+				return;
+			}
+			if (!ChecksRaceCondition(message))
+			{
+				return;
+			}
+			currentCluster.CountMovedKey();
+			RelayMessage moveMessage = new RelayMessage(message.Payload, MessageType.Save, null, null, message.Freshness, true);
+			HandleMessage(moveMessage);
+		}
+
+		private static bool ChecksRaceCondition(RelayMessage message)
+		{
+			TypeSetting typeSetting = NodeManager.Instance.Config.TypeSettings.TypeSettingCollection[message.TypeId];
+			return typeSetting != null && typeSetting.CheckRaceCondition;
+		}
+
+		private void ReadFromPreviousClusters(IList<RelayMessage> messages)
+		{
+			for (int i = 0; i < messages.Count; i++)
+			{
+				if (messages[i] != null)
+				{
+					ReadFromPreviousCluster(messages[i]);
+				}
+			}
+		}
+
 		/// <summary>
 		/// Called when a message would be dropped entirely from delivery. 
 		/// This is most likely to occur if an error queue is full.
@@ -569,6 +764,21 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			statusBuilder.Append("<table class=\"nodeGroupBox\">");
 			statusBuilder.Append("<tr><td><b>Current Server Time:</b></td><td>" + DateTime.Now + "</td></tr>");
 			statusBuilder.Append("<tr><td><b>Initialization Time:</b></td><td>" + _initDate + "</td></tr>");
+			GetCoalescer getCoalescer = _getCoalescer;
+			if (getCoalescer != null && getCoalescer.Gets > 0)
+			{
+				statusBuilder.Append("<tr><td><b>Coalesced Gets:</b></td><td>" + getCoalescer.CoalescedGets + " of " + getCoalescer.Gets
+					+ " (" + (100.0 * getCoalescer.CoalescedGets / getCoalescer.Gets).ToString("N1") + "%)</td></tr>");
+			}
+			InterZoneShipper interZoneShipper = NodeManager.Instance.InterZoneShipper;
+			if (interZoneShipper != null)
+			{
+				statusBuilder.Append("<tr><td><b>Inter Zone Bundles:</b></td><td>" + interZoneShipper.BundlesSent + "</td></tr>");
+				statusBuilder.Append("<tr><td><b>Avg Messages per Bundle:</b></td><td>" + interZoneShipper.AverageMessagesPerBundle.ToString("N1") + "</td></tr>");
+				statusBuilder.Append("<tr><td><b>Avg Bundle Bytes:</b></td><td>" + interZoneShipper.AverageBundleBytes.ToString("N0")
+					+ " (" + interZoneShipper.CompressedPercent.ToString("N1") + "% of uncompressed)</td></tr>");
+				statusBuilder.Append("<tr><td><b>Avg Bundle Delay (ms):</b></td><td>" + interZoneShipper.AverageDelayMilliseconds.ToString("N2") + "</td></tr>");
+			}
 			statusBuilder.Append(@"</table>" + Environment.NewLine);
 			statusBuilder.Append("<br>" + Environment.NewLine);
 			if (NodeManager.Instance.NodeGroups != null)
@@ -30,6 +30,33 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		[XmlElement("MessageBurstTimeout")]
 		public int MessageBurstTimeout = 10;
 		/// <summary>
+		/// If greater than 0, the milliseconds a burst of in messages may take to gather and send.
+		/// Each node then sizes its bursts and their timeout to stay within it, instead of using
+		/// MessageBurstLength and MessageBurstTimeout.
+		/// </summary>
+		[XmlElement("MessageBurstLatencyTarget")]
+		public int MessageBurstLatencyTarget;
+		/// <summary>
+		/// If greater than 0, the most messages and message lists each node may have outstanding.
+		/// Below it, each node's limit adapts to its reply time. Messages over the limit go to another
+		/// node if one can take them, are retried shortly if they are in messages, or fail with NodeOverloaded.
+		/// </summary>
+		[XmlElement("MaximumConcurrencyLimit")]
+		public int MaximumConcurrencyLimit;
+		/// <summary>
+		/// The milliseconds a two way message sent on its caller's thread waits for a node at its
+		/// concurrency limit before being turned away, and the milliseconds in messages turned away
+		/// wait before they are retried. Messages sent from the dispatcher threads don't wait.
+		/// </summary>
+		[XmlElement("ConcurrencyLimitWaitMilliseconds")]
+		public int ConcurrencyLimitWaitMilliseconds = 5;
+		/// <summary>
+		/// The most in messages each node holds for a retry while it is at its concurrency limit.
+		/// In messages beyond it, or still turned away after a few retries, are error queued.
+		/// </summary>
+		[XmlElement("MaximumDeferredInMessages")]
+		public int MaximumDeferredInMessages = 10000;
+		/// <summary>
 		/// The number of threads used to process In Messages.
 		/// </summary>
 		[XmlElement("NumberOfThreads")]
@@ -55,6 +82,24 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		[XmlElement("RepostMessageLists")]
 		public bool RepostMessageLists;
 		/// <summary>
+		/// The percentage of Gets and Queries that may be sent again to a second node when the first
+		/// hasn't answered within the group's 95th percentile reply time. The first answer is used.
+		/// 0, the default, turns hedging off.
+		/// </summary>
+		[XmlElement("HedgeBudgetPercent")]
+		public int HedgeBudgetPercent;
+		/// <summary>
+		/// The fewest milliseconds to wait for the first node before hedging, however fast the group replies.
+		/// </summary>
+		[XmlElement("HedgeMinimumDelayMilliseconds")]
+		public int HedgeMinimumDelayMilliseconds = 1;
+		/// <summary>
+		/// The most milliseconds a Get waits for an identical Get already being sent, for types
+		/// with CoalesceGets set, before it is sent itself.
+		/// </summary>
+		[XmlElement("CoalescedGetMaximumWaitMilliseconds")]
+		public int CoalescedGetMaximumWaitMilliseconds = 1000;
+		/// <summary>
 		/// If true, determine the number of hops away each node is.
 		/// If false, use zone definitions.
 		/// Only the value at startup is meaningful; changing it after initialization has no effect.
@@ -62,6 +107,26 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		[XmlElement("MapNetwork")]
 		public bool MapNetwork; 
 		/// <summary>
+		/// How in system one way messages are replicated within a zone of a cluster. 0, the default,
+		/// sends them from the node they entered at to every other node. 1 sends them along a chain
+		/// of the nodes, and more than 1 down a tree with that many children per node.
+		/// Every node of a cluster must use the same value.
+		/// </summary>
+		[XmlElement("ReplicationFanOut")]
+		public int ReplicationFanOut;
+		/// <summary>
+		/// If greater than 0, one way messages to other zones are gathered into compressed bundles of
+		/// about this many bytes, each sent as a single message. Every relay node the bundles are sent
+		/// to must be able to unpack them.
+		/// </summary>
+		[XmlElement("InterZoneBundleMaximumBytes")]
+		public int InterZoneBundleMaximumBytes;
+		/// <summary>
+		/// The most milliseconds a message waits for its inter zone bundle to fill before the bundle is sent.
+		/// </summary>
+		[XmlElement("InterZoneBundleMaximumDelayMilliseconds")]
+		public int InterZoneBundleMaximumDelayMilliseconds = 20;
+		/// <summary>
 		/// If true, the forwarder will write the message.tostring and destination nodes of all handled RelayMessages to the default Trace.
 		/// </summary>
 		[XmlElement("WriteMessageTrace")]
@@ -11,6 +11,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		public static readonly string PerformanceCategoryName = "MySpace Relay Forwarding";
 		private bool nov09CountersExist = false;
+		private bool hedgeCountersExist = false;
+		private bool coalescedGetCountersExist = false;
 
 		protected PerformanceCounter[] PerformanceCounters;
 		protected enum PerformanceCounterIndexes
@@ -46,7 +48,11 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			DeleteAllWithConfirm = 27,
 			NotificationWithConfirm = 28,
 			IncrementWithConfirm = 29,
-			Increment = 30 //end add 11/9/09
+			Increment = 30, //end add 11/9/09
+
+			HedgesSent = 31,
+			HedgesWon = 32,
+			CoalescedGets = 33
 		}
 
 
@@ -82,7 +88,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			@"Msg/Sec - Confirmed Delete All",
 			@"Msg/Sec - Confirmed Notification",
 			@"Msg/Sec - Confirmed Increment",
-			@"Msg/Sec - Increment"
+			@"Msg/Sec - Increment",
+			@"Msg/Sec - Hedged Requests",
+			@"Msg/Sec - Hedges Won",
+			@"Msg/Sec - Coalesced Gets"
 		};
 
 		public static readonly string[] PerformanceCounterHelp = { 
@@ -116,7 +125,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			"Confirmed Delete All Messages Per Seconds", 
 			"Confirmed Notification Messages Per Second",
 			"Confirmed Increment Messages Per Second",
-			"Increment Messages Per Second"
+			"Increment Messages Per Second",
+			"Gets and Queries per second sent to a second node because the first was slow to answer",
+			"Hedged Gets and Queries per second answered first by the second node",
+			"Gets per second answered with the answer of an identical Get sent at the same time"
 		};
 
 		public static readonly PerformanceCounterType[] PerformanceCounterTypes = { 			
@@ -150,7 +162,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			PerformanceCounterType.RateOfCountsPerSecond32, 
 			PerformanceCounterType.RateOfCountsPerSecond32, 
 			PerformanceCounterType.RateOfCountsPerSecond32, 
-			PerformanceCounterType.RateOfCountsPerSecond32 
+			PerformanceCounterType.RateOfCountsPerSecond32, 
+			PerformanceCounterType.RateOfCountsPerSecond32,
+			PerformanceCounterType.RateOfCountsPerSecond32,
+			PerformanceCounterType.RateOfCountsPerSecond32
 		};
 		#endregion
 
@@ -230,6 +245,26 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						_log.Warn("Confirmed Update Counters are not installed, please reinstall DataRelay counters.");
 					}
 
+					if (PerformanceCounterCategory.CounterExists(PerformanceCounterNames[(int)PerformanceCounterIndexes.HedgesSent],
+						PerformanceCategoryName))
+					{
+						hedgeCountersExist = true;
+					}
+					else
+					{
+						_log.Warn("Hedged Request Counters are not installed, please reinstall DataRelay counters.");
+					}
+
+					if (PerformanceCounterCategory.CounterExists(PerformanceCounterNames[(int)PerformanceCounterIndexes.CoalescedGets],
+						PerformanceCategoryName))
+					{
+						coalescedGetCountersExist = true;
+					}
+					else
+					{
+						_log.Warn("Coalesced Get Counters are not installed, please reinstall DataRelay counters.");
+					}
+
 					_hitCounter = new MinuteAggregateCounter();
 					_attemptCounter = new MinuteAggregateCounter();
 					ResetCounters();
@@ -535,6 +570,30 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 		}
 
+		internal void CountHedgeSent()
+		{
+			if (_countersInitialized && hedgeCountersExist)
+			{
+				PerformanceCounters[(int)PerformanceCounterIndexes.HedgesSent].Increment();
+			}
+		}
+
+		internal void CountHedgeWon()
+		{
+			if (_countersInitialized && hedgeCountersExist)
+			{
+				PerformanceCounters[(int)PerformanceCounterIndexes.HedgesWon].Increment();
+			}
+		}
+
+		internal void CountCoalescedGet()
+		{
+			if (_countersInitialized && coalescedGetCountersExist)
+			{
+				PerformanceCounters[(int)PerformanceCounterIndexes.CoalescedGets].Increment();
+			}
+		}
+
 		internal void SetNumberOfQueuedMessages(int count)
 		{
 			if (_countersInitialized)
@@ -0,0 +1,113 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Keeps the Gets being sent to nodes, so that identical Gets arriving at the same time, as
+	/// they do when a popular object misses in a cache, are sent once and share its answer.
+	/// </summary>
+	/// <remarks>
+	/// Gets are identical when they have the same type, id and extended id. The Gets that wait
+	/// share the payload object of the one sent, as they would sharing a cached object.
+	/// </remarks>
+	internal class GetCoalescer
+	{
+		private readonly Dictionary<string, CoalescedGet> _inFlight = new Dictionary<string, CoalescedGet>();
+		private readonly int _maximumWaitMilliseconds;
+		private long _gets;
+		private long _coalescedGets;
+
+		internal GetCoalescer(int maximumWaitMilliseconds)
+		{
+			_maximumWaitMilliseconds = maximumWaitMilliseconds;
+		}
+
+		/// <summary>
+		/// The number of Gets for types that are coalesced.
+		/// </summary>
+		internal long Gets
+		{
+			get
+			{
+				return Interlocked.Read(ref _gets);
+			}
+		}
+
+		/// <summary>
+		/// The number of Gets answered with the answer of an identical Get.
+		/// </summary>
+		internal long CoalescedGets
+		{
+			get
+			{
+				return Interlocked.Read(ref _coalescedGets);
+			}
+		}
+
+		/// <summary>
+		/// Answers <paramref name="message"/> with the answer to an identical Get already being
+		/// sent, or sends it with <paramref name="send"/> and answers identical Gets that arrive
+		/// meanwhile with its answer.
+		/// </summary>
+		/// <remarks>
+		/// A Get that waits longer than the maximum wait for the identical one, or whose identical
+		/// one threw, is sent itself.
+		/// </remarks>
+		internal void HandleGet(RelayMessage message, Action<RelayMessage> send)
+		{
+			Interlocked.Increment(ref _gets);
+			string key = GetKey(message);
+			CoalescedGet get;
+			bool sending = false;
+			lock (_inFlight)
+			{
+				if (!_inFlight.TryGetValue(key, out get))
+				{
+					get = new CoalescedGet();
+					_inFlight.Add(key, get);
+					sending = true;
+				}
+			}
+
+			if (!sending)
+			{
+				if (get.WaitForAnswer(_maximumWaitMilliseconds))
+				{
+					get.CopyAnswer(message);
+					Interlocked.Increment(ref _coalescedGets);
+					NodeManager.Instance.Counters.CountCoalescedGet();
+					return;
+				}
+				send(message);
+				return;
+			}
+
+			bool sent = false;
+			try
+			{
+				send(message);
+				sent = true;
+			}
+			finally
+			{
+				lock (_inFlight)
+				{
+					_inFlight.Remove(key);
+				}
+				//if sending threw, the waiting Gets are sent themselves
+				get.Complete(sent ? message : null);
+			}
+		}
+
+		private static string GetKey(RelayMessage message)
+		{
+			if (message.ExtendedId == null)
+			{
+				return message.GetCachingKey();
+			}
+			return message.GetCachingKey() + "_" + Convert.ToBase64String(message.ExtendedId);
+		}
+	}
+}
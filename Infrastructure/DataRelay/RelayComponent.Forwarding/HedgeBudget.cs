@@ -0,0 +1,53 @@
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Limits hedged requests to a percentage of the requests that could be hedged. Each such
+	/// request earns a share of a hedge, and a hedge is only sent with a whole one earned, so a
+	/// slow cluster can't be flooded with doubled requests.
+	/// </summary>
+	internal class HedgeBudget
+	{
+		private const int _hedgeCost = 100; //a request earns the budget percent of a hedge
+		private const int _maximumSavedHedges = 10;
+
+		private readonly int _percent;
+		private int _balance;
+
+		internal HedgeBudget(int percent)
+		{
+			_percent = percent;
+		}
+
+		/// <summary>
+		/// Counts a request that could be hedged.
+		/// </summary>
+		internal void CountRequest()
+		{
+			if (Interlocked.Add(ref _balance, _percent) > _hedgeCost * _maximumSavedHedges)
+			{
+				Interlocked.Exchange(ref _balance, _hedgeCost * _maximumSavedHedges);
+			}
+		}
+
+		/// <summary>
+		/// Takes a hedge from the budget, if one has been earned.
+		/// </summary>
+		/// <returns>True if the hedge may be sent.</returns>
+		internal bool TryTakeHedge()
+		{
+			int balance;
+			do
+			{
+				balance = _balance;
+				if (balance < _hedgeCost)
+				{
+					return false;
+				}
+			}
+			while (Interlocked.CompareExchange(ref _balance, balance - _hedgeCost, balance) != balance);
+			return true;
+		}
+	}
+}
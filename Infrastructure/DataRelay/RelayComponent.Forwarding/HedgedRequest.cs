@@ -0,0 +1,164 @@
+using System;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Sends copies of one two way message to more than one node and keeps the first answer.
+	/// </summary>
+	/// <remarks>
+	/// Each node gets a copy of its own, so a reply that loses the race can't change the
+	/// message after the winner has been copied back to it. Only a copy that found its answer,
+	/// or learned there is none, wins while other copies are outstanding; an error or time out
+	/// only wins when it is the last copy to come back.
+	/// </remarks>
+	internal class HedgedRequest
+	{
+		private readonly RelayMessage _message;
+		private readonly object _padLock = new object();
+		private int _outstanding;
+		private RelayMessage _winner;
+		private bool _winnerIsHedge;
+
+		internal HedgedRequest(RelayMessage message)
+		{
+			_message = message;
+		}
+
+		/// <summary>
+		/// Whether the answer came from a hedge rather than the node first asked.
+		/// </summary>
+		internal bool HedgeWon
+		{
+			get
+			{
+				return _winnerIsHedge;
+			}
+		}
+
+		/// <summary>
+		/// Sends a copy of the message to <paramref name="node"/>, without waiting for its answer.
+		/// </summary>
+		internal void Send(Node node, bool isHedge)
+		{
+			RelayMessage copy = CopyMessage();
+			lock (_padLock)
+			{
+				_outstanding++;
+			}
+			try
+			{
+				node.BeginHandleOutMessage(copy, asyncResult => Complete(node, copy, isHedge, asyncResult), null);
+			}
+			catch
+			{
+				lock (_padLock)
+				{
+					_outstanding--;
+				}
+				throw;
+			}
+		}
+
+		private void Complete(Node node, RelayMessage copy, bool isHedge, IAsyncResult asyncResult)
+		{
+			try
+			{
+				node.EndHandleOutMessage(asyncResult);
+			}
+			catch (Exception ex)
+			{
+				//this is the transport's callback thread, so the failure goes on the copy instead
+				copy.SetError(ex);
+				NodeGroup.LogNodeException(copy, node, ex);
+			}
+			lock (_padLock)
+			{
+				_outstanding--;
+				if (_winner == null && (Answered(copy) || _outstanding == 0))
+				{
+					_winner = copy;
+					_winnerIsHedge = isHedge;
+					Monitor.PulseAll(_padLock);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Whether <paramref name="copy"/> came back with an answer, found or not found, rather
+		/// than an error or a time out.
+		/// </summary>
+		private static bool Answered(RelayMessage copy)
+		{
+			if (copy.ErrorOccurred)
+			{
+				return false;
+			}
+			RelayOutcome? outcome = copy.ResultOutcome;
+			return outcome != RelayOutcome.Error && outcome != RelayOutcome.Timeout;
+		}
+
+		/// <summary>
+		/// Waits for an answer.
+		/// </summary>
+		/// <param name="milliseconds">How long to wait, or <see cref="Timeout.Infinite"/>.</param>
+		/// <returns>True if there is an answer.</returns>
+		internal bool WaitForWinner(int milliseconds)
+		{
+			lock (_padLock)
+			{
+				if (milliseconds == Timeout.Infinite)
+				{
+					while (_winner == null)
+					{
+						Monitor.Wait(_padLock);
+					}
+					return true;
+				}
+				int deadline = Environment.TickCount + milliseconds;
+				int remaining = milliseconds;
+				while (_winner == null && remaining > 0)
+				{
+					Monitor.Wait(_padLock, remaining);
+					remaining = deadline - Environment.TickCount;
+				}
+				return _winner != null;
+			}
+		}
+
+		/// <summary>
+		/// Copies the answer back to the message. Call after <see cref="WaitForWinner"/> returns true.
+		/// </summary>
+		internal void CopyWinner()
+		{
+			RelayMessage winner;
+			lock (_padLock)
+			{
+				winner = _winner;
+			}
+			_message.SetError(winner.ErrorType);
+			_message.Payload = winner.Payload;
+			_message.ResultOutcome = winner.ResultOutcome;
+			_message.ResultDetails = winner.ResultDetails;
+			_message.Freshness = winner.Freshness;
+		}
+
+		private RelayMessage CopyMessage()
+		{
+			RelayMessage copy = new RelayMessage(_message, _message.MessageType);
+			copy.QueryId = _message.QueryId;
+			copy.QueryData = _message.QueryData;
+			copy.QueryDataCompressed = _message.QueryDataCompressed;
+			copy.RelayTTL = _message.RelayTTL;
+			copy.SourceZone = _message.SourceZone;
+			copy.HydrationPolicy = _message.HydrationPolicy;
+			copy.KeyType = _message.KeyType;
+			copy.NotificationId = _message.NotificationId;
+			copy.IsInterClusterMsg = _message.IsInterClusterMsg;
+			copy.Priority = _message.Priority;
+			copy.Payload = _message.Payload;
+			copy.AddressHistory.AddRange(_message.AddressHistory);
+			return copy;
+		}
+	}
+}
@@ -0,0 +1,255 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+using MySpace.Logging;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Gathers the one way messages bound for other zones into bundles, and sends each bundle
+	/// compressed as a single message, so the links between zones carry fewer and smaller messages.
+	/// </summary>
+	/// <remarks>
+	/// <para>A bundle is sent once its messages reach the maximum bytes, or once its first message
+	/// has waited the maximum delay. The relay node that receives it unpacks it into HandleMessages.</para>
+	/// <para>Bundles are kept per destination node rather than per zone, since the node chosen in
+	/// another zone is in the cluster its messages belong to and routes them within that cluster.</para>
+	/// </remarks>
+	internal class InterZoneShipper
+	{
+		private const int _messageOverheadBytes = 64; //about what a message takes serialized, besides its payload
+
+		private static readonly LogWrapper _log = new LogWrapper();
+
+		private readonly object _padLock = new object();
+		private readonly Dictionary<Node, Bundle> _bundles = new Dictionary<Node, Bundle>();
+		private readonly int _maximumBytes;
+		private readonly int _maximumDelayMilliseconds;
+		private readonly long _maximumDelayTicks;
+		private readonly Timer _timer;
+		private long _bundlesSent;
+		private long _messagesSent;
+		private long _serializedBytes;
+		private long _compressedBytes;
+		private long _delayTicks;
+
+		private class Bundle
+		{
+			internal readonly List<RelayMessage> Messages = new List<RelayMessage>();
+			internal int Bytes;
+			internal long FirstTicks;
+			internal long AddedTicks; //sum of the times each message was added, for the average delay
+		}
+
+		internal InterZoneShipper(int maximumBytes, int maximumDelayMilliseconds)
+		{
+			_maximumBytes = maximumBytes;
+			_maximumDelayMilliseconds = Math.Max(1, maximumDelayMilliseconds);
+			_maximumDelayTicks = _maximumDelayMilliseconds * Stopwatch.Frequency / 1000;
+			int period = Math.Max(1, _maximumDelayMilliseconds / 2);
+			_timer = new Timer(Timer_Elapsed, null, period, period);
+		}
+
+		internal int MaximumBytes
+		{
+			get
+			{
+				return _maximumBytes;
+			}
+		}
+
+		internal int MaximumDelayMilliseconds
+		{
+			get
+			{
+				return _maximumDelayMilliseconds;
+			}
+		}
+
+		/// <summary>
+		/// The number of bundles sent.
+		/// </summary>
+		internal long BundlesSent
+		{
+			get
+			{
+				return Interlocked.Read(ref _bundlesSent);
+			}
+		}
+
+		/// <summary>
+		/// The average number of messages in a bundle.
+		/// </summary>
+		internal double AverageMessagesPerBundle
+		{
+			get
+			{
+				long bundles = BundlesSent;
+				return bundles == 0 ? 0 : (double)Interlocked.Read(ref _messagesSent) / bundles;
+			}
+		}
+
+		/// <summary>
+		/// The average compressed bytes of a bundle.
+		/// </summary>
+		internal double AverageBundleBytes
+		{
+			get
+			{
+				long bundles = BundlesSent;
+				return bundles == 0 ? 0 : (double)Interlocked.Read(ref _compressedBytes) / bundles;
+			}
+		}
+
+		/// <summary>
+		/// The compressed bytes of the bundles, as a percent of their bytes before compression.
+		/// </summary>
+		internal double CompressedPercent
+		{
+			get
+			{
+				long serializedBytes = Interlocked.Read(ref _serializedBytes);
+				return serializedBytes == 0 ? 0 : 100.0 * Interlocked.Read(ref _compressedBytes) / serializedBytes;
+			}
+		}
+
+		/// <summary>
+		/// The average milliseconds a message waited in its bundle.
+		/// </summary>
+		internal double AverageDelayMilliseconds
+		{
+			get
+			{
+				long messages = Interlocked.Read(ref _messagesSent);
+				return messages == 0 ? 0 : Interlocked.Read(ref _delayTicks) * 1000.0 / Stopwatch.Frequency / messages;
+			}
+		}
+
+		/// <summary>
+		/// Adds an inter zone message to the bundle of each of <paramref name="nodes"/>.
+		/// </summary>
+		internal void Ship(RelayMessage message, SimpleLinkedList<Node> nodes)
+		{
+			Node node;
+			while (nodes.Pop(out node))
+			{
+				Ship(message, node);
+			}
+		}
+
+		/// <summary>
+		/// Adds an inter zone message to the bundle of <paramref name="node"/>, and sends the
+		/// bundle if that fills it.
+		/// </summary>
+		internal void Ship(RelayMessage message, Node node)
+		{
+			int bytes = _messageOverheadBytes;
+			if (message.Payload != null && message.Payload.ByteArray != null)
+			{
+				bytes += message.Payload.ByteArray.Length;
+			}
+			long now = Stopwatch.GetTimestamp();
+			Bundle fullBundle = null;
+			lock (_padLock)
+			{
+				Bundle bundle;
+				if (!_bundles.TryGetValue(node, out bundle))
+				{
+					bundle = new Bundle();
+					bundle.FirstTicks = now;
+					_bundles.Add(node, bundle);
+				}
+				bundle.Messages.Add(message);
+				bundle.Bytes += bytes;
+				bundle.AddedTicks += now;
+				if (bundle.Bytes >= _maximumBytes)
+				{
+					_bundles.Remove(node);
+					fullBundle = bundle;
+				}
+			}
+			if (fullBundle != null)
+			{
+				Send(node, fullBundle);
+			}
+		}
+
+		/// <summary>
+		/// Stops the timer and sends the bundles not yet sent.
+		/// </summary>
+		internal void Shutdown()
+		{
+			_timer.Change(Timeout.Infinite, Timeout.Infinite);
+			_timer.Dispose();
+			SendBundles(true);
+		}
+
+		private void Timer_Elapsed(object state)
+		{
+			SendBundles(false);
+		}
+
+		private void SendBundles(bool all)
+		{
+			List<KeyValuePair<Node, Bundle>> dueBundles = null;
+			long now = Stopwatch.GetTimestamp();
+			lock (_padLock)
+			{
+				foreach (KeyValuePair<Node, Bundle> pair in _bundles)
+				{
+					if (all || now - pair.Value.FirstTicks >= _maximumDelayTicks)
+					{
+						if (dueBundles == null)
+						{
+							dueBundles = new List<KeyValuePair<Node, Bundle>>();
+						}
+						dueBundles.Add(pair);
+					}
+				}
+				if (dueBundles != null)
+				{
+					foreach (KeyValuePair<Node, Bundle> pair in dueBundles)
+					{
+						_bundles.Remove(pair.Key);
+					}
+				}
+			}
+			if (dueBundles != null)
+			{
+				foreach (KeyValuePair<Node, Bundle> pair in dueBundles)
+				{
+					Send(pair.Key, pair.Value);
+				}
+			}
+		}
+
+		private void Send(Node node, Bundle bundle)
+		{
+			RelayMessage bundleMessage;
+			int serializedLength;
+			try
+			{
+				bundleMessage = RelayMessage.CreateBundleFrom(bundle.Messages, out serializedLength);
+			}
+			catch (Exception ex)
+			{
+				if (_log.IsErrorEnabled)
+					_log.ErrorFormat("Exception bundling {0} messages for {1}, sending them one by one: {2}", bundle.Messages.Count, node, ex);
+				foreach (RelayMessage message in bundle.Messages)
+				{
+					node.HandleInMessage(new SerializedRelayMessage(message));
+				}
+				return;
+			}
+
+			long now = Stopwatch.GetTimestamp();
+			Interlocked.Increment(ref _bundlesSent);
+			Interlocked.Add(ref _messagesSent, bundle.Messages.Count);
+			Interlocked.Add(ref _serializedBytes, serializedLength);
+			Interlocked.Add(ref _compressedBytes, bundleMessage.Payload.ByteArray.Length);
+			Interlocked.Add(ref _delayTicks, now * bundle.Messages.Count - bundle.AddedTicks);
+			node.HandleInMessage(new SerializedRelayMessage(bundleMessage));
+		}
+	}
+}
@@ -0,0 +1,117 @@
+using System;
+using System.Diagnostics;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Counts reply times in buckets that double in width, and keeps an estimate of their
+	/// 95th percentile. Counts are halved every <see cref="_decaySamples"/> samples, so the
+	/// estimate follows the recent replies rather than all of them.
+	/// </summary>
+	internal class LatencyHistogram
+	{
+		private const int _bucketCount = 32; //bucket i holds replies of 2^(i-1) to 2^i microseconds
+		private const int _minimumSamples = 100; //no estimate until this many replies are counted
+		private const int _estimateSamples = 128; //the estimate is recalculated this often
+		private const int _decaySamples = 1024;
+		private static readonly double _ticksPerMicrosecond = Stopwatch.Frequency / 1000000.0;
+
+		private readonly int[] _buckets = new int[_bucketCount];
+		private int _samples;
+		private long _percentile95Ticks = -1;
+
+		/// <summary>
+		/// Counts one reply time.
+		/// </summary>
+		/// <param name="ticks">The reply time in <see cref="Stopwatch"/> ticks.</param>
+		internal void Record(long ticks)
+		{
+			Interlocked.Increment(ref _buckets[GetBucket(ticks)]);
+			int samples = Interlocked.Increment(ref _samples);
+			if (samples % _decaySamples == 0)
+			{
+				//racing increments may be halved or not, which an estimate can afford
+				for (int i = 0; i < _bucketCount; i++)
+				{
+					Interlocked.Exchange(ref _buckets[i], _buckets[i] / 2);
+				}
+			}
+			if (samples % _estimateSamples == 0)
+			{
+				Interlocked.Exchange(ref _percentile95Ticks, EstimatePercentile(0.95));
+			}
+		}
+
+		/// <summary>
+		/// The estimated 95th percentile reply time in <see cref="Stopwatch"/> ticks, or -1 until
+		/// enough replies have been counted.
+		/// </summary>
+		internal long Percentile95Ticks
+		{
+			get
+			{
+				return Interlocked.Read(ref _percentile95Ticks);
+			}
+		}
+
+		/// <summary>
+		/// The estimated 95th percentile reply time in whole milliseconds, rounded up, or -1 until
+		/// enough replies have been counted.
+		/// </summary>
+		internal int Percentile95Milliseconds
+		{
+			get
+			{
+				long ticks = Percentile95Ticks;
+				if (ticks < 0)
+				{
+					return -1;
+				}
+				return (int)Math.Ceiling(ticks * 1000.0 / Stopwatch.Frequency);
+			}
+		}
+
+		private long EstimatePercentile(double fraction)
+		{
+			int[] counts = new int[_bucketCount];
+			int total = 0;
+			for (int i = 0; i < _bucketCount; i++)
+			{
+				counts[i] = _buckets[i];
+				total += counts[i];
+			}
+			if (total < _minimumSamples)
+			{
+				return -1;
+			}
+			double wanted = total * fraction;
+			int below = 0;
+			for (int i = 0; i < _bucketCount; i++)
+			{
+				if (below + counts[i] >= wanted)
+				{
+					//interpolate within the bucket
+					double low = i == 0 ? 0 : 1L << (i - 1);
+					double high = 1L << i;
+					double microseconds = low + (high - low) * (wanted - below) / counts[i];
+					return (long)(microseconds * _ticksPerMicrosecond);
+				}
+				below += counts[i];
+			}
+			return (long)((1L << (_bucketCount - 1)) * _ticksPerMicrosecond);
+		}
+
+		private static int GetBucket(long ticks)
+		{
+			long microseconds = (long)(ticks / _ticksPerMicrosecond);
+			int bucket = 0;
+			while (microseconds > 0 && bucket < _bucketCount - 1)
+			{
+				microseconds >>= 1;
+				bucket++;
+			}
+			return bucket;
+		}
+	}
+}
@@ -1,6 +1,9 @@
+using System;
 using System.Collections.Generic;
+using System.IO;
 using MySpace.Common;
 using MySpace.DataRelay.Common.Schemas;
+using MySpace.Logging;
 
 namespace MySpace.DataRelay.RelayComponent.Forwarding
 {
@@ -12,13 +15,38 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		/// </summary>
 		public MessageQueue() { } 
 
-		internal MessageQueue(QueueConfig config)
+		/// <param name="config">The queue settings.</param>
+		/// <param name="persistenceName">The queue's folder under the configured persistence folder, if any.</param>
+		internal MessageQueue(QueueConfig config, string persistenceName)
 		{
 			if (config != null)
 			{
 				_enabled = config.Enabled;
 				_itemsPerDequeue = config.ItemsPerDequeue;
 				_maxCount = config.MaxCount;
+				if (!String.IsNullOrEmpty(config.PersistenceFolder))
+				{
+					OpenPersistedQueue(Path.Combine(config.PersistenceFolder, persistenceName), config);
+				}
+			}
+		}
+
+		private void OpenPersistedQueue(string folder, QueueConfig config)
+		{
+			try
+			{
+				_persistedQueue = PersistedMessageQueue.Open(folder, config);
+				_persistedFolder = folder;
+			}
+			catch (IOException ex)
+			{
+				if (_log.IsErrorEnabled)
+					_log.ErrorFormat("Could not open persisted error queue {0}, queueing in memory: {1}", folder, ex);
+			}
+			catch (UnauthorizedAccessException ex)
+			{
+				if (_log.IsErrorEnabled)
+					_log.ErrorFormat("Could not open persisted error queue {0}, queueing in memory: {1}", folder, ex);
 			}
 		}
 
@@ -28,14 +56,22 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			{
 				_itemsPerDequeue = config.ItemsPerDequeue;
 				_maxCount = config.MaxCount;
+				if (_persistedQueue != null)
+				{
+					_persistedQueue = PersistedMessageQueue.Open(_persistedFolder, config);
+				}
 				_enabled = config.Enabled; //do this last so if it's switching on for the first time 
 										  //the settings will be in place when it starts up
 			}
 		}
 
+		private static readonly LogWrapper _log = new LogWrapper();
+
 		private bool _enabled;
 		private int _maxCount = 1000;
 		private int _itemsPerDequeue = 100;
+		private PersistedMessageQueue _persistedQueue; //null when queueing in memory
+		private string _persistedFolder;
 		
 		private readonly object _inMessageQueueLock = new object();
 		private readonly object _inMessageQueueCreateLock = new object();
@@ -61,11 +97,23 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		{
 			get
 			{
+				int count = _persistedQueue != null ? _persistedQueue.Count : 0;
 				if (_inMessageQueue != null)
 				{
-					return _inMessageQueue.Count;
+					count += _inMessageQueue.Count;
 				}
-				return 0;
+				return count;
+			}
+		}
+
+		/// <summary>
+		/// The queue on disk, or null if messages are queued in memory.
+		/// </summary>
+		internal PersistedMessageQueue PersistedQueue
+		{
+			get
+			{
+				return _persistedQueue;
 			}
 		}
 			
@@ -77,6 +125,19 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					return;
 				}
+				if (_persistedQueue != null)
+				{
+					CountReplays();
+					if (_persistedQueue.Enqueue(message))
+					{
+						NodeManager.Instance.Counters.IncrementErrorQueue();
+					}
+					else
+					{
+						Forwarder.RaiseMessageDropped(message);
+					}
+					return;
+				}
 				lock (_inMessageQueueLock)
 				{
 					while (InMessageQueue.Count >= (_maxCount - 1))
@@ -98,6 +159,17 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		{
 			if (_enabled && messages.Count > 0)
 			{
+				if (_persistedQueue != null)
+				{
+					CountReplays();
+					int kept = _persistedQueue.Enqueue(messages);
+					NodeManager.Instance.Counters.IncrementErrorQueueBy(kept);
+					for (int i = kept; i < messages.Count; i++)
+					{
+						Forwarder.RaiseMessageDropped(messages[i]);
+					}
+					return;
+				}
 				lock (_inMessageQueueLock)
 				{
 					while (InMessageQueue.Count > 0 && InMessageQueue.Count >= (_maxCount - messages.Count))
@@ -124,8 +196,19 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		internal SerializedMessageList Dequeue()
 		{
 			SerializedMessageList list = null;
-			
-			if (_enabled && InMessageQueueCount > 0)
+
+			if (_enabled && _persistedQueue != null && (_inMessageQueue == null || _inMessageQueue.Count == 0))
+			{
+				CountReplays();
+				List<SerializedRelayMessage> messages = _persistedQueue.Dequeue(_itemsPerDequeue);
+				if (messages.Count > 0)
+				{
+					list = new SerializedMessageList();
+					list.InMessages = messages;
+					NodeManager.Instance.Counters.DecrementErrorQueueBy(messages.Count);
+				}
+			}
+			else if (_enabled && _inMessageQueue != null && _inMessageQueue.Count > 0)
 			{
 				int dequeueCount = 0;
 				
@@ -144,6 +227,18 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		}
 
 
+		/// <summary>
+		/// Adds the messages a persisted queue replayed from disk to the error queue counter.
+		/// </summary>
+		private void CountReplays()
+		{
+			int replays = _persistedQueue.TakeUncountedReplays();
+			if (replays > 0)
+			{
+				NodeManager.Instance.Counters.IncrementErrorQueueBy(replays);
+			}
+		}
+
 		#region IVersionSerializable Members
 
 		public void Serialize(MySpace.Common.IO.IPrimitiveWriter writer)
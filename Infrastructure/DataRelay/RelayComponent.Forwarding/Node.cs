@@ -1,6 +1,7 @@
 using System;
 using System.Collections.Generic;
 using System.Diagnostics;
+using System.IO;
 using System.Net;
 using System.Net.NetworkInformation;
 using System.Net.Sockets;
@@ -25,6 +26,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		private static readonly LogWrapper _log = new LogWrapper();
 
 		private readonly IRelayTransport _transport;
+		private readonly SimpleLinkedListNode<Node> _link; //this node alone, shared by every list routing to just it
 		private bool _receivesActive = true;
 		private bool _repostMessageLists;
 		private DispatcherQueue _inMessageQueue;
@@ -33,22 +35,45 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		private int _messageBurstLength = 1;
 		private int _messageBurstTimeout = 500;
 		private TimeSpan _messageBurstTimeoutSpan;
+		private BurstController _burstController; //null to use the configured burst length and timeout
+		private ConcurrencyLimiter _concurrencyLimiter; //null when outstanding work isn't limited
+		private int _concurrencyLimitWait;
+		private int _maximumDeferredInMessages;
+		private int _deferredInMessages; //in messages waiting to retry a node at its concurrency limit
+		private const int _maximumInRetries = 3;
 		private Port<List<SerializedRelayMessage>> _inMessagesPort = new Port<List<SerializedRelayMessage>>();
 		private Port<SerializedRelayMessage> _serializedMessagePort = new Port<SerializedRelayMessage>();
 		private Port<MessagesWithLock> _outMessagesPort = new Port<MessagesWithLock>();
 
 
+		/// <summary>
+		/// Gets a list of just this node, without allocating one for each message routed here.
+		/// </summary>
+		internal SimpleLinkedList<Node> AsList()
+		{
+			return new SimpleLinkedList<Node>(_link, 1);
+		}
+
 		internal static string GetMessageQueueNameFor(RelayNodeDefinition nodeDefinition)
 		{
 			return "Relay Node " + nodeDefinition;
 		}
 
+		/// <summary>
+		/// The folder, under the persistence folder, where this node's error queue is kept on disk.
+		/// </summary>
+		private string GetPersistedQueueName()
+		{
+			return Path.Combine(NodeGroup.GroupName, Host + "_" + Port);
+		}
+
 		internal Node(RelayNodeDefinition nodeDefinition, NodeGroup ownerGroup, NodeCluster ownerCluster, ForwardingConfig forwardingConfig, DispatcherQueue inMessageQueue, DispatcherQueue outMessageQueue)
 		{
 			DetectedZone = 0;
 			NodeDefinition = nodeDefinition;
 			NodeGroup = ownerGroup;
 			NodeCluster = ownerCluster;
+			_link = new SimpleLinkedListNode<Node>(this);
 			_messageCounts = new int[RelayMessage.NumberOfTypes];
 			_lastMessageTimes = new double[RelayMessage.NumberOfTypes];
 			_averageMessageTimes = new double[RelayMessage.NumberOfTypes];
@@ -78,7 +103,9 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				_messageBurstLength = forwardingConfig.MessageBurstLength;
 				_messageBurstTimeout = forwardingConfig.MessageBurstTimeout;
 				_messageBurstTimeoutSpan = TimeSpan.FromMilliseconds(_messageBurstTimeout);
-				MessageErrorQueue = new MessageQueue(ownerGroup.GetQueueConfig());
+				SetBurstController(forwardingConfig);
+				SetConcurrencyLimiter(forwardingConfig);
+				MessageErrorQueue = new MessageQueue(ownerGroup.GetQueueConfig(), GetPersistedQueueName());
 				_repostMessageLists = forwardingConfig.RepostMessageLists;
 			}
 
@@ -157,17 +184,64 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return -1;
 		}
 
+		private void SetBurstController(ForwardingConfig forwardingConfig)
+		{
+			if (forwardingConfig.MessageBurstLatencyTarget > 0)
+			{
+				_burstController = new BurstController(forwardingConfig.MessageBurstLatencyTarget);
+			}
+			else
+			{
+				_burstController = null;
+			}
+		}
+
+		private void SetConcurrencyLimiter(ForwardingConfig forwardingConfig)
+		{
+			_concurrencyLimitWait = forwardingConfig.ConcurrencyLimitWaitMilliseconds;
+			_maximumDeferredInMessages = forwardingConfig.MaximumDeferredInMessages;
+			if (forwardingConfig.MaximumConcurrencyLimit <= 0)
+			{
+				_concurrencyLimiter = null;
+			}
+			else if (_concurrencyLimiter == null || _concurrencyLimiter.MaximumLimit != forwardingConfig.MaximumConcurrencyLimit)
+			{
+				_concurrencyLimiter = new ConcurrencyLimiter(forwardingConfig.MaximumConcurrencyLimit);
+			}
+		}
+
+		/// <summary>
+		/// The number of messages to gather into the next burst.
+		/// </summary>
+		private int BurstLength
+		{
+			get
+			{
+				BurstController burstController = _burstController;
+				return burstController != null ? burstController.Length : _messageBurstLength;
+			}
+		}
+
 		private void ActivateBurstReceive(int count)
+		{
+			ActivateBurstReceive(count, false);
+		}
+
+		/// <param name="count">The number of messages to gather.</param>
+		/// <param name="afterTimeout">True if the messages have already arrived, after a burst timed out.</param>
+		private void ActivateBurstReceive(int count, bool afterTimeout)
 		{
 			try
 			{
 				if (_receivesActive)
 				{
+					BurstController burstController = _burstController;
 					if (count > 1)
 					{
 						Port<DateTime> timeoutPort = new Port<DateTime>();
 						//post a message to the timeoutPort if the burstTimeout is exceeded without receiving enough messages
-						_inMessageQueue.EnqueueTimer(_messageBurstTimeoutSpan, timeoutPort);
+						_inMessageQueue.EnqueueTimer(burstController != null ? burstController.Timeout : _messageBurstTimeoutSpan, timeoutPort);
+						long activatedAt = afterTimeout ? 0 : Stopwatch.GetTimestamp();
 						// activate the Arbiter/Receive channels.
 						Arbiter.Activate(
 							_inMessageQueue,
@@ -176,17 +250,30 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 								Arbiter.MultipleItemReceive<SerializedRelayMessage>(false, _serializedMessagePort, count,
 								delegate(SerializedRelayMessage[] messages)
 								{
-									// already in a queue, no point in skipping it
-									DoHandleInMessages(messages, false);
-									ActivateBurstReceive(_messageBurstLength);
+									if (burstController != null)
+									{
+										HandleBurst(burstController, messages, activatedAt);
+									}
+									else
+									{
+										// already in a queue, no point in skipping it
+										DoHandleInMessages(messages, false);
+									}
+									ActivateBurstReceive(BurstLength);
 								}),
 							//we did not get enough messages, use the TimeoutHandler
 								Arbiter.Receive<DateTime>(false, timeoutPort,
 									date =>
-										ActivateBurstReceive(
-											(_serializedMessagePort.ItemCount < _messageBurstLength)
-												? _serializedMessagePort.ItemCount
-												: _messageBurstLength))
+									{
+										int received = _serializedMessagePort.ItemCount;
+										if (burstController != null)
+										{
+											burstController.BurstTimedOut(received);
+										}
+										int burstLength = BurstLength;
+										//the messages that did arrive are sent as they are, however many fit in a burst now
+										ActivateBurstReceive(Math.Min(received, burstLength), true);
+									})
 							)
 						);
 					}
@@ -196,8 +283,15 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 							Arbiter.Receive<SerializedRelayMessage>(false, _serializedMessagePort,
 								message =>
 								{
-									DoHandleMessage(message);
-									ActivateBurstReceive(_messageBurstLength);
+									if (burstController != null)
+									{
+										HandleBurst(burstController, message);
+									}
+									else
+									{
+										DoHandleMessage(message);
+									}
+									ActivateBurstReceive(BurstLength);
 								}));
 					}
 				}
@@ -210,6 +304,38 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 		}
 
+		/// <summary>
+		/// Sends a burst of messages and records it with the burst controller.
+		/// </summary>
+		/// <param name="activatedAt">The Stopwatch timestamp the burst started being gathered at,
+		/// or 0 if it was taken after a timeout.</param>
+		private void HandleBurst(BurstController burstController, SerializedRelayMessage[] messages, long activatedAt)
+		{
+			long sendStart = Stopwatch.GetTimestamp();
+			// already in a queue, no point in skipping it
+			DoHandleInMessages(messages, false);
+			long sendEnd = Stopwatch.GetTimestamp();
+			burstController.BurstSent(messages.Length,
+				activatedAt > 0 ? sendStart - activatedAt : 0,
+				GetWaitTicks(messages[0], sendStart),
+				sendEnd - sendStart,
+				_serializedMessagePort.ItemCount);
+		}
+
+		private void HandleBurst(BurstController burstController, SerializedRelayMessage message)
+		{
+			long sendStart = Stopwatch.GetTimestamp();
+			DoHandleMessage(message);
+			long sendEnd = Stopwatch.GetTimestamp();
+			burstController.BurstSent(1, 0, GetWaitTicks(message, sendStart), sendEnd - sendStart,
+				_serializedMessagePort.ItemCount);
+		}
+
+		private static long GetWaitTicks(SerializedRelayMessage message, long sendStart)
+		{
+			return (message != null && message.EnteredCurrentSystemAt > 0) ? sendStart - message.EnteredCurrentSystemAt : 0;
+		}
+
 		internal void ReloadMapping(RelayNodeDefinition relayNodeDefinition, ForwardingConfig forwardingConfig)
 		{
 			NodeDefinition = relayNodeDefinition;
@@ -225,10 +351,12 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				DetectedZone = 0;
 			}
 			_messageBurstTimeoutSpan = TimeSpan.FromMilliseconds(_messageBurstTimeout);
+			SetBurstController(forwardingConfig);
+			SetConcurrencyLimiter(forwardingConfig);
 
 			if (MessageErrorQueue == null)
 			{
-				MessageErrorQueue = new MessageQueue(NodeGroup.GetQueueConfig());
+				MessageErrorQueue = new MessageQueue(NodeGroup.GetQueueConfig(), GetPersistedQueueName());
 			}
 			else
 			{
@@ -562,14 +690,49 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		internal void HandleOutMessage(RelayMessage message)
 		{
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null && !concurrencyLimiter.TryAcquire(_concurrencyLimitWait))
+			{
+				message.SetError(RelayErrorType.NodeOverloaded);
+				return;
+			}
 			// out messages are always sync
 			// use false / false for useSyncForInMessages / skipErrorQueueForSync
-			DoHandleMessage(message, false, false);
+			long startTicks = BeginOutMessage();
+			bool handled = false;
+			try
+			{
+				DoHandleMessage(message, false, false);
+				handled = true;
+			}
+			finally
+			{
+				long replyTicks = EndOutMessage(startTicks);
+				if (concurrencyLimiter != null)
+				{
+					concurrencyLimiter.Release(handled && IsRoundTrip(message) ? replyTicks : 0);
+				}
+			}
 		}
 
 		internal IAsyncResult BeginHandleOutMessage(RelayMessage message, AsyncCallback callback, object asyncState)
 		{
-			return BeginDoHandleMessage(message, false, false, callback, asyncState);
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null && !concurrencyLimiter.TryAcquire(_concurrencyLimitWait))
+			{
+				message.SetError(RelayErrorType.NodeOverloaded);
+				return NodeSynchronousAsyncResult.CreateAndComplete(true, callback, asyncState);
+			}
+			long startTicks = BeginOutMessage();
+			return BeginDoHandleMessage(message, false, false, asyncResult =>
+			{
+				long replyTicks = EndOutMessage(startTicks);
+				if (concurrencyLimiter != null)
+				{
+					concurrencyLimiter.Release(IsRoundTrip(message) ? replyTicks : 0);
+				}
+				if (callback != null) callback(asyncResult);
+			}, asyncState);
 		}
 
 		internal void EndHandleOutMessage(IAsyncResult asyncResult)
@@ -603,6 +766,20 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				EnqueueInMessages(messages);
 				return true;
 			}
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null && !concurrencyLimiter.TryAcquire(0))
+			{
+				//the node has all it should take for now, and waiting for it would hold up the dispatcher thread
+				if (skipErrorQueueForSync)
+				{
+					return false;
+				}
+				if (!TryDeferInMessages(new List<SerializedRelayMessage>(messages), 0))
+				{
+					EnqueueInMessages(messages);
+				}
+				return true;
+			}
 
 			bool messagesHandled = true;
 
@@ -619,6 +796,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					_transport.SendInMessageList(messages);
 				}
+				RecordInLag(messages);
 				NodeManager.Instance.Counters.CountInMessages(messages);
 			}
 			catch (Exception ex)
@@ -634,6 +812,13 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				InstrumentException(ex);
 				NodeGroup.LogNodeInMessageException(messages, this, ex);
 			}
+			finally
+			{
+				if (concurrencyLimiter != null)
+				{
+					concurrencyLimiter.Release(0);
+				}
+			}
 
 			return messagesHandled;
 		}
@@ -655,6 +840,12 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		/// skipErrorQueueForSync = true	returns true if the message processing succeeded
 		/// </returns>
 		internal bool DoHandleInMessages(List<SerializedRelayMessage> messages, bool skipErrorQueueForSync)
+		{
+			return DoHandleInMessages(messages, skipErrorQueueForSync, 0);
+		}
+
+		/// <param name="retries">How many times the messages have been turned away by the concurrency limit.</param>
+		private bool DoHandleInMessages(List<SerializedRelayMessage> messages, bool skipErrorQueueForSync, int retries)
 		{
 			if (!Activated)
 			{
@@ -669,6 +860,20 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				EnqueueMessages(messages);
 				return true;
 			}
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null && !concurrencyLimiter.TryAcquire(0))
+			{
+				//the node has all it should take for now, and waiting for it would hold up the dispatcher thread
+				if (skipErrorQueueForSync)
+				{
+					return false;
+				}
+				if (!TryDeferInMessages(messages, retries))
+				{
+					EnqueueMessages(messages);
+				}
+				return true;
+			}
 
 			bool messagesHandled = true;
 
@@ -685,6 +890,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					_transport.SendInMessageList(messages);
 				}
+				RecordInLag(messages);
 				
 				NodeManager.Instance.Counters.CountInMessages(messages);
 			}
@@ -701,6 +907,13 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				InstrumentException(ex);
 				NodeGroup.LogNodeInMessageException(messages, this, ex);
 			}
+			finally
+			{
+				if (concurrencyLimiter != null)
+				{
+					concurrencyLimiter.Release(0);
+				}
+			}
 
 			return messagesHandled;
 		}
@@ -717,6 +930,18 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				}
 				return;
 			}
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			//lists may be sent from the out message dispatcher, whose threads mustn't wait
+			if (concurrencyLimiter != null && !concurrencyLimiter.TryAcquire(0))
+			{
+				for (int i = 0; i < messages.Count; i++)
+				{
+					messages[i].SetError(RelayErrorType.NodeOverloaded);
+				}
+				return;
+			}
+			//a list's reply time says little about a single message's, so only its presence counts
+			Interlocked.Add(ref _outstandingOutMessages, messages.Count);
 			try
 			{
 				if (GatherStats)
@@ -742,6 +967,14 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				}
 				NodeGroup.LogNodeOutMessageException(messages, this, ex);
 			}
+			finally
+			{
+				Interlocked.Add(ref _outstandingOutMessages, -messages.Count);
+				if (concurrencyLimiter != null)
+				{
+					concurrencyLimiter.Release(0);
+				}
+			}
 		}
 
 		/// <summary>
@@ -783,6 +1016,38 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return true;
 		}
 
+		/// <summary>
+		/// Holds in messages turned away by the concurrency limit for a retry on the in message
+		/// dispatcher after <see cref="ForwardingConfig.ConcurrencyLimitWaitMilliseconds"/>, rather than
+		/// error queueing them at once or blocking a dispatcher thread until the node has room.
+		/// </summary>
+		/// <param name="retries">How many times the messages have been turned away already.</param>
+		/// <returns>False if they have been retried enough or too many messages are held already,
+		/// and they should be error queued.</returns>
+		private bool TryDeferInMessages(List<SerializedRelayMessage> messages, int retries)
+		{
+			if (retries >= _maximumInRetries || !_receivesActive)
+			{
+				return false;
+			}
+			if (Interlocked.Add(ref _deferredInMessages, messages.Count) > _maximumDeferredInMessages)
+			{
+				Interlocked.Add(ref _deferredInMessages, -messages.Count);
+				return false;
+			}
+			DispatcherQueue inMessageQueue = _inMessageQueue;
+			Port<DateTime> retryPort = new Port<DateTime>();
+			inMessageQueue.EnqueueTimer(TimeSpan.FromMilliseconds(Math.Max(1, _concurrencyLimitWait)), retryPort);
+			Arbiter.Activate(inMessageQueue,
+				Arbiter.Receive<DateTime>(false, retryPort,
+					date =>
+					{
+						Interlocked.Add(ref _deferredInMessages, -messages.Count);
+						DoHandleInMessages(messages, false, retries + 1);
+					}));
+			return true;
+		}
+
 		internal void PostOutMessages(MessagesWithLock messagesWithLock)
 		{
 			_outMessagesPort.Post(messagesWithLock);
@@ -1008,6 +1273,76 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			Interlocked.Exchange(ref _averageBulkInMessageTime, CalculateAverage(_averageBulkInMessageTime, _lastBulkInMessageTime, _bulkInMessageCount));
 		}
 
+		private int _outstandingOutMessages; //two way messages sent here and not yet answered
+		private long _averageOutTicks; //moving average Stopwatch ticks to answer a two way message
+		private const int _outTicksWeight = 8; //each reply moves the average 1/8 of the way to it
+
+		/// <summary>
+		/// Compares nodes for two way messages: the average reply time scaled by the messages
+		/// already waiting on this node. A node without replies yet costs nothing, so it is tried.
+		/// A node at its concurrency limit costs the most, so the message spills to another.
+		/// </summary>
+		internal long SelectionCost
+		{
+			get
+			{
+				ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+				if (concurrencyLimiter != null && concurrencyLimiter.Full)
+				{
+					return long.MaxValue;
+				}
+				return Interlocked.Read(ref _averageOutTicks) * (_outstandingOutMessages + 1);
+			}
+		}
+
+		/// <summary>
+		/// Whether <paramref name="message"/> went to the node and back without error, so its
+		/// reply time says how loaded the node is.
+		/// </summary>
+		private static bool IsRoundTrip(RelayMessage message)
+		{
+			return !message.ErrorOccurred && message.ResultOutcome != RelayOutcome.NotSent
+				&& message.ResultOutcome != RelayOutcome.Error;
+		}
+
+		private long BeginOutMessage()
+		{
+			Interlocked.Increment(ref _outstandingOutMessages);
+			return Stopwatch.GetTimestamp();
+		}
+
+		/// <returns>The Stopwatch ticks the message took.</returns>
+		private long EndOutMessage(long startTicks)
+		{
+			Interlocked.Decrement(ref _outstandingOutMessages);
+			long sample = Stopwatch.GetTimestamp() - startTicks;
+			NodeGroup.OutLatencies.Record(sample);
+			long average = Interlocked.Read(ref _averageOutTicks);
+			//racing replies may drop each other's samples, which a moving average can afford
+			Interlocked.Exchange(ref _averageOutTicks, average == 0 ? sample : average + (sample - average) / _outTicksWeight);
+			return sample;
+		}
+
+		private long _averageInLagTicks; //moving average Stopwatch ticks from a one way message arriving here to it being sent on
+
+		/// <summary>
+		/// Records how long sent one way messages waited on this hop, from arriving at this server
+		/// to being sent to the node, so replicas relayed along a chain or tree can be watched for lag.
+		/// </summary>
+		private void RecordInLag(IList<SerializedRelayMessage> messages)
+		{
+			long now = Stopwatch.GetTimestamp();
+			for (int i = 0; i < messages.Count; i++)
+			{
+				if (messages[i].EnteredCurrentSystemAt > 0)
+				{
+					long sample = now - messages[i].EnteredCurrentSystemAt;
+					long average = Interlocked.Read(ref _averageInLagTicks);
+					Interlocked.Exchange(ref _averageInLagTicks, average == 0 ? sample : average + (sample - average) / _outTicksWeight);
+				}
+			}
+		}
+
 		private static double CalculateAverage(double baseLine, double newSample, double iterations)
 		{
 			return ((baseLine * (iterations - 1)) + newSample) / iterations;
@@ -1107,6 +1442,25 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			_transport.GetConnectionStats(out openConnections, out activeConnections);
 			NodeGroup.AddPropertyLine(sb, "Active/Open Connections", activeConnections + " / " + openConnections);
 			NodeGroup.AddPropertyLine(sb, "Gathering Stats", GatherStats.ToString());
+			NodeGroup.AddPropertyLine(sb, "Avg Reply Time (ms)", Interlocked.Read(ref _averageOutTicks) * 1000.0 / Stopwatch.Frequency, 3);
+			NodeGroup.AddPropertyLine(sb, "Outstanding Out Messages", _outstandingOutMessages, 0);
+			NodeGroup.AddPropertyLine(sb, "Avg Hop Lag (ms)", Interlocked.Read(ref _averageInLagTicks) * 1000.0 / Stopwatch.Frequency, 3);
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null)
+			{
+				NodeGroup.AddPropertyLine(sb, "Concurrency Limit", concurrencyLimiter.Limit, 0);
+				NodeGroup.AddPropertyLine(sb, "Concurrent Requests", concurrencyLimiter.Outstanding, 0);
+				NodeGroup.AddPropertyLine(sb, "Rejected for Concurrency", concurrencyLimiter.Rejected, 0);
+				NodeGroup.AddPropertyLine(sb, "Deferred In Messages", _deferredInMessages, 0);
+			}
+			BurstController burstController = _burstController;
+			if (burstController != null)
+			{
+				NodeGroup.AddPropertyLine(sb, "Burst Length", burstController.Length, 0);
+				NodeGroup.AddPropertyLine(sb, "Burst Timeout (ms)", burstController.Timeout.TotalMilliseconds, 3);
+				NodeGroup.AddPropertyLine(sb, "Avg Messages per Burst", burstController.AverageBurstLength, 1);
+				NodeGroup.AddPropertyLine(sb, "Avg Burst Wait (ms)", burstController.AverageWaitMilliseconds, 3);
+			}
 
 			if (_serverUnreachableErrors > 0)
 			{
@@ -1127,6 +1481,15 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				NodeGroup.AddPropertyLine(sb, "Queued Messages", MessageErrorQueue.InMessageQueueCount, 0);
 			}
 
+			PersistedMessageQueue persistedQueue = MessageErrorQueue != null ? MessageErrorQueue.PersistedQueue : null;
+			if (persistedQueue != null && persistedQueue.Written > 0)
+			{
+				NodeGroup.AddPropertyLine(sb, "Persisted Queue Size (KB)", persistedQueue.Bytes / 1024.0, 0);
+				NodeGroup.AddPropertyLine(sb, "Persisted Messages Written", persistedQueue.Written, 0);
+				NodeGroup.AddPropertyLine(sb, "Persisted Messages Read", persistedQueue.Read, 0);
+				NodeGroup.AddPropertyLine(sb, "Persisted Messages Dropped", persistedQueue.Dropped, 0);
+			}
+
 			if (GatherStats)
 			{
 				string messageType;
@@ -1227,6 +1590,34 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				nodeStatus.InMessageQueueCount = MessageErrorQueue.InMessageQueueCount;
 			}
 
+			nodeStatus.AverageHopLag = Interlocked.Read(ref _averageInLagTicks) * 1000.0 / Stopwatch.Frequency;
+
+			ConcurrencyLimiter concurrencyLimiter = _concurrencyLimiter;
+			if (concurrencyLimiter != null)
+			{
+				nodeStatus.ConcurrencyLimit = concurrencyLimiter.Limit;
+				nodeStatus.ConcurrentRequests = concurrencyLimiter.Outstanding;
+				nodeStatus.RejectedForConcurrency = concurrencyLimiter.Rejected;
+				nodeStatus.DeferredInMessages = _deferredInMessages;
+			}
+
+			BurstController burstController = _burstController;
+			if (burstController != null)
+			{
+				nodeStatus.BurstLength = burstController.Length;
+				nodeStatus.AverageMessagesPerBurst = burstController.AverageBurstLength;
+				nodeStatus.AverageBurstWait = burstController.AverageWaitMilliseconds;
+			}
+
+			PersistedMessageQueue persistedQueue = MessageErrorQueue != null ? MessageErrorQueue.PersistedQueue : null;
+			if (persistedQueue != null)
+			{
+				nodeStatus.PersistedQueueBytes = persistedQueue.Bytes;
+				nodeStatus.PersistedMessagesWritten = persistedQueue.Written;
+				nodeStatus.PersistedMessagesRead = persistedQueue.Read;
+				nodeStatus.PersistedMessagesDropped = persistedQueue.Dropped;
+			}
+
 			if (GatherStats)
 			{
 				string messageType;
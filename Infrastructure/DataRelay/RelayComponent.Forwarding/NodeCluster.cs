@@ -10,15 +10,12 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 {
 	internal class NodeCluster
 	{
-		internal Node ChosenNode;
-		private readonly object _chooseLock = new object();
+		internal Node ChosenNode; //where one way messages and error queues go, see GetChosenNode
 
 		internal Node Me; //The server the code is running on
 
 		// Nodes organized by their designated Zones
 		internal Dictionary<ushort, List<Node>> ZoneNodes = new Dictionary<ushort, List<Node>>();
-		internal Dictionary<ushort, Node> ChosenZoneNodes = new Dictionary<ushort, Node>();
-		private readonly object _chooseZoneNodeLock = new object();
 
 		internal List<Node> Nodes = new List<Node>(); //All nodes in the cluster EXCEPT "Me"
 		internal readonly int   MaximumHops = 10; //the maximum number of hops to consider for network topography mapping. > this will all be treated as == this
@@ -31,11 +28,15 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		private List<Node>[]    _nodeLayers; //NodesByNumberOfHops composed into layers based on selection window size
 		private List<Node>[]    _nodesByDetectedZone; //Divided using detectedZone, based on the zonedefinition node instead of the per-node zone definition
 		private bool            _mapNetwork = true;
+		private int             _replicationFanOut; //0 to replicate to every node directly
+		private volatile ZoneRoutes _zoneRoutes; //ZoneNodes and the replication tree arranged for in system one way messages
 		private ushort          _localZone; //determined by local ip address and zone definition config, NOT the zone on the node
 		private ZoneDefinitionCollection _zoneDefinitions; //kept around just to see if it's changed during a config reload        
 		private readonly RelayNodeClusterDefinition _clusterDefinition;
 		private int _minimumId, _maximumId;
 		private readonly bool _meInThisCluster;
+		private long _routedKeys; //messages routed here by id, for the cluster's share of its group's keys
+		private long _movedKeys; //keys copied here from their previous cluster while the group migrates
 		
 		/// <summary>
 		/// Returns TRUE if the calling node is contained in the cluster.
@@ -48,6 +49,33 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			get { return _meInThisCluster; }
 		}
 
+		/// <summary>
+		/// The number of messages routed to this cluster by their id.
+		/// </summary>
+		internal long RoutedKeys
+		{
+			get { return System.Threading.Interlocked.Read(ref _routedKeys); }
+		}
+
+		/// <summary>
+		/// The number of keys copied to this cluster from the cluster that held them before its
+		/// group's number of clusters changed.
+		/// </summary>
+		internal long MovedKeys
+		{
+			get { return System.Threading.Interlocked.Read(ref _movedKeys); }
+		}
+
+		internal void CountRoutedKey()
+		{
+			System.Threading.Interlocked.Increment(ref _routedKeys);
+		}
+
+		internal void CountMovedKey()
+		{
+			System.Threading.Interlocked.Increment(ref _movedKeys);
+		}
+
 		internal static string GetQueueNameFor(RelayNodeClusterDefinition definition)
 		{
 			StringBuilder sb = new StringBuilder();
@@ -73,6 +101,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			RelayNodeDefinition meDefinition = nodeConfig.GetMyNode();
 			_meInThisCluster = false;
 			_mapNetwork = forwardingConfig.MapNetwork;
+			_replicationFanOut = forwardingConfig.ReplicationFanOut;
 			_localZone = nodeConfig.GetLocalZone();
 			_zoneDefinitions = nodeConfig.RelayNodeMapping.ZoneDefinitions;
 			foreach (RelayNodeDefinition nodeDefinition in clusterDefinition.RelayNodes)
@@ -129,6 +158,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			_nodesByNumberOfHops = CalculateTopography(Nodes, MaximumHops);
 			_nodeLayers = CalculateNodeLayers(_nodesByNumberOfHops, NodeSelectionHopWindowSize);
 			_nodesByDetectedZone = CalculateNodesByDetectedZone(Nodes, maxDetectedZone);
+			BuildZoneRoutes();
 		}
 
 		#region Node Mapping 
@@ -238,6 +268,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			_minimumId = relayNodeClusterDefinition.MinId;
 			_maximumId = relayNodeClusterDefinition.MaxId;
 			_mapNetwork = forwardingConfig.MapNetwork;
+			bool fanOutChanged = _replicationFanOut != forwardingConfig.ReplicationFanOut;
+			_replicationFanOut = forwardingConfig.ReplicationFanOut;
 			
 			//figure out if anything changed. if it did, rebuild
 			
@@ -378,11 +410,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				_nodesByNumberOfHops = CalculateTopography(Nodes, MaximumHops);                
 				_nodeLayers = CalculateNodeLayers(_nodesByNumberOfHops, NodeSelectionHopWindowSize);
 				_nodesByDetectedZone = CalculateNodesByDetectedZone(Nodes, maxDetectedZone);
-				lock (_chooseLock)
-				{
-					ChosenNode = null;
-				}
-				ChosenZoneNodes = new Dictionary<ushort, Node>();
+				ChosenNode = null;
+				BuildZoneRoutes();
 			}
 			else
 			{	
@@ -406,13 +435,33 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						Nodes[(hitMe ? i - 1 : i)].ReloadMapping(relayNodeClusterDefinition.RelayNodes[i],forwardingConfig);						
 					}
 				}
-				lock (_chooseLock)
+				ChosenNode = null;
+				if (fanOutChanged)
 				{
-					ChosenNode = null;
+					BuildZoneRoutes();
 				}
 			}
 		}
 
+		/// <summary>
+		/// Arranges <see cref="ZoneNodes"/> for routing, with the replication tree of this node's zone,
+		/// and publishes them together.
+		/// </summary>
+		private void BuildZoneRoutes()
+		{
+			ushort myZone = Me != null ? Me.NodeDefinition.Zone : (ushort)0;
+			ReplicationTree tree = null;
+			List<Node> myZoneNodes;
+			if (_replicationFanOut > 0 && Me != null && ZoneNodes.TryGetValue(myZone, out myZoneNodes))
+			{
+				tree = ReplicationTree.Create(Me, myZoneNodes, _replicationFanOut);
+				if (tree == null && _log.IsWarnEnabled)
+					_log.WarnFormat("Nodes of zone {0} in group {1} share addresses, replicating to each directly.",
+						myZone, _nodeGroup.GroupName);
+			}
+			_zoneRoutes = new ZoneRoutes(ZoneNodes, myZone, tree);
+		}
+
 		private bool ContainsNode(RelayNodeDefinition nodeDefinition)
 		{
 			if (Me != null && Me.ToString() == nodeDefinition.ToString())
@@ -433,6 +482,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		#region Node Selection
 
+		/// <summary>
+		/// Returns the node one way messages go to, choosing another when it is missing or unhealthy.
+		/// The choice sticks so that messages to the cluster gather in one node's queue.
+		/// </summary>
 		private Node GetChosenNode()
 		{
 			
@@ -441,57 +494,173 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				return null;
 			}
 			Node chosenNode = ChosenNode;
-			//could potentially be nulled here, after selection made, 
-			//in that case it wouldn't be re-chosen. that's ok, it will be next time
 			if (chosenNode == null || !chosenNode.Activated || chosenNode.DangerZone)
 			{
-				lock (_chooseLock)
-				{   
-					if (ChosenNode == null || !ChosenNode.Activated || ChosenNode.DangerZone)
-					{
-						if (_mapNetwork || _nodesByDetectedZone == null)
-						{
-							chosenNode = SelectANodeIncrementally(_nodeLayers, Randomizer);
-						}
-						else
-						{
-							chosenNode = SelectANodeByZone(_nodesByDetectedZone, Randomizer, _localZone);
-						}
-						ChosenNode = chosenNode; 
-					}
+				Node selectedNode;
+				if (_mapNetwork || _nodesByDetectedZone == null)
+				{
+					selectedNode = SelectANodeIncrementally(_nodeLayers, Randomizer);
+				}
+				else
+				{
+					selectedNode = SelectANodeByZone(_nodesByDetectedZone, Randomizer, _localZone);
 				}
-				//even if ChosenNode is nulled out before we can return,
-				//the local variable will already have a node so we 
-				//won't falsely return null
+				//if another thread replaced the stale choice first, its choice stands
+				Node previousNode = System.Threading.Interlocked.CompareExchange(ref ChosenNode, selectedNode, chosenNode);
+				chosenNode = (previousNode == chosenNode || previousNode == null) ? selectedNode : previousNode;
 			}
 			
 			return chosenNode; 
 		}
 
-		private Node GetChosenZoneNode(ushort Zone)
+		/// <summary>
+		/// Chooses the node for one two way message: the better of two random healthy nodes
+		/// in the nearest hop layer, or the local zone, that has any. A node is better when its
+		/// average reply time, scaled by the messages it already has outstanding, is lower.
+		/// </summary>
+		private Node ChooseNodeForRequest()
 		{
-			Node chosenNode = null;
+			List<Node>[] nodesByDetectedZone = _nodesByDetectedZone;
+			Node candidate;
+			if (_mapNetwork || nodesByDetectedZone == null)
+			{
+				List<Node>[] nodeLayers = _nodeLayers;
+				for (int windex = 0; windex < nodeLayers.Length; windex++)
+				{
+					candidate = ChooseBetterOfTwo(nodeLayers[windex], Randomizer);
+					if (candidate != null)
+					{
+						return candidate;
+					}
+				}
+				return null;
+			}
 
-			if (!ChosenZoneNodes.ContainsKey(Zone) || ChosenZoneNodes[Zone] == null || ChosenZoneNodes[Zone].DangerZone)
+			if (_localZone > 0 && _localZone < nodesByDetectedZone.Length)
 			{
-				lock (_chooseZoneNodeLock)
+				candidate = ChooseBetterOfTwo(nodesByDetectedZone[_localZone], Randomizer);
+				if (candidate != null)
 				{
-					if (!ChosenZoneNodes.ContainsKey(Zone) || ChosenZoneNodes[Zone] == null || ChosenZoneNodes[Zone].DangerZone)
+					return candidate;
+				}
+			}
+			//nothing healthy in the local zone, any other zone will do
+			return SelectANodeByZone(nodesByDetectedZone, Randomizer, _localZone);
+		}
+
+		/// <summary>
+		/// Chooses the node to hedge a slow two way message sent to <paramref name="primary"/>:
+		/// the healthy node other than it with the lowest selection cost, in the nearest hop layer,
+		/// or the local zone, that has one.
+		/// </summary>
+		/// <returns>The node, or null if the cluster has no other healthy node.</returns>
+		internal Node ChooseNodeForHedge(Node primary)
+		{
+			List<Node>[] nodesByDetectedZone = _nodesByDetectedZone;
+			Node candidate;
+			if (_mapNetwork || nodesByDetectedZone == null)
+			{
+				List<Node>[] nodeLayers = _nodeLayers;
+				for (int windex = 0; windex < nodeLayers.Length; windex++)
+				{
+					candidate = ChooseCheapestOtherNode(nodeLayers[windex], primary);
+					if (candidate != null)
 					{
-						chosenNode = SelectSafeNode(new List<Node>(ZoneNodes[Zone]), Randomizer);
-						ChosenZoneNodes[Zone] = chosenNode;
+						return candidate;
 					}
 				}
+				return null;
 			}
-			else
+
+			if (_localZone > 0 && _localZone < nodesByDetectedZone.Length)
+			{
+				candidate = ChooseCheapestOtherNode(nodesByDetectedZone[_localZone], primary);
+				if (candidate != null)
+				{
+					return candidate;
+				}
+			}
+			for (int zone = 0; zone < nodesByDetectedZone.Length; zone++)
 			{
-				chosenNode = ChosenZoneNodes[Zone];
+				if (zone != _localZone)
+				{
+					candidate = ChooseCheapestOtherNode(nodesByDetectedZone[zone], primary);
+					if (candidate != null)
+					{
+						return candidate;
+					}
+				}
 			}
+			return null;
+		}
 
-			return chosenNode;
+		private static Node ChooseCheapestOtherNode(IList<Node> candidates, Node excluded)
+		{
+			if (candidates == null)
+			{
+				return null;
+			}
+			Node cheapest = null;
+			long cheapestCost = 0;
+			for (int i = 0; i < candidates.Count; i++)
+			{
+				Node candidate = candidates[i];
+				if (candidate != excluded && candidate.Activated && !candidate.DangerZone)
+				{
+					long cost = candidate.SelectionCost;
+					if (cheapest == null || cost < cheapestCost)
+					{
+						cheapest = candidate;
+						cheapestCost = cost;
+					}
+				}
+			}
+			return cheapest;
 		}
 
-		private static Node SelectSafeNode(IList<Node> candidates, Random randomizer)
+		private static Node ChooseBetterOfTwo(IList<Node> candidates, Random randomizer)
+		{
+			if (candidates == null || candidates.Count == 0)
+			{
+				return null;
+			}
+			int count = candidates.Count;
+			int firstIndex = randomizer.Next(count);
+			Node first = candidates[firstIndex];
+			bool firstHealthy = first.Activated && !first.DangerZone;
+			if (count > 1)
+			{
+				int secondIndex = randomizer.Next(count - 1);
+				if (secondIndex >= firstIndex)
+				{
+					secondIndex++;
+				}
+				Node second = candidates[secondIndex];
+				if (second.Activated && !second.DangerZone)
+				{
+					if (!firstHealthy || second.SelectionCost < first.SelectionCost)
+					{
+						return second;
+					}
+				}
+			}
+			if (firstHealthy)
+			{
+				return first;
+			}
+			//neither pick was healthy, take the first healthy node after them
+			for (int i = 1; i < count; i++)
+			{
+				Node candidate = candidates[(firstIndex + i) % count];
+				if (candidate.Activated && !candidate.DangerZone)
+				{
+					return candidate;
+				}
+			}
+			return null;
+		}
+
+		internal static Node SelectSafeNode(IList<Node> candidates, Random randomizer)
 		{
 			Node candidate = null;
 			if (candidates != null && candidates.Count > 0)
@@ -572,34 +741,69 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		}
 
 
+		/// <summary>
+		/// Finds the nodes to relay an in system one way message to, if it entered this zone at
+		/// another node of the cluster and is being replicated down its replication tree.
+		/// </summary>
+		/// <remarks>
+		/// Copies relayed down the tree are told apart by their address history rather than by
+		/// <see cref="RelayMessage.RelayTTL"/>, which they arrive with spent, so components that
+		/// act only where a message enters the system, such as data tier forwarding, still see
+		/// them as relayed copies.
+		/// </remarks>
+		/// <returns>True if the message is being relayed down the tree, with the node's children
+		/// in <paramref name="nodes"/>.</returns>
+		internal bool TryGetTreeRelayNodes(RelayMessage message, out SimpleLinkedList<Node> nodes)
+		{
+			ReplicationTree tree = !message.IsTwoWayMessage ? _zoneRoutes.ReplicationTree : null;
+			if (tree == null)
+			{
+				nodes = new SimpleLinkedList<Node>();
+				return false;
+			}
+			return TryGetTreeRelayNodes(tree, message, out nodes);
+		}
+
+		private static bool TryGetTreeRelayNodes(ReplicationTree tree, RelayMessage message, out SimpleLinkedList<Node> nodes)
+		{
+			nodes = new SimpleLinkedList<Node>();
+			int origin = tree.FindOrigin(message.AddressHistory);
+			if (origin < 0)
+			{
+				return false;
+			}
+			//relaying a message that entered the zone at another node, to this node's children only
+			if (origin != tree.MeIndex)
+			{
+				tree.AddChildren(origin, ref nodes);
+			}
+			return true;
+		}
+
 		private SimpleLinkedList<Node> SelectNodes(RelayMessage message)
 		{
 			SimpleLinkedList<Node> nodes;
+			ZoneRoutes zoneRoutes = _zoneRoutes;
 
-			if (ZoneNodes.ContainsKey(Me.NodeDefinition.Zone))
+			ReplicationTree tree = zoneRoutes.ReplicationTree;
+			if (tree != null)
 			{
-				// select all other nodes in the current zone if they exist
-				nodes = new SimpleLinkedList<Node>(ZoneNodes[Me.NodeDefinition.Zone]);
+				if (TryGetTreeRelayNodes(tree, message, out nodes))
+				{
+					return nodes;
+				}
+				tree.AddChildren(tree.MeIndex, ref nodes);
 			}
 			else
 			{
-				nodes = new SimpleLinkedList<Node>();
+				// select all other nodes in the current zone if they exist
+				nodes = zoneRoutes.GetMyZoneNodes();
 			}
 
 			if (message.SourceZone == Me.NodeDefinition.Zone)
 			{
 				// Add 1 node from each foreign zone
-				foreach (ushort zone in ZoneNodes.Keys)
-				{
-					if (zone != Me.NodeDefinition.Zone)
-					{
-						Node ZoneNode = GetChosenZoneNode(zone);
-						if (ZoneNode != null)
-						{
-							nodes.Push(ZoneNode);
-						}
-					}
-				}
+				zoneRoutes.AddForeignZoneNodes(ref nodes, Randomizer);
 			}
 	
 			return nodes;
@@ -607,33 +811,24 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		internal void ReselectNode()
 		{
-			lock (_chooseLock)
-			{
-				ChosenNode = null;
-			}
+			ChosenNode = null;
 		}
 
-		private Random randomizer;
-		private readonly object randomLock = new object();
-		private Random Randomizer
+		[ThreadStatic]
+		private static Random _randomizer;
+		private static int _randomSeed = (int)DateTime.Now.Ticks;
+		/// <summary>
+		/// A <see cref="Random"/> for the calling thread, since node selection takes no lock.
+		/// </summary>
+		private static Random Randomizer
 		{
 			get
 			{
-				if (randomizer == null)
+				if (_randomizer == null)
 				{
-					lock (randomLock)
-					{
-						if (randomizer == null)
-						{
-							Randomizer = new Random((int)DateTime.Now.Ticks);
-						}
-					}
+					_randomizer = new Random(System.Threading.Interlocked.Increment(ref _randomSeed));
 				}
-				return randomizer;
-			}
-			set
-			{
-				randomizer = value;
+				return _randomizer;
 			}
 		}
 
@@ -644,13 +839,9 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			
 			if (message.IsTwoWayMessage)
 			{
-				//messages that always go to a selected node
-				nodes = new SimpleLinkedList<Node>();
-				node = GetChosenNode();
-				if (node != null)
-				{
-					nodes.Push(node);
-				}
+				//messages that go to the better of two nodes, chosen per message
+				node = ChooseNodeForRequest();
+				nodes = node != null ? node.AsList() : new SimpleLinkedList<Node>();
 			}
 			else
 			{
@@ -659,12 +850,13 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				//  in system: to every other node
 				if (Me == null) //out of system
 				{
-					nodes = new SimpleLinkedList<Node>();
 					node = GetChosenNode();
-					if (node != null)
-					{
-						nodes.Push(node);
-					}
+					nodes = node != null ? node.AsList() : new SimpleLinkedList<Node>();
+				}
+				else if (IsReplicatedByChangeCapture(message))
+				{
+					// the change capture of the node storing it sends what it stored instead
+					nodes = new SimpleLinkedList<Node>();
 				}
 				else //in system
 				{
@@ -674,11 +866,45 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return nodes;
 		}
 
+		/// <summary>
+		/// Whether <paramref name="message"/> is a client's write of a type replicated by change
+		/// capture; see <see cref="TypeSetting.ReplicateByChangeCapture"/>.
+		/// </summary>
+		private bool IsReplicatedByChangeCapture(RelayMessage message)
+		{
+			if (message.IsCapturedChange || !message.OriginatesDirectlyFromClient(Me.NodeDefinition.Zone))
+			{
+				return false;
+			}
+			if (message.MessageType != MessageType.Save && message.MessageType != MessageType.Delete)
+			{
+				return false;
+			}
+			TypeSetting typeSetting = NodeManager.Instance.Config.TypeSettings.TypeSettingCollection[message.TypeId];
+			return typeSetting != null && typeSetting.ReplicateByChangeCapture;
+		}
+
 		internal bool ObjectInRange(int objectId)
 		{
 			return (objectId >= _minimumId && objectId <= _maximumId);
 		}
 
+		internal int MinimumId
+		{
+			get
+			{
+				return _minimumId;
+			}
+		}
+
+		internal int MaximumId
+		{
+			get
+			{
+				return _maximumId;
+			}
+		}
+
 		#endregion 
 
 		internal void GetHtmlStatus(StringBuilder statusBuilder)
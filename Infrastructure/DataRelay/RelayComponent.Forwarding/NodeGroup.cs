@@ -17,11 +17,15 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		internal List<NodeCluster> Clusters = new List<NodeCluster>(); //all of the clusters, including "MyCluster"
 		internal static int MaximumQueuedItems = 750000;
 		internal bool Activated;
+		internal readonly LatencyHistogram OutLatencies = new LatencyHistogram(); //reply times of the group's single two way messages
 
 		private static readonly LogWrapper _log = new LogWrapper();
 
 		private ForwardingConfig _forwardingConfig;
 		private bool _clusterByRange;
+		private bool _clusterByHash;
+		private volatile ClusterMap _clusterMap; //where ids go, replaced whole when Clusters or the placement changes
+		private readonly object _clusterMapLock = new object();
 		private readonly System.Threading.Timer _nodeReselectTimer;
 		private readonly System.Threading.TimerCallback _nodeReselectTimerCallback;
 		private int _nodeSelectionHopWindowSize = 1;
@@ -55,6 +59,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			GroupDefinition = groupDefinition;
 			Activated = groupDefinition.Activated;
 			_clusterByRange = groupDefinition.UseIdRanges;
+			_clusterByHash = groupDefinition.UseConsistentHashing;
 			_forwardingConfig = forwardingConfig;
 			NodeSelectionHopWindowSize = groupDefinition.NodeSelectionHopWindowSize;
 			RelayNodeClusterDefinition myClusterDefinition = NodeManager.Instance.GetMyNodeClusterDefinition();
@@ -68,6 +73,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				}
 				Clusters.Add(nodeCluster);
 			}
+			SetClusterMap(0, DateTime.MinValue);
 
 			_nodeReselectTimerCallback = new System.Threading.TimerCallback(NodeReselectTimer_Elapsed);
 			if (_nodeReselectTimer == null)
@@ -90,7 +96,12 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			RelayNodeClusterDefinition myClusterDefinition = newConfig.GetMyCluster();
 			Activated = groupDefinition.Activated;
 			GroupDefinition = groupDefinition;
+			bool wasClusterByHash = _clusterByHash && !_clusterByRange;
+			//a migration under way carries on unless the number of clusters changes again
+			int previousClusterCount = _clusterMap.PreviousClusterCount;
+			DateTime migrationEnds = _clusterMap.MigrationEnds;
 			_clusterByRange = groupDefinition.UseIdRanges;
+			_clusterByHash = groupDefinition.UseConsistentHashing;
 			_forwardingConfig = newForwardingConfig;
 			NodeSelectionHopWindowSize = groupDefinition.NodeSelectionHopWindowSize;
 			if (groupDefinition.RelayNodeClusters.Length == Clusters.Count)
@@ -130,12 +141,37 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 					}
 					newClusters.Add(nodeCluster);
 				}
+				if (wasClusterByHash && _clusterByHash && !_clusterByRange && groupDefinition.MigrationMinutes > 0)
+				{
+					if (_log.IsInfoEnabled)
+						_log.InfoFormat("Group {0} migrating from {1} to {2} clusters for {3} minutes.",
+							GroupName, Clusters.Count, newClusters.Count, groupDefinition.MigrationMinutes);
+					migrationEnds = DateTime.Now.AddMinutes(groupDefinition.MigrationMinutes);
+					previousClusterCount = Clusters.Count;
+				}
+				else
+				{
+					previousClusterCount = 0;
+				}
 				Clusters = newClusters;
 				MyCluster = myCluster;
 			}
+			SetClusterMap(previousClusterCount, migrationEnds);
 			_nodeReselectTimer.Change(NodeReselectIntervalMilliseconds, NodeReselectIntervalMilliseconds);
 		}
 
+		private void SetClusterMap(int previousClusterCount, DateTime migrationEnds)
+		{
+			ClusterMap clusterMap = ClusterMap.Create(Clusters, _clusterByRange, _clusterByHash,
+				previousClusterCount, migrationEnds);
+			if (clusterMap.RangesOverlap && _log.IsWarnEnabled)
+				_log.WarnFormat("Clusters of group {0} have overlapping id ranges, ids will be routed to the first cluster holding them.", GroupName);
+			lock (_clusterMapLock)
+			{
+				_clusterMap = clusterMap;
+			}
+		}
+
 		private void NodeReselectTimer_Elapsed(object state)
 		{
 			ReselectNodes();
@@ -172,38 +208,58 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			{
 				return MyCluster;
 			}
-			int clusterIndex;
-			if (_clusterByRange)
-			{
-				clusterIndex = GetRangedIndex(objectId);
-			}
-			else
-			{
-				clusterIndex = GetModdedIndex(objectId);
-			}
-			if (clusterIndex >= 0)
+			NodeCluster cluster = _clusterMap.GetCluster(objectId);
+			if (cluster != null)
 			{
-				return Clusters[clusterIndex];
+				cluster.CountRoutedKey();
 			}
-			return null;
+			return cluster;
 		}
 
-		private int GetRangedIndex(int objectId)
+		/// <summary>
+		/// While the group is migrating after its number of clusters changed, finds the cluster
+		/// that held <paramref name="objectId"/> before, if it is not the one that holds it now.
+		/// </summary>
+		/// <returns>True if the id has moved and its previous cluster is still in the group.</returns>
+		internal bool TryGetMigration(int objectId, out NodeCluster previousCluster, out NodeCluster currentCluster)
 		{
-			for (int i = 0; i < Clusters.Count; i++)
+			previousCluster = null;
+			currentCluster = null;
+			ClusterMap clusterMap = _clusterMap;
+			if (!clusterMap.Migrating || MyCluster != null)
 			{
-				if (Clusters[i].ObjectInRange(objectId))
+				return false;
+			}
+			if (DateTime.Now > clusterMap.MigrationEnds)
+			{
+				lock (_clusterMapLock)
 				{
-					return i;
+					//a reload since then has already replaced the map
+					if (_clusterMap == clusterMap)
+					{
+						if (_log.IsInfoEnabled)
+							_log.InfoFormat("Group {0} finished migrating from {1} clusters.", GroupName, clusterMap.PreviousClusterCount);
+						_clusterMap = clusterMap.WithoutMigration();
+					}
 				}
+				return false;
+			}
+			int previousIndex, currentIndex;
+			if (!clusterMap.TryGetMigration(objectId, out previousIndex, out currentIndex))
+			{
+				return false;
 			}
-			return -1;
+			previousCluster = clusterMap[previousIndex];
+			currentCluster = clusterMap[currentIndex];
+			return true;
 		}
 
-		private int GetModdedIndex(int objectId)
+		internal bool Migrating
 		{
-			if (objectId == Int32.MinValue) return 0; //cause Math.Abs(Int32.MinValue) throws
-			return Math.Abs(objectId) % Clusters.Count;
+			get
+			{
+				return _clusterMap.Migrating;
+			}
 		}
 
 		/// <summary>
@@ -213,12 +269,13 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		/// <returns></returns>
 		public List<int>[] GetModdedIndexLists(int[] objectIdList)
 		{
-			List<int>[] lists = new List<int>[Clusters.Count];			
+			ClusterMap clusterMap = _clusterMap;
+			List<int>[] lists = new List<int>[clusterMap.Count];			
 
 			for (int i = 0; i < objectIdList.Length; i++)
 			{
 				int itemId = objectIdList[i];
-				int clusterIndex = GetModdedIndex(itemId);
+				int clusterIndex = clusterMap.GetPlacedIndex(itemId, lists.Length);
 
 				if (lists[clusterIndex] == null)
 				{
@@ -232,13 +289,14 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 
 		public List<RelayMessage>[] GetModdedMessageLists(RelayMessage[] messages)
 		{
-			List<RelayMessage>[] lists = new List<RelayMessage>[Clusters.Count];
+			ClusterMap clusterMap = _clusterMap;
+			List<RelayMessage>[] lists = new List<RelayMessage>[clusterMap.Count];
 
 			for (int i = 0; i < messages.Length; i++)
 			{
 				int itemId = messages[i].Id;
 				
-				int clusterIndex = GetModdedIndex(itemId);
+				int clusterIndex = clusterMap.GetPlacedIndex(itemId, lists.Length);
 				
 				if (lists[clusterIndex] == null)
 				{
@@ -358,7 +416,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 			
 			NodeCluster cluster;
-			SimpleLinkedList<Node> nodes = null;
+			SimpleLinkedList<Node> nodes;
 			
 			//messages that, from out of system, go to each cluster
 			if(message.IsClusterBroadcastMessage)
@@ -385,11 +443,15 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					if (message.IsInterClusterMsg && cluster.MeInThisCluster)
 					{
-						nodes = new SimpleLinkedList<Node>();
-						nodes.Push(cluster.Me);
+						//a migration copy of a key this cluster still holds stays where it is
+						nodes = message.IsMigrationCopy ? new SimpleLinkedList<Node>() : cluster.Me.AsList();
 					}
 					else
 					{
+						if (message.IsMigrationCopy)
+						{
+							cluster.CountMovedKey();
+						}
 						nodes = cluster.GetNodesForMessage(message);
 					}
 				}
@@ -430,9 +492,17 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			 statusBuilder.Append(@"</td></tr>" + Environment.NewLine);
 		 }
 
+			long routedKeys = GetRoutedKeys();
 			foreach (NodeCluster cluster in Clusters)
 			{
 				statusBuilder.Append(@"<tr><td>" + Environment.NewLine);
+				if (routedKeys > 0 || cluster.MovedKeys > 0)
+				{
+					statusBuilder.Append("<table>" + Environment.NewLine);
+					AddPropertyLine(statusBuilder, "Key Share", (cluster.RoutedKeys / (double)Math.Max(routedKeys, 1)).ToString("P1"));
+					AddPropertyLine(statusBuilder, "Moved Keys", cluster.MovedKeys, 0);
+					statusBuilder.Append(@"</table>" + Environment.NewLine);
+				}
 				cluster.GetHtmlStatus(statusBuilder);
 				statusBuilder.Append(@"</td></tr>" + Environment.NewLine);
 			}
@@ -475,13 +545,27 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				}
 			}
 
+			long routedKeys = GetRoutedKeys();
 			foreach (NodeCluster cluster in Clusters)
 			{
-				nodeGroupStatus.NodeClusterStatuses.Add(cluster.GetNodeClusterStatus());
+				NodeClusterStatus nodeClusterStatus = cluster.GetNodeClusterStatus();
+				nodeClusterStatus.KeySharePercent = routedKeys == 0 ? 0 : cluster.RoutedKeys * 100.0 / routedKeys;
+				nodeClusterStatus.MovedKeys = cluster.MovedKeys;
+				nodeGroupStatus.NodeClusterStatuses.Add(nodeClusterStatus);
 			}
 
 			return nodeGroupStatus;
 		}
+		private long GetRoutedKeys()
+		{
+			long routedKeys = 0;
+			foreach (NodeCluster cluster in Clusters)
+			{
+				routedKeys += cluster.RoutedKeys;
+			}
+			return routedKeys;
+		}
+
 		internal static void AddPropertyLine(StringBuilder statusBuilder, string propName, double propValue, int precision)
 		{
 			if (propValue.ToString() == "0")
@@ -47,6 +47,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		internal ForwardingConfig ForwardingConfig;
 		
 		internal ForwardingCounters Counters;
+		internal InterZoneShipper InterZoneShipper; //null unless inter zone messages are bundled
 		internal Dispatcher InMessageDispatcher;
 		internal Dispatcher OutMessageDispatcher;
 
@@ -109,6 +110,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				NodeGroup.MaximumQueuedItems = forwardingConfig.MaximumTaskQueueDepth;
 
 				BuildNodeGroups(config, errorQueues);
+				SetInterZoneShipper(forwardingConfig);
 
 				if (config.MyAddresses != null && config.MyAddresses.Count > 0)
 				{	
@@ -158,6 +160,8 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 
 			Config = config;
+			BuildRoutingTable();
+			SetInterZoneShipper(newForwardingConfig);
 
 			_myNodeDefinition = GetMyNodeDefinition();
 			bool doNewInDispatcher, doNewOutDispatcher;
@@ -233,6 +237,31 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			}
 		}
 
+		private void SetInterZoneShipper(ForwardingConfig forwardingConfig)
+		{
+			InterZoneShipper oldShipper = InterZoneShipper;
+			if (forwardingConfig.InterZoneBundleMaximumBytes > 0)
+			{
+				if (oldShipper != null && oldShipper.MaximumBytes == forwardingConfig.InterZoneBundleMaximumBytes
+					&& oldShipper.MaximumDelayMilliseconds == Math.Max(1, forwardingConfig.InterZoneBundleMaximumDelayMilliseconds))
+				{
+					return;
+				}
+				if (_log.IsInfoEnabled)
+					_log.InfoFormat("Bundling inter zone messages up to {0} bytes and {1} ms.",
+						forwardingConfig.InterZoneBundleMaximumBytes, forwardingConfig.InterZoneBundleMaximumDelayMilliseconds);
+				InterZoneShipper = new InterZoneShipper(forwardingConfig.InterZoneBundleMaximumBytes, forwardingConfig.InterZoneBundleMaximumDelayMilliseconds);
+			}
+			else
+			{
+				InterZoneShipper = null;
+			}
+			if (oldShipper != null)
+			{
+				oldShipper.Shutdown();
+			}
+		}
+
 		private void AggregateCounterTicker(object state)
 		{
 			for (int i = 0; i < NodeGroups.Count; i++)
@@ -285,6 +314,16 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			{
 				NodeGroups = new NodeGroupCollection();
 			}
+			BuildRoutingTable();
+		}
+
+		/// <summary>
+		/// Looks up the group of each type again, after the type settings or groups changed.
+		/// </summary>
+		private void BuildRoutingTable()
+		{
+			_routingTable = new RoutingTable(Config.TypeSettings != null ? Config.TypeSettings.TypeSettingCollection : null,
+				NodeGroups, MyNodeGroup);
 		}
 
 		internal RelayNodeDefinition GetMyNodeDefinition()
@@ -300,10 +339,17 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		internal RelayNodeConfig Config;
 
 		internal NodeGroupCollection NodeGroups;
+		private volatile RoutingTable _routingTable; //replaced whole when the config is reloaded
 		internal NodeGroup MyNodeGroup;
 		internal IPAddress MyIpAddress;
 		internal NodeGroup GetNodeGroup(short typeId)
 		{
+			RoutingTable routingTable = _routingTable;
+			if (routingTable != null)
+			{
+				return routingTable.GetNodeGroup(typeId);
+			}
+
 			string groupName = Config.TypeSettings.TypeSettingCollection.GetGroupNameForId(typeId);
 
 			if (MyNodeGroup != null && string.Compare(groupName, MyNodeGroup.GroupName, true) == 0)
@@ -342,14 +388,36 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return group.GroupDefinition.RetryCount;
 		}
 
+		/// <summary>
+		/// Finds the cluster that held the message's id before its group's number of clusters
+		/// changed, while the group is migrating and the id has moved.
+		/// </summary>
+		/// <returns>True if the id has moved; see <see cref="NodeGroup.TryGetMigration"/>.</returns>
+		internal bool TryGetMigration(RelayMessage message, out NodeCluster previousCluster, out NodeCluster currentCluster)
+		{
+			previousCluster = null;
+			currentCluster = null;
+			if (NodeGroups == null || message.IsGroupBroadcastMessage || message.IsClusterBroadcastMessage)
+			{
+				return false;
+			}
+			NodeGroup group = GetNodeGroup(message.TypeId);
+			return group != null && group.Migrating &&
+				group.TryGetMigration(message.Id, out previousCluster, out currentCluster);
+		}
+
 		internal SimpleLinkedList<Node> GetNodesForMessage(RelayMessage message)
 		{
-			SimpleLinkedList<Node> nodes = null;
+			SimpleLinkedList<Node> nodes;
 			
-			if (message == null || message.RelayTTL < 1 || NodeGroups == null)
+			if (message == null || NodeGroups == null)
 			{
 				return new SimpleLinkedList<Node>();
 			}
+			if (message.RelayTTL < 1)
+			{
+				return GetTreeRelayNodes(message);
+			}
 
 			const bool useLegacySerialization = true;
 
@@ -387,11 +455,6 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 					nodes = new SimpleLinkedList<Node>();
 				}
 			}
-			
-			if (nodes == null)
-			{
-				nodes = new SimpleLinkedList<Node>();
-			}
 
 			// If no nodes are returned, we predict that the caller
 			// will drop the message.  Therefore we call the notification delegate.
@@ -406,6 +469,24 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return nodes;
 		}
 
+		/// <summary>
+		/// Gets the nodes to pass a message with no hops left on to, which are only the node's
+		/// children if it is being relayed down its cluster's replication tree.
+		/// </summary>
+		private SimpleLinkedList<Node> GetTreeRelayNodes(RelayMessage message)
+		{
+			NodeGroup group = message.IsGroupBroadcastMessage ? MyNodeGroup : GetNodeGroup(message.TypeId);
+			SimpleLinkedList<Node> nodes;
+			if (group != null && group.MyCluster != null && group.MyCluster.TryGetTreeRelayNodes(message, out nodes))
+			{
+				message.PrepareMessageToBeSent(group.GroupDefinition.LegacySerialization);
+				//keeps the spent TTL from counting down further at every hop of a deep tree
+				message.RelayTTL = 0;
+				return nodes;
+			}
+			return new SimpleLinkedList<Node>();
+		}
+
 		/// <summary>
 		/// Splits messages into various lists of in and out message destined for different nodes.
 		/// </summary>
@@ -426,7 +507,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 					RelayMessage interZoneMessage = null;
 
 					SimpleLinkedList<Node> nodesForMessage = GetNodesForMessage(message);
-					SimpleLinkedList<Node> nodesForInterZoneMessage = null;
+					SimpleLinkedList<Node> nodesForInterZoneMessage = new SimpleLinkedList<Node>();
 					
 					if (nodesForMessage.Count > 0)
 					{
@@ -440,23 +521,36 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						message.ResultOutcome = RelayOutcome.Queued; //will be queued, if sync will not get overwritten
 
 						// Identify nodes in foreign zones
-						int nodeCount = nodesForMessage.Count;
-						for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+						if (_myNodeDefinition != null)
 						{
-							nodesForMessage.Pop(out node);
-							if (_myNodeDefinition != null && _myNodeDefinition.Zone != node.NodeDefinition.Zone)
+							ushort myZone = _myNodeDefinition.Zone;
+							// foreign zone nodes are pushed after this zone's, whose chain other messages
+							// may share, so they come off the head without relinking the rest
+							while (nodesForMessage.Peek(out node) && node.NodeDefinition.Zone != myZone)
 							{
-								// Message needs to cross Zone bounderies
-								if (interZoneMessage == null)
+								nodesForMessage.Pop(out node);
+								nodesForInterZoneMessage.Push(node);
+							}
+							if (HasNodeOutsideZone(nodesForMessage, myZone))
+							{
+								SimpleLinkedList<Node> nodesInZone = new SimpleLinkedList<Node>();
+								while (nodesForMessage.Pop(out node))
 								{
-									interZoneMessage = RelayMessage.CreateInterZoneMessageFrom(message);
-									nodesForInterZoneMessage = new SimpleLinkedList<Node>();
+									if (node.NodeDefinition.Zone != myZone)
+									{
+										nodesForInterZoneMessage.Push(node);
+									}
+									else
+									{
+										nodesInZone.Push(node);
+									}
 								}
-								nodesForInterZoneMessage.Push(node);
+								nodesForMessage = nodesInZone;
 							}
-							else
+							if (nodesForInterZoneMessage.Count > 0)
 							{
-								nodesForMessage.Push(node);
+								// Message needs to cross Zone bounderies
+								interZoneMessage = RelayMessage.CreateInterZoneMessageFrom(message);
 							}
 						}
 					}
@@ -468,10 +562,18 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 						distribution.Add(message, nodesForMessage);
 					}
 
-					if (nodesForInterZoneMessage != null && nodesForInterZoneMessage.Count > 0)
+					if (interZoneMessage != null)
 					{
 						DebugWriter.WriteDebugInfo(interZoneMessage, nodesForInterZoneMessage);
-						distribution.Add(interZoneMessage, nodesForInterZoneMessage);
+						InterZoneShipper interZoneShipper = InterZoneShipper;
+						if (interZoneShipper != null)
+						{
+							interZoneShipper.Ship(interZoneMessage, nodesForInterZoneMessage);
+						}
+						else
+						{
+							distribution.Add(interZoneMessage, nodesForInterZoneMessage);
+						}
 					}
 				}				
 			}
@@ -479,6 +581,18 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return distribution;
 		}
 
+		private static bool HasNodeOutsideZone(SimpleLinkedList<Node> nodes, ushort zone)
+		{
+			for (SimpleLinkedListNode<Node> link = nodes.head; link != null; link = link.Next)
+			{
+				if (link.Value.NodeDefinition.Zone != zone)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
 		internal Dictionary<string, Dictionary<string, MessageQueue>> GetErrorQueues()
 		{
 
@@ -490,7 +604,9 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				{
 					foreach (Node node in cluster.Nodes)
 					{	
-						if (node.MessageErrorQueue != null && node.MessageErrorQueue.InMessageQueueCount > 0)
+						//a persisted queue is found on disk by the node that replaces this one
+						if (node.MessageErrorQueue != null && node.MessageErrorQueue.PersistedQueue == null
+							&& node.MessageErrorQueue.InMessageQueueCount > 0)
 						{
 							groupQueues.Add(node.ToString(), node.MessageErrorQueue);
 						}
@@ -514,6 +630,10 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 				Counters.ResetCounters();
 				Counters.Shutdown();
 			}
+			if (InterZoneShipper != null)
+			{
+				InterZoneShipper.Shutdown();
+			}
 			if (InMessageDispatcher != null)
 			{
 				InMessageDispatcher.Dispose();
@@ -536,6 +656,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 					NodeGroups[i].Shutdown();
 				}
 			}
+			PersistedMessageQueue.CloseAll();
 				
 			lock (_instanceLock)
 			{
@@ -0,0 +1,514 @@
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Threading;
+using MySpace.DataRelay.Common.Schemas;
+using MySpace.Logging;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Keeps one node's error queued messages on disk, in a folder of append only segment files,
+	/// so that they survive a restart.
+	/// </summary>
+	/// <remarks>
+	/// <para>Appends are buffered and written out together: a list of messages at the end of its
+	/// enqueue, single messages within <see cref="_flushMilliseconds"/>. A crash can lose what
+	/// was appended since.</para>
+	/// <para>Each record is the message's stream length (-1 for none), type and payload length,
+	/// then the stream. The segment and offset of the next record to dequeue are kept in a cursor
+	/// file, written after each dequeue. A segment is deleted once it has been read through.</para>
+	/// <para>Reloading the mapping recreates the nodes, so queues are shared by folder: a new
+	/// node opening its folder gets the queue its predecessor had open.</para>
+	/// </remarks>
+	internal class PersistedMessageQueue
+	{
+		private const string _segmentExtension = ".queue";
+		private const string _cursorFileName = "cursor";
+		private const int _recordHeaderSize = 12;
+		private const int _flushMilliseconds = 100;
+		private const int _bytesPerMegabyte = 1024 * 1024;
+
+		private static readonly LogWrapper _log = new LogWrapper();
+		private static readonly Dictionary<string, PersistedMessageQueue> _openQueues =
+			new Dictionary<string, PersistedMessageQueue>(StringComparer.OrdinalIgnoreCase);
+
+		private readonly string _folder;
+		private readonly object _padLock = new object();
+		private readonly byte[] _header = new byte[_recordHeaderSize];
+		private readonly Timer _flushTimer;
+		private readonly List<long> _segments = new List<long>(); //on disk, oldest first
+		private readonly List<int> _segmentCounts = new List<int>(); //messages not yet dequeued in each of _segments
+		private long _maximumBytes;
+		private long _segmentBytes;
+		private FileStream _cursorFile;
+		private FileStream _writer;
+		private FileStream _reader;
+		private int _count;
+		private int _uncountedReplays;
+		private long _bytes;
+		private long _written;
+		private long _read;
+		private long _dropped;
+		private bool _flushPending;
+		private bool _closed;
+
+		/// <summary>
+		/// Gets the queue kept in <paramref name="folder"/>, opening it and replaying what a
+		/// previous process left there if it isn't already open.
+		/// </summary>
+		/// <exception cref="IOException">The folder's files could not be opened.</exception>
+		/// <exception cref="UnauthorizedAccessException">The folder could not be written.</exception>
+		internal static PersistedMessageQueue Open(string folder, QueueConfig config)
+		{
+			lock (_openQueues)
+			{
+				PersistedMessageQueue queue;
+				if (!_openQueues.TryGetValue(folder, out queue))
+				{
+					queue = new PersistedMessageQueue(folder);
+					_openQueues.Add(folder, queue);
+				}
+				queue.ReloadConfig(config);
+				return queue;
+			}
+		}
+
+		/// <summary>
+		/// Writes out and closes every open queue.
+		/// </summary>
+		internal static void CloseAll()
+		{
+			lock (_openQueues)
+			{
+				foreach (PersistedMessageQueue queue in _openQueues.Values)
+				{
+					queue.Close();
+				}
+				_openQueues.Clear();
+			}
+		}
+
+		private PersistedMessageQueue(string folder)
+		{
+			_folder = folder;
+			Directory.CreateDirectory(folder);
+			foreach (string file in Directory.GetFiles(folder, "*" + _segmentExtension))
+			{
+				long segment;
+				if (Int64.TryParse(Path.GetFileNameWithoutExtension(file), NumberStyles.None, CultureInfo.InvariantCulture, out segment))
+				{
+					_segments.Add(segment);
+				}
+			}
+			_segments.Sort();
+
+			_cursorFile = new FileStream(Path.Combine(folder, _cursorFileName), FileMode.OpenOrCreate, FileAccess.ReadWrite, FileShare.Read);
+			long readSegment = 0, readOffset = 0;
+			if (_cursorFile.Length >= 16)
+			{
+				byte[] cursor = new byte[16];
+				ReadFully(_cursorFile, cursor, 16);
+				readSegment = BitConverter.ToInt64(cursor, 0);
+				readOffset = BitConverter.ToInt64(cursor, 8);
+			}
+			//segments before the cursor were read through before they could be deleted
+			while (_segments.Count > 0 && _segments[0] < readSegment)
+			{
+				File.Delete(GetSegmentPath(_segments[0]));
+				_segments.RemoveAt(0);
+			}
+			if (_segments.Count == 0 || _segments[0] > readSegment)
+			{
+				readOffset = 0;
+			}
+
+			for (int i = 0; i < _segments.Count; i++)
+			{
+				string path = GetSegmentPath(_segments[i]);
+				int records;
+				long validLength = CountRecords(path, i == 0 ? readOffset : 0, out records);
+				_segmentCounts.Add(records);
+				_count += records;
+				if (i == _segments.Count - 1)
+				{
+					//a crash can leave part of a record at the end of the last segment
+					using (FileStream last = new FileStream(path, FileMode.Open, FileAccess.Write, FileShare.None))
+					{
+						if (last.Length > validLength)
+						{
+							if (_log.IsWarnEnabled)
+								_log.WarnFormat("Truncating {0} bytes of an incomplete message from persisted queue {1}",
+									last.Length - validLength, folder);
+							last.SetLength(validLength);
+						}
+					}
+				}
+				_bytes += new FileInfo(path).Length;
+			}
+
+			if (_segments.Count == 0)
+			{
+				_segments.Add(readSegment);
+				_segmentCounts.Add(0);
+			}
+			_writer = new FileStream(GetSegmentPath(_segments[_segments.Count - 1]), FileMode.Append, FileAccess.Write, FileShare.Read);
+			_reader = OpenReader(_segments[0]);
+			_reader.Seek(readOffset, SeekOrigin.Begin);
+			_uncountedReplays = _count;
+			_flushTimer = new Timer(FlushElapsed, null, Timeout.Infinite, Timeout.Infinite);
+
+			if (_count > 0 && _log.IsInfoEnabled)
+				_log.InfoFormat("Replaying {0} persisted error queued messages from {1}", _count, folder);
+		}
+
+		private void ReloadConfig(QueueConfig config)
+		{
+			lock (_padLock)
+			{
+				_maximumBytes = (long)config.PersistenceMaxMegabytes * _bytesPerMegabyte;
+				_segmentBytes = (long)Math.Max(config.PersistenceSegmentMegabytes, 1) * _bytesPerMegabyte;
+			}
+		}
+
+		/// <summary>
+		/// The number of messages waiting on disk.
+		/// </summary>
+		internal int Count
+		{
+			get
+			{
+				return _count;
+			}
+		}
+
+		/// <summary>
+		/// The bytes the queue's segments take on disk.
+		/// </summary>
+		internal long Bytes
+		{
+			get
+			{
+				return Interlocked.Read(ref _bytes);
+			}
+		}
+
+		/// <summary>
+		/// The number of messages written since the queue was opened.
+		/// </summary>
+		internal long Written
+		{
+			get
+			{
+				return Interlocked.Read(ref _written);
+			}
+		}
+
+		/// <summary>
+		/// The number of messages dequeued since the queue was opened.
+		/// </summary>
+		internal long Read
+		{
+			get
+			{
+				return Interlocked.Read(ref _read);
+			}
+		}
+
+		/// <summary>
+		/// The number of messages dropped because the queue was full, since it was opened.
+		/// </summary>
+		internal long Dropped
+		{
+			get
+			{
+				return Interlocked.Read(ref _dropped);
+			}
+		}
+
+		/// <summary>
+		/// The number of replayed messages not yet added to the error queue counter, once.
+		/// </summary>
+		internal int TakeUncountedReplays()
+		{
+			return Interlocked.Exchange(ref _uncountedReplays, 0);
+		}
+
+		/// <summary>
+		/// Appends a message, to be written out within <see cref="_flushMilliseconds"/>.
+		/// </summary>
+		/// <returns>False if the queue is full or closed, and the message was not kept.</returns>
+		internal bool Enqueue(SerializedRelayMessage message)
+		{
+			lock (_padLock)
+			{
+				if (!Append(message))
+				{
+					return false;
+				}
+				if (!_flushPending)
+				{
+					_flushPending = true;
+					_flushTimer.Change(_flushMilliseconds, Timeout.Infinite);
+				}
+				return true;
+			}
+		}
+
+		/// <summary>
+		/// Appends messages and writes them out.
+		/// </summary>
+		/// <returns>The number of messages kept, from the start of the list. The rest didn't fit.</returns>
+		internal int Enqueue(IList<SerializedRelayMessage> messages)
+		{
+			lock (_padLock)
+			{
+				int kept = 0;
+				while (kept < messages.Count && Append(messages[kept]))
+				{
+					kept++;
+				}
+				if (kept > 0)
+				{
+					Flush();
+				}
+				return kept;
+			}
+		}
+
+		/// <summary>
+		/// Takes up to <paramref name="maximumCount"/> messages from the front of the queue.
+		/// </summary>
+		internal List<SerializedRelayMessage> Dequeue(int maximumCount)
+		{
+			List<SerializedRelayMessage> messages = new List<SerializedRelayMessage>(Math.Min(maximumCount, _count));
+			lock (_padLock)
+			{
+				if (_closed || _count == 0)
+				{
+					return messages;
+				}
+				if (_segments.Count == 1)
+				{
+					//the reader is on the segment being written
+					Flush();
+				}
+				while (messages.Count < maximumCount && _count > 0)
+				{
+					if (_reader.Length - _reader.Position < _recordHeaderSize)
+					{
+						if (!NextReadSegment())
+						{
+							break;
+						}
+						continue;
+					}
+					ReadFully(_reader, _header, _recordHeaderSize);
+					int streamLength = BitConverter.ToInt32(_header, 0);
+					if (streamLength < -1 || _reader.Position + streamLength > _reader.Length)
+					{
+						if (_log.IsErrorEnabled)
+							_log.ErrorFormat("Skipping the unreadable rest of segment {0} of persisted queue {1}, losing {2} messages",
+								_segments[0], _folder, _segmentCounts[0]);
+						_reader.Seek(0, SeekOrigin.End);
+						_count -= _segmentCounts[0];
+						_segmentCounts[0] = 0;
+						if (!NextReadSegment())
+						{
+							break;
+						}
+						continue;
+					}
+					MemoryStream stream = null;
+					if (streamLength >= 0)
+					{
+						byte[] bytes = new byte[streamLength];
+						ReadFully(_reader, bytes, streamLength);
+						stream = new MemoryStream(bytes);
+					}
+					messages.Add(new SerializedRelayMessage((MessageType)BitConverter.ToInt32(_header, 4), stream,
+						BitConverter.ToInt32(_header, 8)));
+					_count--;
+					_segmentCounts[0]--;
+				}
+				WriteCursor();
+			}
+			Interlocked.Add(ref _read, messages.Count);
+			return messages;
+		}
+
+		private bool Append(SerializedRelayMessage message)
+		{
+			if (_closed)
+			{
+				return false;
+			}
+			int streamLength = message.MessageStream == null ? -1 : (int)message.MessageStream.Length;
+			long recordLength = _recordHeaderSize + Math.Max(streamLength, 0);
+			if (_bytes + recordLength > _maximumBytes)
+			{
+				Interlocked.Increment(ref _dropped);
+				return false;
+			}
+			if (_writer.Position > 0 && _writer.Position + recordLength > _segmentBytes)
+			{
+				NextWriteSegment();
+			}
+			WriteInt32(_header, 0, streamLength);
+			WriteInt32(_header, 4, (int)message.MessageType);
+			WriteInt32(_header, 8, message.PayloadLength);
+			_writer.Write(_header, 0, _recordHeaderSize);
+			if (message.MessageStream != null)
+			{
+				message.MessageStream.WriteTo(_writer);
+			}
+			_count++;
+			_segmentCounts[_segmentCounts.Count - 1]++;
+			Interlocked.Add(ref _bytes, recordLength);
+			Interlocked.Increment(ref _written);
+			return true;
+		}
+
+		private void NextWriteSegment()
+		{
+			_writer.Close();
+			long segment = _segments[_segments.Count - 1] + 1;
+			_segments.Add(segment);
+			_segmentCounts.Add(0);
+			_writer = new FileStream(GetSegmentPath(segment), FileMode.Append, FileAccess.Write, FileShare.Read);
+		}
+
+		/// <returns>False if the reader is already on the segment being written.</returns>
+		private bool NextReadSegment()
+		{
+			if (_segments.Count == 1)
+			{
+				return false;
+			}
+			long length = _reader.Length;
+			_reader.Close();
+			File.Delete(GetSegmentPath(_segments[0]));
+			_segments.RemoveAt(0);
+			_segmentCounts.RemoveAt(0);
+			Interlocked.Add(ref _bytes, -length);
+			if (_segments.Count == 1)
+			{
+				Flush();
+			}
+			_reader = OpenReader(_segments[0]);
+			return true;
+		}
+
+		private void WriteCursor()
+		{
+			byte[] cursor = new byte[16];
+			Array.Copy(BitConverter.GetBytes(_segments[0]), 0, cursor, 0, 8);
+			Array.Copy(BitConverter.GetBytes(_reader.Position), 0, cursor, 8, 8);
+			_cursorFile.Seek(0, SeekOrigin.Begin);
+			_cursorFile.Write(cursor, 0, cursor.Length);
+			_cursorFile.Flush();
+		}
+
+		private void FlushElapsed(object state)
+		{
+			try
+			{
+				lock (_padLock)
+				{
+					_flushPending = false;
+					if (!_closed)
+					{
+						Flush();
+					}
+				}
+			}
+			catch (Exception ex)
+			{
+				if (_log.IsErrorEnabled)
+					_log.ErrorFormat("Exception writing persisted queue {0}: {1}", _folder, ex);
+			}
+		}
+
+		private void Flush()
+		{
+			_writer.Flush();
+		}
+
+		private void Close()
+		{
+			lock (_padLock)
+			{
+				if (_closed)
+				{
+					return;
+				}
+				_closed = true;
+				_flushTimer.Change(Timeout.Infinite, Timeout.Infinite);
+				_flushTimer.Dispose();
+				_writer.Close();
+				WriteCursor();
+				_reader.Close();
+				_cursorFile.Close();
+			}
+		}
+
+		/// <summary>
+		/// Counts the whole records in a segment from <paramref name="offset"/>.
+		/// </summary>
+		/// <returns>The length of the segment up to the end of its last whole record.</returns>
+		private long CountRecords(string path, long offset, out int count)
+		{
+			count = 0;
+			using (FileStream segment = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read))
+			{
+				long position = offset;
+				while (segment.Length - position >= _recordHeaderSize)
+				{
+					segment.Seek(position, SeekOrigin.Begin);
+					ReadFully(segment, _header, _recordHeaderSize);
+					int streamLength = BitConverter.ToInt32(_header, 0);
+					if (streamLength < -1 || position + _recordHeaderSize + Math.Max(streamLength, 0) > segment.Length)
+					{
+						break;
+					}
+					position += _recordHeaderSize + Math.Max(streamLength, 0);
+					count++;
+				}
+				return position;
+			}
+		}
+
+		private FileStream OpenReader(long segment)
+		{
+			return new FileStream(GetSegmentPath(segment), FileMode.Open, FileAccess.Read, FileShare.ReadWrite | FileShare.Delete);
+		}
+
+		private string GetSegmentPath(long segment)
+		{
+			return Path.Combine(_folder, segment.ToString("D10", CultureInfo.InvariantCulture) + _segmentExtension);
+		}
+
+		private static void WriteInt32(byte[] buffer, int offset, int value)
+		{
+			buffer[offset] = (byte)value;
+			buffer[offset + 1] = (byte)(value >> 8);
+			buffer[offset + 2] = (byte)(value >> 16);
+			buffer[offset + 3] = (byte)(value >> 24);
+		}
+
+		private static void ReadFully(Stream stream, byte[] buffer, int count)
+		{
+			int offset = 0;
+			while (offset < count)
+			{
+				int read = stream.Read(buffer, offset, count - offset);
+				if (read == 0)
+				{
+					throw new EndOfStreamException();
+				}
+				offset += read;
+			}
+		}
+	}
+}
@@ -33,4 +33,5 @@ using System.Runtime.InteropServices;
 // by using the '*' as shown below:
 [assembly: AssemblyVersion("1.2.1.4")]
 [assembly: AssemblyFileVersion("1.2.1.4")]
-[assembly: InternalsVisibleTo("MySpace.RelayComponent.Forwarding.Test")]
\ No newline at end of file
+[assembly: InternalsVisibleTo("MySpace.RelayComponent.Forwarding.Test")]
+[assembly: InternalsVisibleTo("SocketTransportBenchmark")]
\ No newline at end of file
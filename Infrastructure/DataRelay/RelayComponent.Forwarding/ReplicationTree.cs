@@ -0,0 +1,110 @@
+using System;
+using System.Collections.Generic;
+using System.Net;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// Arranges the nodes of one zone of a cluster into a tree for replicating in system one
+	/// way messages, so the node a message enters at sends it to a few nodes rather than all.
+	/// </summary>
+	/// <remarks>
+	/// <para>Every node orders the zone's nodes the same way, by address and port. The tree is
+	/// rooted at the node the message entered at, its origin, and laid out from it in that order:
+	/// position p's children are positions p * fan out + 1 to p * fan out + fan out. A fan out of 1
+	/// is a chain.</para>
+	/// <para>A relay finds the origin as the first address in the message's address history
+	/// that belongs to the zone, so the zone's addresses must be unique for the tree to be used.
+	/// A child that is inactive or in the danger zone is skipped, and its children are sent
+	/// to directly.</para>
+	/// </remarks>
+	internal class ReplicationTree
+	{
+		private readonly Node[] _nodes;
+		private readonly int _fanOut;
+		private readonly int _meIndex;
+
+		private ReplicationTree(Node[] nodes, int fanOut, int meIndex)
+		{
+			_nodes = nodes;
+			_fanOut = fanOut;
+			_meIndex = meIndex;
+		}
+
+		/// <summary>
+		/// Creates the tree of <paramref name="me"/> and the other nodes of its zone.
+		/// </summary>
+		/// <returns>The tree, or null if any two of the nodes share an address.</returns>
+		internal static ReplicationTree Create(Node me, IList<Node> zoneNodes, int fanOut)
+		{
+			List<Node> nodes = new List<Node>(zoneNodes.Count + 1);
+			nodes.Add(me);
+			nodes.AddRange(zoneNodes);
+			Dictionary<IPAddress, Node> addresses = new Dictionary<IPAddress, Node>(nodes.Count);
+			foreach (Node node in nodes)
+			{
+				if (node.EndPoint == null || addresses.ContainsKey(node.EndPoint.Address))
+				{
+					return null;
+				}
+				addresses.Add(node.EndPoint.Address, node);
+			}
+			nodes.Sort((x, y) => String.CompareOrdinal(x.ToString(), y.ToString()));
+			return new ReplicationTree(nodes.ToArray(), fanOut, nodes.IndexOf(me));
+		}
+
+		/// <summary>
+		/// Finds the node a message entered the zone at.
+		/// </summary>
+		/// <returns>The origin's index, or -1 if no node of the zone has handled the message yet.</returns>
+		internal int FindOrigin(IList<IPAddress> addressHistory)
+		{
+			for (int i = 0; i < addressHistory.Count; i++)
+			{
+				for (int j = 0; j < _nodes.Length; j++)
+				{
+					if (_nodes[j].EndPoint.Address.Equals(addressHistory[i]))
+					{
+						return j;
+					}
+				}
+			}
+			return -1;
+		}
+
+		/// <summary>
+		/// The index of the node this is running on.
+		/// </summary>
+		internal int MeIndex
+		{
+			get
+			{
+				return _meIndex;
+			}
+		}
+
+		/// <summary>
+		/// Adds the nodes this node sends a message to, in the tree rooted at <paramref name="origin"/>.
+		/// </summary>
+		internal void AddChildren(int origin, ref SimpleLinkedList<Node> nodes)
+		{
+			AddChildren(origin, (_meIndex - origin + _nodes.Length) % _nodes.Length, ref nodes);
+		}
+
+		private void AddChildren(int origin, int position, ref SimpleLinkedList<Node> nodes)
+		{
+			for (int child = position * _fanOut + 1; child <= position * _fanOut + _fanOut && child < _nodes.Length; child++)
+			{
+				Node node = _nodes[(origin + child) % _nodes.Length];
+				if (node.Activated && !node.DangerZone)
+				{
+					nodes.Push(node);
+				}
+				else
+				{
+					AddChildren(origin, child, ref nodes);
+				}
+			}
+		}
+	}
+}
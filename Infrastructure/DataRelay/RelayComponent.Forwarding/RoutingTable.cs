@@ -0,0 +1,58 @@
+using System;
+using MySpace.DataRelay.Common.Schemas;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// The node group of each type id, looked up once when the config is loaded instead of by
+	/// group name for every message.
+	/// </summary>
+	/// <remarks>
+	/// A table is never changed once built. A config reload builds a new one and replaces the
+	/// old one in a single assignment, so messages routed meanwhile see one or the other whole.
+	/// </remarks>
+	internal class RoutingTable
+	{
+		private readonly NodeGroup[] _groupsByTypeId;
+
+		internal RoutingTable(TypeSettingCollection typeSettings, NodeGroupCollection nodeGroups, NodeGroup myNodeGroup)
+		{
+			_groupsByTypeId = new NodeGroup[typeSettings == null ? 0 : typeSettings.MaxTypeId + 1];
+			if (typeSettings == null || nodeGroups == null)
+			{
+				return;
+			}
+			foreach (TypeSetting typeSetting in typeSettings)
+			{
+				string groupName = typeSetting.GroupName;
+				if (typeSetting.TypeId < 0 || groupName == null)
+				{
+					continue;
+				}
+				if (myNodeGroup != null && string.Compare(groupName, myNodeGroup.GroupName, true) == 0)
+				{
+					//in system requests are assumed to be prerouted to this group, see NodeManager.GetNodeGroup
+					_groupsByTypeId[typeSetting.TypeId] = myNodeGroup;
+				}
+				else if (nodeGroups.Contains(groupName))
+				{
+					_groupsByTypeId[typeSetting.TypeId] = nodeGroups[groupName];
+				}
+			}
+		}
+
+		/// <summary>
+		/// Gets the group messages of a type go to.
+		/// </summary>
+		/// <returns>The group, or null if the type has none.</returns>
+		internal NodeGroup GetNodeGroup(short typeId)
+		{
+			NodeGroup[] groupsByTypeId = _groupsByTypeId;
+			if (typeId < 0 || typeId >= groupsByTypeId.Length)
+			{
+				return null;
+			}
+			return groupsByTypeId[typeId];
+		}
+	}
+}
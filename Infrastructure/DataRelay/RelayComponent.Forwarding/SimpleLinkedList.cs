@@ -5,26 +5,47 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 	/// <summary>
 	/// A simple queue (First in/First out) linked list of generics
 	/// </summary>
+	/// <remarks>
+	/// A value type, so that routing a message allocates no list. Popping only moves the head
+	/// and never relinks the nodes, so lists may share a chain built ahead of time by
+	/// <see cref="CreateChain"/>. Pass a list by <see langword="ref"/> to have a method push onto it.
+	/// </remarks>
 	/// <typeparam name="T"></typeparam>
-	public class SimpleLinkedList<T>
+	public struct SimpleLinkedList<T>
 	{
+		/// <summary>
+		/// Create a linked list containing all items of the supplied list.
+		/// </summary>        
+		public SimpleLinkedList(IList<T> list) : this()
+		{
+			for (int i = 0; i < list.Count; i++)
+			{
+				Push(list[i]);
+			}
+		}
 
 		/// <summary>
-		/// Create an empty linked list.
+		/// Create a linked list over an existing chain of <paramref name="count"/> nodes starting
+		/// at <paramref name="head"/>, which other lists may share.
 		/// </summary>
-		public SimpleLinkedList()
+		internal SimpleLinkedList(SimpleLinkedListNode<T> head, int count)
 		{
+			this.head = head;
+			_count = count;
 		}
 
 		/// <summary>
-		/// Create a linked list containing all items of the supplied list.
-		/// </summary>        
-		public SimpleLinkedList(IList<T> list)
+		/// Builds a chain of the items of <paramref name="list"/> for lists to share.
+		/// </summary>
+		/// <returns>The head of the chain, which pops the items in the order they are listed.</returns>
+		internal static SimpleLinkedListNode<T> CreateChain(IList<T> list)
 		{
-			for (int i = 0; i < list.Count; i++)
+			SimpleLinkedListNode<T> chain = null;
+			for (int i = list.Count - 1; i >= 0; i--)
 			{
-				Push(list[i]);
+				chain = new SimpleLinkedListNode<T>(list[i]) { Next = chain };
 			}
+			return chain;
 		}
 
 		private int _count;
@@ -44,15 +65,16 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		/// <summary>
 		/// Push all items of the supplied list on to this one.
 		/// </summary>
+		/// <remarks>
+		/// The items are pushed in new nodes, since the list's own may be part of a shared chain.
+		/// </remarks>
 		/// <param name="list"></param>
 		public void Push(SimpleLinkedList<T> list)
 		{
-			while (list.head != null)
+			T value;
+			while (list.Pop(out value))
 			{
-				SimpleLinkedListNode<T> next = list.head.Next;
-				list.head.Next = null;
-				Push(list.head);
-				list.head = next;
+				Push(value);
 			}
 		}		
 		
@@ -67,7 +89,7 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		}
 
 		/// <summary>
-		/// Push the supplied node onto this list.
+		/// Push the supplied node onto this list. The node must not be part of another list.
 		/// </summary>        
 		public void Push(SimpleLinkedListNode<T> node)
 		{
@@ -93,6 +115,20 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 			return false;
 		}
 
+		/// <summary>
+		/// Gets the head of the list without popping it.
+		/// </summary>
+		internal bool Peek(out T value)
+		{
+			if (head != null)
+			{
+				value = head.Value;
+				return true;
+			}
+			value = default(T);
+			return false;
+		}
+
 		/// <summary>
 		/// Return a copy of the entire list.
 		/// </summary>
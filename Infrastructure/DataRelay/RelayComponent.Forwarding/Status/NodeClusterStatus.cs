@@ -25,5 +25,18 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
 		}
 		[XmlElement("NodeStatuses")]
 		readonly private List<NodeStatus> _nodeStatuses = new List<NodeStatus>(); //All nodes in the cluster EXCEPT "Me"		
+
+		/// <summary>
+		/// The percentage of the messages routed by id in the group that went to this cluster.
+		/// </summary>
+		[XmlElement("KeySharePercent")]
+		public double KeySharePercent { set; get; }
+
+		/// <summary>
+		/// The number of keys copied to this cluster from the cluster that held them before the
+		/// group's number of clusters changed.
+		/// </summary>
+		[XmlElement("MovedKeys")]
+		public long MovedKeys { set; get; }
 	}
 }
@@ -87,6 +87,78 @@ namespace MySpace.DataRelay.RelayComponent.Forwarding
         [XmlElement("InMessageQueueCount")]
 		public int InMessageQueueCount { set; get; }
 
+		/// <summary>
+		/// Average milliseconds one way messages waited on this server before being sent to the node.
+		/// </summary>
+		[XmlElement("AverageHopLag")]
+		public double AverageHopLag { set; get; }
+
+		/// <summary>
+		/// Messages and message lists that may be outstanding on the node, when concurrency is limited.
+		/// </summary>
+		[XmlElement("ConcurrencyLimit")]
+		public int ConcurrencyLimit { set; get; }
+
+		/// <summary>
+		/// Messages and message lists outstanding on the node, when concurrency is limited.
+		/// </summary>
+		[XmlElement("ConcurrentRequests")]
+		public int ConcurrentRequests { set; get; }
+
+		/// <summary>
+		/// Messages and message lists turned away because the node was at its concurrency limit.
+		/// </summary>
+		[XmlElement("RejectedForConcurrency")]
+		public long RejectedForConcurrency { set; get; }
+
+		/// <summary>
+		/// In messages held for a retry because the node was at its concurrency limit.
+		/// </summary>
+		[XmlElement("DeferredInMessages")]
+		public int DeferredInMessages { set; get; }
+
+		/// <summary>
+		/// Messages the node is gathering into a burst, when burst sizes adapt to a latency target.
+		/// </summary>
+		[XmlElement("BurstLength")]
+		public int BurstLength { set; get; }
+
+		/// <summary>
+		/// Average messages sent to the node together, when burst sizes adapt to a latency target.
+		/// </summary>
+		[XmlElement("AverageMessagesPerBurst")]
+		public double AverageMessagesPerBurst { set; get; }
+
+		/// <summary>
+		/// Average milliseconds the oldest message of a burst waited to be sent, when burst sizes adapt to a latency target.
+		/// </summary>
+		[XmlElement("AverageBurstWait")]
+		public double AverageBurstWait { set; get; }
+
+		/// <summary>
+		/// Bytes the node's error queue takes on disk, if it is persisted.
+		/// </summary>
+		[XmlElement("PersistedQueueBytes")]
+		public long PersistedQueueBytes { set; get; }
+
+		/// <summary>
+		/// Messages written to the node's persisted error queue since it was opened.
+		/// </summary>
+		[XmlElement("PersistedMessagesWritten")]
+		public long PersistedMessagesWritten { set; get; }
+
+		/// <summary>
+		/// Messages dequeued from the node's persisted error queue since it was opened.
+		/// </summary>
+		[XmlElement("PersistedMessagesRead")]
+		public long PersistedMessagesRead { set; get; }
+
+		/// <summary>
+		/// Messages dropped because the node's persisted error queue was full, since it was opened.
+		/// </summary>
+		[XmlElement("PersistedMessagesDropped")]
+		public long PersistedMessagesDropped { set; get; }
+
 		/// <summary>
 		/// List of message count information.
 		/// </summary>
@@ -0,0 +1,97 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace MySpace.DataRelay.RelayComponent.Forwarding
+{
+	/// <summary>
+	/// The other nodes of a cluster by zone, and the replication tree of this node's zone,
+	/// arranged for routing in system one way messages when the cluster's nodes change instead
+	/// of for every message.
+	/// </summary>
+	/// <remarks>
+	/// <para>Like <see cref="RoutingTable"/>, a rebuild replaces the whole object in one assignment.
+	/// The nodes of this node's zone are one chain that every message's list shares.</para>
+	/// <para>The node chosen for each foreign zone sits in a slot that is swapped without a lock,
+	/// as <see cref="NodeCluster.ChosenNode"/> is, so a stale choice is replaced by whichever
+	/// thread notices it first.</para>
+	/// </remarks>
+	internal class ZoneRoutes
+	{
+		private readonly SimpleLinkedListNode<Node> _myZoneChain;
+		private readonly int _myZoneCount;
+		private readonly Node[][] _foreignZoneNodes;
+		private readonly Node[] _chosenForeignNodes;
+		private readonly ReplicationTree _replicationTree;
+
+		/// <param name="zoneNodes">The other nodes of the cluster by zone.</param>
+		/// <param name="myZone">The zone of the node this is running on.</param>
+		/// <param name="replicationTree">The tree of this node's zone, or null to replicate to each node directly.</param>
+		internal ZoneRoutes(Dictionary<ushort, List<Node>> zoneNodes, ushort myZone, ReplicationTree replicationTree)
+		{
+			_replicationTree = replicationTree;
+			List<Node[]> foreignZoneNodes = new List<Node[]>(zoneNodes.Count);
+			foreach (KeyValuePair<ushort, List<Node>> zone in zoneNodes)
+			{
+				if (zone.Key == myZone)
+				{
+					_myZoneChain = SimpleLinkedList<Node>.CreateChain(zone.Value);
+					_myZoneCount = zone.Value.Count;
+				}
+				else
+				{
+					foreignZoneNodes.Add(zone.Value.ToArray());
+				}
+			}
+			_foreignZoneNodes = foreignZoneNodes.ToArray();
+			_chosenForeignNodes = new Node[_foreignZoneNodes.Length];
+		}
+
+		/// <summary>
+		/// The replication tree of this node's zone, or null to replicate to each node directly.
+		/// </summary>
+		internal ReplicationTree ReplicationTree
+		{
+			get
+			{
+				return _replicationTree;
+			}
+		}
+
+		/// <summary>
+		/// Gets the other nodes of this node's zone.
+		/// </summary>
+		internal SimpleLinkedList<Node> GetMyZoneNodes()
+		{
+			return new SimpleLinkedList<Node>(_myZoneChain, _myZoneCount);
+		}
+
+		/// <summary>
+		/// Pushes the chosen node of each foreign zone that has a healthy one onto <paramref name="nodes"/>.
+		/// </summary>
+		internal void AddForeignZoneNodes(ref SimpleLinkedList<Node> nodes, Random randomizer)
+		{
+			for (int i = 0; i < _foreignZoneNodes.Length; i++)
+			{
+				Node node = GetChosenNode(i, randomizer);
+				if (node != null)
+				{
+					nodes.Push(node);
+				}
+			}
+		}
+
+		private Node GetChosenNode(int zoneIndex, Random randomizer)
+		{
+			Node chosenNode = _chosenForeignNodes[zoneIndex];
+			if (chosenNode == null || chosenNode.DangerZone)
+			{
+				Node selectedNode = NodeCluster.SelectSafeNode(new List<Node>(_foreignZoneNodes[zoneIndex]), randomizer);
+				//if another thread replaced the stale choice first, its choice stands
+				Node previousNode = Interlocked.CompareExchange(ref _chosenForeignNodes[zoneIndex], selectedNode, chosenNode);
+				chosenNode = (previousNode == chosenNode || previousNode == null) ? selectedNode : previousNode;
+			}
+			return chosenNode;
+		}
+	}
+}
@@ -0,0 +1,96 @@
+using System;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	/// <summary>
+	/// The measurements of one benchmark run, written as one tab separated line so that
+	/// result files from before and after a transport change can be diffed.
+	/// </summary>
+	internal class BenchmarkResult
+	{
+		internal static readonly string[] Columns =
+		{
+			"Engine", "Client", "Connections", "PayloadBytes", "OneWayPercent", "Messages", "Errors",
+			"MsgsPerSec", "P50Micros", "P99Micros", "P999Micros", "MaxMicros",
+			"AllocBytesPerMsg", "Gen0", "Gen1", "Gen2"
+		};
+
+		internal ServerEngine Engine;
+		internal ClientKind Client;
+		internal int Connections;
+		internal int PayloadBytes;
+		internal int OneWayPercent;
+		internal int Messages;
+		internal int Errors;
+		internal double MessagesPerSecond;
+		internal double P50Microseconds;
+		internal double P99Microseconds;
+		internal double P999Microseconds;
+		internal double MaximumMicroseconds;
+		/// <summary>Allocated bytes per message, or -1 when the CLR memory counters can't be read.</summary>
+		internal long AllocatedBytesPerMessage;
+		internal int Gen0Collections;
+		internal int Gen1Collections;
+		internal int Gen2Collections;
+
+		/// <summary>
+		/// Sets the latency percentiles from the latencies of the messages that succeeded.
+		/// </summary>
+		/// <param name="latencyTicks">Stopwatch ticks per message; sorted in place.</param>
+		/// <param name="count">The number of latencies recorded.</param>
+		internal void SetLatencies(long[] latencyTicks, int count)
+		{
+			if (count == 0)
+			{
+				return;
+			}
+			Array.Sort(latencyTicks, 0, count);
+			P50Microseconds = ToMicroseconds(latencyTicks[Percentile(count, 0.5)]);
+			P99Microseconds = ToMicroseconds(latencyTicks[Percentile(count, 0.99)]);
+			P999Microseconds = ToMicroseconds(latencyTicks[Percentile(count, 0.999)]);
+			MaximumMicroseconds = ToMicroseconds(latencyTicks[count - 1]);
+		}
+
+		private static int Percentile(int count, double fraction)
+		{
+			return (int)Math.Ceiling(count * fraction) - 1;
+		}
+
+		private static double ToMicroseconds(long ticks)
+		{
+			return ticks * 1000000.0 / Stopwatch.Frequency;
+		}
+
+		internal static void WriteHeader(TextWriter writer)
+		{
+			writer.WriteLine(String.Join("\t", Columns));
+		}
+
+		internal void Write(TextWriter writer)
+		{
+			CultureInfo culture = CultureInfo.InvariantCulture;
+			writer.WriteLine(String.Join("\t", new string[]
+				{
+					Engine.ToString(),
+					Client.ToString(),
+					Connections.ToString(culture),
+					PayloadBytes.ToString(culture),
+					OneWayPercent.ToString(culture),
+					Messages.ToString(culture),
+					Errors.ToString(culture),
+					MessagesPerSecond.ToString("F0", culture),
+					P50Microseconds.ToString("F1", culture),
+					P99Microseconds.ToString("F1", culture),
+					P999Microseconds.ToString("F1", culture),
+					MaximumMicroseconds.ToString("F1", culture),
+					AllocatedBytesPerMessage.ToString(culture),
+					Gen0Collections.ToString(culture),
+					Gen1Collections.ToString(culture),
+					Gen2Collections.ToString(culture)
+				}));
+		}
+	}
+}
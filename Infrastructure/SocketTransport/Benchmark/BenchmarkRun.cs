@@ -0,0 +1,276 @@
+using System;
+using System.Diagnostics;
+using System.IO;
+using System.Net;
+using System.Threading;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	internal enum ClientKind
+	{
+		SocketClient,
+		AsyncSocketClient
+	}
+
+	internal enum ServerEngine
+	{
+		BeginReceive,
+		SocketAsyncEventArgs
+	}
+
+	/// <summary>
+	/// Sends a number of messages to the benchmark server with one client and connection count,
+	/// payload size and mix of one way and sync messages, and measures how it went.
+	/// </summary>
+	internal class BenchmarkRun
+	{
+		private readonly IPEndPoint destination;
+		private readonly ClientKind client;
+		private readonly int connections;
+		private readonly int payloadBytes;
+		private readonly int oneWayPercent;
+		private readonly int commandId;
+
+		private int messages;
+		private int nextMessage;
+		private int completed;
+		private int errors;
+		private int latencyCount;
+		private long[] latencyTicks;
+		private readonly ManualResetEvent allCompleted = new ManualResetEvent(false);
+
+		internal BenchmarkRun(IPEndPoint destination, ClientKind client, int connections, int payloadBytes,
+			int oneWayPercent, int commandId)
+		{
+			this.destination = destination;
+			this.client = client;
+			this.connections = connections;
+			this.payloadBytes = payloadBytes;
+			this.oneWayPercent = oneWayPercent;
+			this.commandId = commandId;
+		}
+
+		/// <summary>
+		/// Sends <paramref name="warmupMessages"/> unmeasured, then <paramref name="measuredMessages"/> measured.
+		/// </summary>
+		internal BenchmarkResult Run(int warmupMessages, int measuredMessages)
+		{
+			latencyTicks = new long[Math.Max(warmupMessages, measuredMessages)];
+			Send(warmupMessages);
+
+			BenchmarkResult result = new BenchmarkResult();
+			result.Client = client;
+			result.Connections = connections;
+			result.PayloadBytes = payloadBytes;
+			result.OneWayPercent = oneWayPercent;
+			result.Messages = measuredMessages;
+
+			//the CLR memory counters are only brought up to date by a collection
+			GC.Collect();
+			GC.WaitForPendingFinalizers();
+			long allocatedBefore = AllocationCounter.Read();
+			int gen0 = GC.CollectionCount(0), gen1 = GC.CollectionCount(1), gen2 = GC.CollectionCount(2);
+			Stopwatch elapsed = Stopwatch.StartNew();
+
+			Send(measuredMessages);
+
+			elapsed.Stop();
+			result.Gen0Collections = GC.CollectionCount(0) - gen0;
+			result.Gen1Collections = GC.CollectionCount(1) - gen1;
+			result.Gen2Collections = GC.CollectionCount(2) - gen2;
+			GC.Collect();
+			long allocatedAfter = AllocationCounter.Read();
+			result.AllocatedBytesPerMessage = allocatedBefore < 0 || allocatedAfter < 0 || measuredMessages == 0
+				? -1
+				: (allocatedAfter - allocatedBefore) / measuredMessages;
+
+			result.Errors = errors;
+			result.MessagesPerSecond = measuredMessages / elapsed.Elapsed.TotalSeconds;
+			result.SetLatencies(latencyTicks, latencyCount);
+			return result;
+		}
+
+		private void Send(int count)
+		{
+			messages = count;
+			nextMessage = -1;
+			completed = 0;
+			errors = 0;
+			latencyCount = 0;
+			allCompleted.Reset();
+			if (count == 0)
+			{
+				return;
+			}
+			switch (client)
+			{
+				case ClientKind.SocketClient:
+					SendWithSocketClient();
+					break;
+				case ClientKind.AsyncSocketClient:
+					SendWithAsyncSocketClient();
+					break;
+			}
+		}
+
+		private bool IsOneWay(int message)
+		{
+			return message % 100 < oneWayPercent;
+		}
+
+		private void Record(long startTicks, bool succeeded)
+		{
+			if (succeeded)
+			{
+				latencyTicks[Interlocked.Increment(ref latencyCount) - 1] = Stopwatch.GetTimestamp() - startTicks;
+			}
+			else
+			{
+				Interlocked.Increment(ref errors);
+			}
+			if (Interlocked.Increment(ref completed) == messages)
+			{
+				allCompleted.Set();
+			}
+		}
+
+		#region SocketClient
+
+		private void SendWithSocketClient()
+		{
+			SocketSettings settings = SocketClient.GetDefaultSettings();
+			settings.PoolSize = connections;
+			SocketClient socketClient = new SocketClient(destination, settings);
+
+			Thread[] threads = new Thread[connections];
+			for (int i = 0; i < threads.Length; i++)
+			{
+				threads[i] = new Thread(SendSocketClientMessages);
+				threads[i].Start(socketClient);
+			}
+			allCompleted.WaitOne();
+			foreach (Thread thread in threads)
+			{
+				thread.Join();
+			}
+		}
+
+		private void SendSocketClientMessages(object state)
+		{
+			SocketClient socketClient = (SocketClient)state;
+			MemoryStream payload = new MemoryStream(new byte[payloadBytes], 0, payloadBytes, false, true);
+			int message;
+			while ((message = Interlocked.Increment(ref nextMessage)) < messages)
+			{
+				payload.Seek(0, SeekOrigin.Begin);
+				long startTicks = Stopwatch.GetTimestamp();
+				bool succeeded = true;
+				try
+				{
+					if (IsOneWay(message))
+					{
+						socketClient.SendOneWay(commandId, payload);
+					}
+					else
+					{
+						socketClient.SendSync(commandId, payload);
+					}
+				}
+				catch (Exception)
+				{
+					succeeded = false;
+				}
+				Record(startTicks, succeeded);
+			}
+		}
+
+		#endregion
+
+		#region AsyncSocketClient
+
+		private void SendWithAsyncSocketClient()
+		{
+			SocketPoolConfig config = new SocketPoolConfig();
+			config.PoolCapacity = connections;
+			byte[] payload = new byte[payloadBytes];
+			using (AsyncSocketClient asyncClient = new AsyncSocketClient(destination, config))
+			using (Semaphore inFlight = new Semaphore(connections, connections))
+			{
+				int message;
+				while ((message = Interlocked.Increment(ref nextMessage)) < messages)
+				{
+					inFlight.WaitOne();
+					long startTicks = Stopwatch.GetTimestamp();
+					try
+					{
+						if (IsOneWay(message))
+						{
+							asyncClient.SendOneWayAsync<byte[]>((short)commandId, payload, WritePayload,
+								args =>
+								{
+									inFlight.Release();
+									Record(startTicks, args.Error == null);
+								});
+						}
+						else
+						{
+							asyncClient.SendRoundTripAsync<byte[]>((short)commandId, payload, WritePayload,
+								args =>
+								{
+									inFlight.Release();
+									Record(startTicks, args.Error == null);
+								});
+						}
+					}
+					catch (Exception)
+					{
+						inFlight.Release();
+						Record(startTicks, false);
+					}
+				}
+				//the last completion signals before the client and semaphore are disposed
+				allCompleted.WaitOne();
+			}
+		}
+
+		private static void WritePayload(byte[] payload, Stream stream)
+		{
+			stream.Write(payload, 0, payload.Length);
+		}
+
+		#endregion
+	}
+
+	/// <summary>
+	/// Reads the total bytes the process has allocated from the CLR memory performance counters.
+	/// </summary>
+	internal static class AllocationCounter
+	{
+		private static PerformanceCounter allocatedBytes;
+		private static bool unavailable;
+
+		/// <returns>The bytes allocated so far, or -1 if the counters can't be read.</returns>
+		internal static long Read()
+		{
+			if (unavailable)
+			{
+				return -1;
+			}
+			try
+			{
+				if (allocatedBytes == null)
+				{
+					allocatedBytes = new PerformanceCounter(".NET CLR Memory", "Allocated Bytes/sec",
+						Process.GetCurrentProcess().ProcessName, true);
+				}
+				//the raw value of the rate counter is the running total
+				return allocatedBytes.NextSample().RawValue;
+			}
+			catch (Exception)
+			{
+				unavailable = true;
+				return -1;
+			}
+		}
+	}
+}
@@ -0,0 +1,45 @@
+using System;
+using System.IO;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	/// <summary>
+	/// A message handler that does no work of its own, so what is measured is the transport.
+	/// </summary>
+	internal class EchoMessageHandler : IMessageHandler
+	{
+		/// <summary>Replies with a copy of the message.</summary>
+		internal const int EchoCommandId = 1;
+		/// <summary>Replies with <see cref="FixedReplySize"/> bytes whatever the message.</summary>
+		internal const int FixedReplyCommandId = 2;
+
+		private readonly byte[] fixedReply;
+
+		internal EchoMessageHandler(int fixedReplySize)
+		{
+			fixedReply = new byte[fixedReplySize];
+		}
+
+		internal int FixedReplySize
+		{
+			get { return fixedReply.Length; }
+		}
+
+		public MemoryStream HandleMessage(int commandID, MemoryStream messageStream, int messageLength)
+		{
+			switch (commandID)
+			{
+				case EchoCommandId:
+					//the message may be a view over the server's receive buffer, so it is copied
+					MemoryStream reply = new MemoryStream(messageLength);
+					reply.SetLength(messageLength);
+					messageStream.Read(reply.GetBuffer(), 0, messageLength);
+					return reply;
+				case FixedReplyCommandId:
+					return new MemoryStream(fixedReply, 0, fixedReply.Length, false, true);
+				default:
+					return null;
+			}
+		}
+	}
+}
@@ -0,0 +1,136 @@
+using System;
+using System.Diagnostics;
+using System.IO;
+using BerkeleyDbWrapper;
+using MySpace.BerkeleyDb.Configuration;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	/// <summary>
+	/// Measures how the btree key order of object id keys affects leaf page fill and reads, by
+	/// copying a database written in random id order the way a key order migration does.
+	/// </summary>
+	/// <remarks>
+	/// <para>The database as written, in the default byte-wise order, is the before case. It is
+	/// then copied with <see cref="Database.CopyFrom"/> into a byte-wise and an
+	/// <see cref="DatabaseKeyComparison.Int32"/> database. The byte-wise copy shows how much of
+	/// the difference comes from rewriting the file alone.</para>
+	/// <para>Each case reports the leaf page fill from <see cref="Database.GetLeafPageFill"/>, a
+	/// full cursor scan, and gets of runs of neighbouring ids, which is where the key order shows.
+	/// The environment keeps Berkeley Db's default cache, far smaller than the databases, so reads
+	/// go to the file system and the page layout counts.</para>
+	/// </remarks>
+	internal static class KeyOrderBenchmark
+	{
+		private const string writtenFileName = "written.db";
+
+		internal static void Run(int records, int valueBytes, int runLength, string home, TextWriter output, TextWriter console)
+		{
+			foreach (TextWriter writer in new[] { output, console })
+			{
+				writer.WriteLine("# Key order records: {0}, value bytes: {1}, ids per run: {2}", records, valueBytes, runLength);
+				writer.WriteLine("Case\tKeyComparison\tRecords\tLeafPageFill\tCopyMillis\tScanMillis\tNanosPerRunGet");
+			}
+			if (Directory.Exists(home))
+			{
+				Directory.Delete(home, true);
+			}
+			Directory.CreateDirectory(home);
+
+			int[] ids = CreateIds(records);
+			using (BerkeleyDbWrapper.Environment environment = new BerkeleyDbWrapper.Environment(home,
+				EnvOpenFlags.Create | EnvOpenFlags.InitMPool | EnvOpenFlags.Private))
+			{
+				using (Database written = environment.OpenDatabase(CreateConfig(writtenFileName, DatabaseKeyComparison.Bytewise)))
+				{
+					byte[] value = new byte[valueBytes];
+					foreach (int id in ids)
+					{
+						written.Put(id, value);
+					}
+					written.Sync();
+					Measure(output, console, "Written", DatabaseKeyComparison.Bytewise, written, 0, ids, runLength, valueBytes);
+				}
+
+				foreach (DatabaseKeyComparison keyComparison in new[] { DatabaseKeyComparison.Bytewise, DatabaseKeyComparison.Int32 })
+				{
+					string fileName = "copied." + keyComparison + ".db";
+					using (Database copied = environment.OpenDatabase(CreateConfig(fileName, keyComparison)))
+					{
+						Stopwatch watch = Stopwatch.StartNew();
+						copied.CopyFrom(writtenFileName, DatabaseKeyComparison.Bytewise);
+						copied.Sync();
+						watch.Stop();
+						Measure(output, console, "Copied", keyComparison, copied, watch.ElapsedMilliseconds, ids, runLength, valueBytes);
+					}
+				}
+			}
+		}
+
+		private static DatabaseConfig CreateConfig(string fileName, DatabaseKeyComparison keyComparison)
+		{
+			DatabaseConfig config = new DatabaseConfig();
+			config.FileName = fileName;
+			config.Type = DatabaseType.BTree;
+			config.OpenFlags = DbOpenFlags.Create;
+			config.KeyComparison = keyComparison;
+			return config;
+		}
+
+		/// <summary>
+		/// Ids in random order, as object ids arrive; repeats overwrite the earlier record.
+		/// </summary>
+		private static int[] CreateIds(int count)
+		{
+			Random random = new Random(count);
+			int[] ids = new int[count];
+			for (int i = 0; i < ids.Length; i++)
+			{
+				ids[i] = random.Next();
+			}
+			return ids;
+		}
+
+		private static void Measure(TextWriter output, TextWriter console, string name, DatabaseKeyComparison keyComparison,
+			Database db, long copyMilliseconds, int[] ids, int runLength, int valueBytes)
+		{
+			int leafPageFill = db.GetLeafPageFill();
+
+			Stopwatch watch = Stopwatch.StartNew();
+			int count = 0;
+			foreach (DatabaseRecord record in db)
+			{
+				count++;
+			}
+			long scanMilliseconds = watch.ElapsedMilliseconds;
+
+			// runs of ids that are next to each other in number, starting at random ids
+			int[] sortedIds = (int[])ids.Clone();
+			Array.Sort(sortedIds);
+			Random random = new Random(runLength);
+			DatabaseEntry value = new DatabaseEntry(Math.Max(valueBytes, 1));
+			int runs = Math.Max(sortedIds.Length / runLength / 10, 1);
+			int gets = 0;
+			watch = Stopwatch.StartNew();
+			for (int run = 0; run < runs; run++)
+			{
+				int start = random.Next(Math.Max(sortedIds.Length - runLength, 1));
+				for (int i = start; i < start + runLength && i < sortedIds.Length; i++)
+				{
+					value.Length = 0;
+					db.Get(sortedIds[i], value);
+					gets++;
+				}
+			}
+			watch.Stop();
+			double nanosPerGet = gets == 0 ? 0 : watch.Elapsed.TotalMilliseconds * 1000000 / gets;
+
+			foreach (TextWriter writer in new[] { output, console })
+			{
+				writer.WriteLine("{0}\t{1}\t{2}\t{3}\t{4}\t{5}\t{6:F1}", name, keyComparison, count, leafPageFill,
+					copyMilliseconds, scanMilliseconds, nanosPerGet);
+			}
+			output.Flush();
+		}
+	}
+}
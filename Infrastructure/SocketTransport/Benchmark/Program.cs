@@ -0,0 +1,251 @@
+using System;
+using System.Collections.Generic;
+using System.Configuration;
+using System.Globalization;
+using System.IO;
+using System.Net;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	/// <summary>
+	/// Starts a <see cref="SocketServer"/> on loopback with a handler that does no work, and
+	/// measures <see cref="SocketClient"/> and <see cref="AsyncSocketClient"/> against it.
+	/// </summary>
+	class Program
+	{
+		static int Main(string[] args)
+		{
+			Dictionary<string, string> options;
+			if (!TryParseOptions(args, out options) || !TryApplyPreset(options))
+			{
+				PrintUsage();
+				return 1;
+			}
+			string mode;
+			if (options.TryGetValue("mode", out mode) && string.Compare(mode, "routing", true) == 0)
+			{
+				return RunRouting(options);
+			}
+			if (mode != null && string.Compare(mode, "keyorder", true) == 0)
+			{
+				return RunKeyOrder(options);
+			}
+
+			int port = GetInt(options, "port", 9988);
+			int messages = GetInt(options, "messages", 50000);
+			int warmup = GetInt(options, "warmup", 2000);
+			int replyBytes = GetInt(options, "reply", -1);
+			SocketServerConfig serverConfig = ConfigurationManager.GetSection(SocketServer.ConfigSectionName) as SocketServerConfig
+				?? new SocketServerConfig();
+			List<ServerEngine> engines = new List<ServerEngine>();
+			foreach (string engine in GetList(options, "engines", serverConfig.UseSocketAsyncEventArgs
+				? ServerEngine.SocketAsyncEventArgs.ToString() : ServerEngine.BeginReceive.ToString()))
+			{
+				engines.Add((ServerEngine)Enum.Parse(typeof(ServerEngine), engine, true));
+			}
+			List<ClientKind> clients = new List<ClientKind>();
+			foreach (string client in GetList(options, "clients", "SocketClient,AsyncSocketClient"))
+			{
+				clients.Add((ClientKind)Enum.Parse(typeof(ClientKind), client, true));
+			}
+			List<int> connectionCounts = GetInts(options, "connections", "1,4,16");
+			List<int> payloadSizes = GetInts(options, "payloads", "64,1024,16384");
+			List<int> oneWayPercents = GetInts(options, "oneway", "0,50,100");
+			string outputPath = options.ContainsKey("out") ? options["out"] : "SocketTransportBenchmark.tsv";
+
+			EchoMessageHandler handler = new EchoMessageHandler(Math.Max(replyBytes, 0));
+			int commandId = replyBytes < 0 ? EchoMessageHandler.EchoCommandId : EchoMessageHandler.FixedReplyCommandId;
+
+			using (StreamWriter output = new StreamWriter(outputPath, false))
+			{
+				WriteDescription(output, replyBytes);
+				WriteDescription(Console.Out, replyBytes);
+				BenchmarkResult.WriteHeader(output);
+				BenchmarkResult.WriteHeader(Console.Out);
+				for (int i = 0; i < engines.Count; i++)
+				{
+					//each engine gets a fresh server, on its own port so the last one's closing connections don't interfere
+					serverConfig.UseSocketAsyncEventArgs = engines[i] == ServerEngine.SocketAsyncEventArgs;
+					SocketServer server = new SocketServer("Benchmark", port + i, serverConfig);
+					server.MessageHandler = handler;
+					server.Start();
+					IPEndPoint destination = new IPEndPoint(IPAddress.Loopback, port + i);
+					try
+					{
+						foreach (ClientKind client in clients)
+						{
+							foreach (int connections in connectionCounts)
+							{
+								foreach (int payloadBytes in payloadSizes)
+								{
+									foreach (int oneWayPercent in oneWayPercents)
+									{
+										BenchmarkRun run = new BenchmarkRun(destination, client, connections, payloadBytes,
+											oneWayPercent, commandId);
+										BenchmarkResult result = run.Run(warmup, messages);
+										result.Engine = engines[i];
+										result.Write(output);
+										result.Write(Console.Out);
+										output.Flush();
+									}
+								}
+							}
+						}
+					}
+					finally
+					{
+						server.Stop();
+					}
+				}
+			}
+			return 0;
+		}
+
+		/// <summary>
+		/// Runs <see cref="RoutingBenchmark"/> instead of the transport benchmark.
+		/// </summary>
+		private static int RunRouting(Dictionary<string, string> options)
+		{
+			int lookups = GetInt(options, "lookups", 1000000);
+			List<int> clusterCounts = GetInts(options, "clusters", "2,8,32");
+			string outputPath = options.ContainsKey("out") ? options["out"] : "RoutingBenchmark.tsv";
+			using (StreamWriter output = new StreamWriter(outputPath, false))
+			{
+				RoutingBenchmark.Run(lookups, clusterCounts, output, Console.Out);
+			}
+			return 0;
+		}
+
+		/// <summary>
+		/// Runs <see cref="KeyOrderBenchmark"/> instead of the transport benchmark.
+		/// </summary>
+		private static int RunKeyOrder(Dictionary<string, string> options)
+		{
+			int records = GetInt(options, "records", 1000000);
+			int valueBytes = GetInt(options, "value", 100);
+			int runLength = GetInt(options, "run", 100);
+			string home = options.ContainsKey("home") ? options["home"] : "KeyOrderBenchmark";
+			string outputPath = options.ContainsKey("out") ? options["out"] : "KeyOrderBenchmark.tsv";
+			using (StreamWriter output = new StreamWriter(outputPath, false))
+			{
+				KeyOrderBenchmark.Run(records, valueBytes, runLength, home, output, Console.Out);
+			}
+			return 0;
+		}
+
+		/// <summary>
+		/// Fills in the options a -preset stands for, unless they were given as well.
+		/// </summary>
+		/// <remarks>
+		/// The 1k and 10k presets compare the two server engines at that many connections, which
+		/// takes <see cref="AsyncSocketClient"/>; <see cref="SocketClient"/> needs a thread per connection.
+		/// </remarks>
+		/// <returns><see langword="false"/> if the preset is unknown.</returns>
+		private static bool TryApplyPreset(Dictionary<string, string> options)
+		{
+			string preset;
+			if (!options.TryGetValue("preset", out preset))
+			{
+				return true;
+			}
+			string connections;
+			switch (preset.ToLowerInvariant())
+			{
+				case "1k":
+					connections = "1000";
+					break;
+				case "10k":
+					connections = "10000";
+					break;
+				default:
+					return false;
+			}
+			SetDefault(options, "engines", "BeginReceive,SocketAsyncEventArgs");
+			SetDefault(options, "clients", "AsyncSocketClient");
+			SetDefault(options, "connections", connections);
+			SetDefault(options, "payloads", "1024");
+			SetDefault(options, "oneway", "0");
+			SetDefault(options, "messages", "200000");
+			SetDefault(options, "warmup", connections);
+			return true;
+		}
+
+		private static void SetDefault(Dictionary<string, string> options, string name, string value)
+		{
+			if (!options.ContainsKey(name))
+			{
+				options[name] = value;
+			}
+		}
+
+		/// <summary>
+		/// Writes what the results depend on as comment lines, which a diff shows once rather than per run.
+		/// </summary>
+		private static void WriteDescription(TextWriter writer, int replyBytes)
+		{
+			SocketSettings clientSettings = SocketClient.GetDefaultSettings();
+			writer.WriteLine("# Processors: {0}, CLR: {1}, 64 bit: {2}, Server GC: {3}",
+				Environment.ProcessorCount, Environment.Version, IntPtr.Size == 8,
+				System.Runtime.GCSettings.IsServerGC);
+			writer.WriteLine("# Reply: {0}",
+				replyBytes < 0 ? "echo" : replyBytes.ToString(CultureInfo.InvariantCulture) + " bytes");
+			writer.WriteLine("# SocketClient pool: {0}, Latencies are from send to reply, or to send completion for one way messages.",
+				clientSettings.PoolType);
+		}
+
+		private static bool TryParseOptions(string[] args, out Dictionary<string, string> options)
+		{
+			options = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+			for (int i = 0; i < args.Length; i += 2)
+			{
+				if (!args[i].StartsWith("-") || i + 1 >= args.Length)
+				{
+					return false;
+				}
+				options[args[i].Substring(1)] = args[i + 1];
+			}
+			return true;
+		}
+
+		private static int GetInt(Dictionary<string, string> options, string name, int defaultValue)
+		{
+			string value;
+			return options.TryGetValue(name, out value) ? Int32.Parse(value, CultureInfo.InvariantCulture) : defaultValue;
+		}
+
+		private static string[] GetList(Dictionary<string, string> options, string name, string defaultValue)
+		{
+			string value;
+			if (!options.TryGetValue(name, out value))
+			{
+				value = defaultValue;
+			}
+			return value.Split(new[] { ',' }, StringSplitOptions.RemoveEmptyEntries);
+		}
+
+		private static List<int> GetInts(Dictionary<string, string> options, string name, string defaultValue)
+		{
+			List<int> values = new List<int>();
+			foreach (string value in GetList(options, name, defaultValue))
+			{
+				values.Add(Int32.Parse(value, CultureInfo.InvariantCulture));
+			}
+			return values;
+		}
+
+		private static void PrintUsage()
+		{
+			Console.WriteLine("Usage: SocketTransportBenchmark [-preset 1k|10k] [-engines BeginReceive,SocketAsyncEventArgs]");
+			Console.WriteLine("       [-clients SocketClient,AsyncSocketClient] [-connections 1,4,16]");
+			Console.WriteLine("       [-payloads 64,1024,16384] [-oneway 0,50,100] [-messages 50000] [-warmup 2000]");
+			Console.WriteLine("       [-reply {bytes, echo if omitted}] [-port 9988] [-out SocketTransportBenchmark.tsv]");
+			Console.WriteLine("   or: SocketTransportBenchmark -mode routing [-lookups 1000000] [-clusters 2,8,32]");
+			Console.WriteLine("       [-out RoutingBenchmark.tsv]");
+			Console.WriteLine("   or: SocketTransportBenchmark -mode keyorder [-records 1000000] [-value 100] [-run 100]");
+			Console.WriteLine("       [-home KeyOrderBenchmark, emptied first] [-out KeyOrderBenchmark.tsv]");
+			Console.WriteLine("The 1k and 10k presets compare both engines with AsyncSocketClient at that many connections.");
+			Console.WriteLine("Engines default to the one in SocketServer.config; each uses the next port up.");
+			Console.WriteLine("The client pool type and other settings come from SocketServer.config and SocketClient.config.");
+		}
+	}
+}
@@ -0,0 +1,169 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using MySpace.DataRelay.RelayComponent.Forwarding;
+
+namespace MySpace.SocketTransport.Benchmark
+{
+	/// <summary>
+	/// Measures the forwarder's per message routing work without a network: placing an id on
+	/// a cluster, and getting the list of nodes a message goes to.
+	/// </summary>
+	/// <remarks>
+	/// Each case is measured next to the way it was done before routing used maps built when
+	/// the mapping loads: a linear scan of the cluster ranges, and a node list copied for every
+	/// message. The clusters are stand ins, since only their positions in the map matter here.
+	/// </remarks>
+	internal static class RoutingBenchmark
+	{
+		private const int zoneNodeCount = 8;
+
+		internal static void Run(int lookups, IList<int> clusterCounts, TextWriter output, TextWriter console)
+		{
+			foreach (TextWriter writer in new[] { output, console })
+			{
+				writer.WriteLine("# Routing lookups: {0}, zone nodes per list: {1}", lookups, zoneNodeCount);
+				writer.WriteLine("Case\tClusters\tLookups\tNanosPerLookup\tAllocBytesPerLookup");
+			}
+			int[] ids = CreateIds(lookups);
+			foreach (int clusterCount in clusterCounts)
+			{
+				ClusterMap hashMap = CreateMap(clusterCount, false, true);
+				ClusterMap moduloMap = CreateMap(clusterCount, false, false);
+				ClusterMap rangeMap = CreateMap(clusterCount, true, false);
+				int[] minimumIds, maximumIds;
+				CreateRanges(clusterCount, out minimumIds, out maximumIds);
+
+				Write(output, console, "ConsistentHash", clusterCount, ids.Length,
+					Measure(ids, id => hashMap.GetClusterIndex(id)));
+				Write(output, console, "Modulo", clusterCount, ids.Length,
+					Measure(ids, id => moduloMap.GetClusterIndex(id)));
+				Write(output, console, "RangeBinarySearch", clusterCount, ids.Length,
+					Measure(ids, id => rangeMap.GetClusterIndex(id)));
+				Write(output, console, "RangeLinearScan", clusterCount, ids.Length,
+					Measure(ids, id => GetRangedIndex(minimumIds, maximumIds, id)));
+			}
+
+			List<string> zoneNodes = new List<string>(zoneNodeCount);
+			for (int i = 0; i < zoneNodeCount; i++)
+			{
+				zoneNodes.Add("node" + i.ToString(CultureInfo.InvariantCulture));
+			}
+			SimpleLinkedListNode<string> chain = SimpleLinkedList<string>.CreateChain(zoneNodes);
+			Write(output, console, "NodeListCopied", 1, ids.Length,
+				Measure(ids, id => PopAll(new SimpleLinkedList<string>(zoneNodes))));
+			Write(output, console, "NodeListShared", 1, ids.Length,
+				Measure(ids, id => PopAll(new SimpleLinkedList<string>(chain, zoneNodes.Count))));
+		}
+
+		private static int[] CreateIds(int count)
+		{
+			Random random = new Random(count);
+			int[] ids = new int[count];
+			for (int i = 0; i < ids.Length; i++)
+			{
+				ids[i] = random.Next();
+			}
+			return ids;
+		}
+
+		/// <summary>
+		/// Splits the positive ids into <paramref name="clusterCount"/> equal ranges.
+		/// </summary>
+		private static void CreateRanges(int clusterCount, out int[] minimumIds, out int[] maximumIds)
+		{
+			minimumIds = new int[clusterCount];
+			maximumIds = new int[clusterCount];
+			int width = Int32.MaxValue / clusterCount;
+			for (int i = 0; i < clusterCount; i++)
+			{
+				minimumIds[i] = i * width;
+				maximumIds[i] = i == clusterCount - 1 ? Int32.MaxValue : (i + 1) * width - 1;
+			}
+		}
+
+		private static ClusterMap CreateMap(int clusterCount, bool clusterByRange, bool clusterByHash)
+		{
+			int[] minimumIds, maximumIds;
+			CreateRanges(clusterCount, out minimumIds, out maximumIds);
+			return new ClusterMap(new NodeCluster[clusterCount], minimumIds, maximumIds, clusterByRange,
+				clusterByHash, 0, DateTime.MinValue);
+		}
+
+		/// <summary>
+		/// How an id's cluster was found before the ranges were sorted.
+		/// </summary>
+		private static int GetRangedIndex(int[] minimumIds, int[] maximumIds, int objectId)
+		{
+			for (int i = 0; i < minimumIds.Length; i++)
+			{
+				if (objectId >= minimumIds[i] && objectId <= maximumIds[i])
+				{
+					return i;
+				}
+			}
+			return -1;
+		}
+
+		private static int PopAll(SimpleLinkedList<string> nodes)
+		{
+			int count = 0;
+			string node;
+			while (nodes.Pop(out node))
+			{
+				count++;
+			}
+			return count;
+		}
+
+		private delegate int Lookup(int objectId);
+
+		private struct Measurement
+		{
+			internal double NanosecondsPerLookup;
+			internal long AllocatedBytesPerLookup;
+		}
+
+		private static Measurement Measure(int[] ids, Lookup lookup)
+		{
+			//once unmeasured, to jit the lookup and warm the caches
+			int sink = 0;
+			for (int i = 0; i < ids.Length; i++)
+			{
+				sink += lookup(ids[i]);
+			}
+
+			GC.Collect();
+			GC.WaitForPendingFinalizers();
+			long allocatedBefore = AllocationCounter.Read();
+			Stopwatch elapsed = Stopwatch.StartNew();
+			for (int i = 0; i < ids.Length; i++)
+			{
+				sink += lookup(ids[i]);
+			}
+			elapsed.Stop();
+			GC.Collect();
+			long allocatedAfter = AllocationCounter.Read();
+
+			Measurement measurement;
+			measurement.NanosecondsPerLookup = elapsed.Elapsed.TotalMilliseconds * 1000000.0 / ids.Length;
+			measurement.AllocatedBytesPerLookup = allocatedBefore < 0 || allocatedAfter < 0
+				? -1
+				: (allocatedAfter - allocatedBefore) / ids.Length;
+			return measurement;
+		}
+
+		private static void Write(TextWriter output, TextWriter console, string name, int clusterCount, int lookups,
+			Measurement measurement)
+		{
+			foreach (TextWriter writer in new[] { output, console })
+			{
+				writer.WriteLine(string.Format(CultureInfo.InvariantCulture, "{0}\t{1}\t{2}\t{3:F1}\t{4}",
+					name, clusterCount, lookups, measurement.NanosecondsPerLookup, measurement.AllocatedBytesPerLookup));
+			}
+			output.Flush();
+		}
+	}
+}
@@ -253,6 +253,30 @@ namespace MySpace.SocketTransport
 			SocketManager.Instance.GetSocketCounts(destination, settings, out totalSockets, out activeSockets);
 		}
 
+		/// <summary>
+		/// Get the pool size, socket reuse and connect time histograms for a given destination and settings combination.
+		/// </summary>
+		/// <param name="destination">The server endpoint to check for.</param>
+		/// <param name="settings">The settings object portion of the pool key.</param>
+		/// <returns>The statistics, or null if the settings' pool type is not <see cref="SocketPoolType.Adaptive"/>.</returns>
+		public SocketPoolStatistics GetSocketPoolStatistics(IPEndPoint destination, SocketSettings settings)
+		{
+			return SocketManager.Instance.GetSocketPoolStatistics(destination, settings);
+		}
+
+		/// <summary>
+		/// Get how many one way batches failed to send to a given destination and settings combination,
+		/// and how many messages were dropped with them. Both are 0 if the settings don't batch one way messages.
+		/// </summary>
+		/// <param name="destination">The server endpoint to check for.</param>
+		/// <param name="settings">The settings object portion of the pool key.</param>
+		/// <param name="failedBatches">The number of batches dropped.</param>
+		/// <param name="droppedMessages">The number of messages in the dropped batches.</param>
+		public void GetOneWayBatchFailures(IPEndPoint destination, SocketSettings settings, out long failedBatches, out long droppedMessages)
+		{
+			SocketManager.Instance.GetOneWayBatchFailures(destination, settings, out failedBatches, out droppedMessages);
+		}
+
 
 		#region SendOneWay
 
@@ -298,12 +322,24 @@ namespace MySpace.SocketTransport
 
 		private void SendOneWay(SocketPool pool, int commandID, MemoryStream messageStream)
 		{
+			if (pool.OneWayBatcher != null)
+			{
+				pool.OneWayBatcher.Add((short)commandID, messageStream);
+				return;
+			}
+
 			ManagedSocket socket = null;
 			ResourcePoolItem<MemoryStream> rebufferedStreamItem = CreateOneWayMessage(commandID, messageStream, pool);
 
 			try
 			{
 				MemoryStream rebufferedStream = rebufferedStreamItem.Item;
+				MultiplexedSocketPool multiplexedPool = pool as MultiplexedSocketPool;
+				if (multiplexedPool != null)
+				{
+					multiplexedPool.GetConnection().Send(rebufferedStream.GetBuffer(), (int)rebufferedStream.Length);
+					return;
+				}
 				socket = pool.GetSocket();
 				// GetBuffer() should be used in preference to ToArray() where possible
 				// as it does not allocate a new byte[] like ToArray does().
@@ -386,6 +422,12 @@ namespace MySpace.SocketTransport
 
 		private MemoryStream SendSync(SocketPool pool, int commandID, MemoryStream messageStream)
 		{
+			MultiplexedSocketPool multiplexedPool = pool as MultiplexedSocketPool;
+			if (multiplexedPool != null)
+			{
+				return SendSync(multiplexedPool, (short)commandID, messageStream);
+			}
+
 			short messageId = (short)1; //new async scheme doesn't currently need these.
 			ResourcePoolItem<MemoryStream> rebufferedStreamItem = CreateSyncMessage((short)commandID, messageId, messageStream, pool);
 			MemoryStream rebufferedStream = rebufferedStreamItem.Item;
@@ -413,7 +455,7 @@ namespace MySpace.SocketTransport
 			}
 			catch (SocketException ex)
 			{
-				if (socket != null)
+				if (socket != null && !(ex is ShedReplyException))
 				{
 					socket.LastError = ex.SocketErrorCode;
 				}
@@ -431,6 +473,39 @@ namespace MySpace.SocketTransport
 			return replyStream;
 		}
 
+		/// <summary>
+		/// Sends on a shared connection and waits for the reply carrying the request's message id,
+		/// leaving the connection free for other requests meanwhile.
+		/// </summary>
+		private MemoryStream SendSync(MultiplexedSocketPool pool, short commandId, MemoryStream messageStream)
+		{
+			MultiplexedConnection connection = pool.GetConnection();
+			PendingReply reply = connection.Register();
+			try
+			{
+				ResourcePoolItem<MemoryStream> rebufferedStreamItem = CreateMultiplexedMessage(commandId, reply.MessageId, messageStream, pool);
+				try
+				{
+					MemoryStream rebufferedStream = rebufferedStreamItem.Item;
+					connection.Send(rebufferedStream.GetBuffer(), (int)rebufferedStream.Length);
+				}
+				finally
+				{
+					rebufferedStreamItem.Release();
+				}
+				return connection.WaitForReply(reply);
+			}
+			catch (ThreadAbortException)
+			{
+				log.Warn("Thread aborted on SocketClient.");
+				throw;
+			}
+			finally
+			{
+				connection.Complete(reply);
+			}
+		}
+
 		#endregion
 
 		#region Socket Pools
@@ -475,6 +550,10 @@ namespace MySpace.SocketTransport
 		private volatile int envelopeSize = 13; //size in bytes of the non-message information transmitted with each message
 		private byte[] doSendReply = BitConverter.GetBytes(true);
 		private byte[] dontSendReply = BitConverter.GetBytes(false);
+		private const byte sendReplyFlag = 0x01;
+		private const byte extendedMessageIdFlag = 0x02;
+		private const byte deadlineFlag = 0x04;
+		private const byte acceptsCompressionFlag = 0x08;
 		private byte[] messageStarterHost = BitConverter.GetBytes(Int16.MaxValue);
 		private byte[] messageTerminatorHost = BitConverter.GetBytes(Int16.MinValue);
 		private byte[] messageStarterNetwork = BitConverter.GetBytes(IPAddress.HostToNetworkOrder(Int16.MaxValue));
@@ -482,15 +561,20 @@ namespace MySpace.SocketTransport
 
 		internal ResourcePoolItem<MemoryStream> CreateOneWayMessage(int commandId, MemoryStream messageStream, SocketPool pool)
 		{
-			return CreateMessage((short)commandId, 0, messageStream, false, pool);
+			return CreateMessage((short)commandId, 0, false, messageStream, false, pool);
 		}
 
 		internal ResourcePoolItem<MemoryStream> CreateSyncMessage(Int16 commandId, Int16 messageId, MemoryStream messageStream, SocketPool pool)
 		{
-			return CreateMessage(commandId, messageId, messageStream, true, pool);
+			return CreateMessage(commandId, messageId, false, messageStream, true, pool);
 		}
 
-		private ResourcePoolItem<MemoryStream> CreateMessage(short commandId, short messageId, MemoryStream messageStream, bool isSync, SocketPool pool)
+		internal ResourcePoolItem<MemoryStream> CreateMultiplexedMessage(Int16 commandId, Int32 messageId, MemoryStream messageStream, SocketPool pool)
+		{
+			return CreateMessage(commandId, messageId, pool.Settings.UseExtendedMessageId, messageStream, true, pool);
+		}
+
+		private ResourcePoolItem<MemoryStream> CreateMessage(short commandId, int messageId, bool extendedMessageId, MemoryStream messageStream, bool isSync, SocketPool pool)
 		{
 			int messageLength = 0;
 
@@ -501,14 +585,32 @@ namespace MySpace.SocketTransport
 
 			bool useNetworkOrder = pool.Settings.UseNetworkOrder;
 
-			byte[] length = BitConverter.GetBytes(GetNetworkOrdered(messageLength + envelopeSize, useNetworkOrder));
+			//the server only understands the deadline if it is told to expect it
+			bool sendDeadline = isSync && pool.Settings.SendDeadline;
+			bool acceptsCompression = isSync && pool.Settings.AcceptCompressedReplies;
+			int messageEnvelopeSize = envelopeSize;
+			if (extendedMessageId)
+			{
+				messageEnvelopeSize += 4; //the 32 bit message id follows the flags
+			}
+			if (sendDeadline)
+			{
+				messageEnvelopeSize += 4; //then how long the reply will be waited for
+			}
+			byte[] length = BitConverter.GetBytes(GetNetworkOrdered(messageLength + messageEnvelopeSize, useNetworkOrder));
 			byte[] commandIdBytes;
 			byte[] messageIdBytes = null;
 			//byte[] code = BitConverter.GetBytes(GetNetworkOrdered(commandId, useNetworkOrder));
-			if (messageId != 0)
+			if (extendedMessageId)
+			{
+				//the short id is unused, the server reads the one after the flags
+				commandIdBytes = BitConverter.GetBytes(GetNetworkOrdered(commandId, useNetworkOrder));
+				messageIdBytes = BitConverter.GetBytes((short)0);
+			}
+			else if (messageId != 0)
 			{
 				commandIdBytes = BitConverter.GetBytes(GetNetworkOrdered(commandId, useNetworkOrder));
-				messageIdBytes = BitConverter.GetBytes(GetNetworkOrdered(messageId, useNetworkOrder));
+				messageIdBytes = BitConverter.GetBytes(GetNetworkOrdered((short)messageId, useNetworkOrder));
 			}
 			else
 			{
@@ -524,7 +626,7 @@ namespace MySpace.SocketTransport
 			rebufferedStream.Write(GetMessageStarter(useNetworkOrder), 0, 2);
 			rebufferedStream.Write(length, 0, 4);
 			//rebufferedStream.Write(code, 0, 4);
-			if (messageId != 0)
+			if (messageIdBytes != null)
 			{
 				if (useNetworkOrder)
 				{
@@ -542,7 +644,23 @@ namespace MySpace.SocketTransport
 				rebufferedStream.Write(commandIdBytes, 0, 4);
 			}
 
-			if (isSync)
+			if (extendedMessageId || sendDeadline || acceptsCompression)
+			{
+				byte flags = isSync ? sendReplyFlag : (byte)0;
+				if (extendedMessageId) flags |= extendedMessageIdFlag;
+				if (sendDeadline) flags |= deadlineFlag;
+				if (acceptsCompression) flags |= acceptsCompressionFlag;
+				rebufferedStream.WriteByte(flags);
+				if (extendedMessageId)
+				{
+					rebufferedStream.Write(BitConverter.GetBytes(GetNetworkOrdered(messageId, useNetworkOrder)), 0, 4);
+				}
+				if (sendDeadline)
+				{
+					rebufferedStream.Write(BitConverter.GetBytes(GetNetworkOrdered(pool.Settings.ReceiveTimeout, useNetworkOrder)), 0, 4);
+				}
+			}
+			else if (isSync)
 				rebufferedStream.Write(doSendReply, 0, doSendReply.Length);
 			else
 				rebufferedStream.Write(dontSendReply, 0, dontSendReply.Length);
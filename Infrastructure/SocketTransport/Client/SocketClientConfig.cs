@@ -93,6 +93,39 @@ namespace MySpace.SocketTransport
 		/// </summary>
 		[XmlElement("BufferReuses")]
 		public int BufferReuses = 1000;
+		/// <summary>
+		/// Whether multiplexed pools number requests with a 32 bit message id rather than the
+		/// 16 bit one. The server must understand the extended header flag.
+		/// </summary>
+		[XmlElement("UseExtendedMessageId")]
+		public bool UseExtendedMessageId;
+		/// <summary>
+		/// Whether sync messages tell the server how long the reply will be waited for, taken
+		/// from <see cref="ReceiveTimeout"/>, so the server can drop them once that has passed.
+		/// The server must understand the deadline header flag. The flag also tells the server this
+		/// client understands shed replies, so only such clients have messages shed under overload.
+		/// </summary>
+		[XmlElement("SendDeadline")]
+		public bool SendDeadline;
+		/// <summary>
+		/// Whether sync messages tell the server it may compress large replies. The server
+		/// must understand the compression header flag.
+		/// </summary>
+		[XmlElement("AcceptCompressedReplies")]
+		public bool AcceptCompressedReplies;
+		/// <summary>
+		/// When greater than 0, one way messages are gathered into batch frames of up to about
+		/// this many bytes, which the server splits back into messages. The server must
+		/// recognize the batch command id, <see cref="Int16.MaxValue"/>, which no message may use.
+		/// </summary>
+		[XmlElement("OneWayBatchMaxBytes")]
+		public int OneWayBatchMaxBytes;
+		/// <summary>
+		/// How long, in milliseconds, the first one way message of a batch waits for others to
+		/// join it. With 0, messages only gather while an earlier batch is being sent.
+		/// </summary>
+		[XmlElement("OneWayBatchDelayMilliseconds")]
+		public int OneWayBatchDelayMilliseconds;
 
 		/// <summary>
 		/// Mersenne prime base hash algorithm,
@@ -135,6 +168,12 @@ namespace MySpace.SocketTransport
 				case SocketPoolType.Linked:
 					hash = ((hash << 5) ^ (hash >> 27)) ^ 131071;     // 17-bit Mersenne prime
 					break;
+				case SocketPoolType.Multiplexed:
+					hash = ((hash << 5) ^ (hash >> 27)) ^ 2147483647; // 31-bit Mersenne prime
+					break;
+				case SocketPoolType.Adaptive:
+					hash = ((hash << 5) ^ (hash >> 27)) ^ 524287;     // 19-bit Mersenne prime
+					break;
 			}
 			hash = ((hash << 5) ^ (hash >> 27)) ^ PoolSize;
 			hash = ((hash << 5) ^ (hash >> 27)) ^ ConnectTimeout;
@@ -147,6 +186,11 @@ namespace MySpace.SocketTransport
 			hash = ((hash << 5) ^ (hash >> 27)) ^ SocketLifetimeMinutes;
 			hash = ((hash << 5) ^ (hash >> 27)) ^ BufferReuses;
 			if (UseNetworkOrder) { hash = ((hash << 5) ^ (hash >> 27)) ^ 524287; } // 19 bit Mersenne prime
+			if (UseExtendedMessageId) { hash = ((hash << 5) ^ (hash >> 27)) ^ 8191; } // 13 bit Mersenne prime
+			if (SendDeadline) { hash = ((hash << 5) ^ (hash >> 27)) ^ 127; } // 7 bit Mersenne prime
+			if (AcceptCompressedReplies) { hash = ((hash << 5) ^ (hash >> 27)) ^ 131071; } // 17 bit Mersenne prime
+			hash = ((hash << 5) ^ (hash >> 27)) ^ OneWayBatchMaxBytes;
+			hash = ((hash << 5) ^ (hash >> 27)) ^ OneWayBatchDelayMilliseconds;
 
 			hash %= 2147483647; // 31 bit Mersenne prime
 
@@ -172,7 +216,12 @@ namespace MySpace.SocketTransport
 					SendTimeout != settingsObj.SendTimeout ||
 					SocketLifetimeMinutes != settingsObj.SocketLifetimeMinutes ||
 					UseNetworkOrder != settingsObj.UseNetworkOrder ||
-					BufferReuses != settingsObj.BufferReuses
+					BufferReuses != settingsObj.BufferReuses ||
+					UseExtendedMessageId != settingsObj.UseExtendedMessageId ||
+					SendDeadline != settingsObj.SendDeadline ||
+					AcceptCompressedReplies != settingsObj.AcceptCompressedReplies ||
+					OneWayBatchMaxBytes != settingsObj.OneWayBatchMaxBytes ||
+					OneWayBatchDelayMilliseconds != settingsObj.OneWayBatchDelayMilliseconds
 					)
 					return false;
 				else
@@ -206,6 +255,11 @@ namespace MySpace.SocketTransport
 			copy.SendTimeout = this.SendTimeout;
 			copy.SocketLifetimeMinutes = this.SocketLifetimeMinutes;
 			copy.UseNetworkOrder = this.UseNetworkOrder;
+			copy.UseExtendedMessageId = this.UseExtendedMessageId;
+			copy.SendDeadline = this.SendDeadline;
+			copy.AcceptCompressedReplies = this.AcceptCompressedReplies;
+			copy.OneWayBatchMaxBytes = this.OneWayBatchMaxBytes;
+			copy.OneWayBatchDelayMilliseconds = this.OneWayBatchDelayMilliseconds;
 
 			return copy;
 		}
@@ -243,6 +297,17 @@ namespace MySpace.SocketTransport
 		/// <summary>
 		/// A linked list of open sockets. The preferred pool type for most cases.
 		/// </summary>
-		Linked
+		Linked,
+		/// <summary>
+		/// A few shared connections per destination, each carrying many outstanding requests
+		/// matched to their replies by message id. Use where the number of concurrent requests,
+		/// rather than the number of sockets, should scale.
+		/// </summary>
+		Multiplexed,
+		/// <summary>
+		/// Like Linked, but sized to the observed load and preferring the sockets that reply
+		/// fastest. Slow and failed sockets are closed and replaced.
+		/// </summary>
+		Adaptive
 	}
 }
@@ -0,0 +1,398 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	internal class AdaptiveManagedSocket : ManagedSocket
+	{
+		/// <summary>The Stopwatch timestamp of when the socket was last checked out.</summary>
+		internal long CheckedOutTimestamp;
+		/// <summary>The moving average of the socket's reply times, in Stopwatch ticks.</summary>
+		internal double AverageReplyTicks;
+		internal int ReplySamples;
+		internal int Uses;
+
+		internal AdaptiveManagedSocket(SocketSettings settings, SocketPool pool)
+			: base(settings, pool)
+		{
+		}
+	}
+
+	/// <summary>
+	/// A socket pool that sizes itself to the load on its destination and prefers its fastest sockets.
+	/// </summary>
+	/// <remarks>
+	/// <para>Idle sockets are handed out fastest first, by the moving average of their reply
+	/// times. A socket whose average grows well past the pool's is closed, as is one found
+	/// with an error while idle.</para>
+	/// <para>About once a second the pool estimates the sockets it needs by Little's law, from
+	/// the rate sockets are asked for and how long replies take. It closes idle sockets above
+	/// that, and connects new ones ahead of demand when every socket is busy.</para>
+	/// </remarks>
+	internal class AdaptiveSocketPool : SocketPool
+	{
+		private const double smoothing = 0.2;
+		private const int minimumReplySamples = 20;
+		private const double slowFactor = 3.0;
+		private const double headroom = 1.5;
+		private const double maximumPrewarmErrorRate = 0.1;
+		private const int maximumPrewarmPerInterval = 2;
+		private static readonly long maintenanceIntervalTicks = TimeSpan.TicksPerSecond;
+
+		private readonly List<AdaptiveManagedSocket> idleSockets = new List<AdaptiveManagedSocket>();
+		private readonly bool useLimiter;
+		private readonly Semaphore socketLimiter;
+		private readonly int maximumSockets;
+
+		private readonly object averagesLock = new object(); //guards the moving averages below
+		private double averageReplyTicks;
+		private double errorRate;
+		private double arrivalsPerSecond;
+		private int arrivals;
+		private int peakActive;
+		private int targetSize = 1;
+		private long nextMaintenanceTicks;
+		private long lastMaintenanceTicks = DateTime.UtcNow.Ticks;
+		private int prewarming;
+
+		private readonly SocketPoolHistogram poolSizeHistogram = new SocketPoolHistogram(1, 2, 4, 8, 16, 32, 64, 128, 256);
+		private readonly SocketPoolHistogram reuseHistogram = new SocketPoolHistogram(1, 10, 100, 1000, 10000, 100000, 1000000);
+		private readonly SocketPoolHistogram connectHistogram = new SocketPoolHistogram(1, 2, 5, 10, 20, 50, 100, 200, 500, 1000);
+
+		internal AdaptiveSocketPool(IPEndPoint destination, SocketSettings settings)
+			: base(destination, settings)
+		{
+			maximumSockets = settings.PoolSize > 0 ? settings.PoolSize : Int32.MaxValue;
+			if (settings.PoolSize > 0)
+			{
+				useLimiter = true;
+				socketLimiter = new Semaphore(settings.PoolSize, settings.PoolSize);
+			}
+		}
+
+		internal override ManagedSocket GetSocket()
+		{
+			if (!EnterLimiter())
+			{
+				throw new SocketException((int)SocketError.TooManyOpenSockets);
+			}
+			try
+			{
+				Interlocked.Increment(ref arrivals);
+				AdaptiveManagedSocket socket = TakeFastestIdleSocket() ?? BuildSocket();
+				socket.Idle = false;
+				socket.Uses++;
+				socket.CheckedOutTimestamp = Stopwatch.GetTimestamp();
+				socket.AwaitedReply = false;
+				int active = Interlocked.Increment(ref activeSocketCount);
+				int peak;
+				while (active > (peak = peakActive) && Interlocked.CompareExchange(ref peakActive, active, peak) != peak)
+				{
+				}
+				Maintain();
+				return socket;
+			}
+			catch
+			{
+				ExitLimiter();
+				throw;
+			}
+		}
+
+		internal override void ReleaseSocket(ManagedSocket managedSocket)
+		{
+			AdaptiveManagedSocket socket = (AdaptiveManagedSocket)managedSocket;
+			if (socket.Idle)
+			{
+				return;
+			}
+			try
+			{
+				bool failed = socket.LastError != SocketError.Success;
+				RecordUse(socket, failed);
+				Interlocked.Decrement(ref activeSocketCount);
+				if (failed || SocketAgedOut(socket) || IsSlow(socket))
+				{
+					DisposeSocket(socket);
+				}
+				else
+				{
+					lock (idleSockets)
+					{
+						socket.Idle = true;
+						idleSockets.Add(socket);
+					}
+				}
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Exception releasing socket: {0}", ex);
+			}
+			finally
+			{
+				ExitLimiter();
+			}
+			Maintain();
+		}
+
+		internal override void ReleaseAndDisposeAll()
+		{
+			List<AdaptiveManagedSocket> sockets;
+			lock (idleSockets)
+			{
+				sockets = new List<AdaptiveManagedSocket>(idleSockets);
+				idleSockets.Clear();
+			}
+			foreach (AdaptiveManagedSocket socket in sockets)
+			{
+				DisposeSocket(socket);
+			}
+		}
+
+		internal SocketPoolStatistics GetStatistics()
+		{
+			SocketPoolStatistics statistics = new SocketPoolStatistics();
+			statistics.PoolSize = poolSizeHistogram.Snapshot();
+			statistics.Reuse = reuseHistogram.Snapshot();
+			statistics.ConnectMilliseconds = connectHistogram.Snapshot();
+			lock (averagesLock)
+			{
+				statistics.AverageReplyMilliseconds = averageReplyTicks * 1000 / Stopwatch.Frequency;
+				statistics.ErrorRate = errorRate;
+			}
+			statistics.TargetSize = targetSize;
+			return statistics;
+		}
+
+		private AdaptiveManagedSocket BuildSocket()
+		{
+			AdaptiveManagedSocket socket = new AdaptiveManagedSocket(Settings, this);
+			Stopwatch connectTime = Stopwatch.StartNew();
+			socket.Connect(destination, Settings.ConnectTimeout);
+			connectHistogram.Record(connectTime.ElapsedMilliseconds);
+			Interlocked.Increment(ref socketCount);
+			return socket;
+		}
+
+		private AdaptiveManagedSocket TakeFastestIdleSocket()
+		{
+			List<AdaptiveManagedSocket> failedSockets = null;
+			AdaptiveManagedSocket fastest = null;
+			lock (idleSockets)
+			{
+				int fastestIndex = -1;
+				for (int i = idleSockets.Count - 1; i >= 0; i--)
+				{
+					AdaptiveManagedSocket socket = idleSockets[i];
+					if (socket.LastError != SocketError.Success)
+					{
+						//the receive loop can fail a socket while it sits idle
+						if (failedSockets == null) failedSockets = new List<AdaptiveManagedSocket>();
+						failedSockets.Add(socket);
+						idleSockets.RemoveAt(i);
+						if (fastestIndex > i) fastestIndex--;
+						continue;
+					}
+					if (fastest == null || socket.AverageReplyTicks < fastest.AverageReplyTicks)
+					{
+						fastest = socket;
+						fastestIndex = i;
+					}
+				}
+				if (fastest != null)
+				{
+					idleSockets.RemoveAt(fastestIndex);
+				}
+			}
+			if (failedSockets != null)
+			{
+				foreach (AdaptiveManagedSocket socket in failedSockets)
+				{
+					socket.Idle = false;
+					DisposeSocket(socket);
+				}
+			}
+			return fastest;
+		}
+
+		private void RecordUse(AdaptiveManagedSocket socket, bool failed)
+		{
+			//one way sends would make the average look faster than replies are
+			bool sampled = !failed && socket.AwaitedReply;
+			long replyTicks = Stopwatch.GetTimestamp() - socket.CheckedOutTimestamp;
+			if (sampled)
+			{
+				//the socket is only released by the thread that checked it out
+				socket.AverageReplyTicks = socket.ReplySamples == 0
+					? replyTicks
+					: socket.AverageReplyTicks + (replyTicks - socket.AverageReplyTicks) * smoothing;
+				socket.ReplySamples++;
+			}
+			lock (averagesLock)
+			{
+				errorRate += ((failed ? 1.0 : 0.0) - errorRate) * smoothing;
+				if (sampled)
+				{
+					averageReplyTicks = averageReplyTicks == 0
+						? replyTicks
+						: averageReplyTicks + (replyTicks - averageReplyTicks) * smoothing;
+				}
+			}
+		}
+
+		private bool IsSlow(AdaptiveManagedSocket socket)
+		{
+			if (socket.ReplySamples < minimumReplySamples || socketCount <= 1)
+			{
+				return false;
+			}
+			double poolAverageTicks;
+			lock (averagesLock)
+			{
+				poolAverageTicks = averageReplyTicks;
+			}
+			return poolAverageTicks > 0 && socket.AverageReplyTicks > poolAverageTicks * slowFactor;
+		}
+
+		/// <summary>
+		/// Resizes the pool at most once per interval.
+		/// </summary>
+		private void Maintain()
+		{
+			long now = DateTime.UtcNow.Ticks;
+			long next = Interlocked.Read(ref nextMaintenanceTicks);
+			if (now < next || Interlocked.CompareExchange(ref nextMaintenanceTicks, now + maintenanceIntervalTicks, next) != next)
+			{
+				return;
+			}
+			double seconds = (double)(now - lastMaintenanceTicks) / TimeSpan.TicksPerSecond;
+			lastMaintenanceTicks = now;
+			int arrived = Interlocked.Exchange(ref arrivals, 0);
+			int peak = Interlocked.Exchange(ref peakActive, activeSocketCount);
+			poolSizeHistogram.Record(socketCount);
+
+			double concurrency, currentErrorRate;
+			lock (averagesLock)
+			{
+				if (seconds > 0)
+				{
+					arrivalsPerSecond += (arrived / seconds - arrivalsPerSecond) * smoothing;
+				}
+				//Little's law: the sockets in use on average are the arrival rate times the time each is held
+				concurrency = arrivalsPerSecond * averageReplyTicks / Stopwatch.Frequency;
+				currentErrorRate = errorRate;
+			}
+			int target = Math.Max((int)Math.Ceiling(concurrency * headroom), peak) + 1;
+			targetSize = Math.Min(target, maximumSockets);
+
+			ShrinkIdle();
+			if (socketCount < targetSize && currentErrorRate < maximumPrewarmErrorRate &&
+				Interlocked.CompareExchange(ref prewarming, 1, 0) == 0)
+			{
+				ThreadPool.QueueUserWorkItem(Prewarm);
+			}
+		}
+
+		/// <summary>
+		/// Closes the slowest idle sockets above the target size.
+		/// </summary>
+		private void ShrinkIdle()
+		{
+			List<AdaptiveManagedSocket> excess = null;
+			lock (idleSockets)
+			{
+				int extra = Math.Min(socketCount - targetSize, idleSockets.Count);
+				if (extra > 0)
+				{
+					idleSockets.Sort(delegate(AdaptiveManagedSocket x, AdaptiveManagedSocket y)
+						{ return y.AverageReplyTicks.CompareTo(x.AverageReplyTicks); });
+					excess = idleSockets.GetRange(0, extra);
+					idleSockets.RemoveRange(0, extra);
+				}
+			}
+			if (excess != null)
+			{
+				foreach (AdaptiveManagedSocket socket in excess)
+				{
+					socket.Idle = false;
+					DisposeSocket(socket);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Connects sockets up to the target size, so callers don't wait for them.
+		/// </summary>
+		private void Prewarm(object state)
+		{
+			try
+			{
+				for (int built = 0; built < maximumPrewarmPerInterval && socketCount < targetSize; built++)
+				{
+					AdaptiveManagedSocket socket = BuildSocket();
+					lock (idleSockets)
+					{
+						socket.Idle = true;
+						idleSockets.Add(socket);
+					}
+				}
+			}
+			catch (SocketException ex)
+			{
+				if (log.IsWarnEnabled)
+					log.WarnFormat("Socket Error {0} connecting ahead of demand to {1}.", ex.SocketErrorCode, destination);
+			}
+			catch (ObjectDisposedException)
+			{
+			}
+			finally
+			{
+				Interlocked.Exchange(ref prewarming, 0);
+			}
+		}
+
+		private void DisposeSocket(AdaptiveManagedSocket socket)
+		{
+			reuseHistogram.Record(socket.Uses);
+			Interlocked.Decrement(ref socketCount);
+			try
+			{
+				if (socket.Connected)
+				{
+					socket.Shutdown(SocketShutdown.Both);
+				}
+				socket.Close();
+			}
+			catch (SocketException)
+			{ }
+			catch (ObjectDisposedException)
+			{ }
+		}
+
+		private bool EnterLimiter()
+		{
+			return !useLimiter || socketLimiter.WaitOne(Settings.ConnectTimeout, false);
+		}
+
+		private void ExitLimiter()
+		{
+			if (useLimiter)
+			{
+				try
+				{
+					socketLimiter.Release();
+				}
+				catch (SemaphoreFullException)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Socket pool for {0} released a socket too many times.", destination);
+				}
+			}
+		}
+	}
+}
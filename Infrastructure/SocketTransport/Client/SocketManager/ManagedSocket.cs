@@ -4,6 +4,7 @@ using System.Net.Sockets;
 using System.Net;
 using System.Threading;
 using System.Diagnostics;
+using MySpace.Common.IO;
 
 namespace MySpace.SocketTransport
 {
@@ -30,6 +31,7 @@ namespace MySpace.SocketTransport
 		private SocketPool myPool = null;
 
 		internal SocketError LastError = SocketError.Success;
+		internal bool AwaitedReply; //set once a reply has been waited for, for pools that time replies
 
 		internal ManagedSocket(SocketSettings settings, SocketPool socketPool)
 			: base(AddressFamily.InterNetwork, SocketType.Stream, ProtocolType.Tcp)
@@ -113,6 +115,8 @@ namespace MySpace.SocketTransport
 						messageSize = IPAddress.NetworkToHostOrder(messageSize);
 						messageId = IPAddress.NetworkToHostOrder(messageId);
 					}
+					bool compressed = (messageSize & CompressedReplyFlag) != 0;
+					messageSize &= ~CompressedReplyFlag;
 
 					messageBuffer.Write(receiveBuffer, envelopeLength, received - envelopeLength);
 
@@ -124,10 +128,18 @@ namespace MySpace.SocketTransport
 						messageBuffer.Write(receiveBuffer, 0, received);
 					}
 
-					replyStream = CreateGetReplyResponse(messageBuffer, replyLength);
+					bool shed = !compressed && IsShedReply(messageBuffer.GetBuffer(), 0, replyLength);
+					if (compressed)
+					{
+						replyStream = DecompressReply(messageBuffer.GetBuffer(), 0, replyLength);
+					}
+					else if (!shed)
+					{
+						replyStream = CreateGetReplyResponse(messageBuffer, replyLength);
+					}
 					this.BeginReceive(GetReceiveBuffer(settings.ReceiveBufferSize), 0, settings.ReceiveBufferSize, SocketFlags.None, receiveCallBack, null);
 
-					PostReply(messageId, replyStream);
+					PostReply(messageId, replyStream, shed);
 				}
 				catch (SocketException sex)
 				{
@@ -150,6 +162,7 @@ namespace MySpace.SocketTransport
 
 		#region Persocket async reply
 		private MemoryStream replyStream;
+		private bool replyShed;
 		internal EventWaitHandle waitHandle = new EventWaitHandle(false, EventResetMode.AutoReset);
 		short currentMessageId = 1;
 
@@ -160,11 +173,12 @@ namespace MySpace.SocketTransport
 			waitHandle.Set();
 		}
 
-		private void PostReply(short messageId, MemoryStream replyStream)
+		private void PostReply(short messageId, MemoryStream replyStream, bool shed)
 		{
 			if (messageId == currentMessageId)
 			{
 				this.replyStream = replyStream;
+				this.replyShed = shed;
 				waitHandle.Set();
 			}
 			else
@@ -178,9 +192,15 @@ namespace MySpace.SocketTransport
 		internal MemoryStream GetReply()
 		{
 			MemoryStream reply;
+			AwaitedReply = true;
 			if (waitHandle.WaitOne(this.ReceiveTimeout, false))
 			{
 				if (LastError != SocketError.Success) throw new SocketException((int)LastError);
+				if (replyShed)
+				{
+					replyShed = false;
+					throw new ShedReplyException();
+				}
 				reply = replyStream;
 				replyStream = null;
 				return reply;
@@ -194,8 +214,50 @@ namespace MySpace.SocketTransport
 
 		#endregion
 
+		/// <summary>
+		/// Set in the size of a reply whose body the server compressed.
+		/// </summary>
+		internal const int CompressedReplyFlag = 0x40000000;
+
+		/// <summary>
+		/// Decompresses the reply body at <paramref name="offset"/>.
+		/// </summary>
+		internal static MemoryStream DecompressReply(byte[] buffer, int offset, int replyLength)
+		{
+			byte[] compressed = new byte[replyLength];
+			Buffer.BlockCopy(buffer, offset, compressed, 0, replyLength);
+			return new MemoryStream(Compressor.GetInstance().Decompress(compressed));
+		}
+
 		private static Byte[] emptyReplyBytes = { 241, 216, 255, 255 };
 
+		/// <summary>
+		/// Gets whether the reply at <paramref name="offset"/> is the server's "emptyReply".
+		/// </summary>
+		internal static bool IsEmptyReply(byte[] buffer, int offset, int replyLength)
+		{
+			return replyLength == 4
+				&& buffer[offset] == emptyReplyBytes[0]
+				&& buffer[offset + 1] == emptyReplyBytes[1]
+				&& buffer[offset + 2] == emptyReplyBytes[2]
+				&& buffer[offset + 3] == emptyReplyBytes[3];
+		}
+
+		private static Byte[] shedReplyBytes = { 239, 216, 255, 255 };
+
+		/// <summary>
+		/// Gets whether the reply at <paramref name="offset"/> says the server shed the message
+		/// because it expired or the server was overloaded.
+		/// </summary>
+		internal static bool IsShedReply(byte[] buffer, int offset, int replyLength)
+		{
+			return replyLength == 4
+				&& buffer[offset] == shedReplyBytes[0]
+				&& buffer[offset + 1] == shedReplyBytes[1]
+				&& buffer[offset + 2] == shedReplyBytes[2]
+				&& buffer[offset + 3] == shedReplyBytes[3];
+		}
+
 		internal static MemoryStream CreateGetReplyResponse(MemoryStream messageBuffer, Int32 replyLength)
 		{
 			MemoryStream replyStream = null;
@@ -316,6 +378,18 @@ namespace MySpace.SocketTransport
 		}
 
 	}
+	/// <summary>
+	/// Thrown when the server shed a message instead of handling it. It reports a time out,
+	/// but the socket it came in on is still good.
+	/// </summary>
+	internal class ShedReplyException : SocketException
+	{
+		internal ShedReplyException()
+			: base((int)SocketError.TimedOut)
+		{
+		}
+	}
+
 	internal class ManagedConnectState
 	{
 		internal ManagedConnectState(Socket socket)
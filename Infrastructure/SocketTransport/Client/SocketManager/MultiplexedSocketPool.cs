@@ -0,0 +1,497 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// A request waiting on a <see cref="MultiplexedConnection"/> for its reply.
+	/// </summary>
+	internal sealed class PendingReply
+	{
+		internal readonly AutoResetEvent WaitHandle = new AutoResetEvent(false);
+		internal int MessageId;
+		internal MemoryStream Reply;
+		internal SocketError Error;
+		internal bool Shed;
+
+		internal void Reset()
+		{
+			WaitHandle.Reset();
+			MessageId = 0;
+			Reply = null;
+			Error = SocketError.Success;
+			Shed = false;
+		}
+	}
+
+	/// <summary>
+	/// Sends every request for a destination over a few long lived connections instead of
+	/// checking a socket out for each one. Any number of requests can be outstanding on a
+	/// connection; replies are matched to them by message id.
+	/// </summary>
+	/// <remarks>
+	/// <see cref="SocketPool.activeSocketCount"/> counts the requests in flight to the
+	/// destination rather than sockets in use.
+	/// </remarks>
+	internal class MultiplexedSocketPool : SocketPool
+	{
+		private readonly MultiplexedConnection[] connections;
+		private readonly Stack<PendingReply> pendingReplyPool = new Stack<PendingReply>();
+		private readonly int maximumMessageId;
+		private int nextConnection;
+		private int nextMessageId;
+
+		internal MultiplexedSocketPool(IPEndPoint destination, SocketSettings settings)
+			: base(destination, settings)
+		{
+			connections = new MultiplexedConnection[settings.PoolSize > 0 ? settings.PoolSize : 1];
+			//without the extended id the server can only echo a 16 bit id
+			maximumMessageId = settings.UseExtendedMessageId ? Int32.MaxValue : Int16.MaxValue;
+		}
+
+		internal override ManagedSocket GetSocket()
+		{
+			throw new InvalidOperationException("Multiplexed socket pools do not check sockets out. Use GetConnection instead.");
+		}
+
+		internal override void ReleaseSocket(ManagedSocket socket)
+		{
+			throw new InvalidOperationException("Multiplexed socket pools do not check sockets out.");
+		}
+
+		/// <summary>
+		/// Gets the next connection in turn, replacing it first if it has failed or aged out.
+		/// </summary>
+		internal MultiplexedConnection GetConnection()
+		{
+			int index = (Interlocked.Increment(ref nextConnection) & Int32.MaxValue) % connections.Length;
+			MultiplexedConnection connection = connections[index];
+			if (connection != null && connection.IsOpen && !ConnectionAgedOut(connection))
+			{
+				return connection;
+			}
+			lock (connections)
+			{
+				connection = connections[index];
+				if (connection != null && connection.IsOpen && !ConnectionAgedOut(connection))
+				{
+					return connection;
+				}
+				if (connection != null)
+				{
+					//requests already sent on it are still answered
+					connection.Retire();
+				}
+				connection = new MultiplexedConnection(this);
+				connection.Connect(destination, Settings.ConnectTimeout);
+				connections[index] = connection;
+				return connection;
+			}
+		}
+
+		internal override void ReleaseAndDisposeAll()
+		{
+			lock (connections)
+			{
+				for (int i = 0; i < connections.Length; i++)
+				{
+					if (connections[i] != null)
+					{
+						connections[i].Close(SocketError.OperationAborted);
+						connections[i] = null;
+					}
+				}
+			}
+		}
+
+		private bool ConnectionAgedOut(MultiplexedConnection connection)
+		{
+			return DateTime.UtcNow.Ticks - connection.CreatedTicks > socketLifetimeTicks;
+		}
+
+		internal int NextMessageId()
+		{
+			int messageId;
+			do
+			{
+				messageId = (Interlocked.Increment(ref nextMessageId) & Int32.MaxValue) % (maximumMessageId + 1);
+			} while (messageId == 0); //0 means the request carries no message id
+			return messageId;
+		}
+
+		internal PendingReply GetPendingReply()
+		{
+			lock (pendingReplyPool)
+			{
+				if (pendingReplyPool.Count > 0)
+				{
+					return pendingReplyPool.Pop();
+				}
+			}
+			return new PendingReply();
+		}
+
+		internal void ReleasePendingReply(PendingReply pending)
+		{
+			pending.Reply = null;
+			lock (pendingReplyPool)
+			{
+				pendingReplyPool.Push(pending);
+			}
+		}
+	}
+
+	/// <summary>
+	/// One connection of a <see cref="MultiplexedSocketPool"/>. Requests are written under a
+	/// send lock; a receive loop dedicated to the connection reads the replies and wakes the
+	/// requests waiting on them.
+	/// </summary>
+	internal class MultiplexedConnection
+	{
+		private static readonly MySpace.Logging.LogWrapper log = new MySpace.Logging.LogWrapper();
+
+		private readonly MultiplexedSocketPool pool;
+		private readonly Socket socket;
+		private readonly SocketSettings settings;
+		private readonly Dictionary<int, PendingReply> pending = new Dictionary<int, PendingReply>();
+		private readonly object sendLock = new object();
+		private readonly AsyncCallback receiveCallBack;
+		private readonly int messageIdLength;
+		private byte[] receiveBuffer;
+		private int received;
+		private bool closed;
+		private bool retired;
+
+		internal readonly long CreatedTicks;
+
+		internal MultiplexedConnection(MultiplexedSocketPool pool)
+		{
+			this.pool = pool;
+			settings = pool.Settings;
+			CreatedTicks = DateTime.UtcNow.Ticks;
+			messageIdLength = settings.UseExtendedMessageId ? 4 : 2;
+			receiveBuffer = new byte[Math.Max(settings.ReceiveBufferSize, 4 + messageIdLength)];
+			receiveCallBack = new AsyncCallback(ReceiveCallback);
+			socket = new Socket(AddressFamily.InterNetwork, SocketType.Stream, ProtocolType.Tcp);
+			socket.SetSocketOption(SocketOptionLevel.Socket, SocketOptionName.SendBuffer, settings.SendBufferSize);
+			socket.SetSocketOption(SocketOptionLevel.Socket, SocketOptionName.ReceiveBuffer, settings.ReceiveBufferSize);
+			socket.SetSocketOption(SocketOptionLevel.Socket, SocketOptionName.SendTimeout, settings.SendTimeout);
+			socket.SetSocketOption(SocketOptionLevel.Tcp, SocketOptionName.NoDelay, 1);
+		}
+
+		internal bool IsOpen
+		{
+			get { return !closed; }
+		}
+
+		internal void Connect(IPEndPoint remoteEndPoint, int timeout)
+		{
+			IAsyncResult result = socket.BeginConnect(remoteEndPoint, null, null);
+			if (!result.AsyncWaitHandle.WaitOne(timeout, false))
+			{
+				socket.Close();
+				throw new SocketException((int)SocketError.HostUnreachable);
+			}
+			try
+			{
+				socket.EndConnect(result);
+			}
+			catch
+			{
+				//a refused or failed connect leaves the socket open otherwise
+				socket.Close();
+				throw;
+			}
+			Interlocked.Increment(ref pool.socketCount);
+			BeginReceive();
+		}
+
+		/// <summary>
+		/// Registers a request under a new message id. Every registered request must be
+		/// passed to <see cref="Complete"/>.
+		/// </summary>
+		internal PendingReply Register()
+		{
+			PendingReply reply = pool.GetPendingReply();
+			reply.Reset();
+			lock (pending)
+			{
+				do
+				{
+					reply.MessageId = pool.NextMessageId();
+				} while (pending.ContainsKey(reply.MessageId));
+				if (closed)
+				{
+					reply.Error = SocketError.NotConnected;
+				}
+				else
+				{
+					pending.Add(reply.MessageId, reply);
+				}
+			}
+			Interlocked.Increment(ref pool.activeSocketCount);
+			return reply;
+		}
+
+		internal void Send(byte[] buffer, int length)
+		{
+			try
+			{
+				lock (sendLock)
+				{
+					int sent = 0;
+					while (sent < length)
+					{
+						sent += socket.Send(buffer, sent, length - sent, SocketFlags.None);
+					}
+				}
+			}
+			catch (SocketException sex)
+			{
+				Close(sex.SocketErrorCode);
+				throw;
+			}
+			catch (ObjectDisposedException)
+			{
+				Close(SocketError.NotConnected);
+				throw new SocketException((int)SocketError.NotConnected);
+			}
+		}
+
+		/// <summary>
+		/// Waits for the reply to <paramref name="reply"/>.
+		/// </summary>
+		/// <returns>The reply, or <see langword="null"/> if the server sent an empty reply.</returns>
+		/// <exception cref="SocketException">The reply did not arrive in time or the connection failed.</exception>
+		internal MemoryStream WaitForReply(PendingReply reply)
+		{
+			if (reply.Error == SocketError.Success && !reply.WaitHandle.WaitOne(settings.ReceiveTimeout, false))
+			{
+				lock (pending)
+				{
+					//the reply may have arrived since the wait timed out
+					if (pending.Remove(reply.MessageId))
+					{
+						reply.Error = SocketError.TimedOut;
+					}
+				}
+			}
+			if (reply.Error != SocketError.Success)
+			{
+				throw new SocketException((int)reply.Error);
+			}
+			if (reply.Shed)
+			{
+				throw new ShedReplyException();
+			}
+			return reply.Reply;
+		}
+
+		/// <summary>
+		/// Finishes with <paramref name="reply"/>; a late reply to it is discarded.
+		/// </summary>
+		internal void Complete(PendingReply reply)
+		{
+			bool closeRetired;
+			lock (pending)
+			{
+				pending.Remove(reply.MessageId);
+				closeRetired = retired && pending.Count == 0;
+			}
+			Interlocked.Decrement(ref pool.activeSocketCount);
+			//every set of the wait handle happens under the pending lock, so none can follow this
+			pool.ReleasePendingReply(reply);
+			if (closeRetired)
+			{
+				Close(SocketError.Success);
+			}
+		}
+
+		/// <summary>
+		/// Takes the connection out of rotation; it is closed once its outstanding requests are answered.
+		/// </summary>
+		internal void Retire()
+		{
+			bool closeNow;
+			lock (pending)
+			{
+				retired = true;
+				closeNow = pending.Count == 0;
+			}
+			if (closeNow)
+			{
+				Close(SocketError.Success);
+			}
+		}
+
+		/// <summary>
+		/// Closes the connection and fails every outstanding request with <paramref name="error"/>.
+		/// </summary>
+		internal void Close(SocketError error)
+		{
+			lock (pending)
+			{
+				if (closed)
+				{
+					return;
+				}
+				closed = true;
+				foreach (PendingReply reply in pending.Values)
+				{
+					reply.Error = error == SocketError.Success ? SocketError.NotConnected : error;
+					reply.WaitHandle.Set();
+				}
+				pending.Clear();
+			}
+			try
+			{
+				if (socket.Connected)
+				{
+					socket.Shutdown(SocketShutdown.Both);
+				}
+				socket.Close();
+			}
+			catch (SocketException)
+			{ }
+			catch (ObjectDisposedException)
+			{ }
+			Interlocked.Decrement(ref pool.socketCount);
+		}
+
+		private void BeginReceive()
+		{
+			if (received == receiveBuffer.Length)
+			{
+				//the reply being read is bigger than the buffer
+				byte[] larger = new byte[Math.Max(receiveBuffer.Length * 2, GetReplySize())];
+				Buffer.BlockCopy(receiveBuffer, 0, larger, 0, received);
+				receiveBuffer = larger;
+			}
+			socket.BeginReceive(receiveBuffer, received, receiveBuffer.Length - received, SocketFlags.None, receiveCallBack, null);
+		}
+
+		private void ReceiveCallback(IAsyncResult state)
+		{
+			SocketError error;
+			int count;
+			try
+			{
+				count = socket.EndReceive(state, out error);
+			}
+			catch (ObjectDisposedException)
+			{
+				return;
+			}
+			if (error != SocketError.Success || count == 0)
+			{
+				if (error != SocketError.Success && error != SocketError.OperationAborted && log.IsErrorEnabled)
+					log.ErrorFormat("Socket Error {0} receiving from {1}. Closing multiplexed connection.", error, pool.Destination);
+				Close(count == 0 ? SocketError.ConnectionReset : error);
+				return;
+			}
+			try
+			{
+				received += count;
+				ReadReplies();
+				BeginReceive();
+			}
+			catch (ObjectDisposedException)
+			{
+			}
+			catch (SocketException sex)
+			{
+				Close(sex.SocketErrorCode);
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Exception {0} while processing receive from {1}. Closing multiplexed connection.", ex, pool.Destination);
+				Close(SocketError.SocketError);
+			}
+		}
+
+		private int GetReplySize()
+		{
+			int replySize = BitConverter.ToInt32(receiveBuffer, 0);
+			if (settings.UseNetworkOrder)
+			{
+				replySize = IPAddress.NetworkToHostOrder(replySize);
+			}
+			return replySize & ~ManagedSocket.CompressedReplyFlag;
+		}
+
+		/// <summary>
+		/// Hands every complete reply in the receive buffer to its request and moves what is left to the front.
+		/// </summary>
+		private void ReadReplies()
+		{
+			int offset = 0;
+			while (received - offset >= 4 + messageIdLength)
+			{
+				int replySize = BitConverter.ToInt32(receiveBuffer, offset);
+				int messageId = messageIdLength == 4
+					? BitConverter.ToInt32(receiveBuffer, offset + 4)
+					: BitConverter.ToInt16(receiveBuffer, offset + 4);
+				if (settings.UseNetworkOrder)
+				{
+					replySize = IPAddress.NetworkToHostOrder(replySize);
+					messageId = messageIdLength == 4
+						? IPAddress.NetworkToHostOrder(messageId)
+						: IPAddress.NetworkToHostOrder((short)messageId);
+				}
+				bool compressed = (replySize & ManagedSocket.CompressedReplyFlag) != 0;
+				replySize &= ~ManagedSocket.CompressedReplyFlag;
+				if (replySize < 4 + messageIdLength)
+				{
+					throw new InvalidDataException(String.Format("Reply with invalid size {0}.", replySize));
+				}
+				if (received - offset < replySize)
+				{
+					break;
+				}
+				int replyOffset = offset + 4 + messageIdLength;
+				int replyLength = replySize - 4 - messageIdLength;
+				PostReply(messageId, replyOffset, replyLength, compressed);
+				offset += replySize;
+			}
+			if (offset > 0)
+			{
+				Buffer.BlockCopy(receiveBuffer, offset, receiveBuffer, 0, received - offset);
+				received -= offset;
+			}
+		}
+
+		private void PostReply(int messageId, int replyOffset, int replyLength, bool compressed)
+		{
+			PendingReply reply;
+			lock (pending)
+			{
+				if (!pending.TryGetValue(messageId, out reply))
+				{
+					//the request timed out or was abandoned
+					return;
+				}
+				pending.Remove(messageId);
+				if (compressed)
+				{
+					reply.Reply = ManagedSocket.DecompressReply(receiveBuffer, replyOffset, replyLength);
+				}
+				else if (ManagedSocket.IsShedReply(receiveBuffer, replyOffset, replyLength))
+				{
+					reply.Shed = true;
+				}
+				else if (!ManagedSocket.IsEmptyReply(receiveBuffer, replyOffset, replyLength))
+				{
+					reply.Reply = new MemoryStream(replyLength);
+					reply.Reply.Write(receiveBuffer, replyOffset, replyLength);
+					reply.Reply.Seek(0, SeekOrigin.Begin);
+				}
+				reply.WaitHandle.Set();
+			}
+		}
+	}
+}
@@ -0,0 +1,258 @@
+using System;
+using System.IO;
+using System.Net;
+using System.Net.Sockets;
+using System.Threading;
+using MySpace.ResourcePool;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// Gathers the one way messages sent through a socket pool into batch frames, which the
+	/// server splits back into messages.
+	/// </summary>
+	/// <remarks>
+	/// <para>A message is sent at once, alone in its batch, when nothing else is being sent.
+	/// Messages that arrive while a batch is being sent wait for that send, and go out together
+	/// in the next one. A batch that reaches <see cref="SocketSettings.OneWayBatchMaxBytes"/> is
+	/// sent by the thread that filled it, on a socket of its own.</para>
+	/// <para>With <see cref="SocketSettings.OneWayBatchDelayMilliseconds"/> set, the first
+	/// message of a batch also waits that long for others to join it.</para>
+	/// <para>Since a batch holds the messages of many callers, a batch that fails to send is
+	/// dropped here rather than thrown to whichever caller happened to send it. It is logged and
+	/// counted in <see cref="FailedBatches"/> and <see cref="DroppedMessages"/>.</para>
+	/// <para>A batch frame carries the reserved command id <see cref="BatchCommandId"/> and no
+	/// message id or flags. Its body is each message's command id (2 bytes) and length (4 bytes),
+	/// then the message.</para>
+	/// </remarks>
+	internal sealed class OneWayBatcher
+	{
+		/// <summary>The command id of batch frames; no message may be sent with it.</summary>
+		internal const short BatchCommandId = Int16.MaxValue;
+		private const int frameHeaderSize = 11;
+		private const int entryHeaderSize = 6;
+
+		private static readonly Logging.LogWrapper log = new Logging.LogWrapper();
+
+		private readonly SocketPool pool;
+		private readonly int maximumBytes;
+		private readonly int delay;
+		private readonly bool useNetworkOrder;
+		private readonly object padLock = new object();
+		private readonly Timer delayTimer;
+		private ResourcePoolItem<MemoryStream> batch;
+		private int batchCount;
+		private int senders;
+		private bool delayPending;
+		private long failedBatches;
+		private long droppedMessages;
+
+		internal OneWayBatcher(SocketPool pool)
+		{
+			this.pool = pool;
+			maximumBytes = pool.Settings.OneWayBatchMaxBytes;
+			delay = pool.Settings.OneWayBatchDelayMilliseconds;
+			useNetworkOrder = pool.Settings.UseNetworkOrder;
+			if (delay > 0)
+			{
+				delayTimer = new Timer(DelayElapsed, null, Timeout.Infinite, Timeout.Infinite);
+			}
+		}
+
+		/// <summary>
+		/// Adds a message to the batch, sending the batch on this thread if it is due.
+		/// </summary>
+		internal void Add(short commandId, MemoryStream messageStream)
+		{
+			if (commandId == BatchCommandId)
+			{
+				throw new ArgumentOutOfRangeException("commandId", commandId, "The command id is reserved for batch frames.");
+			}
+			int messageLength = messageStream == null ? 0 : (int)messageStream.Length;
+			ResourcePoolItem<MemoryStream> full = null;
+			int fullCount = 0;
+			lock (padLock)
+			{
+				if (batch == null)
+				{
+					batch = pool.GetPooledStream();
+					batch.Item.SetLength(frameHeaderSize); //filled in when the batch is taken
+					batch.Item.Seek(0, SeekOrigin.End);
+				}
+				MemoryStream stream = batch.Item;
+				stream.Write(BitConverter.GetBytes(GetNetworkOrdered(commandId)), 0, 2);
+				stream.Write(BitConverter.GetBytes(GetNetworkOrdered(messageLength)), 0, 4);
+				if (messageStream != null)
+				{
+					messageStream.WriteTo(stream);
+				}
+				batchCount++;
+
+				if (stream.Length >= maximumBytes)
+				{
+					full = TakeBatch(out fullCount);
+				}
+				else if (senders > 0)
+				{
+					//the sender in progress takes it when done
+					return;
+				}
+				else if (delay > 0)
+				{
+					if (!delayPending)
+					{
+						delayPending = true;
+						delayTimer.Change(delay, Timeout.Infinite);
+					}
+					return;
+				}
+				else
+				{
+					full = TakeBatch(out fullCount);
+				}
+				senders++;
+			}
+			SendBatches(full, fullCount);
+		}
+
+		/// <summary>The number of batches that failed to send and were dropped.</summary>
+		internal long FailedBatches
+		{
+			get { return Interlocked.Read(ref failedBatches); }
+		}
+
+		/// <summary>The number of one way messages dropped with the batches that failed to send.</summary>
+		internal long DroppedMessages
+		{
+			get { return Interlocked.Read(ref droppedMessages); }
+		}
+
+		private void DelayElapsed(object state)
+		{
+			ResourcePoolItem<MemoryStream> due;
+			int dueCount;
+			lock (padLock)
+			{
+				delayPending = false;
+				if (batch == null || senders > 0)
+				{
+					return;
+				}
+				due = TakeBatch(out dueCount);
+				senders++;
+			}
+			SendBatches(due, dueCount);
+		}
+
+		/// <summary>
+		/// Sends <paramref name="first"/>, then whatever gathered meanwhile, until nothing is left.
+		/// </summary>
+		private void SendBatches(ResourcePoolItem<MemoryStream> first, int firstCount)
+		{
+			ResourcePoolItem<MemoryStream> next = first;
+			int nextCount = firstCount;
+			while (next != null)
+			{
+				try
+				{
+					Send(next.Item);
+				}
+				catch (Exception ex)
+				{
+					Interlocked.Increment(ref failedBatches);
+					Interlocked.Add(ref droppedMessages, nextCount);
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Exception sending one way batch of {0} messages to {1}, dropping it: {2}",
+							nextCount, pool.Destination, ex);
+				}
+				finally
+				{
+					next.Release();
+					lock (padLock)
+					{
+						next = null;
+						if (batch != null)
+						{
+							if (delay == 0 || batch.Item.Length >= maximumBytes)
+							{
+								next = TakeBatch(out nextCount);
+							}
+							else if (!delayPending)
+							{
+								delayPending = true;
+								delayTimer.Change(delay, Timeout.Infinite);
+							}
+						}
+						if (next == null)
+						{
+							senders--;
+						}
+					}
+				}
+			}
+		}
+
+		/// <returns>The batch with its frame header and terminator written.</returns>
+		private ResourcePoolItem<MemoryStream> TakeBatch(out int messageCount)
+		{
+			ResourcePoolItem<MemoryStream> taken = batch;
+			messageCount = batchCount;
+			batch = null;
+			batchCount = 0;
+			MemoryStream stream = taken.Item;
+			stream.Write(BitConverter.GetBytes(GetNetworkOrdered(Int16.MinValue)), 0, 2);
+			stream.Seek(0, SeekOrigin.Begin);
+			stream.Write(BitConverter.GetBytes(GetNetworkOrdered(Int16.MaxValue)), 0, 2); //message starter
+			stream.Write(BitConverter.GetBytes(GetNetworkOrdered((int)stream.Length)), 0, 4);
+			//the server reads the ids in the same order the sync messages write them
+			byte[] commandIdBytes = BitConverter.GetBytes(GetNetworkOrdered(BatchCommandId));
+			byte[] noMessageId = BitConverter.GetBytes((short)0);
+			if (useNetworkOrder)
+			{
+				stream.Write(noMessageId, 0, 2);
+				stream.Write(commandIdBytes, 0, 2);
+			}
+			else
+			{
+				stream.Write(commandIdBytes, 0, 2);
+				stream.Write(noMessageId, 0, 2);
+			}
+			stream.WriteByte(0); //no flags
+			return taken;
+		}
+
+		private void Send(MemoryStream frame)
+		{
+			MultiplexedSocketPool multiplexedPool = pool as MultiplexedSocketPool;
+			if (multiplexedPool != null)
+			{
+				multiplexedPool.GetConnection().Send(frame.GetBuffer(), (int)frame.Length);
+				return;
+			}
+			ManagedSocket socket = pool.GetSocket();
+			try
+			{
+				socket.Send(frame.GetBuffer(), (int)frame.Length, SocketFlags.None);
+			}
+			catch (SocketException sex)
+			{
+				socket.LastError = sex.SocketErrorCode;
+				throw;
+			}
+			finally
+			{
+				socket.Release();
+			}
+		}
+
+		private short GetNetworkOrdered(short number)
+		{
+			return useNetworkOrder ? IPAddress.HostToNetworkOrder(number) : number;
+		}
+
+		private int GetNetworkOrdered(int number)
+		{
+			return useNetworkOrder ? IPAddress.HostToNetworkOrder(number) : number;
+		}
+	}
+}
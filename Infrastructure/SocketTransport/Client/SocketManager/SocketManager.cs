@@ -40,6 +40,19 @@ namespace MySpace.SocketTransport
 			totalSockets = pool.socketCount;
 		}
 
+		internal SocketPoolStatistics GetSocketPoolStatistics(IPEndPoint destination, SocketSettings settings)
+		{
+			AdaptiveSocketPool pool = GetSocketPool(destination, settings) as AdaptiveSocketPool;
+			return pool != null ? pool.GetStatistics() : null;
+		}
+
+		internal void GetOneWayBatchFailures(IPEndPoint destination, SocketSettings settings, out long failedBatches, out long droppedMessages)
+		{
+			OneWayBatcher batcher = GetSocketPool(destination, settings).OneWayBatcher;
+			failedBatches = batcher != null ? batcher.FailedBatches : 0;
+			droppedMessages = batcher != null ? batcher.DroppedMessages : 0;
+		}
+
 		internal static SocketManager Instance
 		{
 			get
@@ -110,6 +123,10 @@ namespace MySpace.SocketTransport
 					return new NullSocketPool(destination, settings);
 				case SocketPoolType.Linked:
 					return new LinkedManagedSocketPool(destination, settings);
+				case SocketPoolType.Multiplexed:
+					return new MultiplexedSocketPool(destination, settings);
+				case SocketPoolType.Adaptive:
+					return new AdaptiveSocketPool(destination, settings);
 				default:
 					return new ArraySocketPool(destination, settings);
 			}
@@ -26,6 +26,10 @@ namespace MySpace.SocketTransport
             {
                 rebufferedStreamPool = new MemoryStreamPool(settings.InitialMessageSize, settings.BufferReuses);
             }
+			if (settings.OneWayBatchMaxBytes > 0)
+			{
+				OneWayBatcher = new OneWayBatcher(this);
+			}
 		}
         protected Logging.LogWrapper log = new Logging.LogWrapper();
 		protected IPEndPoint destination;
@@ -35,6 +39,8 @@ namespace MySpace.SocketTransport
 		internal int socketCount;
 		internal int activeSocketCount;
 		private readonly MemoryStreamPool rebufferedStreamPool;
+		/// <summary>Gathers one way messages into batch frames, or null when batching is off.</summary>
+		internal readonly OneWayBatcher OneWayBatcher;
 
 		internal IPEndPoint Destination
 		{
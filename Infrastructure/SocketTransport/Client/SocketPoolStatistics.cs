@@ -0,0 +1,81 @@
+using System;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// Counts of observed values by range.
+	/// </summary>
+	public class SocketPoolHistogram
+	{
+		private readonly long[] upperBounds;
+		private readonly long[] counts;
+
+		internal SocketPoolHistogram(params long[] upperBounds)
+		{
+			this.upperBounds = upperBounds;
+			counts = new long[upperBounds.Length + 1];
+		}
+
+		private SocketPoolHistogram(long[] upperBounds, long[] counts)
+		{
+			this.upperBounds = upperBounds;
+			this.counts = counts;
+		}
+
+		/// <summary>
+		/// The inclusive upper bound of each bucket but the last, which holds every larger value.
+		/// </summary>
+		public long[] UpperBounds
+		{
+			get { return (long[])upperBounds.Clone(); }
+		}
+
+		/// <summary>
+		/// The number of values recorded in each bucket; one longer than <see cref="UpperBounds"/>.
+		/// </summary>
+		public long[] Counts
+		{
+			get { return (long[])counts.Clone(); }
+		}
+
+		internal void Record(long value)
+		{
+			int bucket = 0;
+			while (bucket < upperBounds.Length && value > upperBounds[bucket])
+			{
+				bucket++;
+			}
+			Interlocked.Increment(ref counts[bucket]);
+		}
+
+		internal SocketPoolHistogram Snapshot()
+		{
+			long[] snapshot = new long[counts.Length];
+			for (int i = 0; i < counts.Length; i++)
+			{
+				snapshot[i] = Interlocked.Read(ref counts[i]);
+			}
+			return new SocketPoolHistogram(upperBounds, snapshot);
+		}
+	}
+
+	/// <summary>
+	/// What an <see cref="SocketPoolType.Adaptive"/> socket pool has observed about its destination.
+	/// </summary>
+	public class SocketPoolStatistics
+	{
+		/// <summary>The number of open sockets, sampled about once a second.</summary>
+		public SocketPoolHistogram PoolSize;
+		/// <summary>The number of times each closed socket was used.</summary>
+		public SocketPoolHistogram Reuse;
+		/// <summary>How long new sockets took to connect, in milliseconds.</summary>
+		public SocketPoolHistogram ConnectMilliseconds;
+		/// <summary>The moving average time from sending a sync message to receiving its reply.</summary>
+		public double AverageReplyMilliseconds;
+		/// <summary>The moving average fraction of socket uses that ended in an error.</summary>
+		public double ErrorRate;
+		/// <summary>The number of sockets the pool currently aims to keep open.</summary>
+		public int TargetSize;
+	}
+}
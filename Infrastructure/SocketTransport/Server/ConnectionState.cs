@@ -4,6 +4,7 @@ using System.Text;
 using System.IO;
 using System.Net.Sockets;
 using System.Net;
+using MySpace.ResourcePool;
 
 namespace MySpace.SocketTransport
 {
@@ -49,53 +50,66 @@ namespace MySpace.SocketTransport
 			}
 		}
 		
-		private int bufferSize = 0;
-		private int messageBufferInitialSize = 0;
-
-		public int BufferSize
-		{
-			get
-			{
-				return bufferSize;
-			}
-		}
-
-		public int MessageBufferInitialSize
+		/// <summary>
+		/// The slab currently being received into, or <see langword="null"/> before the first receive.
+		/// The connection holds one reference to it.
+		/// </summary>
+		internal ReceiveSlab slab;
+		/// <summary>The offset in <see cref="slab"/> of the first byte not yet parsed.</summary>
+		internal int frameStart;
+		/// <summary>The offset in <see cref="slab"/> just past the last byte received.</summary>
+		internal int receiveEnd;
+
+		/// <summary>The size of the frame being assembled, or -1 until enough of it has arrived.</summary>
+		public int messageSize = -1;
+		/// <summary>The number of times the frame being assembled has been copied.</summary>
+		internal int messageCopies;
+		/// <summary>The bytes of the frame being assembled still to be skipped when it is discarded.</summary>
+		internal int discardRemaining;
+
+		/// <summary>
+		/// Frames too big for a slab are assembled here instead, and handed to the handler as is.
+		/// </summary>
+		internal MemoryStream largeMessage;
+		internal ResourcePoolItem<MemoryStream> largeMessageItem;
+		/// <summary>The header of the frame last read, see <see cref="SocketServer"/>.</summary>
+		internal short frameCommandId;
+		internal int frameMessageId;
+		internal bool frameSendReply;
+		internal bool frameBatch;
+		internal bool frameExtendedMessageId;
+		internal int frameHeaderSize;
+		internal int frameTimeToLive;
+		/// <summary>Whether the client has said it can read compressed replies.</summary>
+		internal bool acceptsCompression;
+
+		/// <summary>
+		/// Used for every receive on the connection by the <see cref="SocketAsyncEventArgs"/> engine.
+		/// </summary>
+		internal SocketAsyncEventArgs receiveEventArgs;
+
+		/// <summary>
+		/// Replies to the messages received on the connection, sent in order of completion.
+		/// </summary>
+		internal readonly ReplyQueue replyQueue = new ReplyQueue();
+
+		/// <summary>
+		/// The connection's fair scheduler queues, one per command class, created as messages arrive.
+		/// </summary>
+		internal SchedulerFlow[] syncFlows;
+		internal SchedulerFlow[] onewayFlows;
+
+		internal void ReleaseSlab()
 		{
-			get
+			if (slab != null)
 			{
-				return messageBufferInitialSize;
+				slab.Release();
+				slab = null;
 			}
+			frameStart = 0;
+			receiveEnd = 0;
 		}
 
-		public byte[] networkBuffer;// Receive buffer.
-
-		public int messageSize = -1;
-		public int messagePosition = 0;
-
-		public MemoryStream messageBuffer;
-
-		public ConnectionState(int bufferSize, int initialMessageSize)
-		{
-			this.bufferSize = bufferSize;
-			this.messageBufferInitialSize = initialMessageSize;
-
-			networkBuffer = new byte[this.bufferSize];
-
-			this.messageBuffer = new MemoryStream(MessageBufferInitialSize);
-		}
-
-		public ConnectionState()
-		{
-			this.bufferSize = 1024;
-			this.messageBufferInitialSize = 20480;
-
-			networkBuffer = new byte[this.bufferSize];
-
-			this.messageBuffer = new MemoryStream(MessageBufferInitialSize);
-		}
-
-
 		#region IDisposable Members
 		private bool disposed = false;
 		public void Dispose()
@@ -110,9 +124,10 @@ namespace MySpace.SocketTransport
 			{
 				if (disposing)
 				{
-					if (messageBuffer != null)
+					ReleaseSlab();
+					if (receiveEventArgs != null)
 					{
-						messageBuffer.Dispose();
+						receiveEventArgs.Dispose();
 					}
 					try
 					{
@@ -0,0 +1,348 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Net;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// A queue that any number of threads may add to without locking, and one thread at a time takes from.
+	/// </summary>
+	internal sealed class MultiProducerQueue<T> where T : class
+	{
+		private sealed class Node
+		{
+			internal T Item;
+			internal volatile Node Next;
+		}
+
+		private Node head; //the last node added
+		private Node tail; //the node before the next item to take
+
+		internal MultiProducerQueue()
+		{
+			head = tail = new Node();
+		}
+
+		internal void Enqueue(T item)
+		{
+			Node node = new Node();
+			node.Item = item;
+			Node previous = Interlocked.Exchange(ref head, node);
+			//until this link is made the item is not visible to the consumer
+			previous.Next = node;
+		}
+
+		/// <returns>The next item, or <see langword="null"/> if none has been added.</returns>
+		internal T Dequeue()
+		{
+			Node next = tail.Next;
+			if (next == null)
+			{
+				return null;
+			}
+			tail = next;
+			T item = next.Item;
+			next.Item = null;
+			return item;
+		}
+
+		internal bool IsEmpty
+		{
+			get { return tail.Next == null; }
+		}
+	}
+
+	/// <summary>
+	/// The messages of one connection and command class waiting for a <see cref="FairScheduler"/>.
+	/// </summary>
+	internal sealed class SchedulerFlow
+	{
+		internal readonly MultiProducerQueue<ProcessState> Queue = new MultiProducerQueue<ProcessState>();
+		internal readonly IPEndPoint RemoteEndpoint;
+		internal readonly SchedulerClass Class;
+		internal int Scheduled; //1 while the flow is, or is about to be, in the scheduler's active list
+		internal int Depth;
+		internal int Deficit;
+		internal double AverageWaitTicks;
+
+		internal SchedulerFlow(IPEndPoint remoteEndpoint, SchedulerClass schedulerClass)
+		{
+			RemoteEndpoint = remoteEndpoint;
+			Class = schedulerClass;
+		}
+	}
+
+	/// <summary>
+	/// A command class as scheduled by a <see cref="FairScheduler"/>.
+	/// </summary>
+	internal sealed class SchedulerClass
+	{
+		internal readonly int Index;
+		internal readonly string Name;
+		internal readonly int Weight;
+		internal readonly int MaximumInFlight;
+		internal int InFlight;
+
+		internal SchedulerClass(int index, string name, int weight, int maximumInFlight)
+		{
+			Index = index;
+			Name = name;
+			Weight = Math.Max(weight, 1);
+			MaximumInFlight = maximumInFlight;
+		}
+	}
+
+	/// <summary>
+	/// The state of one of the <see cref="SocketServer"/> scheduler queues.
+	/// </summary>
+	public class SchedulerQueueStatus
+	{
+		/// <summary>The client the queued messages came from.</summary>
+		public IPEndPoint RemoteEndpoint;
+		/// <summary>The name of the command class of the queued messages.</summary>
+		public string CommandClass;
+		/// <summary>Whether the queue holds sync messages rather than one way messages.</summary>
+		public bool Sync;
+		/// <summary>The number of messages waiting.</summary>
+		public int Depth;
+		/// <summary>The moving average of the time messages waited in the queue.</summary>
+		public double AverageWaitMilliseconds;
+	}
+
+	/// <summary>
+	/// Hands messages to a dispatcher port fairly across connections and command classes,
+	/// using deficit round robin between one queue per connection and command class.
+	/// </summary>
+	/// <remarks>
+	/// Only <see cref="DispatchLimit"/> messages are in the port at a time, so a backlog builds
+	/// up here, where it can be ordered, rather than in the port. A queue takes as many messages
+	/// per turn as its class's weight, and a class with as many messages in flight as its
+	/// maximum is passed over until some complete. Adding a message never takes a lock; the
+	/// thread that finds no dispatch in progress does the dispatching.
+	/// </remarks>
+	internal sealed class FairScheduler
+	{
+		private const double waitSmoothing = 0.1;
+
+		private readonly Action<ProcessState> dispatch;
+		private readonly SchedulerClass[] classes;
+		private readonly Dictionary<short, SchedulerClass> classesByCommand = new Dictionary<short, SchedulerClass>();
+		private readonly bool sync;
+		private readonly MultiProducerQueue<SchedulerFlow> readyFlows = new MultiProducerQueue<SchedulerFlow>();
+		private readonly List<SchedulerFlow> activeFlows = new List<SchedulerFlow>();
+		private int current;
+		private int dispatched;
+		private int signals;
+		private int dispatchLimit;
+
+		/// <summary>Counts the messages waiting in every scheduler, if set.</summary>
+		internal PerformanceCounter QueuedCounter;
+
+		/// <param name="config">The command classes and their weights.</param>
+		/// <param name="sync">Whether the scheduler handles sync messages.</param>
+		/// <param name="dispatch">Posts a message to the dispatcher port.</param>
+		/// <param name="dispatchLimit">The number of messages allowed in the port at once.</param>
+		internal FairScheduler(FairSchedulingConfig config, bool sync, Action<ProcessState> dispatch, int dispatchLimit)
+		{
+			this.sync = sync;
+			this.dispatch = dispatch;
+			DispatchLimit = dispatchLimit;
+			CommandClassConfig[] classConfigs = config.CommandClasses ?? new CommandClassConfig[0];
+			classes = new SchedulerClass[classConfigs.Length + 1];
+			classes[0] = new SchedulerClass(0, "Default", config.DefaultWeight, config.DefaultMaximumInFlight);
+			for (int i = 0; i < classConfigs.Length; i++)
+			{
+				CommandClassConfig classConfig = classConfigs[i];
+				classes[i + 1] = new SchedulerClass(i + 1, classConfig.Name, classConfig.Weight, classConfig.MaximumInFlight);
+				if (classConfig.CommandIds != null)
+				{
+					foreach (short commandId in classConfig.CommandIds)
+					{
+						classesByCommand[commandId] = classes[i + 1];
+					}
+				}
+			}
+		}
+
+		internal int DispatchLimit
+		{
+			get { return dispatchLimit; }
+			set
+			{
+				Interlocked.Exchange(ref dispatchLimit, Math.Max(value, 1));
+				Signal();
+			}
+		}
+
+		/// <summary>
+		/// Queues <paramref name="message"/> behind the earlier messages of its connection and command class.
+		/// </summary>
+		/// <param name="flows">The connection's queues, one per command class, created as needed.
+		/// Only one thread at a time may queue messages for a connection.</param>
+		/// <param name="remoteEndpoint">The client the message came from.</param>
+		/// <param name="message">The message to queue.</param>
+		internal void Enqueue(ref SchedulerFlow[] flows, IPEndPoint remoteEndpoint, ProcessState message)
+		{
+			SchedulerClass schedulerClass;
+			if (!classesByCommand.TryGetValue(message.commandId, out schedulerClass))
+			{
+				schedulerClass = classes[0];
+			}
+			if (flows == null)
+			{
+				flows = new SchedulerFlow[classes.Length];
+			}
+			SchedulerFlow flow = flows[schedulerClass.Index];
+			if (flow == null)
+			{
+				flow = new SchedulerFlow(remoteEndpoint, schedulerClass);
+				flows[schedulerClass.Index] = flow;
+			}
+
+			Interlocked.Increment(ref flow.Depth);
+			if (QueuedCounter != null)
+			{
+				QueuedCounter.Increment();
+			}
+			flow.Queue.Enqueue(message);
+			if (Interlocked.CompareExchange(ref flow.Scheduled, 1, 0) == 0)
+			{
+				readyFlows.Enqueue(flow);
+			}
+			Signal();
+		}
+
+		/// <summary>
+		/// Called when the handling of a dispatched <paramref name="message"/> is over, so another can take its place.
+		/// </summary>
+		internal void Complete(ProcessState message)
+		{
+			SchedulerFlow flow = message.schedulerFlow;
+			if (flow == null)
+			{
+				return;
+			}
+			message.schedulerFlow = null;
+			Interlocked.Decrement(ref flow.Class.InFlight);
+			Interlocked.Decrement(ref dispatched);
+			Signal();
+		}
+
+		/// <summary>
+		/// Adds the state of every queue holding messages to <paramref name="statuses"/>.
+		/// </summary>
+		internal void GetStatus(List<SchedulerQueueStatus> statuses)
+		{
+			lock (activeFlows)
+			{
+				foreach (SchedulerFlow flow in activeFlows)
+				{
+					SchedulerQueueStatus status = new SchedulerQueueStatus();
+					status.RemoteEndpoint = flow.RemoteEndpoint;
+					status.CommandClass = flow.Class.Name;
+					status.Sync = sync;
+					status.Depth = Thread.VolatileRead(ref flow.Depth);
+					status.AverageWaitMilliseconds = flow.AverageWaitTicks * 1000 / Stopwatch.Frequency;
+					statuses.Add(status);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Runs the dispatch loop unless another thread is already running it, in which case
+		/// that thread goes around again.
+		/// </summary>
+		private void Signal()
+		{
+			if (Interlocked.Increment(ref signals) != 1)
+			{
+				return;
+			}
+			int handled;
+			do
+			{
+				handled = Thread.VolatileRead(ref signals);
+				Dispatch();
+			} while (Interlocked.Add(ref signals, -handled) != 0);
+		}
+
+		private void Dispatch()
+		{
+			//the lock only keeps GetStatus out, only one thread dispatches at a time
+			lock (activeFlows)
+			{
+				SchedulerFlow flow;
+				while ((flow = readyFlows.Dequeue()) != null)
+				{
+					flow.Deficit = 0;
+					activeFlows.Add(flow);
+				}
+
+				int passedOver = 0;
+				while (activeFlows.Count > 0 && passedOver < activeFlows.Count &&
+					Thread.VolatileRead(ref dispatched) < dispatchLimit)
+				{
+					if (current >= activeFlows.Count)
+					{
+						current = 0;
+					}
+					flow = activeFlows[current];
+					SchedulerClass schedulerClass = flow.Class;
+					if (schedulerClass.MaximumInFlight > 0 &&
+						Thread.VolatileRead(ref schedulerClass.InFlight) >= schedulerClass.MaximumInFlight)
+					{
+						passedOver++;
+						current++;
+						continue;
+					}
+
+					ProcessState message = flow.Queue.Dequeue();
+					if (message == null)
+					{
+						if (Deactivate(flow))
+						{
+							activeFlows.RemoveAt(current);
+						}
+						continue;
+					}
+					passedOver = 0;
+					if (flow.Deficit <= 0)
+					{
+						flow.Deficit += schedulerClass.Weight;
+					}
+					flow.Deficit--;
+					if (flow.Deficit <= 0)
+					{
+						current++;
+					}
+
+					Interlocked.Decrement(ref flow.Depth);
+					if (QueuedCounter != null)
+					{
+						QueuedCounter.Decrement();
+					}
+					long waitTicks = Stopwatch.GetTimestamp() - message.receivedTicks;
+					flow.AverageWaitTicks += (waitTicks - flow.AverageWaitTicks) * waitSmoothing;
+					Interlocked.Increment(ref schedulerClass.InFlight);
+					Interlocked.Increment(ref dispatched);
+					message.schedulerFlow = flow;
+					dispatch(message);
+				}
+			}
+		}
+
+		/// <summary>
+		/// Takes an empty flow out of rotation.
+		/// </summary>
+		/// <returns><see langword="false"/> if a message was added meanwhile and the flow stays.</returns>
+		private static bool Deactivate(SchedulerFlow flow)
+		{
+			flow.Deficit = 0;
+			Interlocked.Exchange(ref flow.Scheduled, 0);
+			//a message added before the flag was cleared would otherwise never be dispatched
+			return flow.Queue.IsEmpty || Interlocked.CompareExchange(ref flow.Scheduled, 1, 0) != 0;
+		}
+	}
+}
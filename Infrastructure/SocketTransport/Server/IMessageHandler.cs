@@ -13,7 +13,8 @@ namespace MySpace.SocketTransport
 	{
 		/// <summary>Handle a complete message.</summary>
 		/// <param name="commandID">The command id of the message.</param>
-		/// <param name="messageStream">The stream that contains the message.</param>
+		/// <param name="messageStream">A read only stream that contains the message. It may be a view over
+		/// a shared receive buffer, so it must not be used after this method returns.</param>
 		/// <param name="messageLength">The length of the message contained in the stream.</param>
 		/// <returns>Returns a stream containing the message to return to the client. If null, sends an empty response.</returns>
 		MemoryStream HandleMessage(int commandID, MemoryStream messageStream, int messageLength);
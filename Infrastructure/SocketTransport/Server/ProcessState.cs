@@ -13,14 +13,22 @@ namespace MySpace.SocketTransport
 		internal Socket socket = null;	// Client socket.
 		internal bool Idle = false;
 		internal short commandId;
-		internal short messageId;
+		internal int messageId;
+		internal bool extendedMessageId; //the client sent, and expects back, a 32 bit message id
 		internal bool sendReply;
-		internal ResourcePoolItem<MemoryStream> message;
+		internal MemoryStream message;
+		internal ReceiveSlab slab; //set when message is a view over a receive slab
+		internal ResourcePoolItem<MemoryStream> messageItem; //set when message was assembled in a pooled buffer
 		internal int messageLength;
 		internal IPEndPoint remoteEndpoint; //when there's an error, the socket loses track of it.		
-		internal ResourcePoolItem<MemoryStream> replyBuffer; //for the reply + header
+		internal ReplyQueue replyQueue; //the reply queue of the connection the message came in on
+		internal int timeToLive; //milliseconds the client waits for the reply, 0 if it sent no deadline
+		internal long receivedTicks; //Stopwatch timestamp of when the message was queued
+		internal long deadlineTicks; //Stopwatch timestamp past which the reply is useless, 0 for none
+		internal SchedulerFlow schedulerFlow; //set while a fair scheduler counts the message as in flight
+		internal bool acceptsCompression; //the client can read a compressed reply
 
-		internal ProcessState(Socket socket, short commandId, short messageId, bool sendReply, ResourcePoolItem<MemoryStream> message, int messageLength)
+		internal ProcessState(Socket socket, short commandId, int messageId, bool sendReply, MemoryStream message, int messageLength)
 		{
 			this.socket = socket;
 			this.commandId = commandId;
@@ -0,0 +1,76 @@
+using System;
+using System.Diagnostics;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// Watches how long messages wait in a dispatcher queue and tells when new work should be
+	/// turned away. The queue counts as overloaded when even the shortest wait seen over an
+	/// interval exceeds the target, so a short burst does not trigger shedding but a standing
+	/// queue does.
+	/// </summary>
+	internal sealed class QueueWaitMonitor
+	{
+		private readonly object rollLock = new object();
+		private long targetTicks;
+		private long intervalTicks;
+		private long intervalEnd;
+		private long intervalMinimum = Int64.MaxValue;
+		private volatile bool overloaded;
+
+		/// <param name="targetMilliseconds">The longest standing queue wait allowed; 0 turns shedding off.</param>
+		/// <param name="intervalMilliseconds">How long the wait must stay above the target.</param>
+		internal void Configure(int targetMilliseconds, int intervalMilliseconds)
+		{
+			Interlocked.Exchange(ref targetTicks, targetMilliseconds * Stopwatch.Frequency / 1000);
+			Interlocked.Exchange(ref intervalTicks, Math.Max(intervalMilliseconds, 1) * Stopwatch.Frequency / 1000);
+			if (targetMilliseconds <= 0)
+			{
+				overloaded = false;
+			}
+		}
+
+		/// <summary>
+		/// Gets whether work arriving at <paramref name="now"/> should be shed.
+		/// </summary>
+		internal bool ShouldShed(long now)
+		{
+			//nothing is dequeued once the queue has drained, so a verdict that old no longer holds
+			return overloaded && now < Interlocked.Read(ref intervalEnd) + Interlocked.Read(ref intervalTicks);
+		}
+
+		/// <summary>
+		/// Records that a message was dequeued at <paramref name="now"/> after waiting <paramref name="waitTicks"/>.
+		/// </summary>
+		internal void Observe(long waitTicks, long now)
+		{
+			long minimum;
+			while (waitTicks < (minimum = Interlocked.Read(ref intervalMinimum)))
+			{
+				if (Interlocked.CompareExchange(ref intervalMinimum, waitTicks, minimum) == minimum)
+				{
+					break;
+				}
+			}
+			if (now < Interlocked.Read(ref intervalEnd) || !Monitor.TryEnter(rollLock))
+			{
+				return;
+			}
+			try
+			{
+				if (now >= intervalEnd)
+				{
+					minimum = Interlocked.Exchange(ref intervalMinimum, Int64.MaxValue);
+					long target = Interlocked.Read(ref targetTicks);
+					overloaded = target > 0 && minimum != Int64.MaxValue && minimum > target;
+					Interlocked.Exchange(ref intervalEnd, now + Interlocked.Read(ref intervalTicks));
+				}
+			}
+			finally
+			{
+				Monitor.Exit(rollLock);
+			}
+		}
+	}
+}
@@ -0,0 +1,99 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// A receive buffer shared by a connection and the messages parsed out of it. Messages
+	/// are handed to handlers as read only views over the slab; the slab goes back to its
+	/// <see cref="ReceiveSlabPool"/> once the connection and every view have released it.
+	/// </summary>
+	internal sealed class ReceiveSlab
+	{
+		private readonly ReceiveSlabPool pool;
+		private int references;
+
+		internal readonly byte[] Buffer;
+
+		internal ReceiveSlab(ReceiveSlabPool pool, int size)
+		{
+			this.pool = pool;
+			Buffer = new byte[size];
+		}
+
+		/// <summary>
+		/// Gets whether the caller holds the only reference, so the slab can be written from the start again.
+		/// </summary>
+		internal bool IsExclusive
+		{
+			get { return Thread.VolatileRead(ref references) == 1; }
+		}
+
+		internal void AddReference()
+		{
+			Interlocked.Increment(ref references);
+		}
+
+		internal void Release()
+		{
+			if (Interlocked.Decrement(ref references) == 0)
+			{
+				pool.Return(this);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Keeps released <see cref="ReceiveSlab"/>s for reuse.
+	/// </summary>
+	internal sealed class ReceiveSlabPool
+	{
+		private readonly Stack<ReceiveSlab> freeSlabs = new Stack<ReceiveSlab>();
+		private readonly int slabSize;
+		private readonly int maximumFreeSlabs;
+
+		internal ReceiveSlabPool(int slabSize, int maximumFreeSlabs)
+		{
+			this.slabSize = slabSize;
+			this.maximumFreeSlabs = maximumFreeSlabs;
+		}
+
+		internal int SlabSize
+		{
+			get { return slabSize; }
+		}
+
+		/// <summary>
+		/// Gets a slab holding one reference for the caller.
+		/// </summary>
+		internal ReceiveSlab GetSlab()
+		{
+			ReceiveSlab slab = null;
+			lock (freeSlabs)
+			{
+				if (freeSlabs.Count > 0)
+				{
+					slab = freeSlabs.Pop();
+				}
+			}
+			if (slab == null)
+			{
+				slab = new ReceiveSlab(this, slabSize);
+			}
+			slab.AddReference();
+			return slab;
+		}
+
+		internal void Return(ReceiveSlab slab)
+		{
+			lock (freeSlabs)
+			{
+				if (freeSlabs.Count < maximumFreeSlabs)
+				{
+					freeSlabs.Push(slab);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,134 @@
+using System;
+using System.Collections.Generic;
+using System.Net;
+using System.Net.Sockets;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// The replies waiting to be sent on one connection. Replies that complete while a send is
+	/// in flight, or within the coalescing window, go out together in the next send.
+	/// </summary>
+	internal sealed class ReplyQueue
+	{
+		internal struct Reply
+		{
+			internal Socket Socket;
+			internal IPEndPoint RemoteEndpoint;
+			/// <summary>The size and message id prefix, or <see langword="null"/> when no header is sent.</summary>
+			internal byte[] Header;
+			internal ArraySegment<byte> Body;
+
+			internal int Length
+			{
+				get { return (Header == null ? 0 : Header.Length) + Body.Count; }
+			}
+		}
+
+		private readonly List<Reply> pending = new List<Reply>();
+		private readonly List<ArraySegment<byte>> segments = new List<ArraySegment<byte>>();
+		private int pendingBytes;
+		private bool sending;
+		private bool waiting;
+
+		/// <summary>The socket of the batch being sent.</summary>
+		internal Socket Socket;
+		/// <summary>The remote endpoint of the batch being sent.</summary>
+		internal IPEndPoint RemoteEndpoint;
+		/// <summary>The number of replies in the batch being sent.</summary>
+		internal int BatchCount;
+
+		/// <summary>
+		/// Adds <paramref name="reply"/> to the queue.
+		/// </summary>
+		/// <param name="reply">The reply to send.</param>
+		/// <param name="maximumBytes">The number of pending bytes that ends the coalescing window.</param>
+		/// <param name="delay">Whether replies wait out the coalescing window before being sent.</param>
+		/// <param name="startWaiting">Set when the queue has just opened a coalescing window
+		/// and must be flushed when it ends.</param>
+		/// <returns><see langword="true"/> if the caller must send the queue.</returns>
+		internal bool Enqueue(Reply reply, int maximumBytes, bool delay, out bool startWaiting)
+		{
+			startWaiting = false;
+			lock (pending)
+			{
+				pending.Add(reply);
+				pendingBytes += reply.Length;
+				if (sending)
+				{
+					return false;
+				}
+				if (delay && pendingBytes < maximumBytes)
+				{
+					startWaiting = !waiting;
+					waiting = true;
+					return false;
+				}
+				waiting = false;
+				sending = true;
+				return true;
+			}
+		}
+
+		/// <summary>
+		/// Ends the coalescing window.
+		/// </summary>
+		/// <returns><see langword="true"/> if the caller must send the queue.</returns>
+		internal bool EndWaiting()
+		{
+			lock (pending)
+			{
+				waiting = false;
+				if (sending || pending.Count == 0)
+				{
+					return false;
+				}
+				sending = true;
+				return true;
+			}
+		}
+
+		/// <summary>
+		/// Takes the next batch of replies for one socket, up to <paramref name="maximumBytes"/>
+		/// unless the first reply alone is bigger, and sets <see cref="Socket"/>,
+		/// <see cref="RemoteEndpoint"/> and <see cref="BatchCount"/> for it.
+		/// </summary>
+		/// <returns>The segments to send, or <see langword="null"/> if the queue is empty,
+		/// in which case the caller is no longer sending.</returns>
+		internal IList<ArraySegment<byte>> TakeBatch(int maximumBytes)
+		{
+			lock (pending)
+			{
+				if (pending.Count == 0)
+				{
+					sending = false;
+					return null;
+				}
+				segments.Clear();
+				Socket = pending[0].Socket;
+				RemoteEndpoint = pending[0].RemoteEndpoint;
+				int count = 0, bytes = 0;
+				while (count < pending.Count && pending[count].Socket == Socket &&
+					(count == 0 || bytes + pending[count].Length <= maximumBytes))
+				{
+					Reply reply = pending[count];
+					if (reply.Header != null)
+					{
+						segments.Add(new ArraySegment<byte>(reply.Header));
+					}
+					if (reply.Body.Count > 0)
+					{
+						segments.Add(reply.Body);
+					}
+					bytes += reply.Length;
+					count++;
+				}
+				pending.RemoveRange(0, count);
+				pendingBytes -= bytes;
+				BatchCount = count;
+				// the list is only reused once the send using it has completed
+				return segments;
+			}
+		}
+	}
+}
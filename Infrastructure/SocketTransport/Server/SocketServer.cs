@@ -1,4 +1,5 @@
 using System;
+using System.Collections.Generic;
 using System.Configuration;
 using System.Diagnostics;
 using System.IO;
@@ -7,6 +8,7 @@ using System.Net.Sockets;
 using System.Runtime.Serialization.Formatters.Binary;
 using System.Threading;
 using Microsoft.Ccr.Core;
+using MySpace.Common.IO;
 using MySpace.ResourcePool;
 using MySpace.Shared.Configuration;
 
@@ -20,12 +22,15 @@ namespace MySpace.SocketTransport
 	/// <returns><see langword="true"/> if <paramref name="remoteEndpoint"/>
 	/// is whitelisted; otherwise <see langword="false"/>.</returns>
 	public delegate bool ConnectionWhitelist(IPEndPoint remoteEndpoint);
-	public class SocketServer
+	public partial class SocketServer
 	{
 		internal static readonly MySpace.Logging.LogWrapper log = new MySpace.Logging.LogWrapper();
 
 		protected Byte[] emptyReplyBytes = { 241, 216, 255, 255 };
 		protected MemoryStream emptyReplyStream;
+		//sent instead of handling a message that expired or arrived while the server was overloaded
+		protected Byte[] shedReplyBytes = { 239, 216, 255, 255 };
+		protected MemoryStream shedReplyStream;
 
 		protected ConnectionList connections = null;
 		protected Byte[] emptyMessage = new Byte[0] { };
@@ -50,6 +55,8 @@ namespace MySpace.SocketTransport
 		protected AsyncCallback receiveCallBack = null;
 
 		protected bool useNetworkOrder = false;
+		//only read at start, the engine can't be switched while running
+		protected bool useAsyncEventArgs = false;
 
 		protected int initialMessageSize = 1024;
 		protected int maximumMessageSize = 20480;
@@ -62,15 +69,41 @@ namespace MySpace.SocketTransport
 
 		protected WaitCallback processCall;
 
+		//starter(2) size(4) commandId(2) messageId(2) flags(1), then messageId(4) if flagged as extended
+		//and the milliseconds the client will wait for the reply(4) if flagged as having a deadline
+		private const int messageHeaderSize = 11;
+		private const int maximumMessageHeaderSize = 19;
+		private const byte sendReplyFlag = 0x01;
+		private const byte extendedMessageIdFlag = 0x02;
+		private const byte deadlineFlag = 0x04;
+		private const byte acceptsCompressionFlag = 0x08;
+		private const int batchEntryHeaderSize = 6;
+		private const int compressedReplyFlag = 0x40000000; //set in the reply size of a compressed reply
+		private const int messageTerminatorSize = 2;
+
 		protected MemoryStreamPool bufferPool = null;
+		private ReceiveSlabPool slabPool = null;
+		private int minimumReceiveRoom;
 		protected ResourcePool<ConnectionState> connectionStatePool = null;
 		protected ResourcePool<ConnectionState>.BuildItemDelegate buildConnectionStateDelegate;
 		protected ResourcePool<ConnectionState>.ResetItemDelegate resetConnectionStateDelegate;
 
 		protected AsyncCallback replyCallBack = null;
+		private int replyCoalescingMaxBytes;
+		private int replyCoalescingDelay;
+		private Timer replyCoalescingTimer;
+		private readonly List<ReplyQueue> waitingReplyQueues = new List<ReplyQueue>();
+		private readonly QueueWaitMonitor syncQueueWait = new QueueWaitMonitor();
+		private int replyCompressionThreshold;
+		private readonly Compressor compressor = Compressor.GetInstance();
+		private FairScheduler syncScheduler;
+		private FairScheduler onewayScheduler;
 		private static int ReplyChannelCreationCommandId = Int32.MinValue;
+		//the body is one way messages, each with its command id and length
+		private const short BatchCommandId = Int16.MaxValue;
 
 		private SocketServerConfig config;
+		private readonly SocketServerConfig givenConfig;
 		private int maximumSockets;
 
 		public delegate bool AcceptNewConnectionDelegate();
@@ -158,7 +191,21 @@ namespace MySpace.SocketTransport
 			"Free Worker Threads",
 			"Free Completion Threads",
 			"Active Worker Threads",
-			"Active Completion Port Threads"
+			"Active Completion Port Threads",
+			"Avg Copies Per Msg",
+			"Avg Copies Per Msg Base",
+			"Bytes Copied Per Sec",
+			"Avg Sends Per Reply",
+			"Avg Sends Per Reply Base",
+			"Avg Queue Wait",
+			"Avg Queue Wait Base",
+			"Msgs Shed Per Sec",
+			"Msgs Shed",
+			"Msgs Scheduled",
+			"Avg Reply Compression Percent",
+			"Avg Reply Compression Percent Base",
+			"Avg Reply Compression Time",
+			"Avg Reply Compression Time Base"
 		};
 		public static readonly string[] PerformanceCounterHelp =
 		{
@@ -173,7 +220,21 @@ namespace MySpace.SocketTransport
 			"The number of free worker threads available.",
 			"The number of free completion port threads available.",
 			"The number of active worker threads.",
-			"The number of active completion port threads."
+			"The number of active completion port threads.",
+			"Average number of times a received message was copied before it was handled.",
+			"Base for average copies.",
+			"The number of received bytes copied per second to reassemble messages split across receives.",
+			"Average number of socket sends per reply. Below one when replies are coalesced.",
+			"Base for average sends.",
+			"Average time messages wait in the dispatcher queues before being handled.",
+			"Base for average queue wait.",
+			"The number of sync messages per second answered with a shed reply instead of being handled.",
+			"The total number of sync messages answered with a shed reply instead of being handled.",
+			"The number of messages waiting in the fair scheduler queues to be dispatched.",
+			"Average size of compressed replies as a percentage of their uncompressed size.",
+			"Base for average compression percent.",
+			"Average time spent compressing a reply.",
+			"Base for average compression time."
 		};
 		public static readonly PerformanceCounterType[] PerformanceCounterTypes =
 		{
@@ -188,7 +249,21 @@ namespace MySpace.SocketTransport
 			PerformanceCounterType.NumberOfItems32,
 			PerformanceCounterType.NumberOfItems32,
 			PerformanceCounterType.NumberOfItems32,
-			PerformanceCounterType.NumberOfItems32
+			PerformanceCounterType.NumberOfItems32,
+			PerformanceCounterType.AverageCount64,
+			PerformanceCounterType.AverageBase,
+			PerformanceCounterType.RateOfCountsPerSecond64,
+			PerformanceCounterType.AverageCount64,
+			PerformanceCounterType.AverageBase,
+			PerformanceCounterType.AverageTimer32,
+			PerformanceCounterType.AverageBase,
+			PerformanceCounterType.RateOfCountsPerSecond32,
+			PerformanceCounterType.NumberOfItems64,
+			PerformanceCounterType.NumberOfItems32,
+			PerformanceCounterType.AverageCount64,
+			PerformanceCounterType.AverageBase,
+			PerformanceCounterType.AverageTimer32,
+			PerformanceCounterType.AverageBase
 		};
 
 		protected PerformanceCounter socketCountCounter = null;
@@ -208,6 +283,25 @@ namespace MySpace.SocketTransport
 		protected PerformanceCounter activeWorkerThreadCounter = null;
 		protected PerformanceCounter activeCompletionThreadCounter = null;
 
+		protected PerformanceCounter avgCopiesPerMessage = null;
+		protected PerformanceCounter avgCopiesPerMessageBase = null;
+		protected PerformanceCounter bytesCopiedPerSec = null;
+
+		protected PerformanceCounter avgSendsPerReply = null;
+		protected PerformanceCounter avgSendsPerReplyBase = null;
+
+		protected PerformanceCounter avgQueueWait = null;
+		protected PerformanceCounter avgQueueWaitBase = null;
+		protected PerformanceCounter shedPerSec = null;
+		protected PerformanceCounter shedTotal = null;
+
+		protected PerformanceCounter messagesScheduled = null;
+
+		protected PerformanceCounter avgCompressionPercent = null;
+		protected PerformanceCounter avgCompressionPercentBase = null;
+		protected PerformanceCounter avgCompressionTime = null;
+		protected PerformanceCounter avgCompressionTimeBase = null;
+
 		protected string instanceName = null;
 
 		public string InstanceName
@@ -266,6 +360,10 @@ namespace MySpace.SocketTransport
 			emptyReplyStream.Write(emptyReplyBytes, 0, 4);
 			emptyReplyStream.Seek(0, SeekOrigin.Begin);
 
+			shedReplyStream = new MemoryStream(4);
+			shedReplyStream.Write(shedReplyBytes, 0, 4);
+			shedReplyStream.Seek(0, SeekOrigin.Begin);
+
 			trueBytes = BitConverter.GetBytes(true);
 			falseBytes = BitConverter.GetBytes(false);
 
@@ -283,12 +381,25 @@ namespace MySpace.SocketTransport
 			this.instanceName = instanceName;
 		}
 
+		/// <summary>
+		/// Create a new socket server named instanceName, listening on portNumber, with
+		/// settings given in code rather than read from the configuration section
+		/// </summary>
+		/// <param name="instanceName">The name of the socket server instance for performance data</param>
+		/// <param name="portNumber">The port to listen on</param>
+		/// <param name="config">The settings to use, also on <see cref="ReloadConfig"/></param>
+		public SocketServer(string instanceName, int portNumber, SocketServerConfig config)
+			: this(instanceName, portNumber)
+		{
+			givenConfig = config;
+		}
+
 		public void ReloadConfig(object sender, EventArgs args)
 		{
 			if (log.IsInfoEnabled)
 				log.Info("Reloading config");
 			connectionWatcher.Change(Timeout.Infinite, Timeout.Infinite);
-			SocketServerConfig newConfig = ConfigurationManager.GetSection(_configSectionName) as SocketServerConfig;
+			SocketServerConfig newConfig = givenConfig ?? ConfigurationManager.GetSection(_configSectionName) as SocketServerConfig;
 			if (newConfig == null)
 			{
 				if (log.IsWarnEnabled)
@@ -297,6 +408,9 @@ namespace MySpace.SocketTransport
 			}
 			maximumMessageSize = newConfig.MaximumMessageSize;
 			discardTooBigMessages = newConfig.DiscardTooBigMessages;
+			replyCoalescingMaxBytes = newConfig.ReplyCoalescingMaxBytes;
+			syncQueueWait.Configure(newConfig.QueueWaitTargetMilliseconds, newConfig.QueueWaitIntervalMilliseconds);
+			replyCompressionThreshold = newConfig.ReplyCompressionThreshold;
 			connectionCheckInterval = newConfig.ConnectionCheckIntervalSeconds;
 			useNetworkOrder = newConfig.UseNetworkOrder;
 			maximumSockets = (newConfig.MaximumOpenSockets == 0 ? Int32.MaxValue : newConfig.MaximumOpenSockets);
@@ -364,6 +478,10 @@ namespace MySpace.SocketTransport
 					OnewayDispatcher = newOnewayDispatcher;
 					oldOnewayDispatcher.Dispose();
 					OnewayThreads = newOnewayThreads;
+					if (onewayScheduler != null)
+					{
+						onewayScheduler.DispatchLimit = GetDispatchLimit(config.FairScheduling, OnewayThreads);
+					}
 				}
 				catch (Exception ex)
 				{
@@ -395,6 +513,10 @@ namespace MySpace.SocketTransport
 					SyncDispatcher = newSyncDispatcher;
 					oldSyncDispatcher.Dispose();
 					SyncThreads = newSyncThreads;
+					if (syncScheduler != null)
+					{
+						syncScheduler.DispatchLimit = GetDispatchLimit(config.FairScheduling, SyncThreads);
+					}
 				}
 				catch (Exception ex)
 				{
@@ -424,7 +546,7 @@ namespace MySpace.SocketTransport
 
 		private void GetConfig()
 		{
-			config = ConfigurationManager.GetSection(_configSectionName) as SocketServerConfig;
+			config = givenConfig ?? ConfigurationManager.GetSection(_configSectionName) as SocketServerConfig;
 
 			if (config == null)
 			{
@@ -434,6 +556,11 @@ namespace MySpace.SocketTransport
 			}
 
 			useNetworkOrder = config.UseNetworkOrder;
+			useAsyncEventArgs = config.UseSocketAsyncEventArgs;
+			replyCoalescingMaxBytes = config.ReplyCoalescingMaxBytes;
+			replyCoalescingDelay = config.ReplyCoalescingDelayMilliseconds;
+			syncQueueWait.Configure(config.QueueWaitTargetMilliseconds, config.QueueWaitIntervalMilliseconds);
+			replyCompressionThreshold = config.ReplyCompressionThreshold;
 
 			initialMessageSize = config.InitialMessageSize;
 			maximumMessageSize = config.MaximumMessageSize;
@@ -498,6 +625,10 @@ namespace MySpace.SocketTransport
 				bufferPool.AllocatedItemsCounter = this.allocatedBuffers;
 			}
 
+			slabPool = new ReceiveSlabPool(Math.Max(config.ReceiveSlabSize, 1024), config.MaximumFreeReceiveSlabs);
+			//below this much free space a slab is replaced rather than received into
+			minimumReceiveRoom = slabPool.SlabSize / 4;
+
 			buildConnectionStateDelegate = new ResourcePool<ConnectionState>.BuildItemDelegate(BuildConnectionState);
 			resetConnectionStateDelegate = new ResourcePool<ConnectionState>.ResetItemDelegate(ResetConnectionState);
 
@@ -509,6 +640,10 @@ namespace MySpace.SocketTransport
 			connections = new ConnectionList(socketCountCounter);
 			connectionCheckInterval = config.ConnectionCheckIntervalSeconds * 1000;
 			connectionWatcher = new Timer(new TimerCallback(CheckConnections), null, connectionCheckInterval, connectionCheckInterval);
+			if (replyCoalescingDelay > 0)
+			{
+				replyCoalescingTimer = new Timer(FlushWaitingReplies, null, replyCoalescingDelay, replyCoalescingDelay);
+			}
 
 			int currentWorker, currentCompletion, oldWorker, oldCompletion;
 			ThreadPool.GetAvailableThreads(out currentWorker, out currentCompletion);
@@ -545,13 +680,38 @@ namespace MySpace.SocketTransport
 			Arbiter.Activate(SyncMessageQueue,
 				Arbiter.Receive<ProcessState>(true, SyncMessagePort, delegate(ProcessState state) { ProcessCall(state); }));
 
+			if (config.FairScheduling != null)
+			{
+				syncScheduler = new FairScheduler(config.FairScheduling, true, DispatchSync,
+					GetDispatchLimit(config.FairScheduling, SyncThreads));
+				onewayScheduler = new FairScheduler(config.FairScheduling, false, DispatchOneway,
+					GetDispatchLimit(config.FairScheduling, OnewayThreads));
+				if (countersInitialized)
+				{
+					syncScheduler.QueuedCounter = messagesScheduled;
+					onewayScheduler.QueuedCounter = messagesScheduled;
+				}
+			}
+			else
+			{
+				syncScheduler = null;
+				onewayScheduler = null;
+			}
+
 			listener.Bind(new IPEndPoint(IPAddress.Any, this.portNumber));
 
 			listener.Listen(500);
 
 			isRunning = true;
 
-			listener.BeginAccept(acceptCallBack, listener);
+			if (useAsyncEventArgs)
+			{
+				StartAcceptAsync();
+			}
+			else
+			{
+				listener.BeginAccept(acceptCallBack, listener);
+			}
 
 			timerThread = new Thread(TimerStart);
 			timerThread.IsBackground = true;
@@ -608,6 +768,86 @@ namespace MySpace.SocketTransport
 					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
 				}
 
+				try
+				{
+					avgCopiesPerMessage = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[12], InstanceName, false);
+					avgCopiesPerMessageBase = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[13], InstanceName, false);
+					bytesCopiedPerSec = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[14], InstanceName, false);
+					avgCopiesPerMessage.RawValue = 0;
+					avgCopiesPerMessageBase.RawValue = 0;
+				}
+				catch (Exception ex)
+				{
+					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
+					avgCopiesPerMessage = null;
+					avgCopiesPerMessageBase = null;
+					bytesCopiedPerSec = null;
+				}
+
+				try
+				{
+					avgSendsPerReply = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[15], InstanceName, false);
+					avgSendsPerReplyBase = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[16], InstanceName, false);
+					avgSendsPerReply.RawValue = 0;
+					avgSendsPerReplyBase.RawValue = 0;
+				}
+				catch (Exception ex)
+				{
+					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
+					avgSendsPerReply = null;
+					avgSendsPerReplyBase = null;
+				}
+
+				try
+				{
+					avgQueueWait = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[17], InstanceName, false);
+					avgQueueWaitBase = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[18], InstanceName, false);
+					shedPerSec = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[19], InstanceName, false);
+					shedTotal = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[20], InstanceName, false);
+					avgQueueWait.RawValue = 0;
+					avgQueueWaitBase.RawValue = 0;
+					shedTotal.RawValue = 0;
+				}
+				catch (Exception ex)
+				{
+					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
+					avgQueueWait = null;
+					avgQueueWaitBase = null;
+					shedPerSec = null;
+					shedTotal = null;
+				}
+
+				try
+				{
+					messagesScheduled = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[21], InstanceName, false);
+					messagesScheduled.RawValue = 0;
+				}
+				catch (Exception ex)
+				{
+					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
+					messagesScheduled = null;
+				}
+
+				try
+				{
+					avgCompressionPercent = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[22], InstanceName, false);
+					avgCompressionPercentBase = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[23], InstanceName, false);
+					avgCompressionTime = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[24], InstanceName, false);
+					avgCompressionTimeBase = new PerformanceCounter(SocketServer.PerformanceCategoryName, SocketServer.PerformanceCounterNames[25], InstanceName, false);
+					avgCompressionPercent.RawValue = 0;
+					avgCompressionPercentBase.RawValue = 0;
+					avgCompressionTime.RawValue = 0;
+					avgCompressionTimeBase.RawValue = 0;
+				}
+				catch (Exception ex)
+				{
+					log.Error("Some new socket transport performance counters are not installed. Try re-installing them.", ex);
+					avgCompressionPercent = null;
+					avgCompressionPercentBase = null;
+					avgCompressionTime = null;
+					avgCompressionTimeBase = null;
+				}
+
 				CountAvailableThreads();
 
 				countersInitialized = true;
@@ -710,6 +950,13 @@ namespace MySpace.SocketTransport
 				connectionWatcher.Change(Timeout.Infinite, Timeout.Infinite);
 				connectionWatcher = null;
 			}
+			if (replyCoalescingTimer != null)
+			{
+				replyCoalescingTimer.Change(Timeout.Infinite, Timeout.Infinite);
+				replyCoalescingTimer.Dispose();
+				replyCoalescingTimer = null;
+				FlushWaitingReplies(null);
+			}
 			if (log.IsInfoEnabled)
 				log.Info("Socket Server Closing Down Sockets.");
 
@@ -810,15 +1057,9 @@ namespace MySpace.SocketTransport
 						return;
 					}
 
-					connection.ReceiveTimeout = config.ReceiveTimeout;
-					connection.ReceiveBufferSize = config.ReceiveBufferSize;
-					connection.SendTimeout = config.SendTimeout;
-					connection.SendBufferSize = config.SendBufferSize;
-					ResourcePoolItem<ConnectionState> connectionStateItem = connectionStatePool.GetItem();
+					ResourcePoolItem<ConnectionState> connectionStateItem = AddConnection(connection);
 					ConnectionState connectionState = connectionStateItem.Item;
-					connectionState.WorkSocket = connection;
-					connections.Add(connectionState);
-					connection.BeginReceive(connectionState.networkBuffer, 0, connectionState.BufferSize, SocketFlags.None, receiveCallBack, connectionStateItem);
+					connection.BeginReceive(connectionState.slab.Buffer, connectionState.receiveEnd, connectionState.slab.Buffer.Length - connectionState.receiveEnd, SocketFlags.None, receiveCallBack, connectionStateItem);
 				}
 			}
 			catch (SocketException sex)
@@ -850,6 +1091,20 @@ namespace MySpace.SocketTransport
 			}
 		}
 
+		private ResourcePoolItem<ConnectionState> AddConnection(Socket connection)
+		{
+			connection.ReceiveTimeout = config.ReceiveTimeout;
+			connection.ReceiveBufferSize = config.ReceiveBufferSize;
+			connection.SendTimeout = config.SendTimeout;
+			connection.SendBufferSize = config.SendBufferSize;
+			ResourcePoolItem<ConnectionState> connectionStateItem = connectionStatePool.GetItem();
+			ConnectionState connectionState = connectionStateItem.Item;
+			connectionState.WorkSocket = connection;
+			connections.Add(connectionState);
+			PrepareSlab(connectionState);
+			return connectionStateItem;
+		}
+
 		private bool AcceptingNew
 		{
 			get
@@ -860,40 +1115,42 @@ namespace MySpace.SocketTransport
 
 		private ConnectionState BuildConnectionState()
 		{
-			return new ConnectionState(config.ReceiveBufferSize, initialMessageSize);
+			return new ConnectionState();
 		}
 
 		private void ResetConnectionState(ConnectionState state)
 		{
+			//queued messages keep their flows, the next connection starts its own
+			state.syncFlows = null;
+			state.onewayFlows = null;
+			state.acceptsCompression = false;
 			state.WorkSocket = null;
 			state.ReplySocket = null;
 			state.remoteEndPoint = null;
-			ResetConnectionStateMessageBuffer(state);
+			state.ReleaseSlab();
+			ResetFrame(state);
 		}
 
-		private void ResetConnectionStateMessageBuffer(ConnectionState state)
+		private void ResetFrame(ConnectionState state)
 		{
-			if (state.messageSize > maximumMessageSize && !discardTooBigMessages)
+			if (state.largeMessageItem != null)
 			{
-				state.messageBuffer.Dispose();
-				state.messageBuffer = new MemoryStream(initialMessageSize);
+				bufferPool.ReleaseItem(state.largeMessageItem);
+				state.largeMessageItem = null;
 			}
-			else
-			{
-				state.messageBuffer.Seek(0, SeekOrigin.Begin);
-				state.messageBuffer.SetLength(0);
-			}
-			state.messagePosition = 0;
+			state.largeMessage = null;
 			state.messageSize = -1;
+			state.messageCopies = 0;
+			state.discardRemaining = 0;
 		}
 
 
-		protected bool CheckForMessageStarter(byte[] networkBuffer)
+		protected bool CheckForMessageStarter(byte[] buffer, int offset)
 		{
 			byte[] messageStarterBytes = (useNetworkOrder ? this.messageStarterBytesNetwork : this.messageStarterBytesHost);
 			for (int i = 0; i < messageStarterBytes.Length; i++)
 			{
-				if (networkBuffer[i] != messageStarterBytes[i])
+				if (buffer[offset + i] != messageStarterBytes[i])
 				{
 					return false;
 				}
@@ -901,12 +1158,12 @@ namespace MySpace.SocketTransport
 			return true;
 		}
 
-		protected bool CheckForMessageTerminator(byte[] buffer, int messageSize)
+		protected bool CheckForMessageTerminator(byte[] buffer, int messageEnd)
 		{
 			byte[] messageTerminatorBytes = (useNetworkOrder ? this.messageTerminatorBytesNetwork : this.messageTerminatorBytesHost);
 			for (int i = 0; i < messageTerminatorBytes.Length; i++)
 			{
-				if (buffer[messageSize - messageTerminatorBytes.Length + i] != messageTerminatorBytes[i])
+				if (buffer[messageEnd - messageTerminatorBytes.Length + i] != messageTerminatorBytes[i])
 				{
 					return false;
 				}
@@ -915,6 +1172,67 @@ namespace MySpace.SocketTransport
 
 		}
 
+		/// <summary>
+		/// Makes sure the connection's slab has room for the next receive. A slab is only
+		/// replaced when the frame in progress would not fit in it, and then only the received
+		/// part of that frame is copied to the new slab.
+		/// </summary>
+		private void PrepareSlab(ConnectionState state)
+		{
+			if (state.slab == null)
+			{
+				state.slab = slabPool.GetSlab();
+				return;
+			}
+			int pending = state.receiveEnd - state.frameStart;
+			if (pending == 0 && state.slab.IsExclusive)
+			{
+				//no handler is still reading from the slab, start over at the beginning
+				state.frameStart = 0;
+				state.receiveEnd = 0;
+				return;
+			}
+			int room = state.slab.Buffer.Length - state.receiveEnd;
+			int needed = 0;
+			if (state.messageSize > 0 && state.largeMessage == null && state.discardRemaining == 0)
+			{
+				needed = (state.messageSize <= state.slab.Buffer.Length ? state.messageSize : maximumMessageHeaderSize) - pending;
+			}
+			if (room >= minimumReceiveRoom && room >= needed)
+			{
+				return;
+			}
+			ReceiveSlab newSlab = slabPool.GetSlab();
+			if (pending > 0)
+			{
+				Buffer.BlockCopy(state.slab.Buffer, state.frameStart, newSlab.Buffer, 0, pending);
+				CountCopy(state, pending);
+			}
+			state.slab.Release();
+			state.slab = newSlab;
+			state.frameStart = 0;
+			state.receiveEnd = pending;
+		}
+
+		private void CountCopy(ConnectionState state, int bytes)
+		{
+			state.messageCopies++;
+			if (countersInitialized && bytesCopiedPerSec != null)
+			{
+				bytesCopiedPerSec.IncrementBy(bytes);
+			}
+		}
+
+		private void CountMessageCopies(ConnectionState state)
+		{
+			if (countersInitialized && avgCopiesPerMessage != null)
+			{
+				avgCopiesPerMessage.IncrementBy(state.messageCopies);
+				avgCopiesPerMessageBase.Increment();
+			}
+			state.messageCopies = 0;
+		}
+
 		protected void ReceiveCallBack(IAsyncResult ar)
 		{
 			ResourcePoolItem<ConnectionState> stateItem = ar.AsyncState as ResourcePoolItem<ConnectionState>;
@@ -922,7 +1240,6 @@ namespace MySpace.SocketTransport
 			Socket connection = state.WorkSocket;
 			if (connection == null) return;
 			SocketError endError, beginError;
-			bool processing = false;
 
 			try
 			{
@@ -932,99 +1249,12 @@ namespace MySpace.SocketTransport
 				{
 					lock (state)
 					{
-						state.messageBuffer.Write(state.networkBuffer, 0, bytesRead);
-						state.messagePosition += bytesRead;
-						processing = true;
-					}
-
-					while (processing)
-					{
-						if (state.messageSize < 0 && state.messagePosition >= 2)
-						{
-							lock (state)
-							{
-								if (state.messageSize < 0)
-								{
-									if (CheckForMessageStarter(state.messageBuffer.GetBuffer()))
-									{
-										state.messageSize = 0; //found the beginning, can start looking for the rest...
-									}
-									else
-									{
-										if (log.IsWarnEnabled)
-											log.WarnFormat("Expected message start, received other from {0}.  Waiting for next receive that starts with valid message start.", connection.RemoteEndPoint);
-										ResetConnectionStateMessageBuffer(state);
-									}
-								}
-							}
-						}
-
-						if (state.messageSize == 0 && state.messagePosition >= 6)
-						{
-							//we haven't yet determined a message size, but there's enough data 
-							//to do so
-							lock (state)
-							{
-								state.messageSize = GetMessageSize(state.messageBuffer);
-								if (state.messageSize > maximumMessageSize)
-								{
-									if (log.IsWarnEnabled)
-										log.WarnFormat("Message with size {0} from {1}. {2}.",
-										state.messageSize.ToString("N0"),
-										state.remoteEndPoint,
-										discardTooBigMessages ? "Discarding data from this message." : "Message buffer will be disposed immediately after processing."
-										);
-								}
-							}
-						}
-
-						if (state.messagePosition > 0
-							&& state.messageSize > 0
-							&& state.messagePosition >= state.messageSize)
-						{
-							if (state.messageSize > maximumMessageSize && discardTooBigMessages)
-							{
-								//we think we have enough info, but we discarded all of it
-								lock (state)
-								{
-									ResetConnectionStateMessageBuffer(state);
-								}
-							}
-							else
-							{
-								//we have enough data for a message
-								lock (state)
-								{
-									HandleCompleteConnectionState(state);
-									if (state.messagePosition > state.messageSize)
-									{
-										//there's some of the next message in the buffer already
-										int newPos = state.messagePosition - state.messageSize;
-										byte[] buff = state.messageBuffer.GetBuffer();
-										state.messageBuffer.Seek(0, SeekOrigin.Begin);
-										state.messageBuffer.Write(buff, state.messageSize, state.messagePosition - state.messageSize);
-										//now the portion in the buffer that was from the next message is a the beginning of the buffer
-										state.messagePosition = newPos;
-										state.messageSize = -1;
-									}
-									else
-									{
-										ResetConnectionStateMessageBuffer(state);
-										processing = false;
-									}
-								}
-							}
-						}
-						else
-						{
-							//we don't have enough for a message and have to go back to listening
-							processing = false;
-						}
+						ReceiveBytes(state, bytesRead);
 					}
 
 					if (connection.Connected)
 					{
-						connection.BeginReceive(state.networkBuffer, 0, state.BufferSize, SocketFlags.None, out beginError, receiveCallBack, stateItem);
+						connection.BeginReceive(state.slab.Buffer, state.receiveEnd, state.slab.Buffer.Length - state.receiveEnd, SocketFlags.None, out beginError, receiveCallBack, stateItem);
 						if (beginError != SocketError.Success)
 						{
 							if (log.IsErrorEnabled)
@@ -1098,125 +1328,513 @@ namespace MySpace.SocketTransport
 			}
 		}
 
-		private int GetMessageSize(MemoryStream memoryStream)
+		/// <summary>
+		/// Handles the frames completed by <paramref name="bytesRead"/> newly received bytes and
+		/// makes room for the next receive.
+		/// </summary>
+		private void ReceiveBytes(ConnectionState state, int bytesRead)
 		{
-			return GetHostOrdered(BitConverter.ToInt32(memoryStream.GetBuffer(), 2), useNetworkOrder);
+			state.receiveEnd += bytesRead;
+			try
+			{
+				ParseFrames(state);
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception while handling message for {0}: {1}. Resetting message state.", state.remoteEndPoint, ex);
+				state.frameStart = state.receiveEnd;
+				ResetFrame(state);
+			}
+			PrepareSlab(state);
 		}
 
-		protected void HandleCompleteConnectionState(ConnectionState state)
+		/// <summary>
+		/// Handles every complete frame received into the connection's slab, leaving
+		/// <see cref="ConnectionState.frameStart"/> at the start of the first incomplete one.
+		/// </summary>
+		private void ParseFrames(ConnectionState state)
 		{
-			bool sendReply = false;
+			byte[] buffer = state.slab.Buffer;
+			while (true)
+			{
+				int available = state.receiveEnd - state.frameStart;
 
-			byte[] buff = state.messageBuffer.GetBuffer();
-			short commandId = 0;
-			short messageId;
+				if (state.discardRemaining > 0)
+				{
+					int skipped = Math.Min(available, state.discardRemaining);
+					state.frameStart += skipped;
+					state.discardRemaining -= skipped;
+					if (state.discardRemaining > 0)
+					{
+						return;
+					}
+					ResetFrame(state);
+					continue;
+				}
 
-			try
-			{
-				if (useNetworkOrder)
+				if (state.largeMessage != null)
 				{
-					messageId = GetHostOrdered(BitConverter.ToInt16(buff, 6), true);
-					commandId = GetHostOrdered(BitConverter.ToInt16(buff, 8), true);
+					int needed = state.messageSize - state.frameHeaderSize - (int)state.largeMessage.Length;
+					int count = Math.Min(available, needed);
+					state.largeMessage.Write(buffer, state.frameStart, count);
+					if (countersInitialized && bytesCopiedPerSec != null)
+					{
+						bytesCopiedPerSec.IncrementBy(count);
+					}
+					state.frameStart += count;
+					if (count < needed)
+					{
+						return;
+					}
+					HandleLargeMessage(state);
+					continue;
 				}
-				else
+
+				if (available < 2)
 				{
-					commandId = BitConverter.ToInt16(buff, 6);
-					messageId = BitConverter.ToInt16(buff, 8);
+					return;
 				}
-				sendReply = BitConverter.ToBoolean(buff, 10);
-				if (countersInitialized)
+				if (!CheckForMessageStarter(buffer, state.frameStart))
+				{
+					if (log.IsWarnEnabled)
+						log.WarnFormat("Expected message start, received other from {0}.  Waiting for next receive that starts with valid message start.", state.remoteEndPoint);
+					state.frameStart = state.receiveEnd;
+					ResetFrame(state);
+					return;
+				}
+				if (available < 6)
+				{
+					return;
+				}
+
+				if (state.messageSize < 0)
+				{
+					state.messageSize = GetMessageSize(buffer, state.frameStart);
+					if (state.messageSize < messageHeaderSize + messageTerminatorSize)
+					{
+						if (log.IsErrorEnabled)
+							log.ErrorFormat("Message with invalid size {0} from {1}. Resetting connection state.", state.messageSize, state.remoteEndPoint);
+						state.frameStart = state.receiveEnd;
+						ResetFrame(state);
+						return;
+					}
+					if (state.messageSize > maximumMessageSize)
+					{
+						if (log.IsWarnEnabled)
+							log.WarnFormat("Message with size {0} from {1}. {2}.",
+							state.messageSize.ToString("N0"),
+							state.remoteEndPoint,
+							discardTooBigMessages ? "Discarding data from this message." : "Message buffer will be disposed immediately after processing."
+							);
+						if (discardTooBigMessages)
+						{
+							state.discardRemaining = state.messageSize;
+							continue;
+						}
+					}
+				}
+
+				if (available >= state.messageSize)
+				{
+					//the whole frame is in the slab, hand it on where it is
+					HandleCompleteFrame(state, buffer, state.frameStart);
+					state.frameStart += state.messageSize;
+					state.messageSize = -1;
+					continue;
+				}
+
+				if (state.messageSize > buffer.Length && available >= messageHeaderSize
+					&& available >= GetHeaderSize(buffer, state.frameStart))
 				{
-					if (sendReply)
-						syncPerSecCounter.Increment();
+					//the frame will never fit in a slab, assemble its body separately
+					ReadFrameHeader(state, buffer, state.frameStart);
+					if (state.messageSize <= maximumMessageSize)
+					{
+						state.largeMessageItem = bufferPool.GetItem();
+						state.largeMessage = state.largeMessageItem.Item;
+					}
 					else
-						onewayPerSecCounter.Increment();
+					{
+						state.largeMessage = new MemoryStream(state.messageSize - state.frameHeaderSize);
+					}
+					state.frameStart += state.frameHeaderSize;
+					state.messageCopies++;
+					continue;
 				}
+
+				//wait for the rest of the frame
+				return;
 			}
-			catch (Exception e)
+		}
+
+		private int GetMessageSize(byte[] buffer, int offset)
+		{
+			return GetHostOrdered(BitConverter.ToInt32(buffer, offset + 2), useNetworkOrder);
+		}
+
+		private static int GetHeaderSize(byte[] buffer, int offset)
+		{
+			byte flags = buffer[offset + 10];
+			int headerSize = messageHeaderSize;
+			if ((flags & extendedMessageIdFlag) != 0) headerSize += 4;
+			if ((flags & deadlineFlag) != 0) headerSize += 4;
+			return headerSize;
+		}
+
+		/// <summary>
+		/// Reads the header of the frame at <paramref name="offset"/> into the frame fields of <paramref name="state"/>.
+		/// </summary>
+		private void ReadFrameHeader(ConnectionState state, byte[] buffer, int offset)
+		{
+			short messageId;
+			if (useNetworkOrder)
+			{
+				messageId = GetHostOrdered(BitConverter.ToInt16(buffer, offset + 6), true);
+				state.frameCommandId = GetHostOrdered(BitConverter.ToInt16(buffer, offset + 8), true);
+			}
+			else
+			{
+				state.frameCommandId = BitConverter.ToInt16(buffer, offset + 6);
+				messageId = BitConverter.ToInt16(buffer, offset + 8);
+			}
+			byte flags = buffer[offset + 10];
+			int headerSize = messageHeaderSize;
+			state.frameSendReply = (flags & sendReplyFlag) != 0;
+			if ((flags & acceptsCompressionFlag) != 0)
+			{
+				state.acceptsCompression = true;
+			}
+			state.frameBatch = state.frameCommandId == BatchCommandId;
+			state.frameExtendedMessageId = (flags & extendedMessageIdFlag) != 0;
+			if (state.frameExtendedMessageId)
+			{
+				//multiplexing clients number their requests past what the short id can hold
+				state.frameMessageId = GetHostOrdered(BitConverter.ToInt32(buffer, offset + headerSize), useNetworkOrder);
+				headerSize += 4;
+			}
+			else
+			{
+				state.frameMessageId = messageId;
+			}
+			state.frameTimeToLive = 0;
+			if ((flags & deadlineFlag) != 0)
+			{
+				state.frameTimeToLive = GetHostOrdered(BitConverter.ToInt32(buffer, offset + headerSize), useNetworkOrder);
+				headerSize += 4;
+			}
+			state.frameHeaderSize = headerSize;
+		}
+
+		/// <summary>
+		/// Handles a frame lying whole in the connection's slab at <paramref name="offset"/>.
+		/// The handler is given a read only view of the message body within the slab.
+		/// </summary>
+		private void HandleCompleteFrame(ConnectionState state, byte[] buffer, int offset)
+		{
+			ReadFrameHeader(state, buffer, offset);
+
+			int messageLength = state.messageSize - state.frameHeaderSize - messageTerminatorSize;
+			if (messageLength < 0)
 			{
 				if (log.IsErrorEnabled)
-					log.ErrorFormat("Socket Server Exception extracting message info from {0}: {1} . Resetting connection state.", state.remoteEndPoint, e);
-				ResetConnectionStateMessageBuffer(state);
+					log.ErrorFormat("Message with invalid size {0} from {1}. Discarding message.", state.messageSize, state.remoteEndPoint);
+				state.messageCopies = 0;
 				return;
 			}
 
-			if (!CheckForMessageTerminator(buff, state.messageSize))
+			if (!CheckForMessageTerminator(buffer, offset + state.messageSize))
 			{
 				if (log.IsErrorEnabled)
-					log.ErrorFormat("Message without end terminator found from {0}. Resetting connection state.", state.remoteEndPoint);
+					log.ErrorFormat("Message without end terminator found from {0}. Discarding message.", state.remoteEndPoint);
+				state.messageCopies = 0;
+				return;
+			}
 
-				ResetConnectionStateMessageBuffer(state);
+			if (state.frameCommandId == SocketServer.ReplyChannelCreationCommandId)
+			{
+				CreateReplyChannel(state, buffer, offset + state.frameHeaderSize);
+				state.messageCopies = 0;
 				return;
 			}
 
+			if (state.frameBatch)
+			{
+				PostBatch(state, buffer, offset + state.frameHeaderSize, messageLength, true);
+				return;
+			}
 
+			ProcessState processState = new ProcessState(state.ReplySocket, state.frameCommandId, state.frameMessageId, state.frameSendReply,
+				new MemoryStream(buffer, offset + state.frameHeaderSize, messageLength, false, true), messageLength);
+			processState.extendedMessageId = state.frameExtendedMessageId;
+			processState.timeToLive = state.frameTimeToLive;
+			processState.acceptsCompression = state.acceptsCompression;
+			processState.slab = state.slab;
+			processState.replyQueue = state.replyQueue;
+			state.slab.AddReference();
+			PostMessage(state, processState);
+		}
 
+		/// <summary>
+		/// Handles a frame whose body was assembled in <see cref="ConnectionState.largeMessage"/>.
+		/// </summary>
+		private void HandleLargeMessage(ConnectionState state)
+		{
+			MemoryStream message = state.largeMessage;
+			ResourcePoolItem<MemoryStream> messageItem = state.largeMessageItem;
+			state.largeMessage = null;
+			state.largeMessageItem = null;
 
-			try
+			if (!CheckForMessageTerminator(message.GetBuffer(), (int)message.Length))
 			{
-				#region if replychannel
-				if (commandId == SocketServer.ReplyChannelCreationCommandId)
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Message without end terminator found from {0}. Discarding message.", state.remoteEndPoint);
+				if (messageItem != null)
 				{
-					try
-					{
-						byte[] justAddress = new byte[4];
-						Array.Copy(buff, 11, justAddress, 0, 4);
-						IPAddress sendChannelAddress = new IPAddress(justAddress);
-						IPEndPoint sendChannelEndPoint = new IPEndPoint(sendChannelAddress, BitConverter.ToInt32(buff, 15));
+					bufferPool.ReleaseItem(messageItem);
+				}
+				ResetFrame(state);
+				return;
+			}
 
-						connections[sendChannelEndPoint].ReplySocket = state.WorkSocket;
-						SendReplyChannelConfirmation(state.WorkSocket, true);
-					}
-					catch (Exception ex)
-					{
-						if (log.IsErrorEnabled)
-							log.ErrorFormat("Socket Server Exception creating reply socket for {0}: {1}", state.remoteEndPoint, ex);
-						SendReplyChannelConfirmation(state.WorkSocket, false);
-					}
+			int messageLength = state.messageSize - state.frameHeaderSize - messageTerminatorSize;
+			message.SetLength(messageLength);
+			message.Seek(0, SeekOrigin.Begin);
+
+			if (state.frameBatch)
+			{
+				//the messages are copied out so the large buffer can go back to the pool now
+				PostBatch(state, message.GetBuffer(), 0, messageLength, false);
+				if (messageItem != null)
+				{
+					bufferPool.ReleaseItem(messageItem);
+				}
+				state.messageSize = -1;
+				return;
+			}
+
+			ProcessState processState = new ProcessState(state.ReplySocket, state.frameCommandId, state.frameMessageId,
+				state.frameSendReply, message, messageLength);
+			processState.extendedMessageId = state.frameExtendedMessageId;
+			processState.timeToLive = state.frameTimeToLive;
+			processState.acceptsCompression = state.acceptsCompression;
+			processState.messageItem = messageItem;
+			processState.replyQueue = state.replyQueue;
+			PostMessage(state, processState);
+			state.messageSize = -1;
+		}
+
+		/// <summary>
+		/// Posts each one way message of a batch frame whose body is at <paramref name="offset"/>.
+		/// </summary>
+		/// <param name="inSlab">Whether the body is in the connection's slab, in which case the
+		/// messages are views over it, rather than copies.</param>
+		private void PostBatch(ConnectionState state, byte[] buffer, int offset, int length, bool inSlab)
+		{
+			int end = offset + length;
+			while (offset < end)
+			{
+				if (end - offset < batchEntryHeaderSize)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Truncated batch message header from {0}. Discarding the rest of the batch.", state.remoteEndPoint);
+					break;
+				}
+				short commandId = GetHostOrdered(BitConverter.ToInt16(buffer, offset), useNetworkOrder);
+				int messageLength = GetHostOrdered(BitConverter.ToInt32(buffer, offset + 2), useNetworkOrder);
+				offset += batchEntryHeaderSize;
+				if (messageLength < 0 || messageLength > end - offset)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Batch message with invalid size {0} from {1}. Discarding the rest of the batch.", messageLength, state.remoteEndPoint);
+					break;
+				}
+
+				MemoryStream message;
+				if (inSlab)
+				{
+					message = new MemoryStream(buffer, offset, messageLength, false, true);
 				}
-				#endregion
 				else
 				{
-					ResourcePoolItem<MemoryStream> messageBuffer = bufferPool.GetItem();
-					ProcessState processState = null;
-					try
-					{
-						messageBuffer.Item.Write(buff, 11, state.messageSize - 13);
-						messageBuffer.Item.Seek(0, SeekOrigin.Begin);
+					message = new MemoryStream(messageLength);
+					message.Write(buffer, offset, messageLength);
+					message.Seek(0, SeekOrigin.Begin);
+					CountCopy(state, messageLength);
+				}
+				ProcessState processState = new ProcessState(state.ReplySocket, commandId, 0, false, message, messageLength);
+				processState.replyQueue = state.replyQueue;
+				if (inSlab)
+				{
+					processState.slab = state.slab;
+					state.slab.AddReference();
+				}
+				PostMessage(state, processState);
+				offset += messageLength;
+			}
+			state.messageCopies = 0;
+		}
 
-						processState = new ProcessState(state.ReplySocket, commandId, messageId, sendReply, messageBuffer, state.messageSize - 13);
+		private void CreateReplyChannel(ConnectionState state, byte[] buffer, int offset)
+		{
+			try
+			{
+				byte[] justAddress = new byte[4];
+				Array.Copy(buffer, offset, justAddress, 0, 4);
+				IPAddress sendChannelAddress = new IPAddress(justAddress);
+				IPEndPoint sendChannelEndPoint = new IPEndPoint(sendChannelAddress, BitConverter.ToInt32(buffer, offset + 4));
 
-						if (sendReply)
-						{
-							SyncMessagePort.Post(processState);
-						}
-						else
-						{
+				connections[sendChannelEndPoint].ReplySocket = state.WorkSocket;
+				SendReplyChannelConfirmation(state.WorkSocket, true);
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception creating reply socket for {0}: {1}", state.remoteEndPoint, ex);
+				SendReplyChannelConfirmation(state.WorkSocket, false);
+			}
+		}
 
-							OnewayMessagePort.Post(processState);
-						}
+		private void PostMessage(ConnectionState state, ProcessState processState)
+		{
+			if (countersInitialized)
+			{
+				if (processState.sendReply)
+					syncPerSecCounter.Increment();
+				else
+					onewayPerSecCounter.Increment();
+			}
+			CountMessageCopies(state);
+
+			processState.receivedTicks = Stopwatch.GetTimestamp();
+			if (processState.timeToLive > 0)
+			{
+				processState.deadlineTicks = processState.receivedTicks + processState.timeToLive * Stopwatch.Frequency / 1000;
+			}
+
+			try
+			{
+				if (processState.sendReply)
+				{
+					//only clients that send a deadline understand the shed reply; older clients would
+					//take it for a real reply, so their messages are always queued
+					if (processState.timeToLive > 0 && syncQueueWait.ShouldShed(processState.receivedTicks))
+					{
+						//the sync queue has stood above its target wait, turn new work away rather than add to it
+						ShedMessage(processState);
+						return;
 					}
-					catch (Exception ex)
+					if (syncScheduler != null)
 					{
-
-						if (log.IsErrorEnabled)
-							log.ErrorFormat("Socket Server Exception enqueueing message work item for {0}: {1}. Releasing buffer.", state.remoteEndPoint, ex);
-						bufferPool.ReleaseItem(messageBuffer);
+						syncScheduler.Enqueue(ref state.syncFlows, state.remoteEndPoint, processState);
+					}
+					else
+					{
+						SyncMessagePort.Post(processState);
 					}
 				}
+				else if (onewayScheduler != null)
+				{
+					onewayScheduler.Enqueue(ref state.onewayFlows, state.remoteEndPoint, processState);
+				}
+				else
+				{
+					OnewayMessagePort.Post(processState);
+				}
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception enqueueing message work item for {0}: {1}. Releasing buffer.", state.remoteEndPoint, ex);
+				ReleaseMessage(processState);
+			}
+		}
+
+		private static int GetDispatchLimit(FairSchedulingConfig fairScheduling, int threads)
+		{
+			return fairScheduling.DispatchLimit > 0 ? fairScheduling.DispatchLimit : threads * 2;
+		}
 
+		private void DispatchSync(ProcessState state)
+		{
+			try
+			{
+				SyncMessagePort.Post(state);
 			}
 			catch (Exception ex)
 			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception enqueueing scheduled message work item for {0}: {1}. Releasing buffer.", state.remoteEndpoint, ex);
+				ReleaseMessage(state);
+				FinishScheduled(state);
+			}
+		}
 
+		private void DispatchOneway(ProcessState state)
+		{
+			try
+			{
+				OnewayMessagePort.Post(state);
+			}
+			catch (Exception ex)
+			{
 				if (log.IsErrorEnabled)
-					log.ErrorFormat("Socket Server Exception while handling message for {0}: {1}. Resetting message state.", state.remoteEndPoint, ex);
-				ResetConnectionStateMessageBuffer(state);
+					log.ErrorFormat("Socket Server Exception enqueueing scheduled message work item for {0}: {1}. Releasing buffer.", state.remoteEndpoint, ex);
+				ReleaseMessage(state);
+				FinishScheduled(state);
+			}
+		}
+
+		/// <summary>
+		/// Lets the scheduler that dispatched <paramref name="state"/> dispatch another message in its place.
+		/// </summary>
+		private void FinishScheduled(ProcessState state)
+		{
+			if (state.schedulerFlow == null)
+			{
 				return;
 			}
+			FairScheduler scheduler = state.sendReply ? syncScheduler : onewayScheduler;
+			if (scheduler != null)
+			{
+				scheduler.Complete(state);
+			}
 		}
 
+		/// <summary>
+		/// Gets the state of every fair scheduler queue holding messages.
+		/// </summary>
+		/// <returns>The queue states; empty when <see cref="SocketServerConfig.FairScheduling"/> is not configured.</returns>
+		public List<SchedulerQueueStatus> GetSchedulerQueueStatus()
+		{
+			List<SchedulerQueueStatus> statuses = new List<SchedulerQueueStatus>();
+			FairScheduler scheduler = syncScheduler;
+			if (scheduler != null)
+			{
+				scheduler.GetStatus(statuses);
+			}
+			scheduler = onewayScheduler;
+			if (scheduler != null)
+			{
+				scheduler.GetStatus(statuses);
+			}
+			return statuses;
+		}
 
+		private void ReleaseMessage(ProcessState state)
+		{
+			if (state.slab != null)
+			{
+				state.slab.Release();
+				state.slab = null;
+			}
+			if (state.messageItem != null)
+			{
+				bufferPool.ReleaseItem(state.messageItem);
+				state.messageItem = null;
+			}
+			state.message = null;
+		}
 
 		private void SendReplyChannelConfirmation(Socket socket, bool success)
 		{
@@ -1232,15 +1850,63 @@ namespace MySpace.SocketTransport
 			}
 		}
 
+		/// <summary>
+		/// Answers <paramref name="state"/> with the shed reply without handling it. Only messages
+		/// that carried a deadline may be shed, since that flag is how a client says it knows the reply.
+		/// </summary>
+		private void ShedMessage(ProcessState state)
+		{
+			ReleaseMessage(state);
+			FinishScheduled(state);
+			if (countersInitialized && shedPerSec != null)
+			{
+				shedPerSec.Increment();
+				shedTotal.Increment();
+			}
+			SendReply(state, shedReplyStream, 4);
+		}
+
+		/// <summary>
+		/// Records how long <paramref name="state"/> waited to be dequeued, and sheds it if its
+		/// client has stopped waiting for the reply.
+		/// </summary>
+		/// <returns><see langword="true"/> if the message was shed and must not be handled.</returns>
+		private bool CheckQueueWait(ProcessState state)
+		{
+			long now = Stopwatch.GetTimestamp();
+			long waitTicks = now - state.receivedTicks;
+			if (countersInitialized && avgQueueWait != null)
+			{
+				avgQueueWait.IncrementBy(waitTicks);
+				avgQueueWaitBase.Increment();
+			}
+			if (!state.sendReply)
+			{
+				return false;
+			}
+			syncQueueWait.Observe(waitTicks, now);
+			if (state.deadlineTicks != 0 && now > state.deadlineTicks)
+			{
+				ShedMessage(state);
+				return true;
+			}
+			return false;
+		}
+
 		protected void ProcessCall(ProcessState state)
 		{
 			MemoryStream messageStream = null;
 			MemoryStream replyStream = null;
 
+			if (CheckQueueWait(state))
+			{
+				return;
+			}
+
 			MessageState message = null;
 			try
 			{
-				messageStream = state.message.Item;
+				messageStream = state.message;
 
 				if (asyncMessageHandler != null)
 				{
@@ -1263,6 +1929,7 @@ namespace MySpace.SocketTransport
 						{
 							if (log.IsErrorEnabled)
 								log.Error(exc);
+							FinishScheduled(state);
 						}
 					});
 
@@ -1297,8 +1964,7 @@ namespace MySpace.SocketTransport
 					message.Message = null;
 					message.Length = 0;
 				}
-				bufferPool.ReleaseItem(state.message);
-				state.message = null;
+				ReleaseMessage(state);
 			}
 
 			CompleteProcessCall(state, replyStream);
@@ -1306,6 +1972,8 @@ namespace MySpace.SocketTransport
 
 		private void CompleteProcessCall(ProcessState state, MemoryStream replyStream)
 		{
+			FinishScheduled(state);
+
 			if (countersInitialized)
 			{
 				avgHandlerTimeBase.Increment();
@@ -1334,101 +2002,210 @@ namespace MySpace.SocketTransport
 
 		protected void SendReply(ProcessState state, MemoryStream reply, int replyLength)
 		{
-			SocketError socketError;
 			try
 			{
-				int replySize = replyLength + 4;
-				if (state.messageId != 0) //if the client sent a message Id, we need to send it back
+				ReplyQueue.Reply queued = new ReplyQueue.Reply();
+				queued.Socket = state.socket;
+				queued.RemoteEndpoint = state.remoteEndpoint;
+				if (UseDefaultReplyHeader)
 				{
-					replySize += 2;
+					int replySize = replyLength + 4;
+					if (state.extendedMessageId)
+					{
+						replySize += 4;
+					}
+					else if (state.messageId != 0) //if the client sent a message Id, we need to send it back
+					{
+						replySize += 2;
+					}
+					queued.Header = new byte[replySize - replyLength];
+					BitConverter.GetBytes(GetNetworkOrdered(replySize, useNetworkOrder)).CopyTo(queued.Header, 0);
+					if (state.extendedMessageId)
+					{
+						BitConverter.GetBytes(GetNetworkOrdered(state.messageId, useNetworkOrder)).CopyTo(queued.Header, 4);
+					}
+					else if (state.messageId != 0)
+					{
+						BitConverter.GetBytes(GetNetworkOrdered((short)state.messageId, useNetworkOrder)).CopyTo(queued.Header, 4);
+					}
 				}
-
-				state.replyBuffer = bufferPool.GetItem();
-				if (state.replyBuffer.Item.Position > 0)
+				queued.Body = new ArraySegment<byte>(reply.GetBuffer(), 0, replyLength);
+				if (UseDefaultReplyHeader && state.acceptsCompression &&
+					replyCompressionThreshold > 0 && replyLength >= replyCompressionThreshold)
 				{
+					CompressReply(ref queued);
+				}
+				if (queued.Body.Array == reply.GetBuffer() && replyLength > 0)
+				{
+					//the caller may reuse its stream once this returns, while the reply can wait
+					//in the queue or an asynchronous send, so it is sent from a copy
+					byte[] body = new byte[replyLength];
+					Buffer.BlockCopy(reply.GetBuffer(), 0, body, 0, replyLength);
+					queued.Body = new ArraySegment<byte>(body);
+				}
 
-					if (log.IsErrorEnabled)
-						log.ErrorFormat("Buffer from pool had position {0}!. Resetting position and length.", state.replyBuffer.Item.Position.ToString("N0"));
-					state.replyBuffer.Item.Seek(0, SeekOrigin.Begin);
-					state.replyBuffer.Item.SetLength(0);
+				ReplyQueue queue = state.replyQueue ?? new ReplyQueue();
+				bool startWaiting;
+				if (queue.Enqueue(queued, replyCoalescingMaxBytes, replyCoalescingDelay > 0, out startWaiting))
+				{
+					SendReplies(queue);
 				}
-				if (UseDefaultReplyHeader)
+				else if (startWaiting)
 				{
-					state.replyBuffer.Item.Write(BitConverter.GetBytes(GetNetworkOrdered(replySize, useNetworkOrder)), 0, 4);
-					if (state.messageId != 0)
+					lock (waitingReplyQueues)
 					{
-						state.replyBuffer.Item.Write(BitConverter.GetBytes(GetNetworkOrdered(state.messageId, useNetworkOrder)), 0, 2);
+						waitingReplyQueues.Add(queue);
 					}
-					state.replyBuffer.Item.Write(reply.GetBuffer(), 0, replyLength);
 				}
-				if (state.socket.Connected)
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception during SendReply to {0}: {1}.", state.remoteEndpoint, ex);
+			}
+		}
+
+		/// <summary>
+		/// Replaces the body of <paramref name="queued"/> with its compressed form and marks the
+		/// reply size, unless compressing doesn't make it smaller.
+		/// </summary>
+		private void CompressReply(ref ReplyQueue.Reply queued)
+		{
+			long started = Stopwatch.GetTimestamp();
+			byte[] body = new byte[queued.Body.Count];
+			Buffer.BlockCopy(queued.Body.Array, queued.Body.Offset, body, 0, body.Length);
+			byte[] compressed = compressor.Compress(body);
+			if (countersInitialized && avgCompressionTime != null)
+			{
+				avgCompressionTime.IncrementBy(Stopwatch.GetTimestamp() - started);
+				avgCompressionTimeBase.Increment();
+				avgCompressionPercent.IncrementBy(compressed.Length * 100L / body.Length);
+				avgCompressionPercentBase.Increment();
+			}
+			if (compressed.Length >= body.Length)
+			{
+				return;
+			}
+			int replySize = queued.Header.Length + compressed.Length;
+			BitConverter.GetBytes(GetNetworkOrdered(replySize | compressedReplyFlag, useNetworkOrder)).CopyTo(queued.Header, 0);
+			queued.Body = new ArraySegment<byte>(compressed);
+		}
+
+		/// <summary>
+		/// Sends the replies in <paramref name="queue"/> until it is empty or a send is left pending,
+		/// in which case the send's completion carries on.
+		/// </summary>
+		private void SendReplies(ReplyQueue queue)
+		{
+			IList<ArraySegment<byte>> segments;
+			while ((segments = queue.TakeBatch(replyCoalescingMaxBytes)) != null)
+			{
+				if (segments.Count == 0)
+				{
+					continue;
+				}
+				if (countersInitialized && avgSendsPerReply != null)
+				{
+					avgSendsPerReply.Increment();
+					avgSendsPerReplyBase.IncrementBy(queue.BatchCount);
+				}
+
+				Socket socket = queue.Socket;
+				SocketError socketError = SocketError.Success;
+				try
 				{
-					state.socket.BeginSend(state.replyBuffer.Item.GetBuffer(), 0, replySize, SocketFlags.None, out socketError, replyCallBack, state);
-					if (socketError != SocketError.Success)
+					if (!socket.Connected)
 					{
 						if (log.IsErrorEnabled)
-							log.ErrorFormat("Error sending reply to {0}: {1}.", state.remoteEndpoint, socketError);
-						if (!state.socket.Connected)
+							log.ErrorFormat("Connection dropped before reply sent to {0}", queue.RemoteEndpoint);
+						continue;
+					}
+					if (useAsyncEventArgs)
+					{
+						if (SendAsync(queue, segments))
 						{
-							state.socket.Shutdown(SocketShutdown.Both);
-							state.socket.Close();
+							return;
 						}
-						RemoveConnection(state.remoteEndpoint);
+						continue;
+					}
+					socket.BeginSend(segments, SocketFlags.None, out socketError, replyCallBack, queue);
+					if (socketError == SocketError.Success || socketError == SocketError.IOPending)
+					{
+						return;
+					}
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Error sending reply to {0}: {1}.", queue.RemoteEndpoint, socketError);
+					if (!socket.Connected)
+					{
+						socket.Shutdown(SocketShutdown.Both);
+						socket.Close();
 					}
+					RemoveConnection(queue.RemoteEndpoint);
 				}
-				else
+				catch (SocketException ex)
 				{
-
 					if (log.IsErrorEnabled)
-						log.ErrorFormat("Connection dropped before reply sent to {0}", state.remoteEndpoint);
-					bufferPool.ReleaseItem(state.replyBuffer);
-					state.replyBuffer = null;
+						log.ErrorFormat("Socket Exception during SendReply to {0}: {1}.  Removing connection.", queue.RemoteEndpoint, ex);
+					DropReplySocket(queue, "SendReply");
 				}
-			}
-			catch (SocketException ex)
-			{
-				if (state.replyBuffer != null)
+				catch (ObjectDisposedException)
 				{
-					bufferPool.ReleaseItem(state.replyBuffer);
-					state.replyBuffer = null;
 				}
-
-				if (log.IsErrorEnabled)
-					log.ErrorFormat("Socket Exception during SendReply to {0}: {1}.  Removing connection.", state.remoteEndpoint, ex);
-				try
+				catch (Exception ex)
 				{
-					if (state.socket.Connected)
-					{
-						state.socket.Shutdown(SocketShutdown.Both);
-						state.socket.Close();
-					}
-					RemoveConnection(state.remoteEndpoint);
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Socket Server Exception during SendReply to {0}: {1}.", queue.RemoteEndpoint, ex);
 				}
-				catch (Exception exc)
-				{
+			}
+		}
 
-					if (log.IsErrorEnabled)
-						log.ErrorFormat("Socket Server Exception attempted to remove connection in SendReply exception cleanup: {0}", exc);
+		private void DropReplySocket(ReplyQueue queue, string method)
+		{
+			try
+			{
+				if (queue.Socket.Connected)
+				{
+					queue.Socket.Shutdown(SocketShutdown.Both);
+					queue.Socket.Close();
 				}
+				RemoveConnection(queue.RemoteEndpoint);
 			}
-			catch (ObjectDisposedException)
+			catch (Exception exc)
 			{
-				if (state.replyBuffer != null)
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception attempted to remove connection in {0} exception cleanup: {1}", method, exc);
+			}
+		}
+
+		/// <summary>
+		/// Ends the coalescing window of the queues that opened one since the last tick.
+		/// </summary>
+		private void FlushWaitingReplies(object state)
+		{
+			List<ReplyQueue> queues;
+			lock (waitingReplyQueues)
+			{
+				if (waitingReplyQueues.Count == 0)
 				{
-					bufferPool.ReleaseItem(state.replyBuffer);
-					state.replyBuffer = null;
+					return;
 				}
+				queues = new List<ReplyQueue>(waitingReplyQueues);
+				waitingReplyQueues.Clear();
 			}
-			catch (Exception ex)
+			foreach (ReplyQueue queue in queues)
 			{
-				if (state.replyBuffer != null)
+				try
+				{
+					if (queue.EndWaiting())
+					{
+						SendReplies(queue);
+					}
+				}
+				catch (Exception ex)
 				{
-					bufferPool.ReleaseItem(state.replyBuffer);
-					state.replyBuffer = null;
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Socket Server Exception flushing coalesced replies to {0}: {1}", queue.RemoteEndpoint, ex);
 				}
-
-				if (log.IsErrorEnabled)
-					log.ErrorFormat("Socket Server Exception during SendReply to {0}: {1}.", state.remoteEndpoint, ex);
 			}
 		}
 
@@ -1437,7 +2214,8 @@ namespace MySpace.SocketTransport
 		/// represented by <paramref name="responseState"/>.
 		/// </summary>
 		/// <param name="responseState">The state object that represents the existing connection.</param>
-		/// <param name="messageStream">The <see cref="MemoryStream"/> to send.</param>
+		/// <param name="messageStream">The <see cref="MemoryStream"/> to send. It is copied before
+		/// this returns, so the caller may reuse it.</param>
 		/// <exception cref="ArgumentException">Thrown when <paramref name="responseState"/>
 		/// is not an instance of <see cref="ProcessState"/>.</exception>
 		public void SendResponse(object responseState, MemoryStream messageStream)
@@ -1460,33 +2238,20 @@ namespace MySpace.SocketTransport
 
 		protected void SendReplyCallback(IAsyncResult ar)
 		{
-			ProcessState state = ar.AsyncState as ProcessState;
+			ReplyQueue queue = ar.AsyncState as ReplyQueue;
 			try
 			{
-				if (state.socket.Connected)
+				if (queue.Socket.Connected)
 				{
-					state.socket.EndSend(ar);
+					queue.Socket.EndSend(ar);
 				}
 			}
 			catch (SocketException ex)
 			{
 
 				if (log.IsErrorEnabled)
-					log.ErrorFormat("Socket Exception during SendReplyCallback to {0}: {1}. Removing connection.", state.remoteEndpoint, ex);
-				try
-				{
-					if (state.socket.Connected)
-					{
-						state.socket.Shutdown(SocketShutdown.Both);
-						state.socket.Close();
-					}
-					RemoveConnection(state.remoteEndpoint);
-				}
-				catch (Exception exc)
-				{
-					if (log.IsErrorEnabled)
-						log.ErrorFormat("Socket Server Exception attempted to remove connection in SendReplyCallback exception cleanup: {0}", exc);
-				}
+					log.ErrorFormat("Socket Exception during SendReplyCallback to {0}: {1}. Removing connection.", queue.RemoteEndpoint, ex);
+				DropReplySocket(queue, "SendReplyCallback");
 			}
 			catch (ObjectDisposedException)
 			{
@@ -1495,8 +2260,8 @@ namespace MySpace.SocketTransport
 			}
 			finally
 			{
-				bufferPool.ReleaseItem(state.replyBuffer);
-				state.replyBuffer = null;
+				//carry on with the replies queued while this send was in flight
+				SendReplies(queue);
 			}
 		}
 
@@ -0,0 +1,292 @@
+using System;
+using System.Collections.Generic;
+using System.Net;
+using System.Net.Sockets;
+using MySpace.ResourcePool;
+
+namespace MySpace.SocketTransport
+{
+	/// <summary>
+	/// The <see cref="SocketAsyncEventArgs"/> engine, used in place of the Begin/End callbacks
+	/// when <see cref="SocketServerConfig.UseSocketAsyncEventArgs"/> is set. Framing and the
+	/// message handler contracts are the same for both engines.
+	/// </summary>
+	public partial class SocketServer
+	{
+		private SocketAsyncEventArgs acceptEventArgs;
+		private readonly Stack<SocketAsyncEventArgs> sendEventArgsPool = new Stack<SocketAsyncEventArgs>();
+
+		private void StartAcceptAsync()
+		{
+			acceptEventArgs = new SocketAsyncEventArgs();
+			acceptEventArgs.Completed += AcceptAsyncCompleted;
+			AcceptAsync(acceptEventArgs);
+		}
+
+		/// <summary>
+		/// Accepts connections until one is left pending. Accepts that complete synchronously are
+		/// handled in the loop rather than by recursing.
+		/// </summary>
+		private void AcceptAsync(SocketAsyncEventArgs e)
+		{
+			while (isRunning)
+			{
+				e.AcceptSocket = null;
+				try
+				{
+					if (listener.AcceptAsync(e))
+					{
+						return;
+					}
+				}
+				catch (ObjectDisposedException)
+				{
+					return;
+				}
+				catch (Exception ex)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Socket Server Exception beginning another accept: {0}. Restarting service.", ex);
+					Stop();
+					Start();
+					return;
+				}
+				ProcessAccept(e);
+			}
+		}
+
+		private void AcceptAsyncCompleted(object sender, SocketAsyncEventArgs e)
+		{
+			ProcessAccept(e);
+			AcceptAsync(e);
+		}
+
+		private void ProcessAccept(SocketAsyncEventArgs e)
+		{
+			Socket connection = e.AcceptSocket;
+			try
+			{
+				if (e.SocketError != SocketError.Success)
+				{
+					if (isRunning && e.SocketError != SocketError.OperationAborted && log.IsErrorEnabled)
+						log.ErrorFormat("Socket Error {0} accepting connection.", e.SocketError);
+					return;
+				}
+				if (!AcceptingNew ||
+					(whitelistOnly && connectionWhitelist != null &&
+					!connectionWhitelist((IPEndPoint)connection.RemoteEndPoint)))
+				{
+					connection.Close();
+					return;
+				}
+
+				if (countersInitialized)
+				{
+					connectionsPerSecCounter.Increment();
+				}
+
+				ResourcePoolItem<ConnectionState> connectionStateItem = AddConnection(connection);
+				ConnectionState connectionState = connectionStateItem.Item;
+				if (connectionState.receiveEventArgs == null)
+				{
+					//kept with the pooled connection state, so each connection reuses one
+					connectionState.receiveEventArgs = new SocketAsyncEventArgs();
+					connectionState.receiveEventArgs.Completed += ReceiveAsyncCompleted;
+				}
+				connectionState.receiveEventArgs.UserToken = connectionStateItem;
+				ReceiveAsync(connectionStateItem);
+			}
+			catch (SocketException sex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Error {0} accepting connection.", sex.SocketErrorCode);
+			}
+			catch (ObjectDisposedException)
+			{
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception accepting connection: {0}", ex);
+			}
+		}
+
+		/// <summary>
+		/// Receives on the connection until a receive is left pending. Only one receive is ever
+		/// outstanding per connection, so the connection state is not locked.
+		/// </summary>
+		private void ReceiveAsync(ResourcePoolItem<ConnectionState> stateItem)
+		{
+			ConnectionState state = stateItem.Item;
+			SocketAsyncEventArgs e = state.receiveEventArgs;
+			while (true)
+			{
+				Socket connection = state.WorkSocket;
+				if (connection == null) return;
+				try
+				{
+					e.SetBuffer(state.slab.Buffer, state.receiveEnd, state.slab.Buffer.Length - state.receiveEnd);
+					if (connection.ReceiveAsync(e))
+					{
+						return;
+					}
+				}
+				catch (ObjectDisposedException)
+				{
+					return;
+				}
+				catch (Exception ex)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Error beginning another receive from {0}: {1}", state.remoteEndPoint, ex);
+					CloseConnection(stateItem);
+					return;
+				}
+				if (!ProcessReceive(stateItem, e))
+				{
+					return;
+				}
+			}
+		}
+
+		private void ReceiveAsyncCompleted(object sender, SocketAsyncEventArgs e)
+		{
+			ResourcePoolItem<ConnectionState> stateItem = (ResourcePoolItem<ConnectionState>)e.UserToken;
+			if (ProcessReceive(stateItem, e))
+			{
+				ReceiveAsync(stateItem);
+			}
+		}
+
+		/// <returns><see langword="true"/> if the connection should receive again.</returns>
+		private bool ProcessReceive(ResourcePoolItem<ConnectionState> stateItem, SocketAsyncEventArgs e)
+		{
+			ConnectionState state = stateItem.Item;
+			if (state.WorkSocket == null) return false;
+
+			if (e.SocketError == SocketError.Success && e.BytesTransferred > 0)
+			{
+				ReceiveBytes(state, e.BytesTransferred);
+				return true;
+			}
+
+			//a 0 byte read means the client disconnected cleanly; a reset just means the client had its app domain shut off
+			if (e.SocketError != SocketError.Success && e.SocketError != SocketError.ConnectionReset
+				&& e.SocketError != SocketError.OperationAborted)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Error during ReceiveAsync from {0}: {1}.", state.remoteEndPoint, e.SocketError);
+			}
+			CloseConnection(stateItem);
+			return false;
+		}
+
+		private void CloseConnection(ResourcePoolItem<ConnectionState> stateItem)
+		{
+			ConnectionState state = stateItem.Item;
+			try
+			{
+				Socket connection = state.WorkSocket;
+				if (connection != null && connection.Connected)
+				{
+					connection.Shutdown(SocketShutdown.Both);
+					connection.Close();
+				}
+			}
+			catch (SocketException)
+			{
+			}
+			catch (ObjectDisposedException)
+			{
+			}
+			try
+			{
+				state.receiveEventArgs.UserToken = null;
+				RemoveConnection(state);
+				connectionStatePool.ReleaseItem(stateItem);
+			}
+			catch (Exception ex)
+			{
+				if (log.IsErrorEnabled)
+					log.ErrorFormat("Socket Server Exception removing socket: {0}", ex);
+			}
+		}
+
+		/// <summary>
+		/// Sends <paramref name="segments"/>, the current batch of <paramref name="queue"/>.
+		/// </summary>
+		/// <returns><see langword="true"/> if the send is pending and its completion will carry on
+		/// sending the queue; <see langword="false"/> if it completed synchronously.</returns>
+		private bool SendAsync(ReplyQueue queue, IList<ArraySegment<byte>> segments)
+		{
+			SocketAsyncEventArgs e = GetSendEventArgs();
+			e.UserToken = queue;
+			e.BufferList = segments;
+			bool pending;
+			try
+			{
+				pending = queue.Socket.SendAsync(e);
+			}
+			catch
+			{
+				ReleaseSendEventArgs(e);
+				throw;
+			}
+			if (!pending)
+			{
+				ProcessSend(e);
+			}
+			return pending;
+		}
+
+		private void SendAsyncCompleted(object sender, SocketAsyncEventArgs e)
+		{
+			ReplyQueue queue = (ReplyQueue)e.UserToken;
+			ProcessSend(e);
+			//carry on with the replies queued while this send was in flight
+			SendReplies(queue);
+		}
+
+		private void ProcessSend(SocketAsyncEventArgs e)
+		{
+			ReplyQueue queue = (ReplyQueue)e.UserToken;
+			try
+			{
+				if (e.SocketError != SocketError.Success)
+				{
+					if (log.IsErrorEnabled)
+						log.ErrorFormat("Socket Error during SendAsync to {0}: {1}. Removing connection.", queue.RemoteEndpoint, e.SocketError);
+					DropReplySocket(queue, "SendAsyncCompleted");
+				}
+			}
+			finally
+			{
+				ReleaseSendEventArgs(e);
+			}
+		}
+
+		private SocketAsyncEventArgs GetSendEventArgs()
+		{
+			lock (sendEventArgsPool)
+			{
+				if (sendEventArgsPool.Count > 0)
+				{
+					return sendEventArgsPool.Pop();
+				}
+			}
+			SocketAsyncEventArgs e = new SocketAsyncEventArgs();
+			e.Completed += SendAsyncCompleted;
+			return e;
+		}
+
+		private void ReleaseSendEventArgs(SocketAsyncEventArgs e)
+		{
+			e.UserToken = null;
+			e.BufferList = null;
+			lock (sendEventArgsPool)
+			{
+				sendEventArgsPool.Push(e);
+			}
+		}
+	}
+}
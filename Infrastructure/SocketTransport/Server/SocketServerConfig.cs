@@ -19,6 +19,63 @@ namespace MySpace.SocketTransport
 		public int SendTimeout = 1000;
 		[XmlElement("SendBufferSize")]
 		public int SendBufferSize = 8192;
+		/// <summary>
+		/// The size of the buffers connections receive into. Messages that fit in one are
+		/// handed to the handler in place; larger messages are assembled in a separate buffer.
+		/// </summary>
+		[XmlElement("ReceiveSlabSize")]
+		public int ReceiveSlabSize = 16384;
+		/// <summary>
+		/// The number of released receive buffers kept for reuse.
+		/// </summary>
+		[XmlElement("MaximumFreeReceiveSlabs")]
+		public int MaximumFreeReceiveSlabs = 1024;
+		/// <summary>
+		/// When set, connections are accepted, received from and replied to with pooled
+		/// <see cref="System.Net.Sockets.SocketAsyncEventArgs"/> instead of Begin/End callbacks.
+		/// Only read when the server starts.
+		/// </summary>
+		[XmlElement("UseSocketAsyncEventArgs")]
+		public bool UseSocketAsyncEventArgs = false;
+		/// <summary>
+		/// The most bytes of replies sent on a connection in one send. Replies that complete
+		/// while a send is in flight go out together in the next.
+		/// </summary>
+		[XmlElement("ReplyCoalescingMaxBytes")]
+		public int ReplyCoalescingMaxBytes = 65536;
+		/// <summary>
+		/// When greater than zero, replies wait up to this many milliseconds, or until
+		/// <see cref="ReplyCoalescingMaxBytes"/> are pending, to be sent with later replies.
+		/// Only read when the server starts.
+		/// </summary>
+		[XmlElement("ReplyCoalescingDelayMilliseconds")]
+		public int ReplyCoalescingDelayMilliseconds = 0;
+		/// <summary>
+		/// When greater than zero, new sync messages are answered with a shed reply while the
+		/// shortest wait in the sync queue has stayed above this many milliseconds for
+		/// <see cref="QueueWaitIntervalMilliseconds"/>. Only messages from clients that send a
+		/// deadline are shed; messages from other clients are always queued.
+		/// </summary>
+		[XmlElement("QueueWaitTargetMilliseconds")]
+		public int QueueWaitTargetMilliseconds = 0;
+		/// <summary>
+		/// How long the sync queue wait must stay above <see cref="QueueWaitTargetMilliseconds"/>
+		/// before new messages are shed.
+		/// </summary>
+		[XmlElement("QueueWaitIntervalMilliseconds")]
+		public int QueueWaitIntervalMilliseconds = 100;
+		/// <summary>
+		/// When greater than zero, replies of at least this many bytes are compressed for
+		/// clients that say they can read compressed replies.
+		/// </summary>
+		[XmlElement("ReplyCompressionThreshold")]
+		public int ReplyCompressionThreshold = 0;
+		/// <summary>
+		/// When set, messages are dispatched fairly across connections and command classes
+		/// instead of in arrival order. Only read when the server starts.
+		/// </summary>
+		[XmlElement("FairScheduling")]
+		public FairSchedulingConfig FairScheduling;
 		[XmlElement("InitialMessageSize")]
 		public int InitialMessageSize = 8192;
 		[XmlElement("MaximumMessageSize")]
@@ -54,4 +111,51 @@ namespace MySpace.SocketTransport
 		[XmlElement("MaximumOpenSockets")]
 		public int MaximumOpenSockets = 0;
 	}
+
+	/// <summary>
+	/// Settings for the deficit round robin scheduling of messages per connection and command class.
+	/// </summary>
+	public class FairSchedulingConfig
+	{
+		/// <summary>
+		/// The number of messages handed to a dispatcher at once. 0 means twice its threads.
+		/// </summary>
+		[XmlElement("DispatchLimit")]
+		public int DispatchLimit = 0;
+		/// <summary>
+		/// The weight of commands not in any of the <see cref="CommandClasses"/>.
+		/// </summary>
+		[XmlElement("DefaultWeight")]
+		public int DefaultWeight = 1;
+		/// <summary>
+		/// The most messages of commands not in any of the <see cref="CommandClasses"/> being
+		/// handled at once. 0 means no limit.
+		/// </summary>
+		[XmlElement("DefaultMaximumInFlight")]
+		public int DefaultMaximumInFlight = 0;
+		[XmlArray("CommandClasses")]
+		[XmlArrayItem("CommandClass")]
+		public CommandClassConfig[] CommandClasses;
+	}
+
+	/// <summary>
+	/// A group of commands scheduled together.
+	/// </summary>
+	public class CommandClassConfig
+	{
+		[XmlAttribute("Name")]
+		public string Name;
+		/// <summary>
+		/// How many messages a connection's queue for the class may dispatch per turn.
+		/// </summary>
+		[XmlAttribute("Weight")]
+		public int Weight = 1;
+		/// <summary>
+		/// The most messages of the class being handled at once. 0 means no limit.
+		/// </summary>
+		[XmlAttribute("MaximumInFlight")]
+		public int MaximumInFlight = 0;
+		[XmlElement("CommandId")]
+		public short[] CommandIds;
+	}
 }